@@ -0,0 +1,381 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Runner of the benchmark suite.
+ *
+ * Usage: badgerdb_bench [--benchmark_filter=regex] [--benchmark_min_time=seconds]
+ *                       [--benchmark_out=file.json] [--benchmark_format=console|json]
+ *                       [--max_size=n] [--benchmark_list_tests]
+ */
+
+#include "bench.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace bench {
+
+//----------------------------------------
+// State
+//----------------------------------------
+
+State::State(std::uint64_t iterations, const std::vector<std::int64_t> &args)
+	: maxIterations(iterations), remaining(iterations), args(args), started(false), running(false),
+	  cpuStart(0), realSeconds(0), cpuSeconds(0), itemsProcessed(0)
+{
+}
+
+double State::threadCpuSeconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void State::start()
+{
+	started = true;
+	resumeTiming();
+}
+
+void State::stop()
+{
+	if (running)
+		pauseTiming();
+}
+
+void State::pauseTiming()
+{
+	if (!running)
+		return;
+	realSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+	cpuSeconds += threadCpuSeconds() - cpuStart;
+	running = false;
+}
+
+void State::resumeTiming()
+{
+	if (running)
+		return;
+	running = true;
+	cpuStart = threadCpuSeconds();
+	realStart = std::chrono::steady_clock::now();
+}
+
+void State::skipWithError(const std::string &message)
+{
+	error = message;
+	remaining = 0;
+}
+
+//----------------------------------------
+// Benchmark
+//----------------------------------------
+
+Benchmark::Benchmark(const std::string &name, void (*func)(State &))
+	: name(name), func(func)
+{
+}
+
+Benchmark *Benchmark::arg(std::int64_t a)
+{
+	argSets.push_back(std::vector<std::int64_t>(1, a));
+	return this;
+}
+
+Benchmark *Benchmark::args(std::initializer_list<std::int64_t> a)
+{
+	argSets.push_back(std::vector<std::int64_t>(a));
+	return this;
+}
+
+Benchmark *Benchmark::argsProduct(std::initializer_list<std::vector<std::int64_t> > values)
+{
+	std::vector<std::vector<std::int64_t> > product(1);
+	for (std::initializer_list<std::vector<std::int64_t> >::const_iterator v = values.begin(); v != values.end(); ++v)
+	{
+		std::vector<std::vector<std::int64_t> > next;
+		for (std::size_t i = 0; i < product.size(); i++)
+		{
+			for (std::size_t j = 0; j < v->size(); j++)
+			{
+				next.push_back(product[i]);
+				next.back().push_back((*v)[j]);
+			}
+		}
+		product.swap(next);
+	}
+	argSets.insert(argSets.end(), product.begin(), product.end());
+	return this;
+}
+
+Benchmark *Benchmark::argNames(std::initializer_list<std::string> n)
+{
+	names.assign(n.begin(), n.end());
+	return this;
+}
+
+static std::vector<Benchmark*> &registry()
+{
+	static std::vector<Benchmark*> benchmarks;
+	return benchmarks;
+}
+
+Benchmark *registerBenchmark(const std::string &name, void (*func)(State &))
+{
+	registry().push_back(new Benchmark(name, func));
+	return registry().back();
+}
+
+static std::int64_t maxSizeFlag = 100000;
+
+std::int64_t maxSize()
+{
+	return maxSizeFlag;
+}
+
+//----------------------------------------
+// Runner
+//----------------------------------------
+
+/**
+ * Result of the final run of one argument set.
+ */
+struct Result
+{
+	std::string name;
+	std::uint64_t iterations;
+	double realNs;
+	double cpuNs;
+	std::int64_t items;
+	double realSeconds;
+	std::string label;
+	std::string error;
+};
+
+struct Runner
+{
+	/**
+	 * Run an argument set with growing iteration counts until it takes at least minTime.
+	 */
+	static Result run(const Benchmark &b, const std::vector<std::int64_t> &args, const std::string &runName, double minTime)
+	{
+		std::uint64_t iterations = 1;
+		while (true)
+		{
+			State state(iterations, args);
+			b.func(state);
+
+			const bool done = !state.error.empty() || state.realSeconds >= minTime || iterations >= 1000000000ULL;
+			if (done)
+			{
+				Result r;
+				r.name = runName;
+				r.iterations = iterations;
+				r.realNs = state.realSeconds * 1e9 / iterations;
+				r.cpuNs = state.cpuSeconds * 1e9 / iterations;
+				r.items = state.itemsProcessed;
+				r.realSeconds = state.realSeconds;
+				r.label = state.label;
+				r.error = state.error;
+				return r;
+			}
+
+			// aim 40% past the minimum time, growing at most tenfold at a time
+			double next = (state.realSeconds > 0) ? iterations * minTime * 1.4 / state.realSeconds : iterations * 10.0;
+			if (next > iterations * 10.0)
+				next = iterations * 10.0;
+			iterations = (next < iterations + 1) ? iterations + 1 : (std::uint64_t)next;
+		}
+	}
+
+	/**
+	 * Run every registered argument set whose name matches the filter.
+	 */
+	static void runAll(const std::regex &pattern, double minTime, std::ostream *console, bool listOnly,
+	                   std::ostream &report, std::vector<Result> &results);
+
+	static std::string runName(const Benchmark &b, const std::vector<std::int64_t> &args)
+	{
+		std::ostringstream os;
+		os << b.name;
+		for (std::size_t i = 0; i < args.size(); i++)
+		{
+			os << "/";
+			if (i < b.names.size())
+				os << b.names[i] << ":";
+			os << args[i];
+		}
+		return os.str();
+	}
+};
+
+static std::string jsonEscape(const std::string &s)
+{
+	std::string out;
+	for (std::size_t i = 0; i < s.size(); i++)
+	{
+		if (s[i] == '"' || s[i] == '\\')
+			out += '\\';
+		out += s[i];
+	}
+	return out;
+}
+
+static void writeJson(std::ostream &os, const std::vector<Result> &results, const char *executable)
+{
+	char date[64];
+	const std::time_t now = std::time(NULL);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+	os << "{\n  \"context\": {\n"
+	   << "    \"date\": \"" << date << "\",\n"
+	   << "    \"executable\": \"" << jsonEscape(executable) << "\",\n"
+	   << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+	   << "    \"library_build_type\": \"release\"\n"
+	   << "  },\n  \"benchmarks\": [";
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const Result &r = results[i];
+		os << (i == 0 ? "\n" : ",\n") << "    {\n"
+		   << "      \"name\": \"" << jsonEscape(r.name) << "\",\n"
+		   << "      \"run_name\": \"" << jsonEscape(r.name) << "\",\n"
+		   << "      \"run_type\": \"iteration\",\n";
+		if (!r.error.empty())
+		{
+			os << "      \"error_occurred\": true,\n"
+			   << "      \"error_message\": \"" << jsonEscape(r.error) << "\"\n    }";
+			continue;
+		}
+		os << "      \"iterations\": " << r.iterations << ",\n"
+		   << std::fixed << std::setprecision(3)
+		   << "      \"real_time\": " << r.realNs << ",\n"
+		   << "      \"cpu_time\": " << r.cpuNs << ",\n"
+		   << "      \"time_unit\": \"ns\"";
+		if (r.items > 0 && r.realSeconds > 0)
+			os << ",\n      \"items_per_second\": " << r.items / r.realSeconds;
+		if (!r.label.empty())
+			os << ",\n      \"label\": \"" << jsonEscape(r.label) << "\"";
+		os << "\n    }";
+		os.unsetf(std::ios::floatfield);
+	}
+	os << "\n  ]\n}\n";
+}
+
+static void printConsole(std::ostream &os, const Result &r)
+{
+	os << std::left << std::setw(48) << r.name << std::right;
+	if (!r.error.empty())
+	{
+		os << " ERROR: " << r.error << std::endl;
+		return;
+	}
+	os << std::fixed << std::setprecision(0)
+	          << std::setw(14) << r.realNs << " ns"
+	          << std::setw(14) << r.cpuNs << " ns"
+	          << std::setw(12) << r.iterations;
+	if (r.items > 0 && r.realSeconds > 0)
+		os << std::setprecision(3) << std::setw(12) << r.items / r.realSeconds / 1e6 << "M items/s";
+	if (!r.label.empty())
+		os << " " << r.label;
+	os << std::endl;
+	os.unsetf(std::ios::floatfield);
+}
+
+void Runner::runAll(const std::regex &pattern, double minTime, std::ostream *console, bool listOnly,
+                    std::ostream &report, std::vector<Result> &results)
+{
+	const std::vector<Benchmark*> &benchmarks = registry();
+	for (std::size_t i = 0; i < benchmarks.size(); i++)
+	{
+		const Benchmark &b = *benchmarks[i];
+		std::vector<std::vector<std::int64_t> > argSets = b.argSets;
+		if (argSets.empty())
+			argSets.push_back(std::vector<std::int64_t>());
+
+		for (std::size_t j = 0; j < argSets.size(); j++)
+		{
+			if (!argSets[j].empty() && argSets[j][0] > maxSize())
+				continue;
+			const std::string name = runName(b, argSets[j]);
+			if (!std::regex_search(name, pattern))
+				continue;
+			if (listOnly)
+			{
+				report << name << std::endl;
+				continue;
+			}
+
+			results.push_back(run(b, argSets[j], name, minTime));
+			if (console != NULL)
+				printConsole(*console, results.back());
+		}
+	}
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::string filter = ".*";
+	std::string out;
+	std::string format = "console";
+	double minTime = 0.5;
+	bool listOnly = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string a = argv[i];
+		if (a.compare(0, 19, "--benchmark_filter=") == 0)
+			filter = a.substr(19);
+		else if (a.compare(0, 21, "--benchmark_min_time=") == 0)
+			minTime = std::atof(a.substr(21).c_str());
+		else if (a.compare(0, 16, "--benchmark_out=") == 0)
+			out = a.substr(16);
+		else if (a.compare(0, 19, "--benchmark_format=") == 0)
+			format = a.substr(19);
+		else if (a.compare(0, 11, "--max_size=") == 0)
+			bench::maxSizeFlag = std::atoll(a.substr(11).c_str());
+		else if (a == "--benchmark_list_tests")
+			listOnly = true;
+		else
+		{
+			std::cerr << "Unknown flag " << a << std::endl;
+			return 2;
+		}
+	}
+
+	// the library under test prints progress messages; keep them out of the report
+	std::ostream report(std::cout.rdbuf());
+	std::ofstream devNull("/dev/null");
+	std::cout.rdbuf(devNull.rdbuf());
+
+	std::vector<bench::Result> results;
+	const bool console = (format == "console");
+	if (console && !listOnly)
+		report << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(17) << "Time"
+		       << std::setw(17) << "CPU" << std::setw(12) << "Iterations" << std::endl;
+	bench::Runner::runAll(std::regex(filter), minTime, console ? &report : NULL, listOnly, report, results);
+
+	if (format == "json")
+		bench::writeJson(report, results, argv[0]);
+	if (!out.empty())
+	{
+		std::ofstream file(out.c_str());
+		bench::writeJson(file, results, argv[0]);
+	}
+	std::cout.rdbuf(report.rdbuf());
+	return 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * A small benchmark harness in the style of Google Benchmark.
+ *
+ * A benchmark is a function taking a State, registered with BENCHMARK() and given one or more
+ * argument sets:
+ *
+ *   static void BM_Lookup(bench::State &state)
+ *   {
+ *     ... setup using state.range(0) ...
+ *     while (state.keepRunning())
+ *       ... timed work ...
+ *     state.setItemsProcessed(state.iterations());
+ *   }
+ *   BENCHMARK(BM_Lookup)->argNames({"keys"})->arg(10000)->arg(100000);
+ *
+ * The runner calls the function with a growing iteration count until a run takes at least the
+ * minimum time, then reports the time per iteration on the console and, with --benchmark_out,
+ * as JSON in the same layout as Google Benchmark so the usual comparison tools can read it.
+ */
+namespace bench {
+
+/**
+ * @brief Controls the timed loop of one benchmark run.
+ */
+class State
+{
+ public:
+  State(std::uint64_t iterations, const std::vector<std::int64_t> &args);
+
+  /**
+   * Returns true once per iteration.  The timer starts at the first call and stops when it returns false.
+   */
+  bool keepRunning()
+  {
+    if (remaining-- > 0)
+    {
+      if (!started)
+        start();
+      return true;
+    }
+    stop();
+    return false;
+  }
+
+  /**
+   * Returns argument i of the argument set being run.
+   */
+  std::int64_t range(std::size_t i) const { return args.at(i); }
+
+  /**
+   * Returns the number of iterations of this run.
+   */
+  std::uint64_t iterations() const { return maxIterations; }
+
+  /**
+   * Stop the timer, for setup work inside the loop.
+   */
+  void pauseTiming();
+
+  /**
+   * Restart the timer after pauseTiming().
+   */
+  void resumeTiming();
+
+  /**
+   * Report a throughput: the number of items handled by the whole run.
+   */
+  void setItemsProcessed(std::int64_t items) { itemsProcessed = items; }
+
+  /**
+   * Attach a free-form label to the result.
+   */
+  void setLabel(const std::string &text) { label = text; }
+
+  /**
+   * Mark the run as failed; it is reported with the message instead of timings.
+   */
+  void skipWithError(const std::string &message);
+
+ private:
+  friend struct Runner;
+
+  void start();
+  void stop();
+
+  static double threadCpuSeconds();
+
+  std::uint64_t maxIterations;
+  std::int64_t remaining;
+  std::vector<std::int64_t> args;
+
+  bool started;
+  bool running;
+  std::chrono::steady_clock::time_point realStart;
+  double cpuStart;
+  double realSeconds;
+  double cpuSeconds;
+
+  std::int64_t itemsProcessed;
+  std::string label;
+  std::string error;
+};
+
+/**
+ * @brief A registered benchmark function with its argument sets.
+ */
+class Benchmark
+{
+ public:
+  Benchmark(const std::string &name, void (*func)(State &));
+
+  /**
+   * Add an argument set with a single argument.
+   */
+  Benchmark *arg(std::int64_t a);
+
+  /**
+   * Add an argument set.
+   */
+  Benchmark *args(std::initializer_list<std::int64_t> a);
+
+  /**
+   * Add every combination of the given argument values.
+   */
+  Benchmark *argsProduct(std::initializer_list<std::vector<std::int64_t> > values);
+
+  /**
+   * Name the arguments, shown as name:value in the run names.
+   */
+  Benchmark *argNames(std::initializer_list<std::string> names);
+
+ private:
+  friend struct Runner;
+
+  std::string name;
+  void (*func)(State &);
+  std::vector<std::vector<std::int64_t> > argSets;
+  std::vector<std::string> names;
+};
+
+/**
+ * Register a benchmark function, see BENCHMARK().
+ */
+Benchmark *registerBenchmark(const std::string &name, void (*func)(State &));
+
+/**
+ * Returns the largest first argument runs are made for (--max_size), so that the 10M and
+ * 100M key configurations are only run when asked for.
+ */
+std::int64_t maxSize();
+
+/**
+ * Keep the compiler from optimizing a computed value away.
+ */
+template <class T>
+inline void doNotOptimize(const T &value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+#define BENCHMARK(func) \
+  static ::bench::Benchmark *BENCH_CONCAT(benchRegistration_, __LINE__) __attribute__((unused)) = ::bench::registerBenchmark(#func, func)
@@ -0,0 +1,264 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Macro benchmarks of the B+ tree: building an index, inserting, point lookups and range scans,
+ * from 10K to 100M keys in sequential, uniform and zipfian order.  Sizes above --max_size
+ * (100K by default) are skipped.
+ */
+
+#include <cstddef>
+#include <stdlib.h>
+#include "bench.h"
+#include "bench_util.h"
+#include "btree.h"
+#include "buffer.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+/**
+ * Frames of the buffer pool of the index benchmarks, 128 MB.
+ */
+static const std::uint32_t INDEX_POOL_FRAMES = 16384;
+
+#define KEY_COUNTS {10000, 100000, 1000000, 10000000, 100000000}
+#define KEY_DISTS {DIST_SEQUENTIAL, DIST_UNIFORM, DIST_ZIPFIAN}
+
+/**
+ * Relation with keys 0..n-1 and an index over it, both kept for all runs of the same size.
+ */
+struct LookupFixture
+{
+	LookupFixture(std::int64_t n, LeafFormat format = LEAF_FLAT)
+		: bufMgr(INDEX_POOL_FRAMES)
+	{
+		const std::string &relation = benchRelation(n, DIST_SEQUENTIAL);
+		index = new BTreeIndex(relation, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER, format);
+	}
+
+	~LookupFixture()
+	{
+		delete index;
+		removeFile(indexName);
+	}
+
+	BufMgr bufMgr;
+	std::string indexName;
+	BTreeIndex *index;
+};
+
+static void BM_BTreeBulkLoad(State &state)
+{
+	const std::string &relation = benchRelation(state.range(0), (KeyDist)state.range(1));
+	BufMgr bufMgr(INDEX_POOL_FRAMES);
+	while (state.keepRunning())
+	{
+		std::string indexName;
+		BTreeIndex *index = new BTreeIndex(relation, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER);
+		state.pauseTiming();
+		delete index;
+		removeFile(indexName);
+		state.resumeTiming();
+	}
+	state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BTreeBulkLoad)->argNames({"keys", "dist"})->argsProduct({KEY_COUNTS, KEY_DISTS});
+
+static void BM_BTreeInsert(State &state)
+{
+	const std::vector<int> keys = makeKeys(state.range(0), (KeyDist)state.range(1));
+	const std::string &empty = benchRelation(0, DIST_SEQUENTIAL);
+	BufMgr bufMgr(INDEX_POOL_FRAMES);
+	const RecordId rid = {1, 1, 0};
+	while (state.keepRunning())
+	{
+		std::string indexName;
+		state.pauseTiming();
+		BTreeIndex *index = new BTreeIndex(empty, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER);
+		state.resumeTiming();
+
+		for (std::size_t i = 0; i < keys.size(); i++)
+			index->insertEntry(&keys[i], rid);
+
+		state.pauseTiming();
+		delete index;
+		removeFile(indexName);
+		state.resumeTiming();
+	}
+	state.setItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_BTreeInsert)->argNames({"keys", "dist"})->argsProduct({KEY_COUNTS, KEY_DISTS});
+
+static void BM_BTreeLookup(State &state)
+{
+	LookupFixture fixture(state.range(0));
+	KeyStream keys(state.range(0), (KeyDist)state.range(1));
+	RecordId rid;
+	while (state.keepRunning())
+	{
+		// a scan has to run into its end before endScan(), which releases the last leaf
+		const int key = keys.next();
+		fixture.index->startScan(&key, GTE, &key, LTE);
+		try
+		{
+			while (true)
+				fixture.index->scanNext(rid);
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		fixture.index->endScan();
+		doNotOptimize(rid);
+	}
+	state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BTreeLookup)->argNames({"keys", "dist"})->argsProduct({KEY_COUNTS, KEY_DISTS});
+
+static void BM_BTreeLookupPinned(State &state)
+{
+	// point lookups with the top levels of non-leaf nodes pinned, leaving one pool access for the leaf
+	LookupFixture fixture(state.range(0));
+	fixture.index->pinTopLevels(state.range(2));
+	KeyStream keys(state.range(0), (KeyDist)state.range(1));
+	RecordId rid;
+	while (state.keepRunning())
+	{
+		const int key = keys.next();
+		fixture.index->startScan(&key, GTE, &key, LTE);
+		try
+		{
+			while (true)
+				fixture.index->scanNext(rid);
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		fixture.index->endScan();
+		doNotOptimize(rid);
+	}
+	state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BTreeLookupPinned)->argNames({"keys", "dist", "levels"})->argsProduct({KEY_COUNTS, KEY_DISTS, {1, 2}});
+
+static void BM_BTreeRangeScan(State &state)
+{
+	// ranges of 100 keys starting at keys drawn from the distribution
+	LookupFixture fixture(state.range(0));
+	KeyStream keys(state.range(0), (KeyDist)state.range(1));
+	RecordId rid;
+	std::int64_t found = 0;
+	while (state.keepRunning())
+	{
+		const int low = keys.next();
+		const int high = low + 99;
+		fixture.index->startScan(&low, GTE, &high, LTE);
+		try
+		{
+			while (true)
+			{
+				fixture.index->scanNext(rid);
+				found++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		fixture.index->endScan();
+	}
+	state.setItemsProcessed(found);
+}
+BENCHMARK(BM_BTreeRangeScan)->argNames({"keys", "dist"})->argsProduct({KEY_COUNTS, KEY_DISTS});
+
+static void BM_BTreeRangeScanFormat(State &state)
+{
+	// ranges of 10000 keys over flat and bit-packed leaves
+	LookupFixture fixture(state.range(0), (LeafFormat)state.range(1));
+	KeyStream keys(state.range(0), DIST_UNIFORM);
+	RecordId rid;
+	std::int64_t found = 0;
+	while (state.keepRunning())
+	{
+		const int low = keys.next();
+		const int high = low + 9999;
+		fixture.index->startScan(&low, GTE, &high, LTE);
+		try
+		{
+			while (true)
+			{
+				fixture.index->scanNext(rid);
+				found++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		fixture.index->endScan();
+		doNotOptimize(rid);
+	}
+	state.setItemsProcessed(found);
+}
+BENCHMARK(BM_BTreeRangeScanFormat)->argNames({"keys", "format"})->argsProduct({KEY_COUNTS, {LEAF_FLAT, LEAF_PACKED}});
+
+static void BM_NonLeafSearch(State &state)
+{
+	// one level of a descent: finding the child for a random key in a random full non-leaf node,
+	// searching keyArray from the start (search 0) or through the node's summary (search 1).
+	// 4096 nodes are 32 MB, more than the caches hold
+	const std::size_t numNodes = state.range(0);
+	void *memory;
+	if (posix_memalign(&memory, CACHELINESIZE, numNodes * sizeof(NonLeafNodeInt)) != 0)
+	{
+		state.skipWithError("out of memory");
+		return;
+	}
+	NonLeafNodeInt *nodes = (NonLeafNodeInt *)memory;
+	for (std::size_t n = 0; n < numNodes; n++)
+	{
+		nodes[n].numValidKeys = INTARRAYNONLEAFSIZE;
+		for (int i = 0; i < INTARRAYNONLEAFSIZE; i++)
+			nodes[n].keyArray[i] = 2 * i;
+		nodes[n].buildSummary();
+	}
+
+	const std::size_t numProbes = 1 << 16;
+	KeyStream keys(2 * INTARRAYNONLEAFSIZE, DIST_UNIFORM);
+	KeyStream picks(numNodes, DIST_UNIFORM, 7);
+	std::vector<int> probeKeys(numProbes);
+	std::vector<int> probeNodes(numProbes);
+	for (std::size_t p = 0; p < numProbes; p++)
+	{
+		probeKeys[p] = keys.next();
+		probeNodes[p] = picks.next();
+	}
+
+	const bool summary = state.range(1) != 0;
+	std::size_t p = 0;
+	int index = 0;
+	while (state.keepRunning())
+	{
+		// the key depends on the last search, so that searches run one after another as in a descent
+		const NonLeafNodeInt &node = nodes[probeNodes[p]];
+		const int key = probeKeys[p] + (index & 1);
+		if (summary)
+		{
+			index = node.childIndex(key);
+		}
+		else
+		{
+			index = 0;
+			while (index < node.numValidKeys && !(key < node.keyArray[index]))
+				index++;
+		}
+		doNotOptimize(index);
+		p = (p + 1) & (numProbes - 1);
+	}
+	state.setItemsProcessed(state.iterations());
+	free(memory);
+}
+BENCHMARK(BM_NonLeafSearch)->argNames({"nodes", "search"})->argsProduct({{1, 4096}, {0, 1}});
@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * End-to-end load benchmarks for the eBay dataset of PP1: EbayLoader parsing every items-*.json
+ * file into relations with 1 to 8 workers, against PP1 skeleton_parser.py reading the same files
+ * into .dat files.  The data is looked for in ../../PP1/ebay_data, as seen from B+tree/src, or in
+ * $BADGERDB_EBAY_DATA; the Python parser in ../CS564-main/runxin from there, or in
+ * $BADGERDB_EBAY_PARSER.  Either benchmark is skipped if its input cannot be found.
+ */
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "bench.h"
+#include "bench_util.h"
+#include "ebay_loader.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+static std::string ebayDataDir()
+{
+	const char *dir = getenv("BADGERDB_EBAY_DATA");
+	return (dir != NULL) ? dir : "../../PP1/ebay_data";
+}
+
+/**
+ * Absolute paths of items-0.json, items-1.json, ... up to the first one missing.
+ */
+static std::vector<std::string> ebayFiles()
+{
+	std::vector<std::string> files;
+	for (int i = 0; ; i++)
+	{
+		char name[PATH_MAX];
+		snprintf(name, sizeof(name), "%s/items-%d.json", ebayDataDir().c_str(), i);
+		char path[PATH_MAX];
+		if (realpath(name, path) == NULL)
+			break;
+		files.push_back(path);
+	}
+	return files;
+}
+
+static void BM_EbayLoad(State &state)
+{
+	const std::vector<std::string> files = ebayFiles();
+	if (files.empty())
+	{
+		state.skipWithError("no items-*.json in " + ebayDataDir());
+		return;
+	}
+	const std::string prefix = "bench.ebay";
+	EbayLoadStats stats;
+	while (state.keepRunning())
+	{
+		EbayLoader loader(prefix);
+		stats = loader.load(files, state.range(0));
+	}
+
+	const std::string tables[] = {"Item", "Bid", "User", "Category"};
+	for (int i = 0; i < 4; i++)
+		removeFile(prefix + tables[i]);
+	char label[96];
+	snprintf(label, sizeof(label), "%.0fMB/s items=%llu bids=%llu users=%llu categories=%llu",
+	         stats.bytes / 1048576.0 / stats.seconds, (unsigned long long)stats.items,
+	         (unsigned long long)stats.bids, (unsigned long long)stats.users, (unsigned long long)stats.categories);
+	state.setLabel(label);
+	state.setItemsProcessed(state.iterations() * stats.items);
+}
+BENCHMARK(BM_EbayLoad)->argNames({"workers"})->arg(1)->arg(2)->arg(4)->arg(8);
+
+static void BM_EbayLoadPython(State &state)
+{
+	const std::vector<std::string> files = ebayFiles();
+	const char *parser = getenv("BADGERDB_EBAY_PARSER");
+	const std::string script = (parser != NULL) ? parser : ebayDataDir() + "/../CS564-main/runxin/skeleton_parser.py";
+	char scriptPath[PATH_MAX];
+	if (files.empty() || realpath(script.c_str(), scriptPath) == NULL)
+	{
+		state.skipWithError("no items-*.json in " + ebayDataDir() + " or no " + script);
+		return;
+	}
+
+	// The parser writes its .dat files to the working directory
+	const std::string dir = "bench.ebay.python";
+	std::string command = "mkdir -p " + dir + " && cd " + dir + " && python3 " + scriptPath;
+	for (std::size_t i = 0; i < files.size(); i++)
+		command += " " + files[i];
+	command += " > /dev/null";
+	while (state.keepRunning())
+	{
+		if (std::system(command.c_str()) != 0)
+		{
+			state.skipWithError("failed: " + command.substr(0, 200));
+			break;
+		}
+	}
+	std::system(("rm -rf " + dir).c_str());
+}
+BENCHMARK(BM_EbayLoadPython);
@@ -0,0 +1,135 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Restart benchmarks: time to recover an index against the size of the log written since the
+ * last checkpoint, with 1 to 8 redo workers.  The log is made by inserting n uniform keys into a
+ * logged index and injecting a crash into one more insert; every iteration puts the index file
+ * and the log back the way the crash left them and times RecoveryManager::recover alone.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include "bench.h"
+#include "bench_util.h"
+#include "btree.h"
+#include "buffer.h"
+#include "recovery.h"
+#include "wal.h"
+#include "exceptions/bad_log_exception.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+/**
+ * Frames of the buffer pool, 128 MB, so that nothing is written back before the crash.
+ */
+static const std::uint32_t RECOVERY_POOL_FRAMES = 16384;
+
+static void copyFile(const std::string &from, const std::string &to)
+{
+	std::ifstream in(from.c_str(), std::ios::in | std::ios::binary);
+	std::ofstream out(to.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	out << in.rdbuf();
+}
+
+/**
+ * An index and its log as a crash left them, saved aside so that every run starts from the same state.
+ */
+struct CrashedIndex
+{
+	CrashedIndex(std::int64_t n)
+	{
+		const std::string &relation = benchRelation(0, DIST_SEQUENTIAL);
+		logName = relation + ".wal";
+		removeFile(logName);
+
+		BufMgr bufMgr(RECOVERY_POOL_FRAMES);
+		LogManager *log = new LogManager(logName);
+		bufMgr.setLogManager(log);
+		BTreeIndex *index = new BTreeIndex(relation, indexName, &bufMgr, offsetof(BenchRecord, i), INTEGER);
+		index->setLogManager(log);
+		RecoveryManager(log, &bufMgr).checkpoint();
+
+		const std::vector<int> keys = makeKeys(n, DIST_UNIFORM);
+		const RecordId rid = {1, 1, 0};
+		for (std::size_t i = 0; i < keys.size(); i++)
+			index->insertEntry(&keys[i], rid);
+
+		// Die after the first change of one more insert, with the log forced past it, leaving a
+		// transaction to undo
+		log->injectCrash(2);
+		try
+		{
+			const int key = n;
+			index->insertEntry(&key, rid);
+		}
+		catch(const BadLogException &e)
+		{
+		}
+		log->flushAll();
+
+		// What the crash leaves is the files as they are on disk now; tearing the index down
+		// writes its pages back from the pool, which a crash would not
+		copyFile(indexName, indexName + ".crashed");
+		copyFile(logName, logName + ".crashed");
+		log->simulateCrash();
+		bufMgr.setLogManager(NULL);
+		delete index;
+		logBytes = log->getEndLsn();
+		delete log;
+	}
+
+	~CrashedIndex()
+	{
+		removeFile(indexName);
+		removeFile(indexName + ".crashed");
+		removeFile(logName);
+		removeFile(logName + ".crashed");
+	}
+
+	std::string indexName;
+	std::string logName;
+	Lsn logBytes;
+};
+
+static void BM_Recovery(State &state)
+{
+	CrashedIndex crashed(state.range(0));
+	const std::uint32_t workers = state.range(1);
+	RecoveryStats stats;
+	while (state.keepRunning())
+	{
+		state.pauseTiming();
+		copyFile(crashed.indexName + ".crashed", crashed.indexName);
+		copyFile(crashed.logName + ".crashed", crashed.logName);
+		BufMgr *bufMgr = new BufMgr(RECOVERY_POOL_FRAMES);
+		LogManager *log = new LogManager(crashed.logName);
+		bufMgr->setLogManager(log);
+		BlobFile *file = new BlobFile(crashed.indexName, false);
+		RecoveryManager recovery(log, bufMgr);
+		recovery.addFile(file);
+		state.resumeTiming();
+
+		stats = recovery.recover(workers);
+
+		state.pauseTiming();
+		bufMgr->flushFile(file);
+		delete file;
+		delete bufMgr;
+		delete log;
+		state.resumeTiming();
+	}
+
+	char label[96];
+	snprintf(label, sizeof(label), "log=%.1fMB redone=%llu undone=%llu", crashed.logBytes / 1048576.0,
+	         (unsigned long long)stats.recordsRedone, (unsigned long long)stats.recordsUndone);
+	state.setLabel(label);
+	state.setItemsProcessed(state.iterations() * stats.recordsAnalyzed);
+}
+BENCHMARK(BM_Recovery)->argNames({"keys", "workers"})->argsProduct({{10000, 100000, 1000000}, {1, 4, 8}});
@@ -0,0 +1,120 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Sort and join benchmarks.  ExternalSort sorts relations of BenchRecords in random key order,
+ * from 64K records (5.5 MB of pages) to 13M (1.1 GB, run with --max_size=13631488), given 64 or
+ * 1024 frames out of a pool only a little larger, so that nearly all the data goes through the
+ * run file.  The joins match two relations of n records on their key, by sorting and merging and
+ * by hashing.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include "bench.h"
+#include "bench_util.h"
+#include "buffer.h"
+#include "external_sort.h"
+#include "hash_join.h"
+#include "sort_merge_join.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+/**
+ * Frames of the pool beyond those given to the sort: the scan of the input and a few to spare.
+ */
+static const std::uint32_t SPARE_FRAMES = 16;
+
+static bool keyLess(const FieldString &a, const FieldString &b)
+{
+	int x, y;
+	memcpy(&x, a.data + offsetof(BenchRecord, i), sizeof(x));
+	memcpy(&y, b.data + offsetof(BenchRecord, i), sizeof(y));
+	return x < y;
+}
+
+static bool benchKey(const FieldString &record, FieldString &key)
+{
+	key = FieldString(record.data + offsetof(BenchRecord, i), sizeof(int));
+	return true;
+}
+
+static void BM_ExternalSort(State &state)
+{
+	const std::string &relation = benchRelation(state.range(0), DIST_UNIFORM);
+	const std::uint32_t frames = state.range(1);
+	SortStats stats;
+	bool ordered = true;
+	while (state.keepRunning())
+	{
+		BufMgr bufMgr(frames + SPARE_FRAMES);
+		ExternalSort sorter(&bufMgr, relation, keyLess, frames, "bench.sort.runs");
+		int expected = 0;
+		stats = sorter.sort([&](const FieldString &record) {
+			int key;
+			memcpy(&key, record.data + offsetof(BenchRecord, i), sizeof(key));
+			ordered = ordered && key == expected++;
+		});
+	}
+	if (!ordered)
+	{
+		state.skipWithError("output out of order");
+		return;
+	}
+	// Merges free the pages of their runs as they read them: one copy of the input and a page per run merged
+	if (stats.runFilePages > stats.runPages + frames)
+	{
+		state.skipWithError("run file grew past one copy of the input");
+		return;
+	}
+
+	char label[128];
+	snprintf(label, sizeof(label), "runs=%u merges=%u pages=%llu file=%llu", stats.runs, stats.intermediateMerges,
+	         (unsigned long long)stats.pagesWritten, (unsigned long long)stats.runFilePages);
+	state.setLabel(label);
+	state.setItemsProcessed(state.iterations() * stats.records);
+}
+BENCHMARK(BM_ExternalSort)->argNames({"records", "frames"})->argsProduct({{1 << 16, 1 << 20, 13 << 20}, {64, 1024}});
+
+static void BM_SortMergeJoin(State &state)
+{
+	const JoinInput left(benchRelation(state.range(0), DIST_UNIFORM), benchKey);
+	const JoinInput right(benchRelation(state.range(0), DIST_SEQUENTIAL), benchKey);
+	MergeJoinStats stats;
+	while (state.keepRunning())
+	{
+		BufMgr bufMgr(1024 + SPARE_FRAMES);
+		SortMergeJoin join(&bufMgr, left, right, 1024, "bench.join.runs");
+		stats = join.join([](const FieldString &, const FieldString &) {});
+	}
+	if (stats.matches != std::uint64_t(state.range(0)))
+		state.skipWithError("wrong number of matches");
+	state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SortMergeJoin)->argNames({"records"})->arg(1 << 16)->arg(1 << 20)->arg(4 << 20);
+
+static void BM_HashJoin(State &state)
+{
+	const JoinInput build(benchRelation(state.range(0), DIST_UNIFORM), benchKey);
+	const JoinInput probe(benchRelation(state.range(0), DIST_SEQUENTIAL), benchKey);
+	HashJoinStats stats;
+	while (state.keepRunning())
+	{
+		BufMgr bufMgr(1024 + SPARE_FRAMES);
+		HashJoin join(&bufMgr, build, probe, 1024 * Page::SIZE, "bench.join.spill");
+		stats = join.join([](const FieldString &, const FieldString &) {});
+	}
+	if (stats.matches != std::uint64_t(state.range(0)))
+		state.skipWithError("wrong number of matches");
+	char label[64];
+	snprintf(label, sizeof(label), "spill partitions=%u", stats.spillPartitions);
+	state.setLabel(label);
+	state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HashJoin)->argNames({"records"})->arg(1 << 16)->arg(1 << 20)->arg(4 << 20);
@@ -0,0 +1,206 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Microbenchmarks of the storage layer: Page, BufHashTbl, the BufMgr hit and miss paths and FileScan.
+ */
+
+#include <cstring>
+#include "bench.h"
+#include "bench_util.h"
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "file.h"
+#include "filescan.h"
+#include "page.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+
+using namespace badgerdb;
+using namespace bench;
+
+// ---------------------------------------------------------------------------
+// Page
+// ---------------------------------------------------------------------------
+
+static void BM_PageInsert(State &state)
+{
+	const std::string record(state.range(0), 'x');
+	std::int64_t inserted = 0;
+	while (state.keepRunning())
+	{
+		Page page;
+		while (true)
+		{
+			try
+			{
+				page.insertRecord(record);
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+				break;
+			}
+			inserted++;
+		}
+	}
+	state.setItemsProcessed(inserted);
+}
+BENCHMARK(BM_PageInsert)->argNames({"bytes"})->arg(16)->arg(80)->arg(512);
+
+static void BM_PageGet(State &state)
+{
+	const std::string record(state.range(0), 'x');
+	Page page;
+	std::vector<RecordId> rids;
+	try
+	{
+		while (true)
+			rids.push_back(page.insertRecord(record));
+	}
+	catch(const InsufficientSpaceException &e)
+	{
+	}
+
+	KeyStream slots(rids.size(), DIST_UNIFORM);
+	while (state.keepRunning())
+		doNotOptimize(page.getRecord(rids[slots.next()]));
+	state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PageGet)->argNames({"bytes"})->arg(16)->arg(80)->arg(512);
+
+// ---------------------------------------------------------------------------
+// BufHashTbl
+// ---------------------------------------------------------------------------
+
+static void BM_BufHashTblLookup(State &state)
+{
+	const std::int64_t entries = state.range(0);
+	BufHashTbl table(entries * 1.2 + 1);
+
+	// the table only hashes and compares the File pointer, a stand-in object does
+	static char fileStandIn[2];
+	const File *files[2] = {reinterpret_cast<const File*>(&fileStandIn[0]), reinterpret_cast<const File*>(&fileStandIn[1])};
+	for (std::int64_t i = 0; i < entries; i++)
+		table.insert(files[i & 1], i >> 1, i);
+
+	KeyStream keys(entries, (KeyDist)state.range(1));
+	FrameId frameNo;
+	while (state.keepRunning())
+	{
+		const int k = keys.next();
+		table.lookup(files[k & 1], k >> 1, frameNo);
+		doNotOptimize(frameNo);
+	}
+	state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BufHashTblLookup)->argNames({"entries", "dist"})->argsProduct({{1000, 100000, 1000000}, {0, 1, 2}});
+
+// ---------------------------------------------------------------------------
+// BufMgr
+// ---------------------------------------------------------------------------
+
+/**
+ * Scratch blob file with the given number of pages, removed when it goes out of scope.
+ */
+class ScratchFile
+{
+ public:
+	explicit ScratchFile(std::uint32_t pages)
+		: name("bench.scratch")
+	{
+		removeFile(name);
+		file = new BlobFile(BlobFile::create(name));
+		for (std::uint32_t i = 0; i < pages; i++)
+		{
+			PageId pageNo;
+			file->allocatePage(pageNo);
+		}
+	}
+
+	~ScratchFile()
+	{
+		delete file;
+		removeFile(name);
+	}
+
+	const std::string name;
+	BlobFile *file;
+};
+
+static void BM_BufMgrHit(State &state)
+{
+	const std::uint32_t frames = state.range(0);
+	ScratchFile scratch(frames);
+	BufMgr bufMgr(frames);
+	Page *page;
+	for (PageId pageNo = 1; pageNo <= frames; pageNo++)
+	{
+		bufMgr.readPage(scratch.file, pageNo, page);
+		bufMgr.unPinPage(scratch.file, pageNo, false);
+	}
+
+	KeyStream keys(frames, (KeyDist)state.range(1));
+	while (state.keepRunning())
+	{
+		const PageId pageNo = keys.next() + 1;
+		bufMgr.readPage(scratch.file, pageNo, page);
+		bufMgr.unPinPage(scratch.file, pageNo, false);
+	}
+	state.setItemsProcessed(state.iterations());
+	bufMgr.flushFile(scratch.file);
+}
+BENCHMARK(BM_BufMgrHit)->argNames({"frames", "dist"})->argsProduct({{1024, 16384, 65536}, {0, 1, 2}});
+
+static void BM_BufMgrMiss(State &state)
+{
+	// cycling over twice as many pages as frames makes the clock miss on every read
+	const std::uint32_t frames = state.range(0);
+	const std::uint32_t pages = 2 * frames;
+	ScratchFile scratch(pages);
+	BufMgr bufMgr(frames);
+	Page *page;
+
+	PageId pageNo = 0;
+	while (state.keepRunning())
+	{
+		pageNo = pageNo % pages + 1;
+		bufMgr.readPage(scratch.file, pageNo, page);
+		bufMgr.unPinPage(scratch.file, pageNo, (std::int64_t)(pageNo % 100) < state.range(1));
+	}
+	state.setItemsProcessed(state.iterations());
+	bufMgr.flushFile(scratch.file);
+}
+BENCHMARK(BM_BufMgrMiss)->argNames({"frames", "dirtyPercent"})->argsProduct({{1024, 16384}, {0, 50}});
+
+// ---------------------------------------------------------------------------
+// FileScan
+// ---------------------------------------------------------------------------
+
+static void BM_FileScan(State &state)
+{
+	const std::string &relation = benchRelation(state.range(0), DIST_SEQUENTIAL);
+	BufMgr bufMgr(1024);
+	std::int64_t records = 0;
+	while (state.keepRunning())
+	{
+		FileScan scan(relation, &bufMgr);
+		RecordId rid;
+		try
+		{
+			while (true)
+			{
+				scan.scanNext(rid);
+				records++;
+			}
+		}
+		catch(const EndOfFileException &e)
+		{
+		}
+	}
+	state.setItemsProcessed(records);
+}
+BENCHMARK(BM_FileScan)->argNames({"records"})->arg(10000)->arg(100000)->arg(1000000);
@@ -0,0 +1,176 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "file.h"
+#include "page.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+
+using namespace badgerdb;
+
+namespace bench {
+
+//----------------------------------------
+// ZipfianGenerator
+//----------------------------------------
+
+static double zeta(std::uint64_t n, double theta)
+{
+	double sum = 0;
+	for (std::uint64_t i = 1; i <= n; i++)
+		sum += 1.0 / std::pow((double)i, theta);
+	return sum;
+}
+
+ZipfianGenerator::ZipfianGenerator(std::uint64_t n, double theta)
+	: n(n), theta(theta), alpha(1.0 / (1.0 - theta)), zetan(zeta(n, theta)), uniform(0.0, 1.0)
+{
+	eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+}
+
+std::uint64_t ZipfianGenerator::next(std::mt19937_64 &rng)
+{
+	const double u = uniform(rng);
+	const double uz = u * zetan;
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + std::pow(0.5, theta))
+		return 1;
+	const std::uint64_t rank = (std::uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha));
+	return rank < n ? rank : n - 1;
+}
+
+//----------------------------------------
+// KeyStream
+//----------------------------------------
+
+KeyStream::KeyStream(std::int64_t n, KeyDist dist, std::uint64_t seed)
+	: n(n), dist(dist), position(0), rng(seed), zipf(dist == DIST_ZIPFIAN ? n : 2)
+{
+}
+
+int KeyStream::next()
+{
+	switch (dist)
+	{
+		case DIST_SEQUENTIAL:
+			if (position == n)
+				position = 0;
+			return position++;
+		case DIST_UNIFORM:
+			return rng() % n;
+		case DIST_ZIPFIAN:
+			return zipf.next(rng);
+	}
+	return 0;
+}
+
+std::vector<int> makeKeys(std::int64_t n, KeyDist dist, std::uint64_t seed)
+{
+	std::vector<int> keys(n);
+	if (dist == DIST_ZIPFIAN)
+	{
+		KeyStream stream(n, dist, seed);
+		for (std::int64_t i = 0; i < n; i++)
+			keys[i] = stream.next();
+		return keys;
+	}
+
+	for (std::int64_t i = 0; i < n; i++)
+		keys[i] = i;
+	if (dist == DIST_UNIFORM)
+	{
+		std::mt19937_64 rng(seed);
+		std::shuffle(keys.begin(), keys.end(), rng);
+	}
+	return keys;
+}
+
+//----------------------------------------
+// Relations
+//----------------------------------------
+
+void removeFile(const std::string &name)
+{
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+}
+
+/**
+ * Relations created so far, removed when the program exits.  Only constructed on first use, so
+ * that it is destroyed before the static state of File it needs.
+ */
+class RelationCache
+{
+ public:
+	~RelationCache()
+	{
+		for (std::map<std::pair<std::int64_t, int>, std::string>::iterator it = names.begin(); it != names.end(); ++it)
+			removeFile(it->second);
+	}
+
+	std::map<std::pair<std::int64_t, int>, std::string> names;
+};
+
+const std::string &benchRelation(std::int64_t n, KeyDist dist)
+{
+	static RelationCache relations;
+	const std::pair<std::int64_t, int> id(n, dist);
+	std::map<std::pair<std::int64_t, int>, std::string>::iterator it = relations.names.find(id);
+	if (it != relations.names.end())
+		return it->second;
+
+	std::ostringstream os;
+	os << "bench.rel." << n << "." << dist;
+	const std::string name = os.str();
+	removeFile(name);
+
+	{
+		PageFile file = PageFile::create(name);
+		const std::vector<int> keys = makeKeys(n, dist);
+
+		BenchRecord record;
+		memset(&record, 0, sizeof(record));
+		PageId pageNo;
+		Page page = file.allocatePage(pageNo);
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			record.i = keys[i];
+			record.d = keys[i];
+			snprintf(record.s, sizeof(record.s), "%05d string record", keys[i]);
+			const std::string data(reinterpret_cast<const char*>(&record), sizeof(record));
+			try
+			{
+				page.insertRecord(data);
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+				file.writePage(pageNo, page);
+				page = file.allocatePage(pageNo);
+				page.insertRecord(data);
+			}
+		}
+		file.writePage(pageNo, page);
+	}
+
+	return relations.names[id] = name;
+}
+
+}
@@ -0,0 +1,90 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * @brief Key distributions, passed to the benchmarks as an argument.
+ */
+enum KeyDist {
+  DIST_SEQUENTIAL = 0,   // 0, 1, 2, ... in order
+  DIST_UNIFORM    = 1,   // every key of [0, n) equally likely
+  DIST_ZIPFIAN    = 2    // skewed towards the low keys, theta 0.99
+};
+
+/**
+ * @brief Record layout of the benchmark relations, the same as the test driver's.
+ */
+struct BenchRecord
+{
+  int i;
+  double d;
+  char s[64];
+};
+
+/**
+ * @brief Zipfian distribution over [0, n) following Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases" (the generator YCSB uses).  Rank 0 is the most popular.
+ */
+class ZipfianGenerator
+{
+ public:
+  ZipfianGenerator(std::uint64_t n, double theta = 0.99);
+
+  std::uint64_t next(std::mt19937_64 &rng);
+
+ private:
+  std::uint64_t n;
+  double theta;
+  double alpha;
+  double zetan;
+  double eta;
+  std::uniform_real_distribution<double> uniform;
+};
+
+/**
+ * @brief Endless stream of keys of [0, n) drawn from a distribution.
+ */
+class KeyStream
+{
+ public:
+  KeyStream(std::int64_t n, KeyDist dist, std::uint64_t seed = 42);
+
+  int next();
+
+ private:
+  std::int64_t n;
+  KeyDist dist;
+  std::int64_t position;
+  std::mt19937_64 rng;
+  ZipfianGenerator zipf;
+};
+
+/**
+ * Returns n keys of [0, n): in order, a random permutation, or n zipfian draws (with repeats).
+ */
+std::vector<int> makeKeys(std::int64_t n, KeyDist dist, std::uint64_t seed = 42);
+
+/**
+ * Returns the name of a relation holding one BenchRecord per key of makeKeys(n, dist), in that
+ * order.  The relation is created on first use and removed when the benchmark program exits.
+ */
+const std::string &benchRelation(std::int64_t n, KeyDist dist);
+
+/**
+ * Remove a file if it exists.
+ */
+void removeFile(const std::string &name);
+
+}
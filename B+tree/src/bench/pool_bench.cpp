@@ -0,0 +1,173 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Random-probe throughput of the buffer pool with and without huge pages.
+ *
+ * Every configuration fills a pool with the pages of a scratch file and then probes random
+ * frames, once by touching a random byte of a random frame directly (pure TLB and cache cost)
+ * and once through readPage/unPinPage of a random resident page (the buffer hit path).
+ *
+ * Usage: pool_bench [frames] [probes] [numaNodes]
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "buffer.h"
+#include "file.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+static std::uint64_t xorshift(std::uint64_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/**
+ * Parse a positive count of at most max from a command line argument.
+ */
+static bool parseCount(const char *arg, std::uint64_t max, std::uint64_t &value)
+{
+	if (*arg < '0' || *arg > '9')
+		return false;
+	char *end;
+	errno = 0;
+	const unsigned long long parsed = std::strtoull(arg, &end, 10);
+	if (errno != 0 || *end != '\0' || parsed == 0 || parsed > max)
+		return false;
+	value = parsed;
+	return true;
+}
+
+static void usage(std::ostream &os)
+{
+	os << "Usage: pool_bench [frames] [probes] [numaNodes]\n"
+	   << "  frames     frames of the pool, and pages of the scratch file (default 16384)\n"
+	   << "  probes     random probes per measurement (default 4000000)\n"
+	   << "  numaNodes  NUMA nodes to spread the pool over (default 1)\n"
+	   << "All of them have to be positive numbers." << std::endl;
+}
+
+static void runConfig(const std::string &name, BlobFile &file, std::uint32_t frames, std::uint64_t probes,
+                      const BufPoolOptions &options)
+{
+	{
+		BufMgr bufMgr(frames, options);
+		std::vector<PageId> pages;
+		for (PageId pageNo = 1; pageNo <= frames; pageNo++)
+		{
+			Page *page;
+			bufMgr.readPage(&file, pageNo, page);
+			bufMgr.unPinPage(&file, pageNo, false);
+			pages.push_back(pageNo);
+		}
+
+		// touch one random byte of a random frame
+		std::uint64_t state = 88172645463325252ULL;
+		std::uint64_t sum = 0;
+		const char *pool = reinterpret_cast<const char*>(bufMgr.bufPool);
+		const std::uint64_t poolBytes = (std::uint64_t)frames * sizeof(Page);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (std::uint64_t i = 0; i < probes; i++)
+			sum += pool[xorshift(state) % poolBytes];
+		double rawSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// look a random resident page up through the buffer manager
+		start = std::chrono::steady_clock::now();
+		for (std::uint64_t i = 0; i < probes; i++)
+		{
+			const std::uint64_t r = xorshift(state);
+			const PageId pageNo = pages[r % frames];
+			Page *page;
+			bufMgr.readPage(&file, pageNo, page);
+			sum += reinterpret_cast<const char*>(page)[(r >> 32) % sizeof(Page)];
+			bufMgr.unPinPage(&file, pageNo, false);
+		}
+		double hitSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << name << ": backing=" << PoolMemory::backingName(bufMgr.getPoolBacking())
+		          << " nodes=" << bufMgr.getNumNumaNodes()
+		          << " raw_probes_per_sec=" << (std::uint64_t)(probes / rawSecs)
+		          << " readpage_probes_per_sec=" << (std::uint64_t)(probes / hitSecs)
+		          << " (checksum " << sum << ")" << std::endl;
+		bufMgr.flushFile(&file);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0))
+	{
+		usage(std::cout);
+		return 0;
+	}
+
+	// frames is a frame count and a page number, so a PageId has to hold it
+	std::uint64_t args[3] = {16384, 4000000, 1};
+	const std::uint64_t limits[3] = {std::numeric_limits<PageId>::max() - 1, std::numeric_limits<std::uint64_t>::max(),
+	                                 std::numeric_limits<std::uint32_t>::max()};
+	if (argc > 4)
+	{
+		usage(std::cerr);
+		return 1;
+	}
+	for (int i = 1; i < argc; i++)
+	{
+		if (!parseCount(argv[i], limits[i - 1], args[i - 1]))
+		{
+			std::cerr << "pool_bench: bad argument '" << argv[i] << "'" << std::endl;
+			usage(std::cerr);
+			return 1;
+		}
+	}
+	const std::uint32_t frames = args[0];
+	const std::uint64_t probes = args[1];
+	const std::uint32_t nodes = args[2];
+
+	std::cout << "frames=" << frames << " (" << ((std::uint64_t)frames * sizeof(Page) >> 20) << " MB)"
+	          << " probes=" << probes << std::endl;
+
+	// scratch relation with one page per frame, so that every probe of the second phase is a hit
+	const std::string fileName = "pool_bench.scratch";
+	try
+	{
+		File::remove(fileName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	{
+		BlobFile file = BlobFile::create(fileName);
+		for (std::uint32_t i = 0; i < frames; i++)
+		{
+			PageId pageNo;
+			file.allocatePage(pageNo);
+		}
+
+		BufPoolOptions small;
+		small.numaNodes = nodes;
+		runConfig("4k pages  ", file, frames, probes, small);
+
+		BufPoolOptions huge;
+		huge.hugePages = true;
+		huge.numaNodes = nodes;
+		runConfig("huge pages", file, frames, probes, huge);
+	}
+	File::remove(fileName);
+
+	return 0;
+}
@@ -6,7 +6,14 @@
  */
 
 #include "btree.h"
+#include <algorithm>
+#include <limits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "filescan.h"
+#include "parallel.h"
+#include "parallel_filescan.h"
 #include "file.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
@@ -17,17 +24,598 @@
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/index_unusable_exception.h"
 
 //#define DEBUG
 
 namespace badgerdb
 {
 
-IndexMetaInfo *BTreeIndex::allocateMetaInfoNode(PageId &newPageId)
+// Share of the entries left in the old node when a split is caused by an append at the right
+// edge of the tree; the rest, and the new key, go to the new node
+static const int APPEND_SPLIT_PERCENT = 90;
+
+// Share of a node a bulk load fills, leaving room for inserts so that the first ones after the
+// load do not split every node they land in
+static const int BULK_FILL_PERCENT = APPEND_SPLIT_PERCENT;
+
+// Pages of the relation per bulk load worker; a relation smaller than this is loaded on the
+// calling thread alone
+static const std::uint32_t BULK_PAGES_PER_WORKER = 64;
+
+// -----------------------------------------------------------------------------
+// Posting-list leaves
+// -----------------------------------------------------------------------------
+
+/**
+ * A RecordId as the number posting lists order and encode it by.
+ */
+static std::uint64_t ridValue(const RecordId &rid)
+{
+	return (std::uint64_t(rid.page_number) << 16) | rid.slot_number;
+}
+
+static RecordId valueRid(std::uint64_t value)
+{
+	RecordId rid;
+	rid.page_number = PageId(value >> 16);
+	rid.slot_number = SlotId(value & 0xFFFF);
+	rid.padding = 0;
+	return rid;
+}
+
+static int varintSize(std::uint64_t value)
+{
+	int size = 1;
+	while(value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
+
+static int putVarint(unsigned char *out, std::uint64_t value)
+{
+	int size = 0;
+	while(value >= 0x80) {
+		out[size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (unsigned char)value;
+	return size;
+}
+
+static int getVarint(const unsigned char *in, std::uint64_t &value)
+{
+	value = 0;
+	int size = 0;
+	for(int shift = 0; ; shift += 7) {
+		const unsigned char byte = in[size++];
+		value |= std::uint64_t(byte & 0x7F) << shift;
+		if(byte < 0x80) {
+			return size;
+		}
+	}
+}
+
+static PostingHeadInt *postingHeads(PostingLeafNodeInt *node)
+{
+	return (PostingHeadInt *)node->data;
+}
+
+static const PostingHeadInt *postingHeads(const PostingLeafNodeInt *node)
+{
+	return (const PostingHeadInt *)node->data;
+}
+
+/**
+ * Bytes pair adds to a posting-list leaf after prev, NULL if it is the first pair of the leaf.
+ */
+static int postingCost(const RIDKeyPair<int> *prev, const RIDKeyPair<int> &pair)
+{
+	if(prev == NULL || prev->key != pair.key) {
+		return sizeof(PostingHeadInt) + varintSize(ridValue(pair.rid));
+	}
+	return varintSize(ridValue(pair.rid) - ridValue(prev->rid));
+}
+
+/**
+ * Replace the contents of a posting-list leaf with pairs, sorted by key and then rid,
+ * which have to fit.
+ */
+static void packPostingLeaf(PostingLeafNodeInt *node, const RIDKeyPair<int> *pairs, std::size_t numPairs)
+{
+	int numKeys = 0;
+	int bytes = 0;
+	for(std::size_t i = 0; i < numPairs; i++) {
+		const bool newKey = i == 0 || pairs[i].key != pairs[i - 1].key;
+		numKeys += newKey;
+		bytes += postingCost(newKey ? NULL : &pairs[i - 1], pairs[i]) - (newKey ? sizeof(PostingHeadInt) : 0);
+	}
+
+	PostingHeadInt *heads = postingHeads(node);
+	int pos = POSTINGLEAFDATASIZE - bytes;
+	int k = -1;
+	for(std::size_t i = 0; i < numPairs; i++) {
+		if(i == 0 || pairs[i].key != pairs[i - 1].key) {
+			k++;
+			heads[k].key = pairs[i].key;
+			heads[k].offset = pos;
+			heads[k].length = 0;
+			pos += putVarint(node->data + pos, ridValue(pairs[i].rid));
+		} else {
+			pos += putVarint(node->data + pos, ridValue(pairs[i].rid) - ridValue(pairs[i - 1].rid));
+		}
+		heads[k].length = pos - heads[k].offset;
+	}
+	node->numValidKeys = numKeys;
+	node->postingBytes = bytes;
+}
+
+/**
+ * Decode every <key, rid> pair of a posting-list leaf, appending them to pairs in key and rid order.
+ */
+static void unpackPostingLeaf(const PostingLeafNodeInt *node, std::vector<RIDKeyPair<int> > &pairs)
 {
-	IndexMetaInfo *newNode;
-	bufMgr->allocPage(file, newPageId, (Page *&)newNode);
-	return newNode;
+	const PostingHeadInt *heads = postingHeads(node);
+	for(int k = 0; k < node->numValidKeys; k++) {
+		std::uint64_t value = 0;
+		for(int pos = heads[k].offset; pos < heads[k].offset + heads[k].length; ) {
+			std::uint64_t delta;
+			const bool first = pos == heads[k].offset;
+			pos += getVarint(node->data + pos, delta);
+			value = first ? delta : value + delta;
+			RIDKeyPair<int> pair;
+			pair.set(valueRid(value), heads[k].key);
+			pairs.push_back(pair);
+		}
+	}
+}
+
+/**
+ * Insert a <key, rid> pair into a posting-list leaf, after any equal rids of the key.
+ * Returns false, leaving the leaf as it was, if it has no room for the pair.
+ */
+static bool insertPostingEntry(PostingLeafNodeInt *node, int key, const RecordId &rid)
+{
+	PostingHeadInt *heads = postingHeads(node);
+	int index = 0;
+	while(index < node->numValidKeys && heads[index].key < key) {
+		index++;
+	}
+	const bool found = index < node->numValidKeys && heads[index].key == key;
+	const std::uint64_t value = ridValue(rid);
+
+	// The new rid replaces the varint at pos, oldSize bytes long, with newBytes
+	unsigned char newBytes[20];
+	int newSize = 0;
+	int pos;
+	int oldSize = 0;
+	if(found) {
+		// Find the first rid greater than the new one; the new rid is encoded against the one
+		// before it and the greater one against the new rid
+		const int end = heads[index].offset + heads[index].length;
+		std::uint64_t prev = 0;
+		bool first = true;
+		pos = heads[index].offset;
+		while(pos < end) {
+			std::uint64_t delta;
+			const int size = getVarint(node->data + pos, delta);
+			const std::uint64_t next = first ? delta : prev + delta;
+			if(next > value) {
+				oldSize = size;
+				newSize = putVarint(newBytes, first ? value : value - prev);
+				newSize += putVarint(newBytes + newSize, next - value);
+				break;
+			}
+			prev = next;
+			first = false;
+			pos += size;
+		}
+		if(pos == end) {
+			newSize = putVarint(newBytes, value - prev);
+		}
+	} else {
+		pos = index < node->numValidKeys ? heads[index].offset : POSTINGLEAFDATASIZE;
+		newSize = putVarint(newBytes, value);
+	}
+
+	const int growth = newSize - oldSize;
+	const int freeBytes = POSTINGLEAFDATASIZE - node->numValidKeys * int(sizeof(PostingHeadInt)) - node->postingBytes;
+	if(growth + (found ? 0 : int(sizeof(PostingHeadInt))) > freeBytes) {
+		return false;
+	}
+
+	// Move the posting lists before pos down to make room, then write the new bytes
+	const int start = POSTINGLEAFDATASIZE - node->postingBytes;
+	memmove(node->data + start - growth, node->data + start, pos - start);
+	memcpy(node->data + pos - growth, newBytes, newSize);
+	node->postingBytes += growth;
+	for(int k = 0; k < index; k++) {
+		heads[k].offset -= growth;
+	}
+
+	if(found) {
+		heads[index].offset -= growth;
+		heads[index].length += growth;
+	} else {
+		memmove(heads + index + 1, heads + index, (node->numValidKeys - index) * sizeof(PostingHeadInt));
+		heads[index].key = key;
+		heads[index].offset = pos - growth;
+		heads[index].length = growth;
+		node->numValidKeys++;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Bit-packed leaves
+// -----------------------------------------------------------------------------
+
+/**
+ * Offsets in data and widths of the key, page number and slot number columns of a bit-packed
+ * leaf, and how many entries the columns have room for.
+ */
+struct PackedLayout {
+	int bits[3];
+	int offset[3];
+	int capacity;
+};
+
+static std::uint32_t bitMask(int bits)
+{
+	return bits == 32 ? 0xFFFFFFFFu : (std::uint32_t(1) << bits) - 1;
+}
+
+/**
+ * Bits needed for values up to max.
+ */
+static int bitWidth(std::uint32_t max)
+{
+	return max == 0 ? 0 : 32 - __builtin_clz(max);
+}
+
+/**
+ * Bytes of a column of count values, bits bits each, in four lanes of whole 32-bit words.
+ */
+static int packedColumnBytes(int bits, int count)
+{
+	return int((std::int64_t((count + 3) / 4) * bits + 31) / 32 * 16);
+}
+
+static PackedLayout packedLayout(int keyBits, int pageBits, int slotBits)
+{
+	PackedLayout layout;
+	layout.bits[0] = keyBits;
+	layout.bits[1] = pageBits;
+	layout.bits[2] = slotBits;
+
+	int groups = PACKEDLEAFMAXSIZE / 4;
+	const int bits = keyBits + pageBits + slotBits;
+	if(bits > 0) {
+		groups = std::min(groups, PACKEDLEAFDATASIZE * 8 / (4 * bits));
+	}
+	// The last 16 bytes are left over for packedUnpack to read past the end of the last column
+	while(packedColumnBytes(keyBits, 4 * groups) + packedColumnBytes(pageBits, 4 * groups) +
+	      packedColumnBytes(slotBits, 4 * groups) > PACKEDLEAFDATASIZE - 16) {
+		groups--;
+	}
+	layout.capacity = 4 * groups;
+	layout.offset[0] = 0;
+	layout.offset[1] = packedColumnBytes(keyBits, layout.capacity);
+	layout.offset[2] = layout.offset[1] + packedColumnBytes(pageBits, layout.capacity);
+	return layout;
+}
+
+static PackedLayout packedLayout(const PackedLeafNodeInt *node)
+{
+	return packedLayout(node->keyBits, node->pageBits, node->slotBits);
+}
+
+static const std::uint32_t *packedColumn(const PackedLeafNodeInt *node, const PackedLayout &layout, int column)
+{
+	return (const std::uint32_t *)(node->data + layout.offset[column]);
+}
+
+static std::uint32_t *packedColumn(PackedLeafNodeInt *node, const PackedLayout &layout, int column)
+{
+	return (std::uint32_t *)(node->data + layout.offset[column]);
+}
+
+/**
+ * Value of entry index of a column.
+ */
+static std::uint32_t packedGet(const std::uint32_t *column, int bits, int index)
+{
+	if(bits == 0) {
+		return 0;
+	}
+	const int bit = (index >> 2) * bits;
+	const int shift = bit & 31;
+	const std::uint32_t *word = column + (bit >> 5) * 4 + (index & 3);
+	std::uint32_t value = word[0] >> shift;
+	if(shift + bits > 32) {
+		value |= word[4] << (32 - shift);
+	}
+	return value & bitMask(bits);
+}
+
+
+/**
+ * Unpack the values of count entries of a column from entry first on, which is a multiple of 4.
+ * Entries are unpacked four at a time, one from each lane, so out needs room for count rounded
+ * up to a multiple of 4.
+ */
+static void packedUnpack(const std::uint32_t *column, int bits, int first, int count, std::uint32_t *out)
+{
+	const int groups = (count + 3) / 4;
+	if(bits == 0) {
+		memset(out, 0, groups * 4 * sizeof(std::uint32_t));
+		return;
+	}
+	int bit = (first >> 2) * bits;
+#if defined(__SSE2__)
+	// Every lane of a group is at the same bit offset of its word, so one shift serves all four.
+	// The high bits always come from the next word, shifted out entirely (by 32) when the values
+	// do not reach into it, which saves a branch that is taken at random
+	const __m128i mask = _mm_set1_epi32(int(bitMask(bits)));
+	for(int g = 0; g < groups; g++, bit += bits) {
+		const __m128i *word = (const __m128i *)(column + (bit >> 5) * 4);
+		const int shift = bit & 31;
+		const __m128i low = _mm_srl_epi32(_mm_loadu_si128(word), _mm_cvtsi32_si128(shift));
+		const __m128i high = _mm_sll_epi32(_mm_loadu_si128(word + 1), _mm_cvtsi32_si128(shift == 0 ? 32 : 32 - shift));
+		_mm_storeu_si128((__m128i *)(out + 4 * g), _mm_and_si128(_mm_or_si128(low, high), mask));
+	}
+#else
+	const std::uint32_t mask = bitMask(bits);
+	for(int g = 0; g < groups; g++, bit += bits) {
+		const std::uint32_t *word = column + (bit >> 5) * 4;
+		const int shift = bit & 31;
+		for(int lane = 0; lane < 4; lane++) {
+			std::uint32_t value = word[lane] >> shift;
+			if(shift + bits > 32) {
+				value |= word[4 + lane] << (32 - shift);
+			}
+			out[4 * g + lane] = value & mask;
+		}
+	}
+#endif
+}
+
+/**
+ * Pack count values into a column from entry first on, which is a multiple of 4; the inverse of
+ * packedUnpack, with in holding count rounded up to a multiple of 4 values.  Entries before first
+ * are kept, those from first + count on are lost.
+ */
+static void packedPack(std::uint32_t *column, int bits, int first, int count, const std::uint32_t *in)
+{
+	const int groups = (count + 3) / 4;
+	if(bits == 0 || groups == 0) {
+		return;
+	}
+	int bit = (first >> 2) * bits;
+	const int firstWord = bit >> 5;
+	const int lastWord = (bit + groups * bits - 1) >> 5;
+	const std::uint32_t keep = bitMask(bit & 31);
+	for(int lane = 0; lane < 4; lane++) {
+		column[firstWord * 4 + lane] &= keep;
+	}
+	memset(column + (firstWord + 1) * 4, 0, (lastWord - firstWord) * 4 * sizeof(std::uint32_t));
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi32(int(bitMask(bits)));
+	for(int g = 0; g < groups; g++, bit += bits) {
+		__m128i *word = (__m128i *)(column + (bit >> 5) * 4);
+		const int shift = bit & 31;
+		const __m128i value = _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + 4 * g)), mask);
+		_mm_storeu_si128(word, _mm_or_si128(_mm_loadu_si128(word), _mm_sll_epi32(value, _mm_cvtsi32_si128(shift))));
+		if(shift + bits > 32) {
+			_mm_storeu_si128(word + 1, _mm_or_si128(_mm_loadu_si128(word + 1), _mm_srl_epi32(value, _mm_cvtsi32_si128(32 - shift))));
+		}
+	}
+#else
+	const std::uint32_t mask = bitMask(bits);
+	for(int g = 0; g < groups; g++, bit += bits) {
+		std::uint32_t *word = column + (bit >> 5) * 4;
+		const int shift = bit & 31;
+		for(int lane = 0; lane < 4; lane++) {
+			const std::uint32_t value = in[4 * g + lane] & mask;
+			word[lane] |= value << shift;
+			if(shift + bits > 32) {
+				word[4 + lane] |= value >> (32 - shift);
+			}
+		}
+	}
+#endif
+}
+
+static int packedKey(const PackedLeafNodeInt *node, const PackedLayout &layout, int index)
+{
+	return int(std::uint32_t(node->keyBase) + packedGet(packedColumn(node, layout, 0), layout.bits[0], index));
+}
+
+/**
+ * Index of the first entry of a bit-packed leaf with a key greater than or equal to key, or
+ * greater than key if strict; numValidKeys if there is none.
+ */
+static int packedLowerBound(const PackedLeafNodeInt *node, int key, bool strict)
+{
+	const PackedLayout layout = packedLayout(node);
+	int low = 0;
+	int high = node->numValidKeys;
+	while(low < high) {
+		const int mid = (low + high) / 2;
+		const int midKey = packedKey(node, layout, mid);
+		if(midKey < key || (strict && midKey == key)) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/**
+ * Layout of a bit-packed leaf holding pairs, sorted by key, at the narrowest widths; the frames
+ * of reference are returned via keyBase and pageBase.
+ */
+static PackedLayout packedLayoutFor(const RIDKeyPair<int> *pairs, std::size_t numPairs, int &keyBase, PageId &pageBase)
+{
+	keyBase = numPairs > 0 ? pairs[0].key : 0;
+	pageBase = numPairs > 0 ? pairs[0].rid.page_number : 0;
+	PageId maxPage = pageBase;
+	SlotId maxSlot = 0;
+	for(std::size_t i = 0; i < numPairs; i++) {
+		pageBase = std::min(pageBase, pairs[i].rid.page_number);
+		maxPage = std::max(maxPage, pairs[i].rid.page_number);
+		maxSlot = std::max(maxSlot, pairs[i].rid.slot_number);
+	}
+	const std::uint32_t keyRange = numPairs > 0 ? std::uint32_t(pairs[numPairs - 1].key) - std::uint32_t(keyBase) : 0;
+	return packedLayout(bitWidth(keyRange), bitWidth(maxPage - pageBase), bitWidth(maxSlot));
+}
+
+static bool packedFits(const RIDKeyPair<int> *pairs, std::size_t numPairs)
+{
+	int keyBase;
+	PageId pageBase;
+	return numPairs <= std::size_t(packedLayoutFor(pairs, numPairs, keyBase, pageBase).capacity);
+}
+
+/**
+ * Replace the contents of a bit-packed leaf with pairs, sorted by key, which have to fit.
+ */
+static void packPackedLeaf(PackedLeafNodeInt *node, const RIDKeyPair<int> *pairs, std::size_t numPairs)
+{
+	const PackedLayout layout = packedLayoutFor(pairs, numPairs, node->keyBase, node->pageBase);
+	node->keyBits = layout.bits[0];
+	node->pageBits = layout.bits[1];
+	node->slotBits = layout.bits[2];
+	std::vector<std::uint32_t> values((numPairs + 3) / 4 * 4, 0);
+	for(int c = 0; c < 3; c++) {
+		for(std::size_t i = 0; i < numPairs; i++) {
+			values[i] = c == 0 ? std::uint32_t(pairs[i].key) - std::uint32_t(node->keyBase) :
+			            c == 1 ? pairs[i].rid.page_number - node->pageBase : pairs[i].rid.slot_number;
+		}
+		packedPack(packedColumn(node, layout, c), layout.bits[c], 0, numPairs, values.data());
+	}
+	node->numValidKeys = numPairs;
+}
+
+/**
+ * Decode every <key, rid> pair of a bit-packed leaf, appending them to pairs in order.
+ */
+static void unpackPackedLeaf(const PackedLeafNodeInt *node, std::vector<RIDKeyPair<int> > &pairs)
+{
+	const PackedLayout layout = packedLayout(node);
+	const int rounded = (node->numValidKeys + 3) / 4 * 4;
+	std::vector<std::uint32_t> columns[3];
+	for(int c = 0; c < 3; c++) {
+		columns[c].resize(rounded);
+		packedUnpack(packedColumn(node, layout, c), layout.bits[c], 0, node->numValidKeys, columns[c].data());
+	}
+	for(int i = 0; i < node->numValidKeys; i++) {
+		RIDKeyPair<int> pair;
+		RecordId rid;
+		rid.page_number = node->pageBase + columns[1][i];
+		rid.slot_number = SlotId(columns[2][i]);
+		rid.padding = 0;
+		pair.set(rid, int(std::uint32_t(node->keyBase) + columns[0][i]));
+		pairs.push_back(pair);
+	}
+}
+
+/**
+ * Insert a <key, rid> pair into a bit-packed leaf in place, after any entries with an equal key.
+ * Returns false, leaving the leaf as it was, if the leaf is full at its widths or the pair
+ * does not fit them.
+ */
+static bool insertPackedEntry(PackedLeafNodeInt *node, int key, const RecordId &rid)
+{
+	const PackedLayout layout = packedLayout(node);
+	const std::uint32_t keyOffset = std::uint32_t(key) - std::uint32_t(node->keyBase);
+	const std::uint32_t pageOffset = rid.page_number - node->pageBase;
+	if(node->numValidKeys == 0 || node->numValidKeys >= layout.capacity || key < node->keyBase ||
+	   keyOffset > bitMask(layout.bits[0]) || rid.page_number < node->pageBase ||
+	   pageOffset > bitMask(layout.bits[1]) || rid.slot_number > bitMask(layout.bits[2])) {
+		return false;
+	}
+
+	// Unpack every column from the group of four the entry goes in, move the entries at the right
+	// side one slot right and pack them back
+	const int index = packedLowerBound(node, key, true);
+	const int first = index & ~3;
+	const int tail = node->numValidKeys - first;
+	const std::uint32_t newValues[3] = {keyOffset, pageOffset, rid.slot_number};
+	std::uint32_t values[PACKEDLEAFMAXSIZE + 4];
+	for(int c = 0; c < 3; c++) {
+		std::uint32_t *column = packedColumn(node, layout, c);
+		packedUnpack(column, layout.bits[c], first, tail, values);
+		memmove(values + index - first + 1, values + index - first, (tail - (index - first)) * sizeof(std::uint32_t));
+		values[index - first] = newValues[c];
+		packedPack(column, layout.bits[c], first, tail + 1, values);
+	}
+	node->numValidKeys++;
+	return true;
+}
+
+WritePageGuard BTreeIndex::allocateMetaInfoNode(PageId &newPageId)
+{
+	return bufMgr->allocPage(file, newPageId);
+}
+
+// -----------------------------------------------------------------------------
+// Non-leaf node search
+// -----------------------------------------------------------------------------
+
+/**
+ * How many of count ints from values on, count a multiple of 4, are greater than key.
+ */
+static int countGreater(const int *values, int count, int key)
+{
+#if defined(__SSE2__)
+	// Each compare leaves -1 in the lanes that are greater; subtracting adds them up lane by lane
+	const __m128i keys = _mm_set1_epi32(key);
+	__m128i greater = _mm_setzero_si128();
+	for(int i = 0; i < count; i += 4) {
+		greater = _mm_sub_epi32(greater, _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(values + i)), keys));
+	}
+	greater = _mm_add_epi32(greater, _mm_shuffle_epi32(greater, _MM_SHUFFLE(1, 0, 3, 2)));
+	greater = _mm_add_epi32(greater, _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(greater);
+#else
+	int greater = 0;
+	for(int i = 0; i < count; i++) {
+		greater += values[i] > key;
+	}
+	return greater;
+#endif
+}
+
+int NonLeafNodeInt::childIndex(int key) const
+{
+	// The summary is sorted, so the entries not greater than the key are the lines wholly at or
+	// below it.  Past the last full line the summary holds INT_MAX, which only INT_MAX reaches
+	const int fullLines = numValidKeys / NONLEAFLINEKEYS;
+	const int line = std::min(NONLEAFSUMMARYSIZE - countGreater(summary, NONLEAFSUMMARYSIZE, key), fullLines);
+
+	// The child is in that line, or in the partial line after the full ones
+	const int first = line * NONLEAFLINEKEYS;
+	if(line < fullLines) {
+		return first + NONLEAFLINEKEYS - countGreater(keyArray + first, NONLEAFLINEKEYS, key);
+	}
+	int index = first;
+	while(index < numValidKeys && !(key < keyArray[index])) {
+		index++;
+	}
+	return index;
+}
+
+void NonLeafNodeInt::buildSummary()
+{
+	const int fullLines = numValidKeys / NONLEAFLINEKEYS;
+	for(int line = 0; line < NONLEAFSUMMARYSIZE; line++) {
+		summary[line] = line < fullLines ? keyArray[line * NONLEAFLINEKEYS + NONLEAFLINEKEYS - 1]
+		                                 : std::numeric_limits<int>::max();
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -38,13 +626,25 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset1,
-		const Datatype attrType)
+		const Datatype attrType,
+		const LeafFormat leafFormat1,
+		const std::uint32_t numWorkers)
 {
 	bufMgr = bufMgrIn;
 	attributeType = attrType;
 	attrByteOffset = attrByteOffset1;
+	leafFormat = leafFormat1;
 	leafOccupancy = 0;
 	nodeOccupancy = 0;
+	scanExecuting = false;
+	rootPageNum = Page::INVALID_NUMBER;
+	log = NULL;
+	txn = 0;
+	unusable = false;
+	pinnedLevels = 0;
+	pinnedStale = false;
+	rightmostLeaf = Page::INVALID_NUMBER;
+	rightmostLowKey = 0;
     // Add your code below. Please do not remove this line.
     std :: ostringstream idxStr;
     idxStr << relationName << '.' << attrByteOffset;
@@ -62,96 +662,701 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 	}
 
 
-    // Initialize the meta info page (First page of index)
-	IndexMetaInfo *meta = allocateMetaInfoNode(headerPageNum);
-	meta->attrByteOffset = attrByteOffset;
-	meta->attrType = attrType;
-	strcpy(meta->relationName, relationName.c_str());
-	bufMgr->unPinPage(file, headerPageNum, true);
-
-	// TODO: The constructor should scan this relation (using FileScan) and insert 
-	// entries for all the tuples in this relation into the index.
-
-	FileScan fscan(relationName, bufMgr);
-	try
-		{
-			RecordId scanRid;
-			while(1)
-			{
-				fscan.scanNext(scanRid);
-				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
-				int key = *((int *)(record + attrByteOffset));
-				// std::cout << "Extracted : " << key << std::endl;
-				insertEntry(&key, scanRid);
+    // Initialize the meta info page (First page of index)
+	{
+		WritePageGuard metaPage = allocateMetaInfoNode(headerPageNum);
+		IndexMetaInfo *meta = metaPage.as<IndexMetaInfo>();
+		meta->attrByteOffset = attrByteOffset;
+		meta->attrType = attrType;
+		meta->leafFormat = leafFormat;
+		strcpy(meta->relationName, relationName.c_str());
+	}
+
+	// Build the index over every tuple of the relation, scanning and sorting in parallel.
+	bulkLoad(relationName, numWorkers);
+	// File::remove(relationName);
+
+	WritePageGuard metaPage = bufMgr->readPageForWrite(file, headerPageNum);
+	metaPage.as<IndexMetaInfo>()->rootPageNo = rootPageNum;
+}
+
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+
+BTreeIndex::~BTreeIndex()
+{
+    // Add your code below. Please do not remove this line.
+    if(scanExecuting == true) { // An index scan has been initialized
+		endScan();
+	}
+
+	// TODO: Clean up any state variables
+
+    // Unpin any B+ tree pages that are pinned and flush the index file
+	// try {
+	// 	bufMgr->unPinPage(file, rootPageNum, false);
+	// } catch (const PageNotPinnedException &e){
+
+	// }
+	// try {
+	// 	bufMgr->unPinPage(file, 8, false);
+	// } catch (const PageNotPinnedException &e){
+
+	// }
+	// std::cout << "Before flush file" << std::endl;
+	unpinTopLevels();
+	bufMgr->flushFile(file);
+    // std::cout << "After flush file" << std::endl;
+	// Close the index file (Not deleting)
+	delete file;
+}
+
+// -----------------------------------------------------------------------------
+// Parallel bulk load
+// -----------------------------------------------------------------------------
+
+/**
+ * LSD radix sort of <key, rid> pairs on the integer key, 8 bits per pass.
+ * The sign bit is flipped so negative keys sort before positive ones.
+ */
+static void radixSortByKey(std::vector<RIDKeyPair<int> > &pairs)
+{
+	std::vector<RIDKeyPair<int> > buffer(pairs.size());
+	for(int shift = 0; shift < 32; shift += 8) {
+		std::size_t counts[257] = {0};
+		for(std::size_t i = 0; i < pairs.size(); i++) {
+			counts[((((std::uint32_t)pairs[i].key) ^ 0x80000000u) >> shift & 0xFF) + 1]++;
+		}
+		// Every key shares this digit, the pass would not move anything
+		bool trivial = false;
+		for(int d = 1; d <= 256; d++) {
+			if(counts[d] == pairs.size()) {
+				trivial = true;
+			}
+			counts[d] += counts[d - 1];
+		}
+		if(trivial) {
+			continue;
+		}
+		for(std::size_t i = 0; i < pairs.size(); i++) {
+			buffer[counts[(((std::uint32_t)pairs[i].key) ^ 0x80000000u) >> shift & 0xFF]++] = pairs[i];
+		}
+		pairs.swap(buffer);
+	}
+}
+
+static bool keyLess(const RIDKeyPair<int> &a, const RIDKeyPair<int> &b)
+{
+	return a.key < b.key;
+}
+
+/**
+ * Merge sorted runs pairwise, each round merging its pairs in parallel, until one run is left.
+ */
+static void mergeRuns(std::vector<std::vector<RIDKeyPair<int> > > &runs, std::vector<RIDKeyPair<int> > &sorted)
+{
+	while(runs.size() > 1) {
+		std::vector<std::vector<RIDKeyPair<int> > > merged((runs.size() + 1) / 2);
+		runWorkers(runs.size() / 2, [&](std::uint32_t w) {
+			std::vector<RIDKeyPair<int> > &left = runs[2 * w];
+			std::vector<RIDKeyPair<int> > &right = runs[2 * w + 1];
+			merged[w].resize(left.size() + right.size());
+			std::merge(left.begin(), left.end(), right.begin(), right.end(), merged[w].begin(), keyLess);
+			std::vector<RIDKeyPair<int> >().swap(left);
+			std::vector<RIDKeyPair<int> >().swap(right);
+		});
+		if(runs.size() % 2 == 1) {
+			merged.back().swap(runs.back());
+		}
+		runs.swap(merged);
+	}
+	if(!runs.empty()) {
+		sorted.swap(runs[0]);
+	}
+}
+
+void BTreeIndex::bulkLoad(const std::string &relationName, std::uint32_t numWorkers)
+{
+	if(numWorkers == 0) {
+		numWorkers = defaultWorkerCount();
+	}
+	// Threads only pay off with enough pages to share out
+	std::uint32_t relationPages;
+	{
+		PageFile relation(relationName, false);
+		relationPages = relation.getNumPages();
+	}
+	numWorkers = std::max<std::uint32_t>(1, std::min(numWorkers, relationPages / BULK_PAGES_PER_WORKER));
+
+	// Scan partitions of the relation concurrently, one run per worker
+	std::vector<std::vector<RIDKeyPair<int> > > runs;
+	{
+		ParallelFileScan pscan(relationName, bufMgr, numWorkers);
+		runs.resize(pscan.numWorkers());
+		pscan.scan([&](std::uint32_t workerId, const RecordId &scanRid, const std::string &recordStr) {
+			//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
+			RIDKeyPair<int> pair;
+			pair.set(scanRid, *((int *)(recordStr.c_str() + attrByteOffset)));
+			runs[workerId].push_back(pair);
+		});
+	}
+	// pscan goes out of scope here, so relation file gets closed.
+	std::cout << "Read all records" << std::endl;
+
+	// Sort every run on its own worker, then merge them
+	runWorkers(runs.size(), [&](std::uint32_t w) {
+		radixSortByKey(runs[w]);
+	});
+	std::vector<RIDKeyPair<int> > sorted;
+	mergeRuns(runs, sorted);
+
+	if(sorted.empty()) {
+		return;
+	}
+
+	// Emit the leaves, then one level of non-leaf nodes at a time until a single root is left
+	std::vector<PageKeyPair<int> > children;
+	std::vector<PageKeyPair<int> > parents;
+	if(leafFormat == LEAF_POSTING) {
+		// Posting lists keep the rids of a key in order, which the scan order of the runs need not be
+		if(!std::is_sorted(sorted.begin(), sorted.end())) {
+			std::sort(sorted.begin(), sorted.end());
+		}
+		emitPostingLeafLevel(sorted, numWorkers, children);
+	} else if(leafFormat == LEAF_PACKED) {
+		emitPackedLeafLevel(sorted, numWorkers, children);
+	} else {
+		emitLeafLevel(sorted, numWorkers, children);
+	}
+	leafOccupancy = sorted.size();
+
+	int level = 1;
+	while(children.size() > 1) {
+		emitNonLeafLevel(children, level, numWorkers, parents);
+		nodeOccupancy += parents.size();
+		children.swap(parents);
+		level = 0;
+	}
+	rootPageNum = children[0].pageNo;
+}
+
+void BTreeIndex::emitLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                               std::vector<PageKeyPair<int> > &children)
+{
+	// Spread the pairs evenly so that no leaf is left nearly empty
+	const std::size_t numPairs = sorted.size();
+	const std::size_t leafFill = INTARRAYLEAFSIZE * BULK_FILL_PERCENT / 100;
+	const std::size_t numLeaves = (numPairs + leafFill - 1) / leafFill;
+	const std::uint32_t workers = std::min<std::size_t>(numWorkers, numLeaves);
+	children.resize(numLeaves);
+
+	// Every worker writes a contiguous group of leaves and links them together
+	runWorkers(workers, [&](std::uint32_t w) {
+		WritePageGuard prev;
+		for(std::size_t i = numLeaves * w / workers; i < numLeaves * (w + 1) / workers; i++) {
+			const std::size_t first = numPairs * i / numLeaves;
+			const std::size_t last = numPairs * (i + 1) / numLeaves;
+
+			PageId leafId;
+			WritePageGuard leafPage = allocateLeafNode(leafId);
+			LeafNodeInt *leaf = leafPage.as<LeafNodeInt>();
+			for(std::size_t k = first; k < last; k++) {
+				leaf->keyArray[k - first] = sorted[k].key;
+				leaf->ridArray[k - first] = sorted[k].rid;
+			}
+			leaf->numValidKeys = last - first;
+			leaf->sharesFirstKey = first > 0 && sorted[first - 1].key == sorted[first].key;
+			children[i].set(leafId, sorted[first].key);
+
+			if(prev.valid()) {
+				prev.as<LeafNodeInt>()->rightSibPageNo = leafId;
+			}
+			prev = std::move(leafPage);
+		}
+	});
+
+	// Link the last leaf of every group to the first leaf of the next one
+	for(std::uint32_t w = 1; w < workers; w++) {
+		const std::size_t first = numLeaves * w / workers;
+		WritePageGuard leaf = bufMgr->readPageForWrite(file, children[first - 1].pageNo);
+		leaf.as<LeafNodeInt>()->rightSibPageNo = children[first].pageNo;
+	}
+}
+
+void BTreeIndex::emitPostingLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                                      std::vector<PageKeyPair<int> > &children)
+{
+	// How many pairs fit in a leaf depends on how well their rids compress, so the leaves are
+	// cut in one pass first; every leaf but the last is then filled to BULK_FILL_PERCENT
+	std::vector<std::size_t> bounds(1, 0);
+	int bytes = 0;
+	for(std::size_t k = 0; k < sorted.size(); k++) {
+		const int cost = postingCost(k == bounds.back() ? NULL : &sorted[k - 1], sorted[k]);
+		if(bytes + cost > POSTINGLEAFDATASIZE * BULK_FILL_PERCENT / 100) {
+			bounds.push_back(k);
+			bytes = postingCost(NULL, sorted[k]);
+		} else {
+			bytes += cost;
+		}
+	}
+	bounds.push_back(sorted.size());
+
+	const std::size_t numLeaves = bounds.size() - 1;
+	const std::uint32_t workers = std::min<std::size_t>(numWorkers, numLeaves);
+	children.resize(numLeaves);
+
+	runWorkers(workers, [&](std::uint32_t w) {
+		WritePageGuard prev;
+		for(std::size_t i = numLeaves * w / workers; i < numLeaves * (w + 1) / workers; i++) {
+			PageId leafId;
+			WritePageGuard leafPage = allocateLeafNode(leafId);
+			packPostingLeaf(leafPage.as<PostingLeafNodeInt>(), &sorted[bounds[i]], bounds[i + 1] - bounds[i]);
+			leafPage.as<PostingLeafNodeInt>()->sharesFirstKey = i > 0 && sorted[bounds[i] - 1].key == sorted[bounds[i]].key;
+			children[i].set(leafId, sorted[bounds[i]].key);
+
+			if(prev.valid()) {
+				prev.as<PostingLeafNodeInt>()->rightSibPageNo = leafId;
+			}
+			prev = std::move(leafPage);
+		}
+	});
+
+	for(std::uint32_t w = 1; w < workers; w++) {
+		const std::size_t first = numLeaves * w / workers;
+		WritePageGuard leaf = bufMgr->readPageForWrite(file, children[first - 1].pageNo);
+		leaf.as<PostingLeafNodeInt>()->rightSibPageNo = children[first].pageNo;
+	}
+}
+
+void BTreeIndex::emitPackedLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                                     std::vector<PageKeyPair<int> > &children)
+{
+	// The widths only grow as a leaf takes more pairs, so a leaf is cut before the first pair
+	// that would leave it over capacity
+	std::vector<std::size_t> bounds(1, 0);
+	PageId minPage = 0;
+	PageId maxPage = 0;
+	SlotId maxSlot = 0;
+	for(std::size_t k = 0; k < sorted.size(); k++) {
+		const RecordId &rid = sorted[k].rid;
+		if(k == bounds.back()) {
+			minPage = maxPage = rid.page_number;
+			maxSlot = rid.slot_number;
+			continue;
+		}
+		const PageId newMin = std::min(minPage, rid.page_number);
+		const PageId newMax = std::max(maxPage, rid.page_number);
+		const SlotId newSlot = std::max(maxSlot, rid.slot_number);
+		const PackedLayout layout = packedLayout(bitWidth(std::uint32_t(sorted[k].key) - std::uint32_t(sorted[bounds.back()].key)),
+		                                         bitWidth(newMax - newMin), bitWidth(newSlot));
+		if(k - bounds.back() + 1 > std::max<std::size_t>(1, layout.capacity * BULK_FILL_PERCENT / 100)) {
+			bounds.push_back(k);
+			minPage = maxPage = rid.page_number;
+			maxSlot = rid.slot_number;
+		} else {
+			minPage = newMin;
+			maxPage = newMax;
+			maxSlot = newSlot;
+		}
+	}
+	bounds.push_back(sorted.size());
+
+	const std::size_t numLeaves = bounds.size() - 1;
+	const std::uint32_t workers = std::min<std::size_t>(numWorkers, numLeaves);
+	children.resize(numLeaves);
+
+	runWorkers(workers, [&](std::uint32_t w) {
+		WritePageGuard prev;
+		for(std::size_t i = numLeaves * w / workers; i < numLeaves * (w + 1) / workers; i++) {
+			PageId leafId;
+			WritePageGuard leafPage = allocateLeafNode(leafId);
+			packPackedLeaf(leafPage.as<PackedLeafNodeInt>(), &sorted[bounds[i]], bounds[i + 1] - bounds[i]);
+			leafPage.as<PackedLeafNodeInt>()->sharesFirstKey = i > 0 && sorted[bounds[i] - 1].key == sorted[bounds[i]].key;
+			children[i].set(leafId, sorted[bounds[i]].key);
+
+			if(prev.valid()) {
+				prev.as<PackedLeafNodeInt>()->rightSibPageNo = leafId;
+			}
+			prev = std::move(leafPage);
+		}
+	});
+
+	for(std::uint32_t w = 1; w < workers; w++) {
+		const std::size_t first = numLeaves * w / workers;
+		WritePageGuard leaf = bufMgr->readPageForWrite(file, children[first - 1].pageNo);
+		leaf.as<PackedLeafNodeInt>()->rightSibPageNo = children[first].pageNo;
+	}
+}
+
+void BTreeIndex::emitNonLeafLevel(const std::vector<PageKeyPair<int> > &children, int level, std::uint32_t numWorkers,
+                                  std::vector<PageKeyPair<int> > &parents)
+{
+	const std::size_t numChildren = children.size();
+	const std::size_t nodeFill = (INTARRAYNONLEAFSIZE + 1) * BULK_FILL_PERCENT / 100;
+	const std::size_t numNodes = (numChildren + nodeFill - 1) / nodeFill;
+	const std::uint32_t workers = std::min<std::size_t>(numWorkers, numNodes);
+	parents.resize(numNodes);
+
+	runWorkers(workers, [&](std::uint32_t w) {
+		for(std::size_t i = numNodes * w / workers; i < numNodes * (w + 1) / workers; i++) {
+			const std::size_t first = numChildren * i / numNodes;
+			const std::size_t last = numChildren * (i + 1) / numNodes;
+
+			PageId nodeId;
+			WritePageGuard nodePage = allocateNonLeafNode(nodeId);
+			NonLeafNodeInt *node = nodePage.as<NonLeafNodeInt>();
+			node->level = level;
+			node->pageNoArray[0] = children[first].pageNo;
+			for(std::size_t k = first + 1; k < last; k++) {
+				node->keyArray[k - first - 1] = children[k].key;
+				node->pageNoArray[k - first] = children[k].pageNo;
+			}
+			node->numValidKeys = last - first - 1;
+			node->buildSummary();
+			parents[i].set(nodeId, children[first].key);
+		}
+	});
+}
+
+WritePageGuard BTreeIndex::allocateLeafNode(PageId &newPageId)
+{
+	WritePageGuard page = allocNode(newPageId, EXTENT_LEAF);
+	if(leafFormat == LEAF_POSTING) {
+		PostingLeafNodeInt *newNode = page.as<PostingLeafNodeInt>();
+		newNode->rightSibPageNo = -1;
+		newNode->numValidKeys = 0;
+		newNode->postingBytes = 0;
+		newNode->sharesFirstKey = 0;
+		return page;
+	}
+	if(leafFormat == LEAF_PACKED) {
+		PackedLeafNodeInt *newNode = page.as<PackedLeafNodeInt>();
+		newNode->rightSibPageNo = -1;
+		newNode->numValidKeys = 0;
+		newNode->keyBase = 0;
+		newNode->pageBase = 0;
+		newNode->keyBits = 0;
+		newNode->pageBits = 0;
+		newNode->slotBits = 0;
+		newNode->sharesFirstKey = 0;
+		return page;
+	}
+	LeafNodeInt *newNode = page.as<LeafNodeInt>();
+	newNode->rightSibPageNo = -1;
+	newNode->numValidKeys = 0;
+	newNode->sharesFirstKey = 0;
+	return page;
+}
+
+WritePageGuard BTreeIndex::allocateNonLeafNode(PageId &newPageId)
+{
+	WritePageGuard page = allocNode(newPageId, EXTENT_INNER);
+	NonLeafNodeInt *newNode = page.as<NonLeafNodeInt>();
+	newNode->numValidKeys = 0;
+	newNode->buildSummary();
+	return page;
+}
+
+// -----------------------------------------------------------------------------
+// Logged node changes
+// -----------------------------------------------------------------------------
+
+/**
+ * Insert a <key, rid> pair into a leaf with room for it, after any entries with an equal key.
+ */
+static void insertLeafEntry(LeafNodeInt *node, int key, const RecordId &rid)
+{
+	int index = 0;
+	while(index < node->numValidKeys && !(key < node->keyArray[index])) {
+		index++;
+	}
+
+	// Move the nodes at the right side one slot right
+	for(int i = node->numValidKeys; i > index; i--) {
+		node->keyArray[i] = node->keyArray[i - 1];
+		node->ridArray[i] = node->ridArray[i - 1];
+	}
+
+	node->keyArray[index] = key;
+	node->ridArray[index] = rid;
+	node->numValidKeys++;
+}
+
+/**
+ * A node entry to log, with the fields it does not use zeroed.
+ */
+static NodeLogEntry nodeEntry(int format, int key, const RecordId &rid, PageId child)
+{
+	NodeLogEntry entry = NodeLogEntry();
+	entry.format = format;
+	entry.key = key;
+	entry.rid = rid;
+	entry.child = child;
+	return entry;
+}
+
+/**
+ * Remove the <key, rid> pair from pairs, returning false if it is not there.
+ */
+static bool removePair(std::vector<RIDKeyPair<int> > &pairs, int key, const RecordId &rid)
+{
+	for(std::size_t i = 0; i < pairs.size(); i++) {
+		if(pairs[i].key == key && pairs[i].rid == rid) {
+			pairs.erase(pairs.begin() + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Insert an entry into a node, or remove it again, the way insertEntry puts it in: after any equal
+ * keys in a leaf, at slot in a non-leaf node.  Returns false, leaving the node as it was, if
+ * there is no room for the entry or no entry to remove.
+ */
+static bool applyNodeEntry(Page *page, const NodeLogEntry &entry, int slot, bool remove)
+{
+	if(entry.format == NODE_LOG_NONLEAF) {
+		NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+		if(remove) {
+			if(slot >= node->numValidKeys) {
+				return false;
+			}
+			for(int i = slot; i < node->numValidKeys - 1; i++) {
+				node->keyArray[i] = node->keyArray[i + 1];
+				node->pageNoArray[i + 1] = node->pageNoArray[i + 2];
+			}
+			node->numValidKeys--;
+		} else {
+			if(node->numValidKeys >= INTARRAYNONLEAFSIZE || slot > node->numValidKeys) {
+				return false;
+			}
+			// Move the nodes at the right side one slot right
+			for(int i = node->numValidKeys; i > slot; i--) {
+				node->keyArray[i] = node->keyArray[i - 1];
+				node->pageNoArray[i + 1] = node->pageNoArray[i];
+			}
+			node->keyArray[slot] = entry.key;
+			node->pageNoArray[slot + 1] = entry.child;
+			node->numValidKeys++;
+		}
+		node->buildSummary();
+		return true;
+	}
+
+	if(entry.format == LEAF_POSTING) {
+		PostingLeafNodeInt *node = (PostingLeafNodeInt *)page;
+		if(!remove) {
+			return insertPostingEntry(node, entry.key, entry.rid);
+		}
+		std::vector<RIDKeyPair<int> > pairs;
+		unpackPostingLeaf(node, pairs);
+		if(!removePair(pairs, entry.key, entry.rid)) {
+			return false;
+		}
+		packPostingLeaf(node, pairs.data(), pairs.size());
+		return true;
+	}
+
+	if(entry.format == LEAF_PACKED) {
+		// An entry outside the leaf's widths packs the leaf again, at wider ones if they still fit
+		PackedLeafNodeInt *node = (PackedLeafNodeInt *)page;
+		if(!remove && insertPackedEntry(node, entry.key, entry.rid)) {
+			return true;
+		}
+		std::vector<RIDKeyPair<int> > pairs;
+		unpackPackedLeaf(node, pairs);
+		if(remove) {
+			if(!removePair(pairs, entry.key, entry.rid)) {
+				return false;
+			}
+		} else {
+			RIDKeyPair<int> newPair;
+			newPair.set(entry.rid, entry.key);
+			pairs.insert(std::upper_bound(pairs.begin(), pairs.end(), newPair, keyLess), newPair);
+			if(!packedFits(pairs.data(), pairs.size())) {
+				return false;
+			}
+		}
+		packPackedLeaf(node, pairs.data(), pairs.size());
+		return true;
+	}
+
+	LeafNodeInt *node = (LeafNodeInt *)page;
+	if(!remove) {
+		if(node->numValidKeys >= INTARRAYLEAFSIZE) {
+			return false;
+		}
+		insertLeafEntry(node, entry.key, entry.rid);
+		return true;
+	}
+	int index = node->numValidKeys - 1;
+	while(index >= 0 && !(node->keyArray[index] == entry.key && node->ridArray[index] == entry.rid)) {
+		index--;
+	}
+	if(index < 0) {
+		return false;
+	}
+	for(int i = index; i < node->numValidKeys - 1; i++) {
+		node->keyArray[i] = node->keyArray[i + 1];
+		node->ridArray[i] = node->ridArray[i + 1];
+	}
+	node->numValidKeys--;
+	return true;
+}
+
+bool BTreeIndex::applyNodeRecord(Page *page, const LogRecord &record, bool undo)
+{
+	if(record.type == LOG_NODE_IMAGE) {
+		// A compensation for a new node has no image; the node is left to the log's later changes
+		const std::string &image = undo ? record.before : record.after;
+		if(!image.empty()) {
+			if(image.size() != Page::SIZE) {
+				return false;
 			}
+			memcpy(page, image.data(), Page::SIZE);
 		}
-		catch(const EndOfFileException &e)
-		{
-			std::cout << "Read all records" << std::endl;
-		}
-
-	// filescan goes out of scope here, so relation file gets closed.
-	// File::remove(relationName);
+		return true;
+	}
 
-    bufMgr->readPage(file, headerPageNum, (Page *&)meta);
-	meta->rootPageNo = rootPageNum;
-	bufMgr->unPinPage(file, headerPageNum, true);
+	const bool insert = (record.type == LOG_NODE_INSERT) != undo;
+	const std::string &bytes = (record.type == LOG_NODE_INSERT) ? record.after : record.before;
+	NodeLogEntry entry;
+	if(bytes.size() != sizeof(entry)) {
+		return false;
+	}
+	memcpy(&entry, bytes.data(), sizeof(entry));
+	return applyNodeEntry(page, entry, record.offset, !insert);
 }
 
+WritePageGuard BTreeIndex::allocNode(PageId &newPageId, ExtentClass extentClass)
+{
+	return bufMgr->allocPage(file, newPageId, extentClass);
+}
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
-// -----------------------------------------------------------------------------
-
-BTreeIndex::~BTreeIndex()
+bool BTreeIndex::insertNodeEntry(WritePageGuard &page, const NodeLogEntry &entry, int slot)
 {
-    // Add your code below. Please do not remove this line.
-    if(scanExecuting == true) { // An index scan has been initialized
-		endScan();
+	// A node's first change since the last checkpoint logs the whole node, so that redo never
+	// has to apply an entry to a node torn by a crash in the middle of its write-back
+	Page *node = page.get();
+	const bool image = log != NULL && node->lsn() < log->getCheckpointLsn();
+	LogRecord record;
+	if(image) {
+		record.before.assign((const char *)node, Page::SIZE);
+	}
+	if(!applyNodeEntry(node, entry, slot, false)) {
+		return false;
+	}
+	if(log == NULL) {
+		return true;
 	}
 
-	// TODO: Clean up any state variables
+	record.type = image ? LOG_NODE_IMAGE : LOG_NODE_INSERT;
+	record.offset = image ? 0 : slot;
+	if(image) {
+		record.after.assign((const char *)node, Page::SIZE);
+	} else {
+		record.after.assign((const char *)&entry, sizeof(entry));
+	}
+	try {
+		logNodeRecord(page, record);
+	} catch(...) {
+		if(image) {
+			memcpy(node, record.before.data(), Page::SIZE);
+		} else {
+			applyNodeEntry(node, entry, slot, true);
+		}
+		throw;
+	}
+	return true;
+}
 
-    // Unpin any B+ tree pages that are pinned and flush the index file
-	// try {
-	// 	bufMgr->unPinPage(file, rootPageNum, false);
-	// } catch (const PageNotPinnedException &e){
+void BTreeIndex::beginNodeImage(WritePageGuard &page)
+{
+	if(log != NULL) {
+		const char *node = (const char *)page.get();
+		nodeImages[page.getPageNo()].assign(node, node + Page::SIZE);
+	}
+}
 
-	// }
-	// try {
-	// 	bufMgr->unPinPage(file, 8, false);
-	// } catch (const PageNotPinnedException &e){
+void BTreeIndex::logNodeImage(WritePageGuard &page)
+{
+	if(log == NULL) {
+		return;
+	}
+	LogRecord record;
+	record.type = LOG_NODE_IMAGE;
+	record.offset = 0;
+	std::unordered_map<PageId, std::vector<char> >::iterator it = nodeImages.find(page.getPageNo());
+	if(it != nodeImages.end()) {
+		record.before.assign(it->second.begin(), it->second.end());
+	}
+	record.after.assign((const char *)page.get(), Page::SIZE);
+	logNodeRecord(page, record);
+	if(it != nodeImages.end()) {
+		nodeImages.erase(it);
+	}
+}
 
-	// }
-	// std::cout << "Before flush file" << std::endl;
-	bufMgr->flushFile(file);
-    // std::cout << "After flush file" << std::endl;
-	// Close the index file (Not deleting)
-	delete file;
+void BTreeIndex::logNodeRecord(WritePageGuard &page, LogRecord &record)
+{
+	const PageId pageNo = page.getPageNo();
+	if(record.type == LOG_NODE_INSERT) {
+		record.lsn = log->logNodeInsert(txn, file, pageNo, record.offset, record.after.data(), record.after.size());
+	} else {
+		record.lsn = log->logNodeImage(txn, file, pageNo, record.before.empty() ? NULL : record.before.data(),
+		                               record.after.data());
+	}
+	record.prevLsn = txnWrites.empty() ? 0 : txnWrites.back().lsn;
+	record.undoNextLsn = 0;
+	record.compensation = false;
+	record.txn = txn;
+	record.pageNo = pageNo;
+	page.get()->set_lsn(record.lsn);
+	txnWrites.push_back(record);
 }
 
-LeafNodeInt *BTreeIndex::allocateLeafNode(PageId &newPageId)
+void BTreeIndex::rollbackInsert()
 {
-	LeafNodeInt *newNode;
-	bufMgr->allocPage(file, newPageId, (Page *&)newNode);
-	newNode->parentPageNo = -1;
-	newNode->rightSibPageNo = -1;
-	newNode->numValidKeys = 0;
-	return newNode;
+	// The guards are gone by now, so the nodes are pinned again; nodeImages goes first, since
+	// putting its images back leaves every node as the log has it
+	std::unordered_map<PageId, std::vector<char> > unlogged;
+	unlogged.swap(nodeImages);
+	try {
+		for(std::unordered_map<PageId, std::vector<char> >::const_iterator it = unlogged.begin(); it != unlogged.end(); ++it) {
+			WritePageGuard page = bufMgr->readPageForWrite(file, it->first);
+			memcpy(page.get(), it->second.data(), Page::SIZE);
+		}
+
+		// A node is only changed back once its compensation record is in the log
+		for(std::size_t i = txnWrites.size(); i-- > 0; ) {
+			const LogRecord &record = txnWrites[i];
+			WritePageGuard page = bufMgr->readPageForWrite(file, record.pageNo);
+			const Lsn lsn = log->logCompensation(record, file);
+			applyNodeRecord(page.get(), record, true);
+			page.get()->set_lsn(lsn);
+		}
+		if(log->getLastLsn(txn) != 0) {
+			log->logAbort(txn);
+		}
+	} catch(...) {
+		unusable = true;
+	}
+	txnWrites.clear();
 }
 
-NonLeafNodeInt *BTreeIndex::allocateNonLeafNode(PageId &newPageId)
+void BTreeIndex::setLogManager(LogManager *logManager)
 {
-	NonLeafNodeInt *newNode;
-	bufMgr->allocPage(file, newPageId, (Page *&)newNode);
-	newNode->parentPageNo = -1;
-	newNode->numValidKeys = 0;
-	return newNode;
+	// The tree so far is not in the log, so it has to be on disk before logged changes go on top.
+	// Pinned levels are let go for the flush and pinned again by the next descent.
+	unpinTopLevels();
+	bufMgr->flushFile(file);
+	log = logManager;
 }
 
-void BTreeIndex::searchForLeaf(PageId &targetPageId, int key)
+void BTreeIndex::searchForLeaf(PageId &targetPageId, int key, std::vector<PageId> *path)
 {
 	// Situation 1: Tree is empty
 	if(leafOccupancy == 0) {
@@ -163,360 +1368,425 @@ void BTreeIndex::searchForLeaf(PageId &targetPageId, int key)
 		// LeafNodeInt *root;
 		// bufMgr->readPage(file, rootPageNum, (Page *&)root);
 		targetPageId = rootPageNum;
+		if(path != NULL) {
+			rightmostLeaf = rootPageNum;
+			rightmostLowKey = std::numeric_limits<int>::min();
+			rightmostPath.clear();
+		}
 		return;
 	
 	// Situation 3: Root is of type NON-LEAF node
 	} else if(leafOccupancy > 0 && nodeOccupancy > 0){
-		NonLeafNodeInt *curNode;
-		// Starting from Root
-		bufMgr->readPage(file, rootPageNum, (Page *&)curNode);
-		PageId curPageId = rootPageNum; 
-		
-		int index = 0;
+		if(pinnedLevels > 0 && (pinnedStale || pinnedNodes.empty() || pinnedNodes[0].page.getPageNo() != rootPageNum)) {
+			repinTopLevels();
+		}
+
+		// Starting from Root, through the pinned levels without going to the buffer manager
+		PageId curPageNo = rootPageNum;
+		ReadPageGuard curPage;
+		const NonLeafNodeInt *curNode;
+		const PinnedNode *pinned = NULL;
+		if(!pinnedNodes.empty()) {
+			pinned = &pinnedNodes[0];
+			curNode = pinned->node;
+		} else {
+			curPage = bufMgr->readPage(file, rootPageNum);
+			curNode = curPage.as<NonLeafNodeInt>();
+		}
+
+		// Whether every node so far was left through its last child, and the greatest key passed
+		bool rightEdge = true;
+		int lowKey = std::numeric_limits<int>::min();
 		while(1){
+			if(path != NULL) {
+				path->push_back(curPageNo);
+			}
+
+			// The child to follow is the one left of the first key greater than the search key
+			const int index = curNode->childIndex(key);
 			if(index < curNode->numValidKeys) {
-				// 3.1: Found the target index
-				if(key < curNode->keyArray[index]) {
-					// Next level is leaf
-					if(curNode->level == 1) {
-						targetPageId = curNode->pageNoArray[index];
-						// for(int i=0; i<curNode->numValidKeys; i++) {
-						// 	std::cout << "key array of cur Node " << curNode->keyArray[i] << std::endl;
-						// }
-						// for(int i=0; i<=curNode->numValidKeys; i++) {
-						// 	std::cout << "PageNo array of cur Node " << curNode->pageNoArray[i] << std::endl;
-						// }
-						// std::cout << "A Unpinned non-leaf node of PageId: " << curPageId << std::endl;
-						bufMgr->unPinPage(file, curPageId, false);
-						return;
-
-					// Next level is non-leaf node
-					} else {
-						PageId lastPageId = curPageId;
-						curPageId = curNode->pageNoArray[index];
-						// std::cout << "Unpinned non-leaf node of PageId: " << lastPageId << std::endl;
-						bufMgr->unPinPage(file, lastPageId, false);
-						bufMgr->readPage(file, curPageId, (Page *&)curNode);
-						index = 0;
-					}
-
-				// 3.2: key >= root->keyArray[index], go to next
-				} else {
-					index++;
+				rightEdge = false;
+			} else if(index > 0) {
+				lowKey = std::max(lowKey, curNode->keyArray[index - 1]);
+			}
+
+			// Next level is leaf
+			if(curNode->level == 1) {
+				targetPageId = curNode->pageNoArray[index];
+				if(path != NULL && rightEdge) {
+					rightmostLeaf = targetPageId;
+					rightmostLowKey = lowKey;
+					rightmostPath = *path;
 				}
+				return;
+			}
+
+			// Next level is non-leaf node
+			curPageNo = curNode->pageNoArray[index];
+			if(pinned != NULL && !pinned->children.empty()) {
+				pinned = &pinnedNodes[pinned->children[index]];
+				curNode = pinned->node;
 			} else {
-				// Next level is leaf
-				if(curNode->level == 1) {
-					targetPageId = curNode->pageNoArray[index];
-					// if(key == 29) {
-					// 	std::cout << "SearchForLeaf(29) gets target ID : " << targetPageId << std::endl;
-					// 	Page *target;
-					// 	bufMgr->readPage(file, 7, target);
-					// 	LeafNodeInt *targetP = (LeafNodeInt *)target;
-					// 	for(int i=0; i<(targetP->numValidKeys); i++) {
-					// 		std::cout << "targetP 7 key array: " << targetP->keyArray[i] << std::endl;
-					// 	}
-					// 	bufMgr->unPinPage(file, 7, false);
-					// 	bufMgr->readPage(file, 5, target);
-					// 	targetP = (LeafNodeInt *)target;
-					// 	for(int i=0; i<(targetP->numValidKeys); i++) {
-					// 		std::cout << "targetP 5 key array: " << targetP->keyArray[i] << std::endl;
-					// 	}
-					// 	bufMgr->unPinPage(file, 5, false);
-					// 	bufMgr->readPage(file, 8, target);
-					// 	targetP = (LeafNodeInt *)target;
-					// 	for(int i=0; i<(targetP->numValidKeys); i++) {
-					// 		std::cout << "targetP 8 key array: " << targetP->keyArray[i] << std::endl;
-					// 	}
-					// 	bufMgr->unPinPage(file, 8, false);
-					// }
-					// std::cout << "Unpinned non-leaf node of PageId: " << curPageId << std::endl;
-					bufMgr->unPinPage(file, curPageId, false);
-					return;
-
-				// Next level is non-leaf node
-				} else {
-					PageId lastPageId = curPageId;
-					curPageId = curNode->pageNoArray[index];
-					bufMgr->unPinPage(file, lastPageId, false);
-					bufMgr->readPage(file, curPageId, (Page *&)curNode);
-					index = 0;
-				}
+				pinned = NULL;
+				curPage = bufMgr->readPage(file, curPageNo);
+				curNode = curPage.as<NonLeafNodeInt>();
 			}
 		}
 	}
 }
 
-void BTreeIndex::insertToLeaf(PageId leafId, int key, const RecordId rid)
+void BTreeIndex::pinTopLevels(int levels)
 {
-	leafOccupancy++;
-	LeafNodeInt *curNode;
-	bufMgr->readPage(file, leafId, (Page *&)curNode);
-
-	// Situation 0: Leaf empty
-	if(curNode->numValidKeys == 0) {
-		curNode->keyArray[0] = key;
-		curNode->ridArray[0] = rid;
-		curNode->numValidKeys++;
-		bufMgr->unPinPage(file, leafId, true);
-	
-	// Situation 1: Leaf not full => Directly insert to the leaf
-	} else if(curNode->numValidKeys < INTARRAYLEAFSIZE) {
-		int index = 0;
-		while(index < curNode->numValidKeys) {
-			if(key < curNode->keyArray[index]) {
-				// Index to insert at found
-				break;
-			} else {
-				index++;
+	pinnedLevels = levels;
+	unpinTopLevels();
+}
+
+void BTreeIndex::repinTopLevels()
+{
+	unpinTopLevels();
+	pinnedStale = false;
+	if(pinnedLevels <= 0 || nodeOccupancy == 0) {
+		return;
+	}
+
+	PinnedNode root;
+	root.page = bufMgr->readPage(file, rootPageNum);
+	root.node = root.page.as<NonLeafNodeInt>();
+	pinnedNodes.push_back(std::move(root));
+
+	// Pin one whole level at a time, stopping above the leaves
+	std::size_t levelBegin = 0;
+	for(int depth = 1; depth < pinnedLevels && pinnedNodes[levelBegin].node->level != 1; depth++) {
+		const std::size_t levelEnd = pinnedNodes.size();
+		for(std::size_t i = levelBegin; i < levelEnd; i++) {
+			const NonLeafNodeInt *node = pinnedNodes[i].node;
+			for(int k = 0; k <= node->numValidKeys; k++) {
+				PinnedNode child;
+				child.page = bufMgr->readPage(file, node->pageNoArray[k]);
+				child.node = child.page.as<NonLeafNodeInt>();
+				pinnedNodes[i].children.push_back(pinnedNodes.size());
+				pinnedNodes.push_back(std::move(child));
 			}
 		}
-		
-		// Move the nodes at the right side one slot right
-		int lastNodeIndex = curNode->numValidKeys - 1;
-		for(int i=0; i < (curNode->numValidKeys - index); i++) {
-			curNode->keyArray[lastNodeIndex + 1 - i] = curNode->keyArray[lastNodeIndex - i];
-			curNode->ridArray[lastNodeIndex + 1 - i] = curNode->ridArray[lastNodeIndex - i];
-		}
+		levelBegin = levelEnd;
+	}
+	for(std::size_t i = 0; i < pinnedNodes.size(); i++) {
+		pinnedIndex[pinnedNodes[i].page.getPageNo()] = i;
+	}
+}
+
+void BTreeIndex::unpinTopLevels()
+{
+	pinnedIndex.clear();
+	pinnedNodes.clear();
+}
 
-		// Insert at keyArray[index]
-		curNode->keyArray[index] = key;
-		curNode->ridArray[index] = rid;
-		curNode->numValidKeys++;
+void BTreeIndex::insertToLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path)
+{
+	leafOccupancy++;
+	WritePageGuard curPage = bufMgr->readPageForWrite(file, leafId);
+	LeafNodeInt *curNode = curPage.as<LeafNodeInt>();
 
-		bufMgr->unPinPage(file, leafId, true);
+	// Situation 1: Leaf not full => Directly insert to the leaf
+	if(insertNodeEntry(curPage, nodeEntry(LEAF_FLAT, key, rid, 0), 0)) {
+		return;
+	}
 
 	// Situation 2: Leaf full => Split Leaf Node And go up
+	// Allocate a new leaf node to the right of curNode
+	PageId rightSibPageId;
+	WritePageGuard rightSibPage = allocateLeafNode(rightSibPageId);
+	LeafNodeInt *rightSib = rightSibPage.as<LeafNodeInt>();
+
+	// An append to the rightmost leaf leaves it nearly full, since the keys after this one will
+	// go to the right of it as well
+	const bool append = curNode->rightSibPageNo == std::uint32_t(-1) &&
+	                    key >= curNode->keyArray[INTARRAYLEAFSIZE - 1];
+	beginNodeImage(curPage);
+
+	// 0 to midIndex - 1 will be allocated to the left
+	// midIndex to INTARRAYLEAFSIZE - 1 will be allocated to the right
+	int midIndex;
+	bool insertToLeft = false;
+	if(append) {
+		midIndex = INTARRAYLEAFSIZE * APPEND_SPLIT_PERCENT / 100;
 	} else {
-		// Allocate a new leaf node to the right of curNode
-		PageId rightSibPageId;
-		LeafNodeInt *rightSib = allocateLeafNode(rightSibPageId);
-
-		// 0 to midIndex - 1 will be allocated to the left
-		// midIndex to INTARRAYLEAFSIZE - 1 will be allocated to the right
-		int midIndex;
 		if(INTARRAYLEAFSIZE % 2 == 0) {
 			midIndex = INTARRAYLEAFSIZE / 2 - 1;
 		} else {
 			midIndex = INTARRAYLEAFSIZE / 2;
 		}
 
-		bool insertToLeft = false;
 		if(key >= curNode->keyArray[midIndex]) {
 			midIndex++;
 		} else {
 			insertToLeft = true;
 		}
+	}
 
-		for(int i=0; i<(INTARRAYLEAFSIZE - midIndex); i++) { // Right Sibling
-			rightSib->keyArray[i] = curNode->keyArray[midIndex + i];
-			rightSib->ridArray[i] = curNode->ridArray[midIndex + i];
-			rightSib->numValidKeys++;
-			curNode->keyArray[midIndex + i] = 0;
-			curNode->ridArray[midIndex + i] = (struct RecordId) {0, 0, 0};
-			curNode->numValidKeys--;
-		}
+	for(int i=0; i<(INTARRAYLEAFSIZE - midIndex); i++) { // Right Sibling
+		rightSib->keyArray[i] = curNode->keyArray[midIndex + i];
+		rightSib->ridArray[i] = curNode->ridArray[midIndex + i];
+	}
+	rightSib->numValidKeys = INTARRAYLEAFSIZE - midIndex;
+	curNode->numValidKeys = midIndex;
 
-		if(insertToLeft) {
-			insertToLeaf(leafId, key, rid);
-		} else {
-			insertToLeaf(rightSibPageId, key, rid);
-		}
+	if(insertToLeft) {
+		insertLeafEntry(curNode, key, rid);
+	} else {
+		insertLeafEntry(rightSib, key, rid);
+	}
 
-		// Insert the middle pair of <key, rid> to the parent node
-		if(curNode->parentPageNo == std::uint32_t(-1)) {
-			allocateNonLeafNode(curNode->parentPageNo);
-			bufMgr->unPinPage(file, curNode->parentPageNo, true);
-			rightSib->parentPageNo = curNode->parentPageNo;
-			rootPageNum = curNode->parentPageNo;
-		}
-		PageId parentPageNum = curNode->parentPageNo;
-		int parentKey = rightSib->keyArray[0];
-		// std::cout << "Inserting parent key = " << parentKey << std::endl;
-		rightSib->parentPageNo = parentPageNum;
-		rightSib->rightSibPageNo = curNode->rightSibPageNo;
-		curNode->rightSibPageNo = rightSibPageId;
+	rightSib->rightSibPageNo = curNode->rightSibPageNo;
+	rightSib->sharesFirstKey = curNode->keyArray[curNode->numValidKeys - 1] == rightSib->keyArray[0];
+	curNode->rightSibPageNo = rightSibPageId;
+	const int parentKey = rightSib->keyArray[0];
 
-		bufMgr->unPinPage(file, leafId, true);
-		bufMgr->unPinPage(file, rightSibPageId, true);
-		insertToNonLeaf(parentPageNum, parentKey, leafId, rightSibPageId, 1);
+	logNodeImage(curPage);
+	logNodeImage(rightSibPage);
+	curPage.release();
+	rightSibPage.release();
 
-		// TODO: Add the rightSib and curNode Page number to the parent node's array
+	// The new leaf takes over the right edge, until a split of a non-leaf node says otherwise
+	if(leafId == rightmostLeaf) {
+		rightmostLeaf = rightSibPageId;
+		rightmostLowKey = parentKey;
 	}
+
+	// Insert the middle key and the new leaf to the parent node
+	insertToNonLeaf(path, parentKey, leafId, rightSibPageId, 1, append);
 }
 
-void BTreeIndex::insertToNonLeaf(PageId nonLeafId, int key, PageId leftChildPageId, PageId rightChildPageId, int level)
+void BTreeIndex::insertToPostingLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path)
 {
-	nodeOccupancy++;
-	NonLeafNodeInt *curNode;
-	bufMgr->readPage(file, nonLeafId, (Page *&)curNode);
-
-	// Situation 1: empty node
-	if(curNode->numValidKeys == 0) {
-		curNode->keyArray[0] = key;
-		curNode->pageNoArray[0] = leftChildPageId;
-		curNode->pageNoArray[1] = rightChildPageId;
-		curNode->numValidKeys++;
-		curNode->level = level;
-		bufMgr->unPinPage(file, nonLeafId, true);
-
-	// Situation 2: Non-empty node
-	} else {
-		// 2.1 Node not full => Directly insert
-		if(curNode->numValidKeys < INTARRAYNONLEAFSIZE) {
-			int index = 0;
-			while(index < curNode->numValidKeys) {
-				if(key < curNode->keyArray[index]) {
-					// Target index found
-					break;
-				} else {
-					index++;
-				}
-			}
-			
-			// Move the nodes at the right side one slot right
-			int lastNodeIndex = curNode->numValidKeys - 1;
-			for(int i=0; i < (curNode->numValidKeys - index); i++) {
-				curNode->keyArray[lastNodeIndex + 1 - i] = curNode->keyArray[lastNodeIndex - i];
-				curNode->pageNoArray[lastNodeIndex + 2 - i] = curNode->pageNoArray[lastNodeIndex + 1 - i];
-			}
+	leafOccupancy++;
+	WritePageGuard curPage = bufMgr->readPageForWrite(file, leafId);
+	PostingLeafNodeInt *curNode = curPage.as<PostingLeafNodeInt>();
 
-			// Insert at keyArray[index]
-			curNode->keyArray[index] = key;
-			curNode->pageNoArray[index + 1] = rightChildPageId;
-			curNode->numValidKeys++;
+	// Situation 1: Room for the rid => Directly insert to the leaf
+	if(insertNodeEntry(curPage, nodeEntry(LEAF_POSTING, key, rid, 0), 0)) {
+		return;
+	}
 
-			bufMgr->unPinPage(file, nonLeafId, true);
-		// 2.2: Node Already Full => Split
-		} else {
-			// Allocate a new non-leaf node to the right of curNode
-			PageId rightPageId;
-			NonLeafNodeInt *rightPage = allocateNonLeafNode(rightPageId);
-			rightPage->level = curNode->level;
-
-			int midIndex;
-			if(INTARRAYNONLEAFSIZE % 2 == 0) {
-				midIndex = INTARRAYNONLEAFSIZE / 2 - 1;
-			} else {
-				midIndex = INTARRAYNONLEAFSIZE / 2;
-			}
-			
-			int index = 0;
-			while(index < curNode->numValidKeys) {
-				if(key < curNode->keyArray[index]) {
-					// Target index found
-					break;
-				} else {
-					index++;
-				}
-			}
+	// Situation 2: Leaf full => Split Leaf Node And go up
+	const bool append = curNode->rightSibPageNo == std::uint32_t(-1) &&
+	                    key >= postingHeads(curNode)[curNode->numValidKeys - 1].key;
+
+	std::vector<RIDKeyPair<int> > pairs;
+	unpackPostingLeaf(curNode, pairs);
+	RIDKeyPair<int> newPair;
+	newPair.set(rid, key);
+	pairs.insert(std::upper_bound(pairs.begin(), pairs.end(), newPair), newPair);
+
+	// prefix[i] is the size of the first i pairs in a leaf
+	std::vector<int> prefix(pairs.size() + 1, 0);
+	for(std::size_t i = 0; i < pairs.size(); i++) {
+		prefix[i + 1] = prefix[i] + postingCost(i == 0 ? NULL : &pairs[i - 1], pairs[i]);
+	}
+	const int total = prefix.back();
+	// Size of the pairs from cut on in a leaf, where the first one starts its key's posting list
+	auto rightBytes = [&](std::size_t cut) {
+		return total - prefix[cut] + postingCost(NULL, pairs[cut]) - postingCost(&pairs[cut - 1], pairs[cut]);
+	};
+
+	// Split the bytes in half, or keep APPEND_SPLIT_PERCENT of them on an append, moving the cut
+	// to the nearer end of the posting list it falls in if the halves still fit; only a key whose
+	// rids do not fit on either side ends up in both leaves
+	const int target = append ? total * APPEND_SPLIT_PERCENT / 100 : total / 2;
+	std::size_t cut = 1;
+	while(cut < pairs.size() - 1 && prefix[cut] < target) {
+		cut++;
+	}
+	if(pairs[cut - 1].key == pairs[cut].key) {
+		std::size_t begin = cut;
+		std::size_t end = cut;
+		while(begin > 0 && pairs[begin - 1].key == pairs[cut].key) {
+			begin--;
+		}
+		while(end < pairs.size() && pairs[end].key == pairs[cut].key) {
+			end++;
+		}
+		const bool beginFits = begin > 0 && rightBytes(begin) <= POSTINGLEAFDATASIZE;
+		const bool endFits = end < pairs.size() && prefix[end] <= POSTINGLEAFDATASIZE;
+		if(beginFits && (!endFits || target - prefix[begin] <= prefix[end] - target)) {
+			cut = begin;
+		} else if(endFits) {
+			cut = end;
+		}
+	}
 
-			int parentKey;
-
-			// New key will be on the left child node
-			if(index <= midIndex) {
-				for(int i=0; i<(INTARRAYNONLEAFSIZE - midIndex); i++) {
-					rightPage->keyArray[i] = curNode->keyArray[midIndex + i];
-					rightPage->pageNoArray[i] = curNode->pageNoArray[midIndex + 1 + i];
-					rightPage->numValidKeys++;
-					curNode->keyArray[midIndex + i] = 0;
-					curNode->pageNoArray[midIndex + 1 + i] = 0;
-					curNode->numValidKeys--;
-				}
-				
-				// Move the nodes at the right side one slot right
-				int lastNodeIndex = curNode->numValidKeys - 1;
-				for(int i=0; i < (curNode->numValidKeys - index); i++) {
-					curNode->keyArray[lastNodeIndex + 1 - i] = curNode->keyArray[lastNodeIndex - i];
-					curNode->pageNoArray[lastNodeIndex + 2 - i] = curNode->pageNoArray[lastNodeIndex + 1 - i];
-				}
+	PageId rightSibPageId;
+	WritePageGuard rightSibPage = allocateLeafNode(rightSibPageId);
+	PostingLeafNodeInt *rightSib = rightSibPage.as<PostingLeafNodeInt>();
+	beginNodeImage(curPage);
+	packPostingLeaf(curNode, &pairs[0], cut);
+	packPostingLeaf(rightSib, &pairs[cut], pairs.size() - cut);
+
+	rightSib->rightSibPageNo = curNode->rightSibPageNo;
+	rightSib->sharesFirstKey = pairs[cut - 1].key == pairs[cut].key;
+	curNode->rightSibPageNo = rightSibPageId;
+	const int parentKey = pairs[cut].key;
+
+	logNodeImage(curPage);
+	logNodeImage(rightSibPage);
+	curPage.release();
+	rightSibPage.release();
+
+	if(leafId == rightmostLeaf) {
+		rightmostLeaf = rightSibPageId;
+		rightmostLowKey = parentKey;
+	}
 
-				// Insert at keyArray[index]
-				curNode->keyArray[index] = key;
-				curNode->pageNoArray[index + 1] = rightChildPageId;
-				curNode->numValidKeys++;
+	insertToNonLeaf(path, parentKey, leafId, rightSibPageId, 1, append);
+}
 
-				// Move the first key on the rightPage to the parent Node
-				parentKey = rightPage->keyArray[0];
-				for(int i=0; i<(rightPage->numValidKeys - 1); i++) {
-					rightPage->keyArray[i] = rightPage->keyArray[i + 1];
-				}
-				rightPage->numValidKeys--;
-
-			// new key will be the parent node of two child nodes
-			} else if(index == midIndex + 1) {
-				rightPage->pageNoArray[0] = rightPageId;
-				for(int i=0; i<(INTARRAYNONLEAFSIZE - midIndex - 1); i++) {
-					rightPage->keyArray[i] = curNode->keyArray[midIndex + 1 + i];
-					rightPage->pageNoArray[i + 1] = curNode->pageNoArray[midIndex + 2 + i];
-					rightPage->numValidKeys++;
-					curNode->keyArray[midIndex + 1 + i] = 0;
-					curNode->pageNoArray[midIndex + 2 + i] = 0;
-					curNode->numValidKeys--;
-				}
-				// Add the parent node (key = key)
-				parentKey = key;
+void BTreeIndex::insertToPackedLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path)
+{
+	leafOccupancy++;
+	WritePageGuard curPage = bufMgr->readPageForWrite(file, leafId);
+	PackedLeafNodeInt *curNode = curPage.as<PackedLeafNodeInt>();
 
-			// new key will be on the right child node
-			} else {
-				for(int i=0; i<(INTARRAYNONLEAFSIZE - midIndex - 1); i++) {
-					rightPage->keyArray[i] = curNode->keyArray[midIndex + 1 + i];
-					rightPage->pageNoArray[i] = curNode->pageNoArray[midIndex + 2 + i];
-					rightPage->numValidKeys++;
-					curNode->keyArray[midIndex + 1 + i] = 0;
-					curNode->pageNoArray[midIndex + 2 + i] = 0;
-					curNode->numValidKeys--;
-				}
+	// Situation 1: Room for the entry at the leaf's widths, or at wider ones => Insert to the leaf
+	if(insertNodeEntry(curPage, nodeEntry(LEAF_PACKED, key, rid, 0), 0)) {
+		return;
+	}
 
-				// Move the nodes at the right side one slot right
-				index = index - curNode->numValidKeys;
-				int lastNodeIndex = rightPage->numValidKeys - 1;
-				for(int i=0; i < (rightPage->numValidKeys - index); i++) {
-					rightPage->keyArray[lastNodeIndex + 1 - i] = rightPage->keyArray[lastNodeIndex - i];
-					rightPage->pageNoArray[lastNodeIndex + 1 - i] = rightPage->pageNoArray[lastNodeIndex - i];
-				}
+	const bool append = curNode->rightSibPageNo == std::uint32_t(-1) &&
+	                    key >= packedKey(curNode, packedLayout(curNode), curNode->numValidKeys - 1);
 
-				// Insert at keyArray[index]
-				rightPage->keyArray[index] = key;
-				rightPage->pageNoArray[index] = rightChildPageId;
-				rightPage->numValidKeys++;
+	std::vector<RIDKeyPair<int> > pairs;
+	unpackPackedLeaf(curNode, pairs);
+	RIDKeyPair<int> newPair;
+	newPair.set(rid, key);
+	pairs.insert(std::upper_bound(pairs.begin(), pairs.end(), newPair, keyLess), newPair);
 
-				// Move the leftest node to the parent
-				parentKey = rightPage->keyArray[0];
-				for(int i=0; i<(rightPage->numValidKeys - 1); i++) {
-					rightPage->keyArray[i] = rightPage->keyArray[i+1];
-				}
-				rightPage->numValidKeys--;
-			}
+	// Situation 2: Leaf full => Split Leaf Node And go up
+	// Half the entries go to each side, or APPEND_SPLIT_PERCENT of them stay on an append,
+	// moving the cut if either side would not fit its widths
+	std::size_t cut = append ? pairs.size() * APPEND_SPLIT_PERCENT / 100 : pairs.size() / 2;
+	while(cut > 1 && !packedFits(&pairs[0], cut)) {
+		cut--;
+	}
+	while(cut < pairs.size() - 1 && !packedFits(&pairs[cut], pairs.size() - cut)) {
+		cut++;
+	}
 
-			// Update the parentPageId for rightPage's child pages
-			for(int i=0; i<(rightPage->numValidKeys + 1); i++) {
-				Page *childNode; 
-				bufMgr->readPage(file, rightPage->pageNoArray[i], (Page *&)childNode);
-				if(level == 1) {
-					LeafNodeInt *child = (LeafNodeInt *)childNode;
-					child->parentPageNo = rightPageId;
-				} else {
-					NonLeafNodeInt *child = (NonLeafNodeInt *)childNode;
-					child->parentPageNo = rightPageId;
-				}
-				bufMgr->unPinPage(file, rightPage->pageNoArray[i], true);
-			}
+	PageId rightSibPageId;
+	WritePageGuard rightSibPage = allocateLeafNode(rightSibPageId);
+	PackedLeafNodeInt *rightSib = rightSibPage.as<PackedLeafNodeInt>();
+	beginNodeImage(curPage);
+	packPackedLeaf(curNode, &pairs[0], cut);
+	packPackedLeaf(rightSib, &pairs[cut], pairs.size() - cut);
+
+	rightSib->rightSibPageNo = curNode->rightSibPageNo;
+	rightSib->sharesFirstKey = pairs[cut - 1].key == pairs[cut].key;
+	curNode->rightSibPageNo = rightSibPageId;
+	const int parentKey = pairs[cut].key;
+
+	logNodeImage(curPage);
+	logNodeImage(rightSibPage);
+	curPage.release();
+	rightSibPage.release();
+
+	if(leafId == rightmostLeaf) {
+		rightmostLeaf = rightSibPageId;
+		rightmostLowKey = parentKey;
+	}
 
-			// Insert the middle pair of <key, rid> to the parent node
-			if(curNode->parentPageNo == std::uint32_t(-1)) {
-				allocateNonLeafNode(curNode->parentPageNo);
-				bufMgr->unPinPage(file, curNode->parentPageNo, true);
-				rightPage->parentPageNo = curNode->parentPageNo;
-				rootPageNum = curNode->parentPageNo;
-			}
+	insertToNonLeaf(path, parentKey, leafId, rightSibPageId, 1, append);
+}
 
-			PageId parentPageId = curNode->parentPageNo;
-			bufMgr->unPinPage(file, nonLeafId, true);
-			bufMgr->unPinPage(file, rightPageId, true);
-			insertToNonLeaf(parentPageId, parentKey, nonLeafId, rightPageId, 0);
+void BTreeIndex::insertToNonLeaf(std::vector<PageId> &path, int key, PageId leftChildPageId, PageId rightChildPageId, int level,
+                                 bool append)
+{
+	nodeOccupancy++;
+
+	// Situation 1: The split node was the root => a new root over the two halves
+	if(path.empty()) {
+		rightmostLeaf = Page::INVALID_NUMBER;
+		WritePageGuard rootPage = allocateNonLeafNode(rootPageNum);
+		NonLeafNodeInt *root = rootPage.as<NonLeafNodeInt>();
+		root->keyArray[0] = key;
+		root->pageNoArray[0] = leftChildPageId;
+		root->pageNoArray[1] = rightChildPageId;
+		root->numValidKeys = 1;
+		root->level = level;
+		root->buildSummary();
+		logNodeImage(rootPage);
+		return;
+	}
+
+	const PageId nonLeafId = path.back();
+	path.pop_back();
+
+	// A new child under a pinned node above the lowest pinned level has to be pinned as well
+	std::unordered_map<PageId, std::size_t>::const_iterator pinnedIt = pinnedIndex.find(nonLeafId);
+	if(pinnedIt != pinnedIndex.end() && !pinnedNodes[pinnedIt->second].children.empty()) {
+		pinnedStale = true;
+	}
+
+	WritePageGuard curPage = bufMgr->readPageForWrite(file, nonLeafId);
+	NonLeafNodeInt *curNode = curPage.as<NonLeafNodeInt>();
+
+	// The new key goes right after the left child, which is keyArray[index - 1]'s right child
+	int index = 0;
+	while(curNode->pageNoArray[index] != leftChildPageId) {
+		index++;
+	}
+
+	// Situation 2: Node not full => Directly insert
+	if(insertNodeEntry(curPage, nodeEntry(NODE_LOG_NONLEAF, key, RecordId(), rightChildPageId), index)) {
+		return;
+	}
+
+	// Situation 3: Node full => Split
+	// The path to the rightmost leaf changes; the next descent along the right edge finds it again
+	rightmostLeaf = Page::INVALID_NUMBER;
+
+	// Lay out the keys and children as if the node had room for one more, then the middle key
+	// moves up and everything right of it goes to a new node
+	int keys[INTARRAYNONLEAFSIZE + 1];
+	PageId children[INTARRAYNONLEAFSIZE + 2];
+	children[0] = curNode->pageNoArray[0];
+	for(int i = 0, k = 0; i <= INTARRAYNONLEAFSIZE; i++) {
+		if(i == index) {
+			keys[i] = key;
+			children[i + 1] = rightChildPageId;
+		} else {
+			keys[i] = curNode->keyArray[k];
+			children[i + 1] = curNode->pageNoArray[k + 1];
+			k++;
 		}
 	}
+
+	append = append && index == INTARRAYNONLEAFSIZE;
+	const int midIndex = append ? (INTARRAYNONLEAFSIZE + 1) * APPEND_SPLIT_PERCENT / 100 : (INTARRAYNONLEAFSIZE + 1) / 2;
+	PageId rightPageId;
+	WritePageGuard rightGuard = allocateNonLeafNode(rightPageId);
+	NonLeafNodeInt *rightPage = rightGuard.as<NonLeafNodeInt>();
+	rightPage->level = curNode->level;
+	beginNodeImage(curPage);
+
+	for(int i = 0; i < midIndex; i++) {
+		curNode->keyArray[i] = keys[i];
+		curNode->pageNoArray[i + 1] = children[i + 1];
+	}
+	curNode->numValidKeys = midIndex;
+
+	rightPage->pageNoArray[0] = children[midIndex + 1];
+	for(int i = midIndex + 1; i <= INTARRAYNONLEAFSIZE; i++) {
+		rightPage->keyArray[i - midIndex - 1] = keys[i];
+		rightPage->pageNoArray[i - midIndex] = children[i + 1];
+	}
+	rightPage->numValidKeys = INTARRAYNONLEAFSIZE - midIndex;
+	curNode->buildSummary();
+	rightPage->buildSummary();
+
+	logNodeImage(curPage);
+	logNodeImage(rightGuard);
+	curPage.release();
+	rightGuard.release();
+	insertToNonLeaf(path, keys[midIndex], nonLeafId, rightPageId, 0, append);
 }
 
 // -----------------------------------------------------------------------------
@@ -526,22 +1796,83 @@ void BTreeIndex::insertToNonLeaf(PageId nonLeafId, int key, PageId leftChildPage
 void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
     // Add your code below. Please do not remove this line.
-	// Situation 1: Empty Tree => Allocate a new leaf node (new root)
-    if(leafOccupancy == 0) {
-		LeafNodeInt *root = allocateLeafNode(rootPageNum);
-		root->keyArray[0] = *((int*)key); // Key set to be integer
-		root->ridArray[0] = rid;
-		root->numValidKeys++;
-        root->rightSibPageNo = -1; // No right sibling yet
-		bufMgr->unPinPage(file, rootPageNum, true);
-		leafOccupancy++;
-
-	// Situation 2: Not empty tree => Insert to appropriate leaf node
-	} else {
-		// First locate the appropriate leaf node to insert
-		PageId targetLeaf;
-		searchForLeaf(targetLeaf, *((int*)key));
-		insertToLeaf(targetLeaf, *((int*)key), rid);
+	if(unusable) {
+		throw IndexUnusableException(file->filename());
+	}
+	const PageId oldRootPageNum = rootPageNum;
+	const int oldLeafOccupancy = leafOccupancy;
+	const int oldNodeOccupancy = nodeOccupancy;
+	if(log != NULL) {
+		txn = log->beginTxn();
+		txnWrites.clear();
+	}
+
+	bool applied = false;
+	try {
+		// Situation 1: Empty Tree => Allocate a new leaf node (new root)
+		if(leafOccupancy == 0) {
+			WritePageGuard rootPage = allocateLeafNode(rootPageNum);
+			if(leafFormat == LEAF_POSTING) {
+				insertPostingEntry(rootPage.as<PostingLeafNodeInt>(), *((int*)key), rid);
+			} else if(leafFormat == LEAF_PACKED) {
+				RIDKeyPair<int> pair;
+				pair.set(rid, *((int*)key));
+				packPackedLeaf(rootPage.as<PackedLeafNodeInt>(), &pair, 1);
+			} else {
+				LeafNodeInt *root = rootPage.as<LeafNodeInt>();
+				root->keyArray[0] = *((int*)key); // Key set to be integer
+				root->ridArray[0] = rid;
+				root->numValidKeys++;
+				root->rightSibPageNo = -1; // No right sibling yet
+			}
+			logNodeImage(rootPage);
+			leafOccupancy++;
+
+		// Situation 2: Not empty tree => Insert to appropriate leaf node
+		} else {
+			// First locate the appropriate leaf node to insert
+			PageId targetLeaf;
+			if(rightmostLeaf != Page::INVALID_NUMBER && *((int*)key) >= rightmostLowKey) {
+				// An append at the right edge goes straight to the rightmost leaf
+				targetLeaf = rightmostLeaf;
+				insertPath = rightmostPath;
+			} else {
+				insertPath.clear();
+				searchForLeaf(targetLeaf, *((int*)key), &insertPath);
+			}
+			if(leafFormat == LEAF_POSTING) {
+				insertToPostingLeaf(targetLeaf, *((int*)key), rid, insertPath);
+			} else if(leafFormat == LEAF_PACKED) {
+				insertToPackedLeaf(targetLeaf, *((int*)key), rid, insertPath);
+			} else {
+				insertToLeaf(targetLeaf, *((int*)key), rid, insertPath);
+			}
+		}
+
+		// A split reached the root, record the new one in the meta page
+		if(rootPageNum != oldRootPageNum) {
+			WritePageGuard metaPage = bufMgr->readPageForWrite(file, headerPageNum);
+			beginNodeImage(metaPage);
+			metaPage.as<IndexMetaInfo>()->rootPageNo = rootPageNum;
+			logNodeImage(metaPage);
+		}
+
+		applied = true;
+		if(log != NULL) {
+			log->commit(txn);
+		}
+	} catch(...) {
+		// An insert stopped part way, or whose commit record did not make it into the log, is rolled
+		// back; once the commit record is in, only making it durable failed and the insert stands
+		if(log != NULL && (!applied || log->getLastLsn(txn) != 0)) {
+			rollbackInsert();
+			rootPageNum = oldRootPageNum;
+			leafOccupancy = oldLeafOccupancy;
+			nodeOccupancy = oldNodeOccupancy;
+			rightmostLeaf = Page::INVALID_NUMBER;
+			pinnedStale = true;
+		}
+		throw;
 	}
 }
 
@@ -555,6 +1886,9 @@ void BTreeIndex::startScan(const void* lowValParm,
 				   const Operator highOpParm)
 {
     // Add your code below. Please do not remove this line.
+	if(unusable) {
+		throw IndexUnusableException(file->filename());
+	}
 	if(*((int *)lowValParm)> *((int *)highValParm)){
 		throw BadScanrangeException();
 	}
@@ -569,48 +1903,110 @@ void BTreeIndex::startScan(const void* lowValParm,
 	lowOp = lowOpParm;
 	highOp = highOpParm;
 	scanExecuting = true;
-	//get the leaf node for the low param
-	searchForLeaf(currentPageNum,lowValInt);
-	// std::cout << "Current Page Number is: " << currentPageNum << std::endl;
-	bufMgr->readPage(file, currentPageNum, currentPageData);
-	LeafNodeInt *cur = (LeafNodeInt *)currentPageData;
+	currentPage.release();
 	nextEntry = 0;
-	// coordinate to use the global instance nextEntry to track the record
-	while(cur->keyArray[nextEntry] < lowValInt){
-		if(nextEntry == cur->numValidKeys){
+	postingPos = 0;
+	packedBlockFirst = -1;
+
+	// The leaf stays pinned through a local guard until the scan is known to have a first
+	// entry, so that the NoSuchKeyFoundException paths below leave nothing pinned
+	ReadPageGuard leafPage;
+	searchForScanLeaf(leafPage);
+
+	if(leafFormat == LEAF_PACKED) {
+		const PackedLeafNodeInt *cur = leafPage.as<PackedLeafNodeInt>();
+		nextEntry = packedLowerBound(cur, lowValInt, lowOpParm == GT);
+		while(nextEntry == cur->numValidKeys) {
 			if(cur->rightSibPageNo == std::uint32_t(-1)) { // Reached beyond the rightest node
 				throw NoSuchKeyFoundException();
 			}
-			PageId lastPageNum = currentPageNum;
-  			currentPageNum = cur->rightSibPageNo;
-			bufMgr->unPinPage(file, lastPageNum, false);
-  			bufMgr->readPage(file, currentPageNum, currentPageData);
-  			nextEntry = 0;
-			cur = (LeafNodeInt *)currentPageData;
-		} else {
-			nextEntry++;
+			currentPageNum = cur->rightSibPageNo;
+			leafPage = bufMgr->readPage(file, currentPageNum);
+			cur = leafPage.as<PackedLeafNodeInt>();
+			nextEntry = packedLowerBound(cur, lowValInt, lowOpParm == GT);
 		}
+		if(packedKey(cur, packedLayout(cur), nextEntry) > highValInt) {
+			throw NoSuchKeyFoundException();
+		}
+		currentPage = std::move(leafPage);
+		return;
 	}
-	if(cur->keyArray[nextEntry] == lowValInt && lowOpParm == GT) {
-		if(nextEntry < (cur->numValidKeys - 1)) {
-			nextEntry++;
-		} else { // Reached the rightest valid node of curNode
-			// Go to the right sibling if there's one
+
+	if(leafFormat == LEAF_POSTING) {
+		const PostingLeafNodeInt *cur = leafPage.as<PostingLeafNodeInt>();
+		while(nextEntry == cur->numValidKeys || postingHeads(cur)[nextEntry].key < lowValInt ||
+		      (postingHeads(cur)[nextEntry].key == lowValInt && lowOpParm == GT)) {
+			if(nextEntry == cur->numValidKeys) {
+				if(cur->rightSibPageNo == std::uint32_t(-1)) { // Reached beyond the rightest node
+					throw NoSuchKeyFoundException();
+				}
+				currentPageNum = cur->rightSibPageNo;
+				leafPage = bufMgr->readPage(file, currentPageNum);
+				cur = leafPage.as<PostingLeafNodeInt>();
+				nextEntry = 0;
+			} else {
+				nextEntry++;
+			}
+		}
+		if(postingHeads(cur)[nextEntry].key > highValInt) {
+			throw NoSuchKeyFoundException();
+		}
+		currentPage = std::move(leafPage);
+		return;
+	}
+
+	const LeafNodeInt *cur = leafPage.as<LeafNodeInt>();
+	// coordinate to use the global instance nextEntry to track the record; GT skips every copy of lowValInt
+	while(nextEntry == cur->numValidKeys || cur->keyArray[nextEntry] < lowValInt ||
+	      (cur->keyArray[nextEntry] == lowValInt && lowOpParm == GT)){
+		if(nextEntry == cur->numValidKeys){
 			if(cur->rightSibPageNo == std::uint32_t(-1)) { // Reached beyond the rightest node
 				throw NoSuchKeyFoundException();
-			} else {
-				nextEntry = 0;
-				PageId lastPageNum = currentPageNum;
-				currentPageNum = cur->rightSibPageNo;
-				bufMgr->unPinPage(file, lastPageNum, false);
-				bufMgr->readPage(file, currentPageNum, currentPageData);
 			}
+  			currentPageNum = cur->rightSibPageNo;
+			leafPage = bufMgr->readPage(file, currentPageNum);
+  			nextEntry = 0;
+			cur = leafPage.as<LeafNodeInt>();
+		} else {
+			nextEntry++;
 		}
 	}
 	if (cur->keyArray[nextEntry] > highValInt) {
     	throw NoSuchKeyFoundException();
   	}
-	bufMgr->unPinPage(file, currentPageNum, false);
+	currentPage = std::move(leafPage);
+}
+
+void BTreeIndex::searchForScanLeaf(ReadPageGuard &leafPage)
+{
+	searchForLeaf(currentPageNum, lowValInt);
+	leafPage = bufMgr->readPage(file, currentPageNum);
+	if(lowOp == GT || lowValInt == std::numeric_limits<int>::min()) {
+		return;
+	}
+
+	// The descent for a separator key goes right of it, so copies of the key left of the
+	// separator are missed; the leaf says if there are any, and only then is the scan started
+	// from the leaf the key just below it is in
+	bool shared;
+	int firstKey;
+	if(leafFormat == LEAF_PACKED) {
+		const PackedLeafNodeInt *leaf = leafPage.as<PackedLeafNodeInt>();
+		shared = leaf->sharesFirstKey;
+		firstKey = leaf->keyBase;
+	} else if(leafFormat == LEAF_POSTING) {
+		const PostingLeafNodeInt *leaf = leafPage.as<PostingLeafNodeInt>();
+		shared = leaf->sharesFirstKey;
+		firstKey = shared ? postingHeads(leaf)[0].key : 0;
+	} else {
+		const LeafNodeInt *leaf = leafPage.as<LeafNodeInt>();
+		shared = leaf->sharesFirstKey;
+		firstKey = shared ? leaf->keyArray[0] : 0;
+	}
+	if(shared && firstKey == lowValInt) {
+		searchForLeaf(currentPageNum, lowValInt - 1);
+		leafPage = bufMgr->readPage(file, currentPageNum);
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -625,10 +2021,67 @@ void BTreeIndex::scanNext(RecordId& outRid)
 	}
 	if(currentPageNum == std::uint32_t(-1)) {
 		throw IndexScanCompletedException();
-	} else {
-		bufMgr->readPage(file, currentPageNum, currentPageData);
+	} else if(!currentPage.valid()) {
+		currentPage = bufMgr->readPage(file, currentPageNum);
+	}
+
+	if(leafFormat == LEAF_PACKED) {
+		// Entries are unpacked a block at a time, from the group of four nextEntry is in
+		const PackedLeafNodeInt *cur = currentPage.as<PackedLeafNodeInt>();
+		if(packedBlockFirst < 0 || nextEntry >= packedBlockFirst + PACKEDSCANBLOCK) {
+			const PackedLayout layout = packedLayout(cur);
+			packedBlockFirst = nextEntry & ~3;
+			const int count = std::min(PACKEDSCANBLOCK, cur->numValidKeys - packedBlockFirst);
+			for(int c = 0; c < 3; c++) {
+				packedUnpack(packedColumn(cur, layout, c), layout.bits[c], packedBlockFirst, count, packedBlock[c]);
+			}
+		}
+		const int i = nextEntry - packedBlockFirst;
+		const int curVal = int(std::uint32_t(cur->keyBase) + packedBlock[0][i]);
+		if(curVal > highValInt || (curVal == highValInt && highOp == LT)) {
+			throw IndexScanCompletedException();
+		}
+		outRid.page_number = cur->pageBase + packedBlock[1][i];
+		outRid.slot_number = SlotId(packedBlock[2][i]);
+		outRid.padding = 0;
+		if(nextEntry < cur->numValidKeys - 1) {
+			nextEntry++;
+		} else {
+			currentPageNum = cur->rightSibPageNo;
+			currentPage.release();
+			nextEntry = 0;
+			packedBlockFirst = -1;
+		}
+		return;
+	}
+
+	if(leafFormat == LEAF_POSTING) {
+		// Decode the next rid of the current key's posting list, moving on to the next key
+		// (and leaf) at its end
+		const PostingLeafNodeInt *cur = currentPage.as<PostingLeafNodeInt>();
+		const PostingHeadInt &head = postingHeads(cur)[nextEntry];
+		if(head.key > highValInt || (head.key == highValInt && highOp == LT)) {
+			throw IndexScanCompletedException();
+		}
+		std::uint64_t delta;
+		const int size = getVarint(cur->data + head.offset + postingPos, delta);
+		postingValue = postingPos == 0 ? delta : postingValue + delta;
+		postingPos += size;
+		outRid = valueRid(postingValue);
+		if(postingPos == head.length) {
+			postingPos = 0;
+			if(nextEntry < cur->numValidKeys - 1) {
+				nextEntry++;
+			} else {
+				currentPageNum = cur->rightSibPageNo;
+				currentPage.release();
+				nextEntry = 0;
+			}
+		}
+		return;
 	}
-	LeafNodeInt *cur = (LeafNodeInt *)currentPageData;
+
+	const LeafNodeInt *cur = currentPage.as<LeafNodeInt>();
 	int curVal = cur -> keyArray[nextEntry];
 	if ( curVal > highValInt ||(curVal == highValInt && highOp == LT)) {
 		throw IndexScanCompletedException();
@@ -639,15 +2092,10 @@ void BTreeIndex::scanNext(RecordId& outRid)
 	// std::cout << "numValidKey = " << cur->numValidKeys << std::endl;
 	if(nextEntry < (cur->numValidKeys - 1)) {
 		nextEntry++;
-		bufMgr->unPinPage(file, currentPageNum, false);
 	} else if(nextEntry == (cur->numValidKeys - 1)){
-		// if(cur->rightSibPageNo == std::uint32_t(-1)) { // Reached beyond the rightest node
-		// 	throw IndexScanCompletedException();
-		// }
-		PageId lastPageId = currentPageNum;
+		// The right sibling is read by the next call, so a scan ending on this leaf never reads it
   		currentPageNum = cur->rightSibPageNo;
-		bufMgr->unPinPage(file, lastPageId, false);
-  		// bufMgr->readPage(file, currentPageNum, currentPageData);
+		currentPage.release();
   		nextEntry = 0;
 	}
 }
@@ -663,9 +2111,7 @@ void BTreeIndex::endScan()
 		throw ScanNotInitializedException();
 	}
 	scanExecuting = false;
-	if(currentPageNum != std::uint32_t(-1)) {
-		bufMgr->unPinPage(file, currentPageNum, false);
-	}
+	currentPage.release();
 	return;
 }
 
@@ -11,11 +11,14 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <vector>
+#include <unordered_map>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "wal.h"
 
 namespace badgerdb
 {
@@ -41,19 +44,44 @@ enum Operator
 	GT		/* Greater Than */
 };
 
+/**
+ * @brief Leaf layouts of an index.  Passed to the BTreeIndex constructor and kept in its meta page.
+ */
+enum LeafFormat
+{
+	LEAF_FLAT = 0,		/* One key and RecordId per entry */
+	LEAF_POSTING = 1,	/* Each distinct key once, with a compressed list of its RecordIds */
+	LEAF_PACKED = 2		/* One entry per key and RecordId, bit-packed against the lowest key and page of the leaf */
+};
+
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr     numValidKeys           key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - sizeof( int )) / ( sizeof( int ) + sizeof( RecordId ) );
+//                                                       lsn         sibling ptr     numValidKeys    sharesFirstKey           key               rid
+const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( Lsn ) - sizeof( PageId ) - sizeof( int ) - sizeof( int )) / ( sizeof( int ) + sizeof( RecordId ) );
 // const  int INTARRAYLEAFSIZE = 4; // For testing purposes
 
+/**
+ * @brief Bytes of a cache line, the unit the non-leaf node layout is aligned to.
+ */
+const  int CACHELINESIZE = 64;
+
+/**
+ * @brief Keys of a non-leaf node in one cache line, one entry of the node's summary.
+ */
+const  int NONLEAFLINEKEYS = CACHELINESIZE / sizeof( int );
+
+/**
+ * @brief Entries of the separator key summary at the head of a non-leaf node.
+ */
+const  int NONLEAFSUMMARYSIZE = 64;
+
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo          numValidKeys           key             pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - 2 * sizeof( PageId ) - sizeof( int )) / ( sizeof( int ) + sizeof( PageId ) );
+//                                                    header line (lsn, numValidKeys, level)           summary                  extra pageNo           key             pageNo
+const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - CACHELINESIZE - NONLEAFSUMMARYSIZE * sizeof( int ) - sizeof( PageId )) / ( sizeof( int ) + sizeof( PageId ) );
 // const  int INTARRAYNONLEAFSIZE = 4; // For testing purposes
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -89,18 +117,48 @@ public:
 
 /**
  * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
+ * and if they are the same compares their rids, page number first and then slot number,
+ * which is the order RecordIds are kept in within a posting list.
 */
 template <class T>
 bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
 {
 	if( r1.key != r2.key )
 		return r1.key < r2.key;
-	else
+	else if( r1.rid.page_number != r2.rid.page_number )
 		return r1.rid.page_number < r2.rid.page_number;
+	else
+		return r1.rid.slot_number < r2.rid.slot_number;
 }
 
+/**
+ * @brief NodeLogEntry::format of an entry of a non-leaf node.
+ */
+const int NODE_LOG_NONLEAF = -1;
+
+/**
+ * @brief An entry of a B+ tree node, as logged by LOG_NODE_INSERT and LOG_NODE_REMOVE.  Redo and
+ * undo find the entry's place by its key (and rid) in a leaf, and by the record's slot in a
+ * non-leaf node.
+ */
+struct NodeLogEntry {
+	/**
+	 * LeafFormat of the leaf, or NODE_LOG_NONLEAF
+	 */
+	int format;
+	int key;
+
+	/**
+	 * Rid of a leaf entry
+	 */
+	RecordId rid;
+
+	/**
+	 * Child right of the key in a non-leaf node
+	 */
+	PageId child;
+};
+
 /**
  * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
  * to the following structure to store or retrieve information from it.
@@ -110,6 +168,11 @@ bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
  * at the root the root page may get moved up and get a new page no.
 */
 struct IndexMetaInfo{
+  /**
+   * LSN of the last logged change, overlays PageHeader::lsn.
+   */
+	Lsn lsn;
+
   /**
    * Name of base relation.
    */
@@ -129,6 +192,11 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
 	PageId rootPageNo;
+
+  /**
+   * Layout of the leaves.
+   */
+	LeafFormat leafFormat;
 };
 
 /*
@@ -136,6 +204,8 @@ Each node is a page, so once we read the page in we just cast the pointer to the
 These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
 node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
 at this level are just above the leaf nodes. Otherwise set to 0.
+Nodes do not point back at their parents; an insert remembers the non-leaf nodes it went down
+through and carries a split up along that path instead.
 */
 
 /**
@@ -144,9 +214,9 @@ at this level are just above the leaf nodes. Otherwise set to 0.
 struct NonLeafNodeInt{
 
   /**
-   * Page number of the non-leaf parent node
+   * LSN of the last logged change, overlays PageHeader::lsn.
    */
-  PageId parentPageNo;
+	Lsn lsn;
 
   /**
    * How many valid keys are stored inside the non-leaf node
@@ -158,6 +228,13 @@ struct NonLeafNodeInt{
    */
 	int level;
 
+  /**
+   * Last key of each full cache line of keyArray, INT_MAX past the last full line.  A search
+   * reads this and then the one line of keyArray it points at instead of going through keyArray
+   * from the start.  Rebuilt by buildSummary after any change to keyArray.
+   */
+	alignas( CACHELINESIZE ) int summary[ NONLEAFSUMMARYSIZE ];
+
   /**
    * Stores keys.
    */
@@ -167,8 +244,25 @@ struct NonLeafNodeInt{
    * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
    */
 	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
+
+  /**
+   * Index into pageNoArray of the child to follow for a key: the one left of the first key
+   * greater than it.
+   *
+   * @param key	Key to search for
+   * @return	Index of the child
+   */
+	int childIndex(int key) const;
+
+  /**
+   * Rebuild summary from keyArray.
+   */
+	void buildSummary();
 };
 
+static_assert(NONLEAFSUMMARYSIZE * NONLEAFLINEKEYS >= INTARRAYNONLEAFSIZE,
+              "The summary of a non-leaf node must cover all of its keys.");
+
 
 /**
  * @brief Structure for all leaf nodes when the key is of INTEGER type.
@@ -176,15 +270,21 @@ struct NonLeafNodeInt{
 struct LeafNodeInt{
 
   /**
-   * Page number of the non-leaf parent node
+   * LSN of the last logged change, overlays PageHeader::lsn.
    */
-  PageId parentPageNo;
+	Lsn lsn;
 
   /**
    * How many valid keys are stored inside the leaf node
    */
 	int numValidKeys;
 
+  /**
+   * Nonzero if the leaf on the left ends with this leaf's first key, so that a scan from that
+   * key has to start there.
+   */
+	int sharesFirstKey;
+
   /**
    * Stores keys.
    */
@@ -202,6 +302,149 @@ struct LeafNodeInt{
 	PageId rightSibPageNo;
 };
 
+/**
+ * @brief Number of bytes for the key directory and posting lists of a posting-list leaf.
+ */
+//                                                      lsn        numValidKeys    postingBytes      sibling ptr    sharesFirstKey
+const  int POSTINGLEAFDATASIZE = Page::SIZE - sizeof( Lsn ) - sizeof( int ) - sizeof( int ) - sizeof( PageId ) - sizeof( int );
+
+/**
+ * @brief Directory entry of a key in a posting-list leaf.
+ */
+struct PostingHeadInt{
+
+  /**
+   * The key.
+   */
+	int key;
+
+  /**
+   * Offset of the key's posting list in the leaf's data.
+   */
+	std::uint16_t offset;
+
+  /**
+   * Length of the key's posting list in bytes.
+   */
+	std::uint16_t length;
+};
+
+/**
+ * @brief Structure for leaf nodes of LEAF_POSTING indexes when the key is of INTEGER type.
+ * The data starts with a directory of the distinct keys of the leaf in ascending order; their
+ * posting lists are packed in the same order at the end of the data, with the free space in between.
+ * A posting list holds the RecordIds of its key in ascending order, each as page_number << 16 |
+ * slot_number, the first one in full and every later one as the difference from the one before,
+ * all as varints (seven bits per byte, low bits first, the high bit set on every byte but the last).
+ * A key whose RecordIds do not fit in one leaf continues in the leaves to its right.
+*/
+struct PostingLeafNodeInt{
+
+  /**
+   * LSN of the last logged change, overlays PageHeader::lsn.
+   */
+	Lsn lsn;
+
+  /**
+   * How many distinct keys are stored inside the leaf node
+   */
+	int numValidKeys;
+
+  /**
+   * Bytes of posting lists at the end of data.
+   */
+	int postingBytes;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Nonzero if the posting list of this leaf's first key starts in the leaf on the left.
+   */
+	int sharesFirstKey;
+
+  /**
+   * Key directory (PostingHeadInt entries) followed by free space and the posting lists.
+   */
+	unsigned char data[ POSTINGLEAFDATASIZE ];
+};
+
+/**
+ * @brief Number of bytes for the packed columns of a bit-packed leaf.
+ */
+//                                                     lsn        numValidKeys      sibling ptr        keyBase          pageBase        bit widths, sharesFirstKey
+const  int PACKEDLEAFDATASIZE = Page::SIZE - sizeof( Lsn ) - sizeof( int ) - sizeof( PageId ) - sizeof( int ) - sizeof( PageId ) - 4;
+
+/**
+ * @brief Most entries a bit-packed leaf holds, however few bits they take.
+ */
+const  int PACKEDLEAFMAXSIZE = 4096;
+
+/**
+ * @brief Structure for leaf nodes of LEAF_PACKED indexes when the key is of INTEGER type.
+ * Entries are sorted like those of LeafNodeInt, but kept as three bit-packed columns: the key less
+ * keyBase in keyBits bits, the RecordId's page number less pageBase in pageBits bits and its slot
+ * number in slotBits bits.  keyBase is the lowest key of the leaf and pageBase the lowest page
+ * number.  Each column packs its values into four interleaved lanes of 32-bit words, entry i going
+ * to lane i % 4, so that four entries are unpacked at once with 128-bit shifts and masks.
+ * The columns follow each other in data, each sized for as many entries as the leaf has room for
+ * at the current widths; an entry that does not fit the widths re-packs the leaf.
+*/
+struct PackedLeafNodeInt{
+
+  /**
+   * LSN of the last logged change, overlays PageHeader::lsn.
+   */
+	Lsn lsn;
+
+  /**
+   * How many entries are stored inside the leaf node
+   */
+	int numValidKeys;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Frame of reference of the keys.
+   */
+	int keyBase;
+
+  /**
+   * Frame of reference of the RecordIds' page numbers.
+   */
+	PageId pageBase;
+
+  /**
+   * Bits per key, page number and slot number.
+   */
+	std::uint8_t keyBits;
+	std::uint8_t pageBits;
+	std::uint8_t slotBits;
+
+  /**
+   * Nonzero if the leaf on the left ends with this leaf's first key.
+   */
+	std::uint8_t sharesFirstKey;
+
+  /**
+   * Key, page number and slot number columns.
+   */
+	unsigned char data[ PACKEDLEAFDATASIZE ];
+};
+
+/**
+ * @brief Entries a scan of a bit-packed leaf unpacks at a time.
+ */
+const  int PACKEDSCANBLOCK = 128;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE && sizeof(LeafNodeInt) <= Page::SIZE &&
+              sizeof(PostingLeafNodeInt) <= Page::SIZE && sizeof(PackedLeafNodeInt) <= Page::SIZE,
+              "B+ tree nodes must fit in a page.");
 
 /**
  * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
@@ -241,6 +484,11 @@ class BTreeIndex {
    */
 	int 		attrByteOffset;
 
+  /**
+   * Layout of the leaves.
+   */
+	LeafFormat	leafFormat;
+
   /**
    * Number of keys in leaf node, depending upon the type of key.
    */
@@ -260,19 +508,42 @@ class BTreeIndex {
 	bool		scanExecuting;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Index of next entry to be scanned in current leaf being scanned.  In a posting-list leaf,
+   * the index of the key whose posting list is being scanned.
    */
 	int			nextEntry;
 
+  /**
+   * Offset of the next RecordId to be scanned in the posting list of key nextEntry, 0 at its start.
+   */
+	int			postingPos;
+
+  /**
+   * Last RecordId scanned from the posting list of key nextEntry, as page_number << 16 | slot_number.
+   */
+	std::uint64_t	postingValue;
+
+  /**
+   * Index of the first entry of the current bit-packed leaf unpacked into packedBlock, -1 if none is.
+   */
+	int			packedBlockFirst;
+
+  /**
+   * Keys, page numbers and slot numbers of PACKEDSCANBLOCK entries of the current bit-packed leaf,
+   * less their frames of reference.
+   */
+	std::uint32_t	packedBlock[3][PACKEDSCANBLOCK];
+
   /**
    * Page number of current page being scanned.
    */
 	PageId	currentPageNum;
 
   /**
-   * Current Page being scanned.
+   * Current Page being scanned, pinned from the entry that reaches it until the scan moves
+   * past it or ends.  Empty while the scan waits to read the next leaf.
    */
-	Page		*currentPageData;
+	ReadPageGuard	currentPage;
 
   /**
    * Low INTEGER value for scan.
@@ -314,13 +585,96 @@ class BTreeIndex {
    */
 	Operator	highOp;
 
+	// MEMBERS SPECIFIC TO LOGGING
+
+  /**
+   * Write-ahead log node changes are recorded in, NULL if the index is not logged.
+   */
+	LogManager	*log;
+
+  /**
+   * Transaction of the insert in progress.
+   */
+	TxnId		txn;
+
+  /**
+   * Contents before the change of the nodes a split of the insert in progress is rewriting, until
+   * the rewrite is logged, while a log is attached.
+   */
+	std::unordered_map<PageId, std::vector<char> > nodeImages;
+
+  /**
+   * Node changes the insert in progress has logged, oldest first, kept for rolling it back.
+   */
+	std::vector<LogRecord> txnWrites;
+
+  /**
+   * Set when an insert failed and could not be rolled back, leaving the tree half changed.
+   */
+	bool		unusable;
+
+  /**
+   * Non-leaf nodes the insert in progress went down through, root first.  Kept across inserts
+   * so that its storage is reused.
+   */
+	std::vector<PageId> insertPath;
+
+  /**
+   * Rightmost leaf as found by the last descent that took the last child all the way down,
+   * Page::INVALID_NUMBER while unknown.  Inserts of keys from rightmostLowKey up belong in it
+   * and go straight to it, without a descent.
+   */
+	PageId	rightmostLeaf;
+
+  /**
+   * Lowest key that belongs in rightmostLeaf, the greatest key of the non-leaf nodes above it.
+   */
+	int			rightmostLowKey;
+
+  /**
+   * Non-leaf nodes above rightmostLeaf, root first.
+   */
+	std::vector<PageId> rightmostPath;
+
+	// MEMBERS SPECIFIC TO PINNED LEVELS
+
+  /**
+   * @brief A non-leaf node kept pinned by pinTopLevels.
+   */
+	struct PinnedNode {
+		ReadPageGuard	page;
+		const NonLeafNodeInt	*node;
+		// Indexes into pinnedNodes of the children, in pageNoArray order; empty at the lowest pinned level
+		std::vector<std::size_t>	children;
+	};
+
+  /**
+   * Levels of non-leaf nodes, counting the root, to keep pinned.
+   */
+	int			pinnedLevels;
+
+  /**
+   * Set when a split changed the children of a pinned node above the lowest pinned level.
+   */
+	bool		pinnedStale;
+
+  /**
+   * Pinned nodes level by level from the root, which is the first one when any are pinned.
+   */
+	std::vector<PinnedNode>	pinnedNodes;
+
+  /**
+   * Page number of every pinned node to its index in pinnedNodes.
+   */
+	std::unordered_map<PageId, std::size_t> pinnedIndex;
+
 	
  public:
 
   /**
-   * Allocate a new Meta Info Page
+   * Allocate a new Meta Info Page, pinned until the returned guard is released
    * */
-  IndexMetaInfo *allocateMetaInfoNode(PageId &newPageId);
+  WritePageGuard allocateMetaInfoNode(PageId &newPageId);
 
   /**
    * BTreeIndex Constructor. 
@@ -332,10 +686,13 @@ class BTreeIndex {
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
+   * @param leafFormat1					Layout of the leaves; LEAF_POSTING keeps each distinct key once and suits attributes with few distinct values
+   * @param numWorkers					Threads to build the index on, 0 for one per hardware thread
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset1,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const int attrByteOffset1,	const Datatype attrType,
+						const LeafFormat leafFormat1 = LEAF_FLAT, const std::uint32_t numWorkers = 0);
 	
 
   /**
@@ -346,31 +703,148 @@ class BTreeIndex {
 	 * */
 	~BTreeIndex();
 
+  /**
+   * Build the tree bottom-up from the relation on numWorkers threads (0 for one per hardware thread),
+   * but no more than one per 64 pages of the relation, so a small relation is loaded on this thread.
+   * Partitions of the relation are scanned concurrently into one run per worker, every run is radix
+   * sorted on its own worker, the runs are merged pairwise in parallel, and then each level of the
+   * tree is emitted with the workers writing disjoint, contiguous groups of nodes.
+   * Must only be called on an empty tree.
+   * */
+  void bulkLoad(const std::string &relationName, std::uint32_t numWorkers);
+
+  /**
+   * Write the sorted pairs into linked leaves, each filled to 90% so that inserts after the load
+   * do not split them right away.
+   * Returns the page number and lowest key of every leaf, left to right, via children.
+   * */
+  void emitLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                     std::vector<PageKeyPair<int> > &children);
+
+  /**
+   * Write the sorted pairs into linked posting-list leaves, filled like emitLeafLevel.
+   * */
+  void emitPostingLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                            std::vector<PageKeyPair<int> > &children);
+
+  /**
+   * Write the sorted pairs into linked bit-packed leaves, filled like emitLeafLevel.
+   * */
+  void emitPackedLeafLevel(const std::vector<RIDKeyPair<int> > &sorted, std::uint32_t numWorkers,
+                           std::vector<PageKeyPair<int> > &children);
+
+  /**
+   * Write one level of non-leaf nodes over children (page number and lowest key of each child),
+   * filled like emitLeafLevel.
+   * Returns the page number and lowest key of every new node, left to right, via parents.
+   * */
+  void emitNonLeafLevel(const std::vector<PageKeyPair<int> > &children, int level, std::uint32_t numWorkers,
+                        std::vector<PageKeyPair<int> > &parents);
+
   /** 
-   * Allocate a new leaf node
+   * Allocate a new leaf node, pinned until the returned guard is released
    * */
-  LeafNodeInt *allocateLeafNode(PageId &newPageId);
+  WritePageGuard allocateLeafNode(PageId &newPageId);
 
   /** 
-   * Allocate a new non-leaf node
+   * Allocate a new non-leaf node, pinned until the returned guard is released
+   * */
+  WritePageGuard allocateNonLeafNode(PageId &newPageId);
+
+  /**
+   * Allocate and pin a new node.  Leaves and non-leaf nodes come from separate extents of the
+   * index file, so that a range scan along the leaves reads contiguous pages.
+   * */
+  WritePageGuard allocNode(PageId &newPageId, ExtentClass extentClass);
+
+  /**
+   * Insert an entry into a node with room for it.  While a log is attached, the insert is logged
+   * as a LOG_NODE_INSERT record of the insert's transaction, or as images of the whole node if
+   * it is the node's first change since the last checkpoint, and the node is stamped with its LSN.
+   * Returns false, leaving the node as it was, if the node has no room for the entry.
+   * */
+  bool insertNodeEntry(WritePageGuard &page, const NodeLogEntry &entry, int slot);
+
+  /**
+   * Keep the contents of a node a split is about to rewrite, for logNodeImage.
+   * */
+  void beginNodeImage(WritePageGuard &page);
+
+  /**
+   * Log a node rewritten by a split, or a new node, as a LOG_NODE_IMAGE record of the insert's
+   * transaction, with the contents kept by beginNodeImage as its before image, and stamp the node
+   * with its LSN.  A rewrite not logged when an exception unwinds the insert is put back by
+   * rollbackInsert.
    * */
-  NonLeafNodeInt *allocateNonLeafNode(PageId &newPageId);
+  void logNodeImage(WritePageGuard &page);
+
+  /**
+   * Append a node change to the log, stamp the node with its LSN and keep it for rollbackInsert.
+   * */
+  void logNodeRecord(WritePageGuard &page, LogRecord &record);
+
+  /**
+   * Roll back an insert that failed part way: put back the nodes a split rewrote without logging
+   * it from nodeImages, undo the logged changes newest first, each with a compensation record,
+   * and log the abort of the transaction.  If that fails as well, as when the log cannot be
+   * written, the index is left unusable.
+   * */
+  void rollbackInsert();
+
+  /**
+   * Pin the top pinnedLevels levels of non-leaf nodes again after the root or the children of a
+   * pinned node changed.
+   * */
+  void repinTopLevels();
+
+  /**
+   * Unpin every node pinned by pinTopLevels.
+   * */
+  void unpinTopLevels();
 
   /**
    * Get to the leaf node that the required key value fits in
    * Store the targetPageId of the leaf node
+   * If path is given, the page numbers of the non-leaf nodes gone through are appended to it, root first
+   * */
+  void searchForLeaf(PageId &targetPageId, int key, std::vector<PageId> *path = NULL);
+
+  /**
+   * Get to the leaf a scan from lowValInt starts in, setting currentPageNum and pinning it through leafPage.
+   * That is the leaf lowValInt fits in, unless its copies start in the leaf to the left of it
    * */
-  void searchForLeaf(PageId &targetPageId, int key);
+  void searchForScanLeaf(ReadPageGuard &leafPage);
 
   /**
    * Insert a pair of <key, rid> into a specific leaf node with PageId = leafId
+   * path holds the non-leaf nodes above the leaf, root first, as left by searchForLeaf
    * */
-  void insertToLeaf(PageId leafId, int key, const RecordId rid);
+  void insertToLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path);
 
   /**
-   * Insert a pair of <key, rid> into a specific non-leaf node with PageId = nonLeafId
+   * Insert a pair of <key, rid> into a specific posting-list leaf, like insertToLeaf
+   * A leaf without room splits by bytes of posting lists, between two keys where it can
    * */
-  void insertToNonLeaf(PageId nonLeafId, int key, PageId leftChildPageId, PageId rightChildPageId, int level);
+  void insertToPostingLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path);
+
+  /**
+   * Insert a pair of <key, rid> into a specific bit-packed leaf, like insertToLeaf
+   * An entry that fits the leaf's bit widths is inserted in place; otherwise the leaf is unpacked
+   * and packed again at the widths of its new contents, splitting if they do not fit
+   * */
+  void insertToPackedLeaf(PageId leafId, int key, const RecordId rid, std::vector<PageId> &path);
+
+  /**
+   * Insert the separator key and new right child of a split into the parent of the split node,
+   * which is the last node of path, popping it.  If path is empty the split node was the root and
+   * a new root is made over the two halves.  A parent that is full splits in turn.
+   * level is 1 if the children are leaves, 0 otherwise
+   * append is set when the split below was of the rightmost node of its level by a key above all
+   * of its keys; a full node that is appended to in turn keeps APPEND_SPLIT_PERCENT of its keys
+   * instead of half, so that ascending keys leave the tree nearly full rather than half full
+   * */
+  void insertToNonLeaf(std::vector<PageId> &path, int key, PageId leftChildPageId, PageId rightChildPageId, int level,
+                       bool append);
 
   /**
 	 * Insert a new entry using the pair <value,rid>. 
@@ -378,11 +852,45 @@ class BTreeIndex {
 	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
 	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
 	 * Make sure to unpin pages as soon as you can.
+	 * While a log is attached, an insert that throws part way is rolled back before the exception
+	 * is passed on.
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	 * @throws  IndexUnusableException If an earlier insert failed and could not be rolled back
 	**/
 	void insertEntry(const void* key, const RecordId rid);
 
+  /**
+	 * Log every later insertEntry to a write-ahead log.  Each insert becomes a transaction whose node
+	 * changes are logged as the entries inserted, or as page images for splits, and which is committed
+	 * (made durable) before insertEntry returns; a root change is logged in the meta page as well.  The tree built so far is written
+	 * back first, since the bulk load is not logged.  The buffer manager should have the same log
+	 * attached, so that nodes are not written back ahead of their log records.
+   * @param logManager	Log to record inserts in, NULL to stop logging
+	 * @throws PagePinnedException If a scan is executing
+	**/
+	void setLogManager(LogManager *logManager);
+
+  /**
+	 * Apply a logged node change to its page, as redo does, or undo it.
+   * @param page	Page of the node, pinned
+   * @param record	LOG_NODE_INSERT, LOG_NODE_REMOVE or LOG_NODE_IMAGE record
+   * @param undo	Apply the inverse change
+   * @return	False if the change does not fit the node, which then is left as it was
+	**/
+	static bool applyNodeRecord(Page *page, const LogRecord &record, bool undo);
+
+  /**
+	 * Keep the root and the non-leaf levels under it, levels in all, pinned in the buffer pool for as
+	 * long as the index is open.  A descent then follows pointers through the pinned levels and only
+	 * goes through the buffer manager for the levels under them and the leaf, so a tree of up to
+	 * levels + 1 levels costs one buffer pool access per lookup.  Pinned nodes are never evicted,
+	 * however large a file scan runs through the pool.  Leaves are never pinned, nor is a root that
+	 * is a leaf.  Splits are picked up by the next descent.
+   * @param levels	Levels to keep pinned, 0 to unpin them
+	**/
+	void pinTopLevels(int levels);
+
   /**
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
 	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
@@ -397,6 +905,7 @@ class BTreeIndex {
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	 * @throws  IndexUnusableException If an earlier insert failed and could not be rolled back
 	**/
 	void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
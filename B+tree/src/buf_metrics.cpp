@@ -0,0 +1,208 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_metrics.h"
+
+namespace badgerdb {
+
+//----------------------------------------
+// LatencySnapshot
+//----------------------------------------
+
+std::uint64_t LatencySnapshot::count() const
+{
+	std::uint64_t total = 0;
+	for (std::size_t i = 0; i < buckets.size(); i++)
+		total += buckets[i];
+	return total;
+}
+
+std::uint64_t LatencySnapshot::percentile(double percentile) const
+{
+	const std::uint64_t total = count();
+	if (total == 0)
+		return 0;
+
+	std::uint64_t rank = (std::uint64_t)(percentile / 100.0 * total + 0.5);
+	if (rank == 0)
+		rank = 1;
+	std::uint64_t seen = 0;
+	for (std::uint32_t i = 0; i < buckets.size(); i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+			return (i + 1 < buckets.size()) ? LatencyHistogram::bucketLowest(i + 1) - 1 : LatencyHistogram::bucketLowest(i);
+	}
+	return LatencyHistogram::bucketLowest(buckets.size() - 1);
+}
+
+//----------------------------------------
+// LatencyHistogram
+//----------------------------------------
+
+std::uint32_t LatencyHistogram::bucketOf(std::uint64_t nanos)
+{
+	if (nanos < (1ULL << SUB_BUCKET_BITS))
+		return nanos;
+
+	const std::uint32_t magnitude = 63 - __builtin_clzll(nanos);
+	if (magnitude > MAX_MAGNITUDE)
+		return NUM_BUCKETS - 1;
+	const std::uint32_t shift = magnitude - SUB_BUCKET_BITS;
+	return ((shift + 1) << SUB_BUCKET_BITS) + (std::uint32_t)((nanos >> shift) - (1ULL << SUB_BUCKET_BITS));
+}
+
+std::uint64_t LatencyHistogram::bucketLowest(std::uint32_t bucket)
+{
+	if (bucket < (1U << SUB_BUCKET_BITS))
+		return bucket;
+
+	const std::uint32_t shift = (bucket >> SUB_BUCKET_BITS) - 1;
+	const std::uint64_t subBucket = bucket & ((1U << SUB_BUCKET_BITS) - 1);
+	return (subBucket + (1ULL << SUB_BUCKET_BITS)) << shift;
+}
+
+void LatencyHistogram::addTo(LatencySnapshot &snapshot) const
+{
+	snapshot.buckets.resize(NUM_BUCKETS, 0);
+	for (std::uint32_t i = 0; i < NUM_BUCKETS; i++)
+		snapshot.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::clear()
+{
+	for (std::uint32_t i = 0; i < NUM_BUCKETS; i++)
+		buckets[i].store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------
+// BufMetrics
+//----------------------------------------
+
+BufMetrics::BufMetrics()
+{
+	clear();
+}
+
+std::uint64_t BufMetrics::total(BufOp op, BufEvent event) const
+{
+	return counts[op][event].load(std::memory_order_relaxed);
+}
+
+std::uint64_t BufMetrics::total(BufEvent event) const
+{
+	std::uint64_t sum = 0;
+	for (std::uint32_t op = 0; op < NUM_BUFOPS; op++)
+		sum += total((BufOp)op, event);
+	return sum;
+}
+
+double BufMetrics::hitRatio() const
+{
+	const std::uint64_t hits = total(BUFOP_READ_PAGE, BUFEVENT_HIT);
+	const std::uint64_t misses = total(BUFOP_READ_PAGE, BUFEVENT_MISS);
+	return (hits + misses == 0) ? 0 : (double)hits / (hits + misses);
+}
+
+LatencySnapshot BufMetrics::readLatency() const
+{
+	LatencySnapshot snapshot;
+	readLatencies.addTo(snapshot);
+	return snapshot;
+}
+
+LatencySnapshot BufMetrics::writeLatency() const
+{
+	LatencySnapshot snapshot;
+	writeLatencies.addTo(snapshot);
+	return snapshot;
+}
+
+void BufMetrics::retireFile(const std::string &name, const BufFileCounters &counters)
+{
+	std::lock_guard<std::mutex> guard(retiredLatch);
+	retiredFiles[name].add(counters);
+}
+
+std::map<std::string, BufFileCounters> BufMetrics::fileCounters(const std::map<std::string, BufFileCounters> &live) const
+{
+	std::map<std::string, BufFileCounters> files;
+	{
+		std::lock_guard<std::mutex> guard(retiredLatch);
+		files = retiredFiles;
+	}
+	for (std::map<std::string, BufFileCounters>::const_iterator it = live.begin(); it != live.end(); ++it)
+		files[it->first].add(it->second);
+	return files;
+}
+
+static void printLatency(std::ostream &os, const char *name, const LatencySnapshot &latency)
+{
+	os << name << ": count=" << latency.count()
+	   << " p50=" << latency.percentile(50) << "ns"
+	   << " p99=" << latency.percentile(99) << "ns"
+	   << " p99.9=" << latency.percentile(99.9) << "ns"
+	   << " max=" << latency.percentile(100) << "ns\n";
+}
+
+void BufMetrics::dump(std::ostream &os, const std::map<std::string, BufFileCounters> &live) const
+{
+	os << "Hit ratio:" << hitRatio() << "\n";
+	for (std::uint32_t op = 0; op < NUM_BUFOPS; op++)
+	{
+		os << opName((BufOp)op) << ":"
+		   << " hits=" << total((BufOp)op, BUFEVENT_HIT)
+		   << " misses=" << total((BufOp)op, BUFEVENT_MISS)
+		   << " evictions=" << total((BufOp)op, BUFEVENT_EVICTION)
+		   << " dirtyEvictions=" << total((BufOp)op, BUFEVENT_DIRTY_EVICTION)
+		   << " writes=" << total((BufOp)op, BUFEVENT_WRITE) << "\n";
+	}
+
+	const std::map<std::string, BufFileCounters> files = fileCounters(live);
+	for (std::map<std::string, BufFileCounters>::const_iterator it = files.begin(); it != files.end(); ++it)
+	{
+		os << "File " << it->first << ":"
+		   << " hits=" << it->second.hits
+		   << " misses=" << it->second.misses
+		   << " evictions=" << it->second.evictions
+		   << " dirtyEvictions=" << it->second.dirtyEvictions
+		   << " writes=" << it->second.writes << "\n";
+	}
+
+	printLatency(os, "readPage latency", readLatency());
+	printLatency(os, "writePage latency", writeLatency());
+}
+
+void BufMetrics::clear()
+{
+	for (std::uint32_t op = 0; op < NUM_BUFOPS; op++)
+		for (std::uint32_t event = 0; event < NUM_BUFEVENTS; event++)
+			counts[op][event].store(0, std::memory_order_relaxed);
+	readLatencies.clear();
+	writeLatencies.clear();
+
+	std::lock_guard<std::mutex> guard(retiredLatch);
+	retiredFiles.clear();
+}
+
+const char* BufMetrics::opName(BufOp op)
+{
+	switch (op)
+	{
+		case BUFOP_READ_PAGE:  return "readPage";
+		case BUFOP_ALLOC_PAGE: return "allocPage";
+		case BUFOP_FLUSH_FILE: return "flushFile";
+		case BUFOP_BG_WRITER:  return "backgroundWriter";
+		case BUFOP_CHECKPOINT: return "checkpoint";
+		case BUFOP_SHUTDOWN:   return "shutdown";
+		case BUFOP_PREFETCH:   return "prefetch";
+		case NUM_BUFOPS:       break;
+	}
+	return "unknown";
+}
+
+}
@@ -0,0 +1,257 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Buffer manager operation an event is attributed to.
+ */
+enum BufOp {
+  BUFOP_READ_PAGE,
+  BUFOP_ALLOC_PAGE,
+  BUFOP_FLUSH_FILE,
+  BUFOP_BG_WRITER,
+  BUFOP_CHECKPOINT,
+  BUFOP_SHUTDOWN,
+  BUFOP_PREFETCH,
+  NUM_BUFOPS
+};
+
+/**
+ * @brief Event counted by the buffer manager metrics.
+ */
+enum BufEvent {
+  BUFEVENT_HIT,             // page found in the pool
+  BUFEVENT_MISS,            // page had to be read from disk
+  BUFEVENT_EVICTION,        // valid page thrown out to make room
+  BUFEVENT_DIRTY_EVICTION,  // evicted page which had to be written first
+  BUFEVENT_WRITE,           // page written back to disk
+  NUM_BUFEVENTS
+};
+
+/**
+ * @brief Counters kept for every file with pages in the pool.
+ */
+struct BufFileCounters
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t evictions;
+  std::uint64_t dirtyEvictions;
+  std::uint64_t writes;
+
+  BufFileCounters()
+    : hits(0), misses(0), evictions(0), dirtyEvictions(0), writes(0)
+  {
+  }
+
+  /**
+   * Add another set of counters to this one.
+   */
+  void add(const BufFileCounters &other)
+  {
+    hits += other.hits;
+    misses += other.misses;
+    evictions += other.evictions;
+    dirtyEvictions += other.dirtyEvictions;
+    writes += other.writes;
+  }
+};
+
+/**
+ * @brief Point in time copy of a LatencyHistogram, used for reporting.
+ */
+struct LatencySnapshot
+{
+  /**
+   * Number of samples per bucket.
+   */
+  std::vector<std::uint64_t> buckets;
+
+  /**
+   * Returns the total number of samples.
+   */
+  std::uint64_t count() const;
+
+  /**
+   * Returns an upper bound of the given percentile, in nanoseconds, 0 if there are no samples.
+   *
+   * @param percentile  Between 0 and 100
+   */
+  std::uint64_t percentile(double percentile) const;
+};
+
+/**
+ * @brief Log-linear (HDR style) histogram of latencies in nanoseconds.
+ *
+ * Every power of two range is cut into 2^SUB_BUCKET_BITS equal buckets, which keeps the relative
+ * error of a reported value below 1 / 2^SUB_BUCKET_BITS over the whole range with a few hundred
+ * buckets.  Recording is not atomic: the recorder must be serialized, as the buffer manager's
+ * latch does, but a snapshot may be taken at any time.
+ */
+class LatencyHistogram
+{
+ public:
+  static const std::uint32_t SUB_BUCKET_BITS = 3;
+  static const std::uint32_t MAX_MAGNITUDE = 40;   // about 18 minutes
+  static const std::uint32_t NUM_BUCKETS = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+
+  LatencyHistogram() { clear(); }
+
+  /**
+   * Count one sample.
+   */
+  void record(std::uint64_t nanos)
+  {
+    std::atomic<std::uint64_t> &bucket = buckets[bucketOf(nanos)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Add the counts of this histogram to a snapshot.
+   */
+  void addTo(LatencySnapshot &snapshot) const;
+
+  /**
+   * Reset all buckets to zero.
+   */
+  void clear();
+
+  /**
+   * Returns the bucket a value falls into.
+   */
+  static std::uint32_t bucketOf(std::uint64_t nanos);
+
+  /**
+   * Returns the smallest value falling into a bucket.
+   */
+  static std::uint64_t bucketLowest(std::uint32_t bucket);
+
+ private:
+  std::atomic<std::uint64_t> buckets[NUM_BUCKETS];
+};
+
+/**
+ * @brief Low overhead counters and latency histograms of a buffer manager.
+ *
+ * Every event is recorded under the buffer manager's latch, so the per-operation counters and the
+ * histograms are plain increments.  They are kept in relaxed atomics only so that they can be read
+ * without the latch.  Per-file counters are kept by the buffer manager next to the file's frame
+ * lists; the counters of files which leave the pool are retired here, keyed by file name.
+ */
+class BufMetrics
+{
+ public:
+  BufMetrics();
+
+  /**
+   * Count one event of an operation.
+   */
+  void count(BufOp op, BufEvent event)
+  {
+    std::atomic<std::uint64_t> &counter = counts[op][event];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Record the latency of reading one page from disk into the pool.
+   */
+  void recordRead(std::uint64_t nanos) { readLatencies.record(nanos); }
+
+  /**
+   * Record the latency of writing one page back to disk.
+   */
+  void recordWrite(std::uint64_t nanos) { writeLatencies.record(nanos); }
+
+  /**
+   * Returns the number of events of an operation.
+   */
+  std::uint64_t total(BufOp op, BufEvent event) const;
+
+  /**
+   * Returns the number of events summed over all operations.
+   */
+  std::uint64_t total(BufEvent event) const;
+
+  /**
+   * Returns the fraction of readPage calls which found their page in the pool, 0 if there were none.
+   */
+  double hitRatio() const;
+
+  /**
+   * Returns the latencies of page reads.
+   */
+  LatencySnapshot readLatency() const;
+
+  /**
+   * Returns the latencies of page writes.
+   */
+  LatencySnapshot writeLatency() const;
+
+  /**
+   * Keep the counters of a file whose last page left the pool.
+   *
+   * @param name      Name of the file
+   * @param counters  Counters gathered while the file had pages in the pool
+   */
+  void retireFile(const std::string &name, const BufFileCounters &counters);
+
+  /**
+   * Returns the counters of every file, the given live counters added to the retired ones.
+   *
+   * @param live  Counters of the files which currently have pages in the pool
+   */
+  std::map<std::string, BufFileCounters> fileCounters(const std::map<std::string, BufFileCounters> &live) const;
+
+  /**
+   * Print the counters, per operation and per file, and the latency percentiles.
+   *
+   * @param os    Stream to print to
+   * @param live  Counters of the files which currently have pages in the pool
+   */
+  void dump(std::ostream &os, const std::map<std::string, BufFileCounters> &live) const;
+
+  /**
+   * Reset all counters and histograms.
+   */
+  void clear();
+
+  /**
+   * Returns a printable name of an operation.
+   */
+  static const char* opName(BufOp op);
+
+ private:
+  BufMetrics(const BufMetrics &);
+  BufMetrics &operator=(const BufMetrics &);
+
+  std::atomic<std::uint64_t> counts[NUM_BUFOPS][NUM_BUFEVENTS];
+  LatencyHistogram readLatencies;
+  LatencyHistogram writeLatencies;
+
+  /**
+   * Guards retiredFiles.
+   */
+  mutable std::mutex retiredLatch;
+
+  /**
+   * Counters of files which no longer have pages in the pool.
+   */
+  std::map<std::string, BufFileCounters> retiredFiles;
+};
+
+}
@@ -0,0 +1,124 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_trace.h"
+
+#include <cstring>
+#include "exceptions/bad_trace_exception.h"
+
+namespace badgerdb {
+
+static const char TRACE_MAGIC[8] = {'B', 'D', 'B', 'T', 'R', 'C', '0', '1'};
+
+// Buffered bytes are written out once this many have gathered
+static const std::size_t TRACE_BUFFER_SIZE = 1 << 16;
+
+//----------------------------------------
+// BufTraceWriter
+//----------------------------------------
+
+BufTraceWriter::BufTraceWriter(const std::string &path)
+	: out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+{
+	if (!out)
+		throw BadTraceException(path, "cannot create");
+	buffer.reserve(TRACE_BUFFER_SIZE + 256);
+	append(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+}
+
+BufTraceWriter::~BufTraceWriter()
+{
+	flush();
+}
+
+void BufTraceWriter::append(const void *bytes, std::size_t len)
+{
+	const char *p = static_cast<const char*>(bytes);
+	buffer.insert(buffer.end(), p, p + len);
+}
+
+void BufTraceWriter::record(const std::string &fileName, PageId pageNo, BufTraceOp op)
+{
+	std::unordered_map<std::string, std::uint32_t>::iterator it = fileIds.find(fileName);
+	if (it == fileIds.end())
+	{
+		const std::uint32_t id = fileIds.size();
+		it = fileIds.insert(std::make_pair(fileName, id)).first;
+
+		const std::uint8_t nameOp = TRACE_FILE_NAME;
+		const std::uint16_t len = fileName.size() > 0xFFFF ? 0xFFFF : fileName.size();
+		append(&nameOp, sizeof(nameOp));
+		append(&id, sizeof(id));
+		append(&len, sizeof(len));
+		append(fileName.data(), len);
+	}
+
+	const std::uint8_t accessOp = op;
+	append(&accessOp, sizeof(accessOp));
+	append(&it->second, sizeof(it->second));
+	append(&pageNo, sizeof(pageNo));
+
+	if (buffer.size() >= TRACE_BUFFER_SIZE)
+		flush();
+}
+
+void BufTraceWriter::flush()
+{
+	out.write(buffer.data(), buffer.size());
+	out.flush();
+	buffer.clear();
+}
+
+//----------------------------------------
+// BufTraceReader
+//----------------------------------------
+
+BufTraceReader::BufTraceReader(const std::string &path)
+	: path(path), in(path.c_str(), std::ios::in | std::ios::binary)
+{
+	char magic[sizeof(TRACE_MAGIC)];
+	if (!in)
+		throw BadTraceException(path, "cannot open");
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+		throw BadTraceException(path, "not a page access trace");
+}
+
+bool BufTraceReader::next(BufTraceRecord &record)
+{
+	while (true)
+	{
+		std::uint8_t op;
+		if (!in.read(reinterpret_cast<char*>(&op), sizeof(op)))
+			return false;
+
+		std::uint32_t fileId;
+		if (!in.read(reinterpret_cast<char*>(&fileId), sizeof(fileId)))
+			throw BadTraceException(path, "truncated entry");
+
+		if (op == TRACE_FILE_NAME)
+		{
+			std::uint16_t len;
+			if (!in.read(reinterpret_cast<char*>(&len), sizeof(len)) || fileId != names.size())
+				throw BadTraceException(path, "bad file name entry");
+			std::string name(len, '\0');
+			if (len > 0 && !in.read(&name[0], len))
+				throw BadTraceException(path, "truncated file name");
+			names.push_back(name);
+			continue;
+		}
+
+		if (op > TRACE_FLUSH_FILE || fileId >= names.size())
+			throw BadTraceException(path, "bad access entry");
+		if (!in.read(reinterpret_cast<char*>(&record.pageNo), sizeof(record.pageNo)))
+			throw BadTraceException(path, "truncated entry");
+		record.fileId = fileId;
+		record.op = (BufTraceOp)op;
+		return true;
+	}
+}
+
+}
@@ -0,0 +1,149 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Kind of a page access trace entry.
+ */
+enum BufTraceOp {
+  TRACE_FILE_NAME    = 0,   // introduces the name of a file id
+  TRACE_READ_PAGE    = 1,   // readPage pinned the page
+  TRACE_ALLOC_PAGE   = 2,   // allocPage created and pinned the page
+  TRACE_UNPIN        = 3,   // unPinPage, page clean
+  TRACE_UNPIN_DIRTY  = 4,   // unPinPage, page dirtied
+  TRACE_DISPOSE_PAGE = 5,   // disposePage
+  TRACE_FLUSH_FILE   = 6    // flushFile, page number is Page::INVALID_NUMBER
+};
+
+/**
+ * @brief One page access of a trace.
+ */
+struct BufTraceRecord
+{
+  /**
+   * Small integer standing for the file, see BufTraceReader::fileName().
+   */
+  std::uint32_t fileId;
+
+  /**
+   * Page accessed.
+   */
+  PageId pageNo;
+
+  /**
+   * What happened to the page.
+   */
+  BufTraceOp op;
+};
+
+/**
+ * @brief Writes a compact binary log of page accesses.
+ *
+ * A trace starts with the 8 byte magic "BDBTRC01".  Every access is then 9 bytes: the op, the
+ * file id and the page number, integers in host byte order.  The first access of a file is
+ * preceded by a TRACE_FILE_NAME entry: the op, the file id, a 16 bit length and the name.
+ * Entries are buffered and written out in large chunks.
+ */
+class BufTraceWriter
+{
+ public:
+  /**
+   * Create (or truncate) the trace file.
+   *
+   * @param path  Name of the trace file
+   * @throws BadTraceException  If the file cannot be created
+   */
+  explicit BufTraceWriter(const std::string &path);
+
+  /**
+   * Write out the buffered entries and close the trace.
+   */
+  ~BufTraceWriter();
+
+  /**
+   * Append an access.
+   *
+   * @param fileName  Name of the file accessed
+   * @param pageNo    Page accessed
+   * @param op        What happened to the page
+   */
+  void record(const std::string &fileName, PageId pageNo, BufTraceOp op);
+
+  /**
+   * Write out the buffered entries.
+   */
+  void flush();
+
+ private:
+  BufTraceWriter(const BufTraceWriter &);
+  BufTraceWriter &operator=(const BufTraceWriter &);
+
+  void append(const void *bytes, std::size_t len);
+
+  std::ofstream out;
+
+  /**
+   * Entries not written yet.
+   */
+  std::vector<char> buffer;
+
+  /**
+   * Id of every file seen so far.
+   */
+  std::unordered_map<std::string, std::uint32_t> fileIds;
+};
+
+/**
+ * @brief Reads back a trace written by BufTraceWriter.
+ */
+class BufTraceReader
+{
+ public:
+  /**
+   * Open a trace.
+   *
+   * @param path  Name of the trace file
+   * @throws BadTraceException  If the file cannot be opened or is not a trace
+   */
+  explicit BufTraceReader(const std::string &path);
+
+  /**
+   * Read the next access.
+   *
+   * @param record  Access returned via this reference
+   * @return        False at the end of the trace
+   * @throws BadTraceException  If the trace is truncated or corrupt
+   */
+  bool next(BufTraceRecord &record);
+
+  /**
+   * Returns the name of a file id seen so far.
+   */
+  const std::string &fileName(std::uint32_t fileId) const { return names[fileId]; }
+
+  /**
+   * Returns the number of file ids seen so far.
+   */
+  std::uint32_t numFiles() const { return names.size(); }
+
+ private:
+  std::string path;
+  std::ifstream in;
+  std::vector<std::string> names;
+};
+
+}
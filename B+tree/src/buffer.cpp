@@ -7,7 +7,12 @@
 
 #include <memory>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <new>
 #include "buffer.h"
+#include "wal.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
@@ -21,144 +26,359 @@ namespace badgerdb {
 //----------------------------------------
 
 BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+	: BufMgr(bufs, BufPoolOptions()) {
+}
+
+BufMgr::BufMgr(std::uint32_t bufs, const BufPoolOptions &options)
+	: numBufs(bufs), trace(NULL), log(NULL), numDirty(0), bgWriterRunning(false),
+	  bgLowDirtyRatio(0), bgHighDirtyRatio(1), bgPagesPerRound(0), bgIntervalMs(0) {
+	numNodes = (options.numaNodes == 0) ? PoolMemory::numNumaNodes() : options.numaNodes;
+	if (numNodes > bufs)
+		numNodes = bufs;
+
+	// binding sub-pools to nodes needs page aligned mappings rather than the heap
+	PoolBacking request = options.hugePages ? POOL_HUGETLB : (numNodes > 1 ? POOL_MMAP : POOL_HEAP);
+	descMemory = new PoolMemory(bufs * sizeof(BufDesc), request);
+	try
+	{
+		poolMemory = new PoolMemory(bufs * sizeof(Page), request);
+	}
+	catch (...)
+	{
+		delete descMemory;
+		throw;
+	}
 
+	bufDescTable = static_cast<BufDesc*>(descMemory->base());
   for (FrameId i = 0; i < bufs; i++) 
   {
+		new (&bufDescTable[i]) BufDesc();
   	bufDescTable[i].frameNo = i;
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+	// Split the frames into one run per node, starting every run on a huge page boundary
+	const std::uint32_t framesPerUnit = options.hugePages ? PoolMemory::HUGE_PAGE_SIZE / sizeof(Page) : 1;
+	std::uint32_t perNode = (bufs + numNodes - 1) / numNodes;
+	perNode = (perNode + framesPerUnit - 1) / framesPerUnit * framesPerUnit;
+	nodeFirstFrame.push_back(0);
+	while (nodeFirstFrame.back() < bufs)
+		nodeFirstFrame.push_back(std::min<std::uint64_t>((std::uint64_t)nodeFirstFrame.back() + perNode, bufs));
+	numNodes = nodeFirstFrame.size() - 1;
+	for (std::uint32_t node = 0; node < numNodes; node++)
+	{
+		nodeClockHand.push_back(nodeFirstFrame[node + 1] - 1);
+		nodeNumValid.push_back(0);
+		if (numNodes > 1)
+			poolMemory->bindToNode((std::size_t)nodeFirstFrame[node] * sizeof(Page),
+			                       (std::size_t)(nodeFirstFrame[node + 1] - nodeFirstFrame[node]) * sizeof(Page), node);
+	}
+
+	// first touch only after the policy is set
+  bufPool = static_cast<Page*>(poolMemory->base());
+  for (FrameId i = 0; i < bufs; i++)
+		new (&bufPool[i]) Page();
 
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  clockNode = 0;
+  clockHand = nodeClockHand[0];
 }
 
 
 BufMgr::~BufMgr() {
+  stopBackgroundWriter();
+  stopTrace();
+
   //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
-  {
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
-		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-  	}
-  }
+  std::vector<FrameId> frames;
+  collectDirtyFrames(frames, false);
+  for (std::size_t i = 0; i < frames.size(); i++)
+		writeFrame(frames[i], BUFOP_SHUTDOWN);
 
 	delete hashTable;
-  delete [] bufDescTable;
-  delete [] bufPool;
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+		bufDescTable[i].~BufDesc();
+		bufPool[i].~Page();
+  }
+  delete descMemory;
+  delete poolMemory;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(std::unique_lock<std::mutex> &lock, FrameId & frame, BufOp op) 
+{
+  FrameId victim;
+  while (true)
+  {
+    victim = pickVictim();
+    BufDesc& desc = bufDescTable[victim];
+    if (!desc.valid)
+      break;
+
+    // flush any existing changes to disk if necessary
+    if (desc.dirty)
+    {
+      if (!writeVictim(lock, victim, op))
+        continue;
+      metrics.count(op, BUFEVENT_DIRTY_EVICTION);
+      fileFrames[desc.file].counters.dirtyEvictions++;
+    }
+
+    // remove previous entry from hash table
+    hashTable->remove(desc.file, desc.pageNo);
+    metrics.count(op, BUFEVENT_EVICTION);
+    fileFrames[desc.file].counters.evictions++;
+    unlinkFrame(victim);
+    break;
+  }
+
+	//Reset all the BufDesc entry for the frame before returning the frame
+  bufDescTable[victim].Clear();
+
+  // return new frame number
+  frame = victim;
+} // end allocBuf
+
+FrameId BufMgr::pickVictim()
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
-  // Assumes non-concurrent access to buffer manager
+  // Called with the latch held
   std::uint32_t numScanned = 0;
   bool found = 0;
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
-  {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+  // While the background writer runs, skip over dirty victims and remember the first one
+  // in case no clean frame turns up
+  bool haveDirtyVictim = false;
+  FrameId dirtyVictim = 0;
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+  // Sweep the sub-pool of our own NUMA node first, then the others
+  std::uint32_t homeNode = 0;
+  if (numNodes > 1)
+  {
+    homeNode = PoolMemory::currentNumaNode() % numNodes;
+    // rather take a free frame on another node than evict a page on our own
+    for (std::uint32_t n = 0; n < numNodes; n++)
     {
-      break;
+      const std::uint32_t node = (homeNode + n) % numNodes;
+      if (nodeNumValid[node] < nodeFirstFrame[node + 1] - nodeFirstFrame[node])
+      {
+        homeNode = node;
+        break;
+      }
     }
+  }
+  for (std::uint32_t n = 0; n < numNodes && !found; n++)
+  {
+    clockNode = (homeNode + n) % numNodes;
+    clockHand = nodeClockHand[clockNode];
+    const std::uint32_t nodeBufs = nodeFirstFrame[clockNode + 1] - nodeFirstFrame[clockNode];
+    numScanned = 0;
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    while (numScanned < 2*nodeBufs)	//Need to scn twice
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // advance the clock
+      advanceClock();
+      numScanned++;
+
+      // if invalid, use frame
+      if (! bufDescTable[clockHand].valid)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
         found = true;
         break;
       }
+
+      // is valid, check referenced bit
+      if (! bufDescTable[clockHand].refbit)
+      {
+        // check to see if someone has it pinned
+        if (bufDescTable[clockHand].pinCnt == 0)
+        {
+          if (bgWriterRunning && bufDescTable[clockHand].dirty)
+          {
+            if (!haveDirtyVictim)
+            {
+              haveDirtyVictim = true;
+              dirtyVictim = clockHand;
+            }
+            continue;
+          }
+
+          // hasn't been referenced and is not pinned, use it
+          found = true;
+          break;
+        }
+      }
+      else
+      {
+        // has been referenced, clear the bit
+        bufDescTable[clockHand].refbit = false;
+      }
     }
-    else
-    {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
-    }
+    nodeClockHand[clockNode] = clockHand;
   }
-  
+
+  if (!found && haveDirtyVictim)
+  {
+    // every unpinned frame is dirty, the writer is falling behind
+    clockHand = dirtyVictim;
+    found = true;
+    bgWriterCond.notify_one();
+  }
+
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  if (!found)
   {
     throw BufferExceededException();
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  return clockHand;
+}
+
+bool BufMgr::writeVictim(std::unique_lock<std::mutex> &lock, FrameId frameNo, BufOp op)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  File* file = tmpbuf->file;
+  const PageId pageNo = tmpbuf->pageNo;
+
+  // The pin keeps the frame from being picked again, and the copy is what gets written, so a
+  // thread pinning the page in the meantime may change it.  A change marks the page dirty again.
+  const Page image(bufPool[frameNo]);
+  tmpbuf->pinCnt++;
+  unlinkDirty(frameNo);
+  tmpbuf->dirty = false;
+  numDirty--;
+  bufStats.diskwrites++;
+  metrics.count(op, BUFEVENT_WRITE);
+  fileFrames[file].counters.writes++;
+
+  lock.unlock();
+  try
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    // WAL rule: the log records of every change in the page go out before the page does
+    if (log != NULL)
+      log->flush(image.lsn());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> io(ioLatch);
+      file->writePage(pageNo, image);
+    }
+    metrics.recordWrite(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
   }
+  catch (...)
+  {
+    lock.lock();
+    if (tmpbuf->valid && tmpbuf->file == file && tmpbuf->pageNo == pageNo)
+    {
+      tmpbuf->pinCnt--;
+      if (!tmpbuf->dirty)
+        markDirty(frameNo);
+    }
+    throw;
+  }
+  lock.lock();
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
-
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  // the page may have been disposed of, and the frame given to another, while the latch was let go
+  if (!tmpbuf->valid || tmpbuf->file != file || tmpbuf->pageNo != pageNo)
+    return false;
+  tmpbuf->pinCnt--;
+  return tmpbuf->pinCnt == 0 && !tmpbuf->dirty;
+}
 
 	
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
+  page = &bufPool[pinFrame(file, pageNo)];
+}
+
+ReadPageGuard BufMgr::readPage(File* file, const PageId pageNo)
+{
+  const FrameId frameNo = pinFrame(file, pageNo);
+  return ReadPageGuard(this, file, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+WritePageGuard BufMgr::readPageForWrite(File* file, const PageId pageNo)
+{
+  const FrameId frameNo = pinFrame(file, pageNo);
+  return WritePageGuard(this, file, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::pinFrame(File* file, const PageId pageNo)
+{
+  std::unique_lock<std::mutex> lock(bufLatch);
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
+  bufStats.accesses++;
 	try
 	{
   	hashTable->lookup(file, pageNo, frameNo);
-
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    pinResident(frameNo);
   }
   catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
   {
     // alloc a new frame
-    allocBuf(frameNo);
+    allocBuf(lock, frameNo, BUFOP_READ_PAGE);
+
+    // another thread may have read the page in while a victim was written back; the frame just
+    // freed is left free then
+    FrameId resident;
+    try
+    {
+      hashTable->lookup(file, pageNo, resident);
+      pinResident(resident);
+      traceAccess(file, pageNo, TRACE_READ_PAGE);
+      return resident;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
 
     // read the page into the new frame
     bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> io(ioLatch);
+      file->readPageInto(pageNo, &bufPool[frameNo]);
+    }
+    metrics.recordRead(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
 
     // set up the entry properly
     bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    notePin(frameNo);
+    linkFrame(frameNo).counters.misses++;
 
     // insert in the hash table
     hashTable->insert(file, pageNo, frameNo);
+
+    metrics.count(BUFOP_READ_PAGE, BUFEVENT_MISS);
   }
+  traceAccess(file, pageNo, TRACE_READ_PAGE);
+  return frameNo;
 }
 
 
+void BufMgr::pinResident(FrameId frameNo)
+{
+  // set the referenced bit
+  bufDescTable[frameNo].refbit = true;
+  if (bufDescTable[frameNo].pinCnt == 0)
+    notePin(frameNo);
+  bufDescTable[frameNo].pinCnt++;
+  bufDescTable[frameNo].hits++;
+  metrics.count(BUFOP_READ_PAGE, BUFEVENT_HIT);
+}
+
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  std::lock_guard<std::mutex> guard(bufLatch);
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true && !bufDescTable[frameNo].dirty) markDirty(frameNo);
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
@@ -166,70 +386,371 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
   	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   }
   else bufDescTable[frameNo].pinCnt--;
+  traceAccess(file, pageNo, dirty ? TRACE_UNPIN_DIRTY : TRACE_UNPIN);
+}
+
+void BufMgr::unpinFrame(FrameId frameNo, File* file, PageId pageNo, bool dirty)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  // The frame may have been given to another page, if the guard's was disposed of or its pin
+  // already dropped some other way
+  BufDesc& desc = bufDescTable[frameNo];
+  if (!desc.valid || desc.file != file || desc.pageNo != pageNo || desc.pinCnt == 0)
+    throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+
+  if (dirty && !desc.dirty) markDirty(frameNo);
+  desc.pinCnt--;
+  traceAccess(desc.file, desc.pageNo, dirty ? TRACE_UNPIN_DIRTY : TRACE_UNPIN);
+}
+
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, ExtentClass extentClass) 
+{
+  page = &bufPool[allocFrame(file, pageNo, extentClass)];
+}
+
+WritePageGuard BufMgr::allocPage(File* file, PageId &pageNo, ExtentClass extentClass)
+{
+  const FrameId frameNo = allocFrame(file, pageNo, extentClass);
+  return WritePageGuard(this, file, frameNo, pageNo, &bufPool[frameNo]);
 }
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+FrameId BufMgr::allocFrame(File* file, PageId &pageNo, ExtentClass extentClass)
 {
+  std::unique_lock<std::mutex> lock(bufLatch);
   FrameId frameNo;
+  bufStats.accesses++;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  allocBuf(lock, frameNo, BUFOP_ALLOC_PAGE);
 
   // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  {
+    std::lock_guard<std::mutex> io(ioLatch);
+    file->allocatePageInto(pageNo, &bufPool[frameNo], extentClass);
+  }
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
+  notePin(frameNo);
+  linkFrame(frameNo);
 
   // insert in the hash table
   hashTable->insert(file, pageNo, frameNo);
+  traceAccess(file, pageNo, TRACE_ALLOC_PAGE);
+  return frameNo;
 }
 
 void BufMgr::flushFile(const File* file) 
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
+  std::lock_guard<std::mutex> guard(bufLatch);
+  traceAccess(file, Page::INVALID_NUMBER, TRACE_FLUSH_FILE);
+  {
+    std::lock_guard<std::mutex> io(ioLatch);
+    file->flushHeader();
+  }
+  std::unordered_map<const File*, FileFrames>::iterator it = fileFrames.find(file);
+  if (it == fileFrames.end())
+    return;
+
+  std::vector<FrameId> frames;
+  for (FrameId i = it->second.residentHead; i != INVALID_FRAME; i = bufDescTable[i].fileNext)
+    frames.push_back(i);
+
+  // Check everything first so that an error leaves the file's pages untouched
+  for (std::size_t i = 0; i < frames.size(); i++)
 	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
-
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
-
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
+  	BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+		if (tmpbuf->valid == false)
   		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+	  if (tmpbuf->pinCnt > 0)
+  		throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  }
+
+  sortFramesByPage(frames);
+  for (std::size_t i = 0; i < frames.size(); i++)
+	{
+  	BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+	  if (tmpbuf->dirty == true)
+		{
+			writeFrame(frames[i], BUFOP_FLUSH_FILE);
+    }
+
+    hashTable->remove(file,tmpbuf->pageNo);
+    unlinkFrame(frames[i]);
+    tmpbuf->Clear();
   }
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
+  std::lock_guard<std::mutex> guard(bufLatch);
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
 
 	// clear the page
+	unlinkFrame(frameNo);
 	bufDescTable[frameNo].Clear();
 
 	hashTable->remove(file, pageNo);
 
   // deallocate it in the file	
-  file->deletePage(pageNo);
+  {
+    std::lock_guard<std::mutex> io(ioLatch);
+    file->deletePage(pageNo);
+  }
+  traceAccess(file, pageNo, TRACE_DISPOSE_PAGE);
+}
+
+FileFrames& BufMgr::linkFrame(FrameId frameNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  FileFrames& lists = fileFrames[tmpbuf->file];
+  if (lists.numResident == 0)
+    lists.name = tmpbuf->file->filename();
+
+  tmpbuf->filePrev = INVALID_FRAME;
+  tmpbuf->fileNext = lists.residentHead;
+  if (lists.residentHead != INVALID_FRAME)
+    bufDescTable[lists.residentHead].filePrev = frameNo;
+  lists.residentHead = frameNo;
+  lists.numResident++;
+  nodeNumValid[nodeOf(frameNo)]++;
+  return lists;
+}
+
+void BufMgr::unlinkFrame(FrameId frameNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  if (tmpbuf->dirty)
+  {
+    unlinkDirty(frameNo);
+    tmpbuf->dirty = false;
+    numDirty--;
+  }
+
+  std::unordered_map<const File*, FileFrames>::iterator it = fileFrames.find(tmpbuf->file);
+  FileFrames& lists = it->second;
+  if (tmpbuf->filePrev != INVALID_FRAME)
+    bufDescTable[tmpbuf->filePrev].fileNext = tmpbuf->fileNext;
+  else
+    lists.residentHead = tmpbuf->fileNext;
+  if (tmpbuf->fileNext != INVALID_FRAME)
+    bufDescTable[tmpbuf->fileNext].filePrev = tmpbuf->filePrev;
+  tmpbuf->filePrev = tmpbuf->fileNext = INVALID_FRAME;
+  nodeNumValid[nodeOf(frameNo)]--;
+  lists.counters.hits += tmpbuf->hits;
+  tmpbuf->hits = 0;
+
+  if (--lists.numResident == 0)
+  {
+    metrics.retireFile(lists.name, lists.counters);
+    fileFrames.erase(it);
+  }
+}
+
+void BufMgr::unlinkDirty(FrameId frameNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  FileFrames& lists = fileFrames[tmpbuf->file];
+
+  if (tmpbuf->dirtyPrev != INVALID_FRAME)
+    bufDescTable[tmpbuf->dirtyPrev].dirtyNext = tmpbuf->dirtyNext;
+  else
+    lists.dirtyHead = tmpbuf->dirtyNext;
+  if (tmpbuf->dirtyNext != INVALID_FRAME)
+    bufDescTable[tmpbuf->dirtyNext].dirtyPrev = tmpbuf->dirtyPrev;
+  tmpbuf->dirtyPrev = tmpbuf->dirtyNext = INVALID_FRAME;
+  lists.numDirty--;
+}
+
+void BufMgr::collectDirtyFrames(std::vector<FrameId> &frames, bool unpinnedOnly)
+{
+  for (std::unordered_map<const File*, FileFrames>::iterator it = fileFrames.begin(); it != fileFrames.end(); ++it)
+  {
+    for (FrameId i = it->second.dirtyHead; i != INVALID_FRAME; i = bufDescTable[i].dirtyNext)
+    {
+      if (!unpinnedOnly || bufDescTable[i].pinCnt == 0)
+        frames.push_back(i);
+    }
+  }
+  sortFramesByPage(frames);
+}
+
+void BufMgr::markDirty(FrameId frameNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  FileFrames& lists = fileFrames[tmpbuf->file];
+
+  tmpbuf->dirty = true;
+  tmpbuf->dirtyPrev = INVALID_FRAME;
+  tmpbuf->dirtyNext = lists.dirtyHead;
+  if (lists.dirtyHead != INVALID_FRAME)
+    bufDescTable[lists.dirtyHead].dirtyPrev = frameNo;
+  lists.dirtyHead = frameNo;
+  lists.numDirty++;
+  numDirty++;
+
+  if (bgWriterRunning && numDirty > bgHighDirtyRatio * numBufs)
+    bgWriterCond.notify_one();
+}
+
+void BufMgr::notePin(FrameId frameNo)
+{
+  if (log != NULL && !bufDescTable[frameNo].dirty)
+    bufDescTable[frameNo].recLsn = log->getEndLsn();
+}
+
+void BufMgr::writeFrame(FrameId frameNo, BufOp op)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  // WAL rule: the log records of every change in the page go out before the page does
+  if (log != NULL)
+    log->flush(bufPool[frameNo].lsn());
+  bufStats.diskwrites++;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> io(ioLatch);
+    tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[frameNo]);
+  }
+  metrics.recordWrite(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  metrics.count(op, BUFEVENT_WRITE);
+  fileFrames[tmpbuf->file].counters.writes++;
+  unlinkDirty(frameNo);
+  tmpbuf->dirty = false;
+  numDirty--;
+}
+
+void BufMgr::sortFramesByPage(std::vector<FrameId> &frames)
+{
+  const BufDesc* table = bufDescTable;
+  std::sort(frames.begin(), frames.end(), [table](FrameId a, FrameId b) {
+    if (table[a].file != table[b].file)
+      return table[a].file < table[b].file;
+    return table[a].pageNo < table[b].pageNo;
+  });
+}
+
+void BufMgr::bgWriterLoop()
+{
+  std::unique_lock<std::mutex> lock(bufLatch);
+  while (bgWriterRunning)
+  {
+    bgWriterCond.wait_for(lock, std::chrono::milliseconds(bgIntervalMs));
+    if (!bgWriterRunning)
+      break;
+
+    if (numDirty <= bgHighDirtyRatio * numBufs)
+      continue;
+
+    while (bgWriterRunning && numDirty > bgLowDirtyRatio * numBufs)
+    {
+      std::vector<FrameId> frames;
+      collectDirtyFrames(frames, true);
+      if (frames.empty())
+        break;
+
+      std::uint32_t written = 0;
+      for (std::size_t i = 0; i < frames.size() && written < bgPagesPerRound; i++)
+      {
+        if (numDirty <= bgLowDirtyRatio * numBufs)
+          break;
+        writeFrame(frames[i], BUFOP_BG_WRITER);
+        written++;
+      }
+
+      // let foreground threads in between rounds
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
+    }
+  }
+}
+
+void BufMgr::startBackgroundWriter(double lowDirtyRatio, double highDirtyRatio,
+                                   std::uint32_t pagesPerRound, std::uint32_t intervalMs)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  if (bgWriterRunning)
+    return;
+
+  bgLowDirtyRatio = lowDirtyRatio;
+  bgHighDirtyRatio = highDirtyRatio < lowDirtyRatio ? lowDirtyRatio : highDirtyRatio;
+  bgPagesPerRound = pagesPerRound == 0 ? 1 : pagesPerRound;
+  bgIntervalMs = intervalMs == 0 ? 1 : intervalMs;
+  bgWriterRunning = true;
+  bgWriter = std::thread(&BufMgr::bgWriterLoop, this);
+}
+
+void BufMgr::stopBackgroundWriter()
+{
+  {
+    std::lock_guard<std::mutex> guard(bufLatch);
+    if (!bgWriterRunning)
+      return;
+    bgWriterRunning = false;
+  }
+  bgWriterCond.notify_all();
+  bgWriter.join();
+}
+
+std::uint32_t BufMgr::checkpoint(std::uint32_t pagesPerBatch)
+{
+  if (pagesPerBatch == 0)
+    pagesPerBatch = 1;
+
+  // The frames dirty right now are the extent of this checkpoint
+  std::vector<std::pair<File*, PageId> > targets;
+  {
+    std::lock_guard<std::mutex> guard(bufLatch);
+    std::vector<FrameId> frames;
+    collectDirtyFrames(frames, false);
+    for (std::size_t i = 0; i < frames.size(); i++)
+      targets.push_back(std::make_pair(bufDescTable[frames[i]].file, bufDescTable[frames[i]].pageNo));
+  }
+
+  std::uint32_t written = 0;
+  for (std::size_t batch = 0; batch < targets.size(); batch += pagesPerBatch)
+  {
+    std::lock_guard<std::mutex> guard(bufLatch);
+    for (std::size_t i = batch; i < targets.size() && i < batch + pagesPerBatch; i++)
+    {
+      FrameId frameNo;
+      try
+      {
+        hashTable->lookup(targets[i].first, targets[i].second, frameNo);
+      }
+      catch(const HashNotFoundException &e)
+      {
+        // evicted (and so written) since the checkpoint started
+        continue;
+      }
+
+      // a file that grew writes back its header with its pages
+      {
+        std::lock_guard<std::mutex> io(ioLatch);
+        targets[i].first->flushHeader();
+      }
+      if (bufDescTable[frameNo].dirty && bufDescTable[frameNo].pinCnt == 0)
+      {
+        writeFrame(frameNo, BUFOP_CHECKPOINT);
+        written++;
+      }
+    }
+  }
+  return written;
+}
+
+std::uint32_t BufMgr::getNumDirtyFrames()
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  return numDirty;
 }
 
 void BufMgr::printSelf(void) 
 {
+  std::lock_guard<std::mutex> guard(bufLatch);
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
@@ -244,6 +765,147 @@ void BufMgr::printSelf(void)
   }
 
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
+	metrics.dump(std::cout, liveFileCounters());
+}
+
+std::map<std::string, BufFileCounters> BufMgr::liveFileCounters()
+{
+  std::map<std::string, BufFileCounters> live;
+  for (std::unordered_map<const File*, FileFrames>::iterator it = fileFrames.begin(); it != fileFrames.end(); ++it)
+  {
+    BufFileCounters& counters = live[it->second.name];
+    counters.add(it->second.counters);
+    for (FrameId i = it->second.residentHead; i != INVALID_FRAME; i = bufDescTable[i].fileNext)
+      counters.hits += bufDescTable[i].hits;
+  }
+  return live;
+}
+
+BufFileCounters BufMgr::getFileCounters(const std::string &name)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  std::map<std::string, BufFileCounters> files = metrics.fileCounters(liveFileCounters());
+  std::map<std::string, BufFileCounters>::iterator it = files.find(name);
+  return (it == files.end()) ? BufFileCounters() : it->second;
+}
+
+void BufMgr::dumpMetrics(std::ostream &os)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  metrics.dump(os, liveFileCounters());
+}
+
+void BufMgr::startTrace(const std::string &path)
+{
+  BufTraceWriter *writer = new BufTraceWriter(path);
+  std::lock_guard<std::mutex> guard(bufLatch);
+  delete trace;
+  trace = writer;
+}
+
+void BufMgr::stopTrace()
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  delete trace;
+  trace = NULL;
+}
+
+void BufMgr::setLogManager(LogManager *logManager)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  log = logManager;
+}
+
+void BufMgr::clearMetrics()
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  metrics.clear();
+  for (std::unordered_map<const File*, FileFrames>::iterator it = fileFrames.begin(); it != fileFrames.end(); ++it)
+  {
+    it->second.counters = BufFileCounters();
+    for (FrameId i = it->second.residentHead; i != INVALID_FRAME; i = bufDescTable[i].fileNext)
+      bufDescTable[i].hits = 0;
+  }
+}
+
+void BufMgr::getDirtyPages(std::vector<DirtyPage> &pages)
+{
+  std::lock_guard<std::mutex> guard(bufLatch);
+  std::vector<FrameId> frames;
+  collectDirtyFrames(frames, false);
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    DirtyPage page;
+    page.fileName = fileFrames[bufDescTable[frames[i]].file].name;
+    page.pageNo = bufDescTable[frames[i]].pageNo;
+    page.recLsn = bufDescTable[frames[i]].recLsn;
+    pages.push_back(page);
+  }
+}
+
+std::uint32_t BufMgr::prefetchPages(File* file, const std::vector<PageId> &pageNos)
+{
+  std::vector<PageId> sorted(pageNos);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  std::unique_lock<std::mutex> lock(bufLatch);
+  std::vector<FrameId> loaded;
+  std::uint32_t read = 0;
+  for (std::size_t i = 0; i < sorted.size(); i++)
+  {
+    FrameId frameNo = 0;
+    try
+    {
+      hashTable->lookup(file, sorted[i], frameNo);
+      bufDescTable[frameNo].refbit = true;
+      metrics.count(BUFOP_PREFETCH, BUFEVENT_HIT);
+      continue;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+
+    // keep the pages of this batch from evicting each other: a victim from the batch means the pool is too small
+    try
+    {
+      allocBuf(lock, frameNo, BUFOP_PREFETCH);
+    }
+    catch(const BufferExceededException &e)
+    {
+      break;
+    }
+    if (std::find(loaded.begin(), loaded.end(), frameNo) != loaded.end())
+      break;
+
+    // read in by another thread while a victim was written back
+    FrameId resident;
+    try
+    {
+      hashTable->lookup(file, sorted[i], resident);
+      continue;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bufStats.diskreads++;
+    {
+      std::lock_guard<std::mutex> io(ioLatch);
+      file->readPageInto(sorted[i], &bufPool[frameNo]);
+    }
+    metrics.recordRead(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    bufDescTable[frameNo].Set(file, sorted[i]);
+    bufDescTable[frameNo].pinCnt = 0;
+    linkFrame(frameNo).counters.misses++;
+    hashTable->insert(file, sorted[i], frameNo);
+    loaded.push_back(frameNo);
+    read++;
+
+    metrics.count(BUFOP_PREFETCH, BUFEVENT_MISS);
+  }
+  return read;
 }
 
 }
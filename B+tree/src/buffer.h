@@ -9,7 +9,17 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "pool_memory.h"
+#include "buf_metrics.h"
+#include "buf_trace.h"
+#include "wal.h"
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 namespace badgerdb {
 
@@ -17,6 +27,13 @@ namespace badgerdb {
 * forward declaration of BufMgr class 
 */
 class BufMgr;
+class ReadPageGuard;
+class WritePageGuard;
+
+/**
+* @brief Frame number used to terminate the per-file frame lists
+*/
+const FrameId INVALID_FRAME = 0xFFFFFFFF;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
@@ -61,6 +78,27 @@ class BufDesc {
 	 */
   bool refbit;
 
+	/**
+   * Previous and next frame holding a page of the same file
+	 */
+  FrameId filePrev, fileNext;
+
+	/**
+   * Previous and next dirty frame holding a page of the same file
+	 */
+  FrameId dirtyPrev, dirtyNext;
+
+	/**
+   * Number of readPage hits on the page since it was brought in, folded into the file's counters when it leaves
+	 */
+  std::uint32_t hits;
+
+	/**
+   * End of the log when the page was last pinned while clean, so no logged change of the page
+   * since it was last written has a smaller LSN.  0 without a log.
+	 */
+  Lsn recLsn;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
@@ -72,6 +110,10 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+		filePrev = fileNext = INVALID_FRAME;
+		dirtyPrev = dirtyNext = INVALID_FRAME;
+		hits = 0;
+		recLsn = 0;
   };
 
 	/**
@@ -123,7 +165,7 @@ class BufDesc {
 struct BufStats
 {
 	/**
-   * Total number of accesses to buffer pool
+   * Total number of accesses to buffer pool (readPage and allocPage calls)
 	 */
   int accesses;
 
@@ -155,12 +197,93 @@ struct BufStats
 };
 
 
+/**
+* @brief Heads of the intrusive lists, threaded through BufDesc, of the frames holding pages of one file
+*/
+struct FileFrames
+{
+	/**
+   * First frame holding a page of the file
+	 */
+  FrameId residentHead;
+
+	/**
+   * First dirty frame holding a page of the file
+	 */
+  FrameId dirtyHead;
+
+	/**
+   * Number of frames holding a page of the file
+	 */
+  std::uint32_t numResident;
+
+	/**
+   * Number of dirty frames holding a page of the file
+	 */
+  std::uint32_t numDirty;
+
+	/**
+   * Name of the file, taken when its first page entered the pool
+	 */
+  std::string name;
+
+	/**
+   * Metrics of the file, not including the hits of the pages still resident
+	 */
+  BufFileCounters counters;
+
+  FileFrames()
+    : residentHead(INVALID_FRAME), dirtyHead(INVALID_FRAME), numResident(0), numDirty(0)
+  {
+  }
+};
+
+
+/**
+* @brief Options controlling how the memory of the buffer pool is allocated
+*/
+struct BufPoolOptions
+{
+	/**
+   * Back the frames with huge pages: MAP_HUGETLB if huge pages are reserved, transparent huge pages otherwise
+	 */
+  bool hugePages;
+
+	/**
+   * Number of NUMA sub-pools the frames are split into, 0 for one per node of the machine.
+   * Each sub-pool is bound to its node and has its own clock; a thread needing a frame sweeps the
+   * sub-pool of the node it runs on first.
+	 */
+  std::uint32_t numaNodes;
+
+  BufPoolOptions()
+    : hugePages(false), numaNodes(1)
+  {
+  }
+};
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The public methods serialize on a single latch, so one BufMgr may be shared by several scan workers.
+* Writing back an evicted dirty page is done with the latch let go, so hits are not held up by it.
+* A pinned page is never moved or evicted, so its contents may be read without holding the latch.
 */
 class BufMgr 
 {
  private:
+	/**
+   * Latch serializing access to the descriptor table, the hash table and the clock
+	 */
+  std::mutex bufLatch;
+
+	/**
+   * Latch serializing the file I/O of the pool, which may happen with bufLatch let go.  Taken
+   * after bufLatch if both are held.
+	 */
+  std::mutex ioLatch;
+
 	/**
    * Current position of clockhand in our buffer pool
 	 */
@@ -187,20 +310,270 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Per-operation counters and latency histograms
+	 */
+  BufMetrics metrics;
+
+	/**
+   * Page access trace being recorded, NULL when tracing is off
+	 */
+  BufTraceWriter *trace;
+
+	/**
+   * Write-ahead log a page is flushed up to before it is written back, NULL when there is none
+	 */
+  LogManager *log;
+
+	/**
+   * Append an access to the trace, if one is being recorded.  Called with the latch held.
+	 */
+  void traceAccess(const File* file, PageId pageNo, BufTraceOp op)
+  {
+		if (trace != NULL)
+			trace->record(file->filename(), pageNo, op);
+  }
+
+	/**
+   * Memory holding the descriptor table and the frames
+	 */
+  PoolMemory *descMemory, *poolMemory;
+
+	/**
+   * Number of NUMA sub-pools
+	 */
+  std::uint32_t numNodes;
+
+	/**
+   * Frames of sub-pool i are nodeFirstFrame[i] to nodeFirstFrame[i + 1] - 1
+	 */
+  std::vector<FrameId> nodeFirstFrame;
+
+	/**
+   * Saved clock hand of every sub-pool
+	 */
+  std::vector<FrameId> nodeClockHand;
+
+	/**
+   * Number of valid frames of every sub-pool
+	 */
+  std::vector<std::uint32_t> nodeNumValid;
+
+	/**
+   * Returns the sub-pool a frame belongs to
+	 */
+  std::uint32_t nodeOf(FrameId frameNo) const
+  {
+		return std::upper_bound(nodeFirstFrame.begin(), nodeFirstFrame.end(), frameNo) - nodeFirstFrame.begin() - 1;
+  }
+
+	/**
+   * Sub-pool the clock hand is currently sweeping
+	 */
+  std::uint32_t clockNode;
+
+	/**
+   * Advance clock to next frame in the current sub-pool of the buffer pool
 	 */
   void advanceClock()
   {
-		clockHand = (clockHand + 1) % numBufs;
+		clockHand = (clockHand + 1 == nodeFirstFrame[clockNode + 1]) ? nodeFirstFrame[clockNode] : clockHand + 1;
   }
 
 	/**
-	 * Allocate a free frame.  
+   * Number of valid frames whose dirty bit is set
+	 */
+  std::uint32_t numDirty;
+
+	/**
+   * Resident and dirty frame lists of every file with pages in the pool, so that flushing a file
+   * only touches that file's frames
+	 */
+  std::unordered_map<const File*, FileFrames> fileFrames;
+
+	/**
+   * Background writer thread, joinable while the writer runs
+	 */
+  std::thread bgWriter;
+
+	/**
+   * Signalled to wake the background writer up early or to stop it
+	 */
+  std::condition_variable bgWriterCond;
+
+	/**
+   * True while the background writer should keep running
+	 */
+  bool bgWriterRunning;
+
+	/**
+   * The writer stops trickling once the dirty frames drop to this fraction of the pool
+	 */
+  double bgLowDirtyRatio;
+
+	/**
+   * The writer starts trickling once the dirty frames exceed this fraction of the pool
+	 */
+  double bgHighDirtyRatio;
+
+	/**
+   * Maximum number of pages the writer writes before releasing the latch
+	 */
+  std::uint32_t bgPagesPerRound;
+
+	/**
+   * How long the writer sleeps between checks of the dirty ratio, in milliseconds
+	 */
+  std::uint32_t bgIntervalMs;
+
+	/**
+	 * Allocate a free frame, sweeping the sub-pool of the caller's NUMA node first, unless it is
+	 * full while another sub-pool still has invalid frames.
+	 * A dirty victim is written back with the latch let go, and passed over if it was pinned or
+	 * changed meanwhile.  Called with the latch held.
 	 *
+	 * @param lock    	Holder of the latch
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param op      	Operation the eviction, if any, is counted for
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(std::unique_lock<std::mutex> &lock, FrameId & frame, BufOp op);
+
+	/**
+	 * Run the clock to the next frame to allocate, invalid or unpinned and not referenced.
+	 * While the background writer runs, clean victims are preferred and a dirty victim is only
+	 * picked if every unpinned frame is dirty.
+	 *
+	 * @return        	Frame picked
+	 * @throws BufferExceededException If every frame is pinned
+	 */
+  FrameId pickVictim();
+
+	/**
+	 * Write a dirty victim back to its file with the latch let go.  The frame stays pinned and
+	 * a copy of the page is written, so it can neither be picked again nor be torn by a change.
+	 *
+	 * @param lock    	Holder of the latch, let go during the write
+	 * @param frameNo 	Frame to write
+	 * @param op      	Operation the write is counted for
+	 * @return        	True if the frame still holds the page, unpinned and clean, and may be evicted
+	 */
+  bool writeVictim(std::unique_lock<std::mutex> &lock, FrameId frameNo, BufOp op);
+
+	/**
+	 * Pin a frame found in the hash table, counting a hit
+	 *
+	 * @param frameNo 	Frame to pin
+	 */
+  void pinResident(FrameId frameNo);
+
+	/**
+	 * Add a frame which was just Set() to the resident list of its file.  Called with the latch held.
+	 *
+	 * @param frameNo 	Frame to link
+	 * @return        	The lists of the frame's file
+	 */
+  FileFrames& linkFrame(FrameId frameNo);
+
+	/**
+	 * Remove a valid frame from the lists of its file before it is cleared, discarding its dirty bit.
+	 * The file's counters are retired into the metrics once its last frame is gone.
+	 * Called with the latch held.
+	 *
+	 * @param frameNo 	Frame to unlink
+	 */
+  void unlinkFrame(FrameId frameNo);
+
+	/**
+	 * Remove a frame from the dirty list of its file.  Called with the latch held.
+	 *
+	 * @param frameNo 	Frame to unlink
+	 */
+  void unlinkDirty(FrameId frameNo);
+
+	/**
+	 * Collect the dirty frames of every file, sorted by file and page number.  Called with the latch held.
+	 *
+	 * @param frames        	Dirty frames returned via this vector
+	 * @param unpinnedOnly  	Leave out frames which are pinned
+	 */
+  void collectDirtyFrames(std::vector<FrameId> &frames, bool unpinnedOnly);
+
+	/**
+	 * Set the dirty bit of a frame, waking the background writer if the high dirty ratio is crossed.
+	 * Called with the latch held.
+	 *
+	 * @param frameNo 	Frame to mark dirty
+	 */
+  void markDirty(FrameId frameNo);
+
+	/**
+	 * Note a pin of a frame which was unpinned: if the page is clean, changes made from now on can
+	 * only get LSNs from the current end of the log on.  Called with the latch held.
+	 *
+	 * @param frameNo 	Frame being pinned
+	 */
+  void notePin(FrameId frameNo);
+
+	/**
+	 * Write a dirty frame back to its file and clear its dirty bit.  If a log is attached, the log
+	 * is first made durable up to the LSN stamped in the page.  Called with the latch held.
+	 *
+	 * @param frameNo 	Frame to write
+	 * @param op      	Operation the write is counted for
+	 */
+  void writeFrame(FrameId frameNo, BufOp op);
+
+	/**
+	 * Returns the counters of the files with pages in the pool, including the hits of their resident pages.
+	 * Called with the latch held.
+	 */
+  std::map<std::string, BufFileCounters> liveFileCounters();
+
+	/**
+	 * Sort frames by file and then page number, so that writing them in order is sequential per file.
+	 *
+	 * @param frames 	Frames to sort
+	 */
+  void sortFramesByPage(std::vector<FrameId> &frames);
+
+	/**
+	 * Pin a page, reading it into a frame if it is not resident.  Takes the latch.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return       	Frame holding the page
+	 */
+  FrameId pinFrame(File* file, const PageId pageNo);
+
+	/**
+	 * Allocate a new page in the file and pin it in a frame.  Takes the latch.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  The number assigned to the page in the file is returned via this reference.
+	 * @param extentClass	Class of page, whose extent the page is taken from
+	 * @return       	Frame holding the page
+	 */
+  FrameId allocFrame(File* file, PageId &pageNo, ExtentClass extentClass);
+
+	/**
+	 * Unpin the page in a frame without looking it up.  Takes the latch.
+	 *
+	 * @param frameNo 	Frame holding the page
+	 * @param file   	File object of the page the guard holds
+	 * @param pageNo  	Page number of the page the guard holds
+	 * @param dirty		True if the page needs to be marked dirty
+	 * @throws  PageNotPinnedException If the frame no longer holds that page, or it is not pinned
+	 */
+  void unpinFrame(FrameId frameNo, File* file, PageId pageNo, bool dirty);
+
+	friend class PageGuard;
+
+	/**
+	 * Body of the background writer thread.  Whenever the dirty ratio exceeds the high mark it
+	 * writes unpinned dirty frames in (file, page number) order until the low mark is reached,
+	 * releasing the latch every bgPagesPerRound pages.
+	 */
+  void bgWriterLoop();
 
  public:
 	/**
@@ -212,6 +585,14 @@ class BufMgr
    * Constructor of BufMgr class
 	 */
   BufMgr(std::uint32_t bufs);
+
+	/**
+   * Constructor of BufMgr class
+	 *
+	 * @param bufs     	Number of frames
+	 * @param options  	How to allocate the memory of the pool
+	 */
+  BufMgr(std::uint32_t bufs, const BufPoolOptions &options);
 	
 	/**
    * Destructor of BufMgr class
@@ -229,6 +610,25 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Reads the given page like readPage(file, PageNo, page) and returns a guard that unpins it,
+	 * without looking it up again, when it goes out of scope.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @return       	Read guard of the page, which is unpinned clean
+	 */
+  ReadPageGuard readPage(File* file, const PageId PageNo);
+
+	/**
+	 * Reads the given page like readPage(file, PageNo), for a caller that is going to change it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @return       	Write guard of the page, which is unpinned dirty
+	 */
+  WritePageGuard readPageForWrite(File* file, const PageId PageNo);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -246,13 +646,27 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param extentClass	Class of page, whose extent the page is taken from
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, ExtentClass extentClass = EXTENT_DEFAULT);
+
+	/**
+	 * Allocates a new, empty page in the file like allocPage(file, PageNo, page, extentClass) and
+	 * returns a guard that unpins it when it goes out of scope.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param extentClass	Class of page, whose extent the page is taken from
+	 * @return       	Write guard of the page, which is unpinned dirty
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  WritePageGuard allocPage(File* file, PageId &PageNo, ExtentClass extentClass = EXTENT_DEFAULT);
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, in page number order, and evicts the file's pages from the pool.
+	 * The file header is written back as well.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned, before any page has been written or evicted.
+	 * Only the frames holding pages of the file are visited.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
@@ -270,6 +684,54 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Start a background thread which trickles dirty frames to disk, so that frames are usually
+	 * clean by the time allocBuf picks them as victims.  The writer wakes up when the number of
+	 * dirty frames exceeds highDirtyRatio of the pool (or every intervalMs) and writes unpinned
+	 * dirty frames in page-number order until at most lowDirtyRatio of the pool is dirty.
+	 * Does nothing if the writer is already running.
+	 *
+	 * @param lowDirtyRatio   	Fraction of dirty frames at which the writer stops
+	 * @param highDirtyRatio  	Fraction of dirty frames at which the writer starts
+	 * @param pagesPerRound   	Pages written before the writer releases the latch
+	 * @param intervalMs      	Time between checks of the dirty ratio, in milliseconds
+	 */
+  void startBackgroundWriter(double lowDirtyRatio = 0.1, double highDirtyRatio = 0.3,
+                             std::uint32_t pagesPerRound = 32, std::uint32_t intervalMs = 20);
+
+	/**
+	 * Stop the background writer and wait for it to exit.  Does nothing if it is not running.
+	 */
+  void stopBackgroundWriter();
+
+	/**
+	 * Fuzzy, incremental checkpoint.  The set of frames that are dirty when the call starts is
+	 * written back in (file, page number) order, pagesPerBatch pages at a time, releasing the latch
+	 * between batches so that other threads keep making progress.  Frames dirtied after the call
+	 * started are left for the next checkpoint, and so are frames that are pinned when their turn
+	 * comes.  Unlike flushFile nothing is evicted and pinned pages are not an error.  The headers of
+	 * the files the pages belong to are written back too.
+	 *
+	 * @param pagesPerBatch  	Pages written per latch acquisition
+	 * @return            	Number of pages written
+	 */
+  std::uint32_t checkpoint(std::uint32_t pagesPerBatch = 32);
+
+	/**
+   * Returns the number of valid frames whose dirty bit is set.
+	 */
+  std::uint32_t getNumDirtyFrames();
+
+	/**
+	 * Returns how the frames of the pool are backed.
+	 */
+  PoolBacking getPoolBacking() const { return poolMemory->backing(); }
+
+	/**
+	 * Returns the number of NUMA sub-pools the frames are split into.
+	 */
+  std::uint32_t getNumNumaNodes() const { return numNodes; }
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
@@ -289,6 +751,241 @@ class BufMgr
   {
 		bufStats.clear();
   }
+
+	/**
+   * Get the per-operation counters and latency histograms
+	 */
+  const BufMetrics & getMetrics() const
+  {
+		return metrics;
+  }
+
+	/**
+   * Returns the counters of a file, whether or not it still has pages in the pool.
+	 *
+	 * @param name  	Name of the file
+	 */
+  BufFileCounters getFileCounters(const std::string &name);
+
+	/**
+   * Print the hit ratio, the per-operation and per-file counters and the latency percentiles.
+	 *
+	 * @param os    	Stream to print to
+	 */
+  void dumpMetrics(std::ostream &os);
+
+	/**
+   * Reset the per-operation and per-file counters and the latency histograms
+	 */
+  void clearMetrics();
+
+	/**
+   * Start logging every pin, unpin, dispose and flush to a binary trace file, for replay by the
+   * buf_replay tool.  A trace already being recorded is closed first.
+	 *
+	 * @param path  	Name of the trace file, created or truncated
+	 * @throws BadTraceException If the file cannot be created
+	 */
+  void startTrace(const std::string &path);
+
+	/**
+   * Stop tracing and close the trace file.  Does nothing if no trace is being recorded.
+	 */
+  void stopTrace();
+
+	/**
+   * Attach a write-ahead log.  From then on no dirty page is written back, whether evicted,
+   * flushed or checkpointed, before the log is durable up to the LSN stamped in its header.
+   * The log is not owned by the buffer manager and has to outlive it, or be detached first.
+	 *
+	 * @param logManager  	Log to enforce, NULL to detach
+	 */
+  void setLogManager(LogManager *logManager);
+
+	/**
+   * Returns the attached write-ahead log, NULL if there is none.
+	 */
+  LogManager *getLogManager() const { return log; }
+
+	/**
+   * Returns the dirty page table for a checkpoint: every dirty page with the smallest LSN a change
+   * of it missing on disk can have.
+	 *
+	 * @param pages  	Dirty pages returned via this vector
+	 */
+  void getDirtyPages(std::vector<DirtyPage> &pages);
+
+	/**
+   * Read pages of a file into the pool ahead of their use, in page number order and holding the
+   * latch except while a victim is written back, leaving them unpinned.  Pages already resident are only referenced.
+   * Stops early rather than evicting a page prefetched by the same call.
+	 *
+	 * @param file    	File object
+	 * @param pageNos 	Pages to read
+	 * @return        	Number of pages read from the file
+	 */
+  std::uint32_t prefetchPages(File* file, const std::vector<PageId> &pageNos);
+};
+
+
+/**
+* @brief Pin of a page in the buffer pool, released when the guard goes out of scope
+*
+* A guard remembers the frame the page is in, so releasing it is O(1) instead of a lookup in the
+* hash table, and a page is never left pinned when an exception unwinds past its guard.  Guards
+* can be moved, but not copied; a moved-from or released guard holds nothing.
+*/
+class PageGuard
+{
+ public:
+	/**
+   * Constructs a guard holding nothing
+	 */
+  PageGuard()
+    : bufMgr(NULL), file(NULL), frameNo(INVALID_FRAME), pageNo(Page::INVALID_NUMBER), page(NULL), dirty(false)
+  {
+  }
+
+  PageGuard(PageGuard &&other)
+    : bufMgr(other.bufMgr), file(other.file), frameNo(other.frameNo), pageNo(other.pageNo), page(other.page),
+      dirty(other.dirty)
+  {
+		other.page = NULL;
+  }
+
+  PageGuard &operator=(PageGuard &&other)
+  {
+		if (this != &other)
+		{
+			release();
+			bufMgr = other.bufMgr;
+			file = other.file;
+			frameNo = other.frameNo;
+			pageNo = other.pageNo;
+			page = other.page;
+			dirty = other.dirty;
+			other.page = NULL;
+		}
+		return *this;
+  }
+
+  PageGuard(const PageGuard &) = delete;
+  PageGuard &operator=(const PageGuard &) = delete;
+
+	/**
+   * Unpins the page.  A guard whose pin was dropped behind its back is a bug in the caller; the
+   * exception release() throws for it cannot leave a destructor and terminates the program.
+	 */
+  ~PageGuard()
+  {
+		release();
+  }
+
+	/**
+   * Unpin the page now.  Does nothing if the guard holds nothing.
+	 *
+	 * @throws  PageNotPinnedException If the page is no longer pinned in the frame the guard holds
+	 */
+  void release()
+  {
+		if (page != NULL)
+		{
+			page = NULL;
+			bufMgr->unpinFrame(frameNo, file, pageNo, dirty);
+		}
+  }
+
+	/**
+   * Returns true if the guard holds a pinned page
+	 */
+  bool valid() const { return page != NULL; }
+
+	/**
+   * Returns the number of the page in its file
+	 */
+  PageId getPageNo() const { return pageNo; }
+
+	/**
+   * Returns the frame holding the page
+	 */
+  FrameId getFrameNo() const { return frameNo; }
+
+ protected:
+  PageGuard(BufMgr *bufMgrIn, File *fileIn, FrameId frame, PageId pageNum, Page *pagePtr, bool dirtyOnRelease)
+    : bufMgr(bufMgrIn), file(fileIn), frameNo(frame), pageNo(pageNum), page(pagePtr), dirty(dirtyOnRelease)
+  {
+  }
+
+  BufMgr *bufMgr;
+  File *file;
+  FrameId frameNo;
+  PageId pageNo;
+  Page *page;
+
+	/**
+   * Whether the page is marked dirty when it is unpinned
+	 */
+  bool dirty;
+};
+
+
+/**
+* @brief Guard of a page that is only read, unpinned clean
+*/
+class ReadPageGuard : public PageGuard
+{
+ public:
+  ReadPageGuard() {}
+
+	/**
+   * Returns the page
+	 */
+  const Page *get() const { return page; }
+  const Page *operator->() const { return page; }
+
+	/**
+   * Returns the page cast to the layout it holds, e.g. a B+ tree node
+	 */
+  template <class T>
+  const T *as() const { return reinterpret_cast<const T *>(page); }
+
+ private:
+  ReadPageGuard(BufMgr *bufMgrIn, File *fileIn, FrameId frame, PageId pageNum, Page *pagePtr)
+    : PageGuard(bufMgrIn, fileIn, frame, pageNum, pagePtr, false)
+  {
+  }
+
+  friend class BufMgr;
+};
+
+
+/**
+* @brief Guard of a page that is changed, unpinned dirty
+*/
+class WritePageGuard : public PageGuard
+{
+ public:
+  WritePageGuard() {}
+
+	/**
+   * Returns the page
+	 */
+  Page *get() const { return page; }
+  Page *operator->() const { return page; }
+
+	/**
+   * Returns the page cast to the layout it holds, e.g. a B+ tree node
+	 */
+  template <class T>
+  T *as() const { return reinterpret_cast<T *>(page); }
+
+ private:
+  WritePageGuard(BufMgr *bufMgrIn, File *fileIn, FrameId frame, PageId pageNum, Page *pagePtr)
+    : PageGuard(bufMgrIn, fileIn, frame, pageNum, pagePtr, true)
+  {
+  }
+
+  friend class BufMgr;
 };
 
 }
@@ -0,0 +1,615 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "ebay_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include "ebay_schema.h"
+#include "json_sax.h"
+#include "page.h"
+#include "parallel.h"
+#include "exceptions/bad_json_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+static const char *const TABLE_SUFFIXES[EBAY_NUM_TABLES] = {"Item", "Bid", "User", "Category"};
+
+/**
+ * An optional string field of the JSON.
+ */
+struct JsonField
+{
+	std::string value;
+	bool present;
+
+	void clear() { value.clear(); present = false; }
+	void assign(const char *s, std::size_t len) { value.assign(s, len); present = true; }
+};
+
+/**
+ * Bidder and amount of one bid, as read.
+ */
+struct EbayBid
+{
+	JsonField userId, rating, location, country, time, amount;
+
+	void clear()
+	{
+		userId.clear(); rating.clear(); location.clear(); country.clear(); time.clear(); amount.clear();
+	}
+};
+
+/**
+ * Everything about one item, as read.
+ */
+struct EbayItem
+{
+	JsonField itemId, name, currently, buyPrice, firstBid, numberOfBids, location, country;
+	JsonField started, ends, sellerId, sellerRating, description;
+	std::vector<std::string> categories;
+	std::vector<EbayBid> bids;
+	std::size_t numBids;
+
+	void clear()
+	{
+		itemId.clear(); name.clear(); currently.clear(); buyPrice.clear(); firstBid.clear();
+		numberOfBids.clear(); location.clear(); country.clear(); started.clear(); ends.clear();
+		sellerId.clear(); sellerRating.clear(); description.clear();
+		categories.clear();
+		numBids = 0;
+	}
+};
+
+/**
+ * Days from 1970-01-01 to a date of the proleptic Gregorian calendar.
+ */
+static std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day)
+{
+	year -= month <= 2;
+	const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+	const unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+/**
+ * @brief Pages one worker fills for one relation.  Pages are allocated and written back under the
+ * lock of the relation; records go in between without any.
+ */
+class EbayPageAppender
+{
+ public:
+	EbayPageAppender(EbayLoader *ebayLoader, EbayTable ebayTable)
+		: loader(ebayLoader), table(ebayTable), pageNo(Page::INVALID_NUMBER), records(0)
+	{
+	}
+
+	void append(const std::string &record)
+	{
+		if (pageNo != Page::INVALID_NUMBER && !page.hasSpaceForRecord(record))
+			flush();
+		if (pageNo == Page::INVALID_NUMBER)
+		{
+			std::lock_guard<std::mutex> guard(loader->relationLatches[table]);
+			page = loader->relations[table]->allocatePage(pageNo);
+		}
+		page.insertRecord(record);
+		records++;
+	}
+
+	/**
+	 * Write the page being filled back to the relation.
+	 */
+	void flush()
+	{
+		if (pageNo == Page::INVALID_NUMBER)
+			return;
+		std::lock_guard<std::mutex> guard(loader->relationLatches[table]);
+		loader->relations[table]->writePage(pageNo, page);
+		pageNo = Page::INVALID_NUMBER;
+	}
+
+	EbayLoader *loader;
+	EbayTable table;
+	Page page;
+	PageId pageNo;
+	std::uint64_t records;
+};
+
+/**
+ * @brief Collects the items of a document from the parser's events and stores the rows of each
+ * as soon as it ends.
+ */
+class EbayItemCollector : public JsonHandler
+{
+ public:
+	EbayItemCollector(EbayLoader *ebayLoader)
+		: truncatedDescriptions(0), loader(ebayLoader)
+	{
+		for (int table = 0; table < EBAY_NUM_TABLES; table++)
+			appenders.push_back(EbayPageAppender(loader, static_cast<EbayTable>(table)));
+	}
+
+	/**
+	 * Start on a new document.
+	 */
+	void startDocument(const std::string &name)
+	{
+		document = name;
+		contexts.clear();
+	}
+
+	/**
+	 * Write back every page being filled.
+	 */
+	void flush()
+	{
+		for (std::size_t i = 0; i < appenders.size(); i++)
+			appenders[i].flush();
+	}
+
+	std::uint64_t records(EbayTable table) const { return appenders[table].records; }
+
+	void startObject()
+	{
+		Context context = IGNORE;
+		if (contexts.empty())
+			context = ROOT;
+		else if (contexts.back() == ITEMS)
+		{
+			context = ITEM;
+			item.clear();
+		}
+		else if (contexts.back() == ITEM && currentKey == "Seller")
+			context = SELLER;
+		else if (contexts.back() == BIDS)
+			context = BID_WRAPPER;
+		else if (contexts.back() == BID_WRAPPER && currentKey == "Bid")
+		{
+			context = BID;
+			if (item.numBids == item.bids.size())
+				item.bids.push_back(EbayBid());
+			item.bids[item.numBids].clear();
+		}
+		else if (contexts.back() == BID && currentKey == "Bidder")
+			context = BIDDER;
+		contexts.push_back(context);
+	}
+
+	void endObject()
+	{
+		const Context context = contexts.back();
+		contexts.pop_back();
+		if (context == ITEM)
+			storeItem();
+		else if (context == BID)
+			item.numBids++;
+	}
+
+	void startArray()
+	{
+		Context context = IGNORE;
+		if (contexts.empty())
+			fail("expected an object at the top level");
+		else if (contexts.back() == ROOT && currentKey == "Items")
+			context = ITEMS;
+		else if (contexts.back() == ITEM && currentKey == "Category")
+			context = CATEGORIES;
+		else if (contexts.back() == ITEM && currentKey == "Bids")
+			context = BIDS;
+		contexts.push_back(context);
+	}
+
+	void endArray()
+	{
+		contexts.pop_back();
+	}
+
+	void key(const char *s, std::size_t len)
+	{
+		currentKey.assign(s, len);
+	}
+
+	void string(const char *s, std::size_t len)
+	{
+		if (contexts.empty())
+			fail("expected an object at the top level");
+		JsonField *field = NULL;
+		switch (contexts.back())
+		{
+			case ITEM:
+				field = itemField();
+				break;
+			case CATEGORIES:
+				item.categories.push_back(std::string(s, len));
+				break;
+			case SELLER:
+				if (currentKey == "UserID")
+					field = &item.sellerId;
+				else if (currentKey == "Rating")
+					field = &item.sellerRating;
+				break;
+			case BID:
+				if (currentKey == "Time")
+					field = &item.bids[item.numBids].time;
+				else if (currentKey == "Amount")
+					field = &item.bids[item.numBids].amount;
+				break;
+			case BIDDER:
+			{
+				EbayBid &bid = item.bids[item.numBids];
+				if (currentKey == "UserID")
+					field = &bid.userId;
+				else if (currentKey == "Rating")
+					field = &bid.rating;
+				else if (currentKey == "Location")
+					field = &bid.location;
+				else if (currentKey == "Country")
+					field = &bid.country;
+				break;
+			}
+			default:
+				break;
+		}
+		if (field != NULL)
+			field->assign(s, len);
+	}
+
+	// The dataset writes its numbers as strings; real ones are taken the same way
+	void number(const char *s, std::size_t len)
+	{
+		string(s, len);
+	}
+
+	void boolean(bool value)
+	{
+		if (contexts.empty())
+			fail("expected an object at the top level");
+	}
+
+	void null()
+	{
+		if (contexts.empty())
+			fail("expected an object at the top level");
+	}
+
+	/**
+	 * Descriptions cut short so far.
+	 */
+	std::uint64_t truncatedDescriptions;
+
+ private:
+	/**
+	 * Container being read: which part of the dataset it is, or IGNORE for one not stored.
+	 */
+	enum Context {
+		ROOT,
+		ITEMS,
+		ITEM,
+		CATEGORIES,
+		SELLER,
+		BIDS,
+		BID_WRAPPER,
+		BID,
+		BIDDER,
+		IGNORE
+	};
+
+	void fail(const std::string &reason) const
+	{
+		throw BadJsonException(document, reason);
+	}
+
+	JsonField *itemField()
+	{
+		switch (currentKey.empty() ? 0 : currentKey[0])
+		{
+			case 'B': return (currentKey == "Buy_Price") ? &item.buyPrice : NULL;
+			case 'C':
+				if (currentKey == "Currently")
+					return &item.currently;
+				return (currentKey == "Country") ? &item.country : NULL;
+			case 'D': return (currentKey == "Description") ? &item.description : NULL;
+			case 'E': return (currentKey == "Ends") ? &item.ends : NULL;
+			case 'F': return (currentKey == "First_Bid") ? &item.firstBid : NULL;
+			case 'I': return (currentKey == "ItemID") ? &item.itemId : NULL;
+			case 'L': return (currentKey == "Location") ? &item.location : NULL;
+			case 'N':
+				if (currentKey == "Name")
+					return &item.name;
+				return (currentKey == "Number_of_Bids") ? &item.numberOfBids : NULL;
+			case 'S': return (currentKey == "Started") ? &item.started : NULL;
+			default: return NULL;
+		}
+	}
+
+	std::int32_t parseInt(const JsonField &field, const char *what) const
+	{
+		char *end;
+		const long value = strtol(field.value.c_str(), &end, 10);
+		if (!field.present || field.value.empty() || *end != '\0' || value < INT32_MIN || value > INT32_MAX)
+			fail(std::string("bad ") + what + " \"" + field.value + "\" of item " + item.itemId.value);
+		return static_cast<std::int32_t>(value);
+	}
+
+	// "$3,453.23"
+	double parseMoney(const JsonField &field, const char *what) const
+	{
+		char digits[64];
+		std::size_t len = 0;
+		for (std::size_t i = 0; i < field.value.size() && len + 1 < sizeof(digits); i++)
+		{
+			const char c = field.value[i];
+			if (c != '$' && c != ',')
+				digits[len++] = c;
+		}
+		digits[len] = '\0';
+		char *end;
+		const double value = strtod(digits, &end);
+		if (!field.present || len == 0 || *end != '\0')
+			fail(std::string("bad ") + what + " \"" + field.value + "\" of item " + item.itemId.value);
+		return value;
+	}
+
+	// "Dec-03-01 18:10:40"
+	std::int64_t parseTime(const JsonField &field, const char *what) const
+	{
+		static const char *const MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+		const std::string &s = field.value;
+		unsigned month = 0;
+		for (unsigned m = 0; m < 12 && s.size() >= 3; m++)
+			if (memcmp(s.data(), MONTHS + 3 * m, 3) == 0)
+				month = m + 1;
+		int day, year, hour, minute, second;
+		char tail;
+		if (!field.present || month == 0 ||
+		    sscanf(s.c_str() + 3, "-%2d-%2d %2d:%2d:%2d%c", &day, &year, &hour, &minute, &second, &tail) != 5)
+			fail(std::string("bad ") + what + " \"" + s + "\" of item " + item.itemId.value);
+		return daysFromCivil(2000 + year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	}
+
+	void storeUser(const JsonField &userId, const JsonField &rating, const JsonField &location,
+	               const JsonField &country)
+	{
+		if (!userId.present)
+			fail("user without UserID in item " + item.itemId.value);
+		if (!loader->claimUser(userId.value))
+			return;
+		user.clear();
+		user.set<UserSchema::USER_ID>(userId.value);
+		user.set<UserSchema::RATING>(parseInt(rating, "Rating"));
+		if (location.present)
+			user.set<UserSchema::LOCATION>(location.value);
+		else
+			user.setNull<UserSchema::LOCATION>();
+		if (country.present)
+			user.set<UserSchema::COUNTRY>(country.value);
+		else
+			user.setNull<UserSchema::COUNTRY>();
+		user.encode(record);
+		appenders[EBAY_USER].append(record);
+	}
+
+	void storeItem()
+	{
+		const std::int32_t itemId = parseInt(item.itemId, "ItemID");
+		if (!item.name.present || !item.sellerId.present)
+			fail("item " + item.itemId.value + " without Name or Seller");
+
+		// Item, with as much of the description as fits in a page
+		itemRecord.clear();
+		itemRecord.set<ItemSchema::ITEM_ID>(itemId);
+		itemRecord.set<ItemSchema::NAME>(item.name.value);
+		itemRecord.set<ItemSchema::CURRENTLY>(parseMoney(item.currently, "Currently"));
+		if (item.buyPrice.present)
+			itemRecord.set<ItemSchema::BUY_PRICE>(parseMoney(item.buyPrice, "Buy_Price"));
+		else
+			itemRecord.setNull<ItemSchema::BUY_PRICE>();
+		itemRecord.set<ItemSchema::FIRST_BID>(parseMoney(item.firstBid, "First_Bid"));
+		itemRecord.set<ItemSchema::NUMBER_OF_BIDS>(parseInt(item.numberOfBids, "Number_of_Bids"));
+		itemRecord.set<ItemSchema::STARTED>(parseTime(item.started, "Started"));
+		itemRecord.set<ItemSchema::ENDS>(parseTime(item.ends, "Ends"));
+		itemRecord.set<ItemSchema::SELLER_ID>(item.sellerId.value);
+		const std::size_t fixedSize = itemRecord.size();
+		std::string &description = item.description.value;
+		if (fixedSize + description.size() > EbayLoader::maxRecordSize())
+		{
+			if (fixedSize > EbayLoader::maxRecordSize())
+				fail("item " + item.itemId.value + " does not fit in a page");
+			std::size_t keep = EbayLoader::maxRecordSize() - fixedSize;
+			while (keep > 0 && (static_cast<unsigned char>(description[keep]) & 0xc0) == 0x80)
+				keep--;
+			description.resize(keep);
+			truncatedDescriptions++;
+		}
+		if (item.description.present)
+			itemRecord.set<ItemSchema::DESCRIPTION>(description);
+		else
+			itemRecord.setNull<ItemSchema::DESCRIPTION>();
+		itemRecord.encode(record);
+		appenders[EBAY_ITEM].append(record);
+
+		// Categories, each once
+		std::sort(item.categories.begin(), item.categories.end());
+		item.categories.erase(std::unique(item.categories.begin(), item.categories.end()), item.categories.end());
+		for (std::size_t i = 0; i < item.categories.size(); i++)
+		{
+			category.clear();
+			category.set<CategorySchema::ITEM_ID>(itemId);
+			category.set<CategorySchema::CATEGORY_NAME>(item.categories[i]);
+			category.encode(record);
+			appenders[EBAY_CATEGORY].append(record);
+		}
+
+		// The seller is located where the item is
+		storeUser(item.sellerId, item.sellerRating, item.location, item.country);
+
+		for (std::size_t i = 0; i < item.numBids; i++)
+		{
+			const EbayBid &bid = item.bids[i];
+			if (!bid.userId.present)
+				fail("bid without Bidder in item " + item.itemId.value);
+			bidRecord.clear();
+			bidRecord.set<BidSchema::ITEM_ID>(itemId);
+			bidRecord.set<BidSchema::BIDDER_ID>(bid.userId.value);
+			bidRecord.set<BidSchema::TIME>(parseTime(bid.time, "Time"));
+			bidRecord.set<BidSchema::AMOUNT>(parseMoney(bid.amount, "Amount"));
+			bidRecord.encode(record);
+			appenders[EBAY_BID].append(record);
+
+			storeUser(bid.userId, bid.rating, bid.location, bid.country);
+		}
+	}
+
+	EbayLoader *loader;
+
+	/**
+	 * Name of the document, for errors.
+	 */
+	std::string document;
+
+	/**
+	 * Open containers, innermost last.
+	 */
+	std::vector<Context> contexts;
+
+	/**
+	 * Name of the member whose value comes next.
+	 */
+	std::string currentKey;
+
+	/**
+	 * Item being read.  Bids are reused between items, so that reading one does not allocate.
+	 */
+	EbayItem item;
+
+	/**
+	 * Records being encoded, one builder per relation.
+	 */
+	RecordBuilder<ItemSchema> itemRecord;
+	RecordBuilder<BidSchema> bidRecord;
+	RecordBuilder<UserSchema> user;
+	RecordBuilder<CategorySchema> category;
+	std::string record;
+
+	/**
+	 * One page appender per relation.
+	 */
+	std::vector<EbayPageAppender> appenders;
+};
+
+EbayLoader::EbayLoader(const std::string &relationPrefix)
+{
+	for (int table = 0; table < EBAY_NUM_TABLES; table++)
+	{
+		names[table] = relationPrefix + TABLE_SUFFIXES[table];
+		try
+		{
+			File::remove(names[table]);
+		}
+		catch(const FileNotFoundException &)
+		{
+		}
+		relations[table] = new PageFile(names[table], true);
+	}
+}
+
+EbayLoader::~EbayLoader()
+{
+	for (int table = 0; table < EBAY_NUM_TABLES; table++)
+		delete relations[table];
+}
+
+std::size_t EbayLoader::maxRecordSize()
+{
+	return Page::DATA_SIZE - sizeof(PageSlot);
+}
+
+bool EbayLoader::claimUser(const std::string &userId)
+{
+	UserShard &shard = userShards[std::hash<std::string>()(userId) % USER_SHARDS];
+	std::lock_guard<std::mutex> guard(shard.latch);
+	return shard.ids.insert(userId).second;
+}
+
+EbayLoadStats EbayLoader::load(const std::vector<std::string> &files, std::uint32_t numWorkers,
+                               std::size_t chunkSize)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const std::uint32_t workers = std::min<std::uint32_t>(
+		(numWorkers == 0) ? defaultWorkerCount() : numWorkers, std::max<std::size_t>(files.size(), 1));
+	if (chunkSize == 0)
+		chunkSize = 1;
+
+	std::vector<EbayLoadStats> workerStats(workers);
+	std::atomic<std::size_t> nextFile(0);
+	runWorkers(workers, [&](std::uint32_t workerId) {
+		EbayLoadStats &stats = workerStats[workerId];
+		EbayItemCollector collector(this);
+		std::vector<char> buffer(chunkSize);
+		for (std::size_t f = nextFile++; f < files.size(); f = nextFile++)
+		{
+			std::ifstream in(files[f].c_str(), std::ios::in | std::ios::binary);
+			if (!in)
+				throw FileNotFoundException(files[f]);
+			collector.startDocument(files[f]);
+			JsonSaxParser parser(&collector, files[f]);
+
+			// Bytes the parser did not consume stay at the front of the buffer; a token longer
+			// than the buffer doubles it
+			std::size_t have = 0;
+			bool last = false;
+			while (!last)
+			{
+				if (have == buffer.size())
+					buffer.resize(2 * buffer.size());
+				in.read(&buffer[have], buffer.size() - have);
+				const std::size_t got = in.gcount();
+				last = in.eof();
+				if (!last && !in)
+					throw BadJsonException(files[f], "read failed");
+				stats.bytes += got;
+				have += got;
+				const std::size_t used = parser.parse(&buffer[0], have, last);
+				memmove(&buffer[0], &buffer[used], have - used);
+				have -= used;
+			}
+			stats.files++;
+		}
+		collector.flush();
+		stats.items = collector.records(EBAY_ITEM);
+		stats.bids = collector.records(EBAY_BID);
+		stats.users = collector.records(EBAY_USER);
+		stats.categories = collector.records(EBAY_CATEGORY);
+		stats.truncatedDescriptions = collector.truncatedDescriptions;
+	});
+
+	EbayLoadStats total;
+	for (std::size_t i = 0; i < workerStats.size(); i++)
+	{
+		total.items += workerStats[i].items;
+		total.bids += workerStats[i].bids;
+		total.users += workerStats[i].users;
+		total.categories += workerStats[i].categories;
+		total.truncatedDescriptions += workerStats[i].truncatedDescriptions;
+		total.files += workerStats[i].files;
+		total.bytes += workerStats[i].bytes;
+	}
+	total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return total;
+}
+
+}
@@ -0,0 +1,155 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Relations of the eBay dataset, after the tables of PP1 create.sql.
+ */
+enum EbayTable {
+  EBAY_ITEM,
+  EBAY_BID,
+  EBAY_USER,
+  EBAY_CATEGORY,
+  EBAY_NUM_TABLES
+};
+
+/**
+ * @brief What a load did.
+ */
+struct EbayLoadStats
+{
+  /**
+   * Records stored per relation.
+   */
+  std::uint64_t items, bids, users, categories;
+
+  /**
+   * Descriptions cut short so that their item fits in a page.
+   */
+  std::uint64_t truncatedDescriptions;
+
+  /**
+   * JSON files and bytes read.
+   */
+  std::uint64_t files, bytes;
+
+  /**
+   * Wall time of the load, in seconds.
+   */
+  double seconds;
+
+  EbayLoadStats()
+    : items(0), bids(0), users(0), categories(0), truncatedDescriptions(0), files(0), bytes(0), seconds(0)
+  {
+  }
+};
+
+/**
+ * @brief Loads the items-*.json files of the eBay dataset into four PageFile relations, the way
+ * PP1 skeleton_parser.py turns them into .dat files for SQLite.
+ *
+ * Files are handed out to worker threads one at a time.  Each worker streams its file through a
+ * JsonSaxParser in fixed size chunks, collects one item at a time and encodes its rows straight
+ * into pages of its own, so that the document is never held in memory and workers only meet to
+ * append a full page to a relation.  Like the Python pipeline, categories are deduplicated per
+ * item and users across the whole load; a user seen in several files is stored by whichever
+ * worker gets to it first.
+ *
+ * Records are encoded with the layouts of ebay_schema.h, so RecordView reads them in place.
+ * Amounts are in dollars; times are seconds since 1970-01-01 00:00:00, read as UTC.  The few
+ * descriptions too long for a page are cut at a UTF-8 character boundary.
+ */
+class EbayLoader
+{
+ public:
+  /**
+   * Constructor of EbayLoader class.  Creates the relations, replacing any of the same name.
+   *
+   * @param relationPrefix  The relations are named relationPrefix + "Item", "Bid", "User" and "Category"
+   */
+  EbayLoader(const std::string &relationPrefix);
+
+  /**
+   * Destructor of EbayLoader class.  Closes the relations.
+   */
+  ~EbayLoader();
+
+  /**
+   * Parse JSON files and append their rows to the relations.
+   *
+   * @param files       Paths of the items-*.json files
+   * @param numWorkers  Worker threads, 0 for one per hardware thread
+   * @param chunkSize   Bytes a worker reads from its file at a time
+   * @return            What was loaded
+   * @throws BadJsonException  If a file is malformed or not shaped like the dataset
+   */
+  EbayLoadStats load(const std::vector<std::string> &files, std::uint32_t numWorkers = 0,
+                     std::size_t chunkSize = 1 << 20);
+
+  /**
+   * Returns the name of a relation.
+   */
+  const std::string &relationName(EbayTable table) const { return names[table]; }
+
+  /**
+   * Returns the largest record a page holds.
+   */
+  static std::size_t maxRecordSize();
+
+ private:
+  friend class EbayPageAppender;
+  friend class EbayItemCollector;
+
+  /**
+   * Claim a user id for storing.
+   *
+   * @return  False if the user has been stored already
+   */
+  bool claimUser(const std::string &userId);
+
+  /**
+   * Number of shards of the set of stored users.
+   */
+  static const std::size_t USER_SHARDS = 64;
+
+  /**
+   * One shard of the set of stored users, with its own lock.
+   */
+  struct UserShard {
+    std::mutex latch;
+    std::unordered_set<std::string> ids;
+  };
+
+  /**
+   * Relation names.
+   */
+  std::string names[EBAY_NUM_TABLES];
+
+  /**
+   * Relations, appended to by the workers under their locks.
+   */
+  PageFile *relations[EBAY_NUM_TABLES];
+  std::mutex relationLatches[EBAY_NUM_TABLES];
+
+  /**
+   * Users stored so far, sharded by hash.
+   */
+  UserShard userShards[USER_SHARDS];
+};
+
+}
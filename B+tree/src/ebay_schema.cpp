@@ -0,0 +1,18 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "ebay_schema.h"
+
+namespace badgerdb {
+
+// Definitions of the field arrays, for uses of them outside of constant expressions
+constexpr FieldDesc ItemSchema::FIELDS[];
+constexpr FieldDesc BidSchema::FIELDS[];
+constexpr FieldDesc UserSchema::FIELDS[];
+constexpr FieldDesc CategorySchema::FIELDS[];
+
+}
@@ -0,0 +1,115 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include "schema.h"
+
+namespace badgerdb {
+
+/**
+ * Schemas of the eBay dataset, after the tables of PP1 create.sql.  DATETIME columns are stored as
+ * seconds since the epoch and money in dollars.  VARCHAR lengths are not enforced, as in SQLite.
+ */
+
+/**
+ * @brief Item(item_id, name, currently, buy_price, first_bid, number_of_bids, started, ends,
+ * description, seller_id)
+ */
+struct ItemSchema {
+  enum Field {
+    ITEM_ID,
+    NAME,
+    CURRENTLY,
+    BUY_PRICE,
+    FIRST_BID,
+    NUMBER_OF_BIDS,
+    STARTED,
+    ENDS,
+    DESCRIPTION,
+    SELLER_ID,
+    NUM_FIELDS
+  };
+  static constexpr FieldDesc FIELDS[NUM_FIELDS] = {
+    {"item_id",        FIELD_INT32,    false},
+    {"name",           FIELD_VARCHAR,  false},
+    {"currently",      FIELD_DOUBLE,   true},
+    {"buy_price",      FIELD_DOUBLE,   true},
+    {"first_bid",      FIELD_DOUBLE,   true},
+    {"number_of_bids", FIELD_INT32,    false},
+    {"started",        FIELD_DATETIME, false},
+    {"ends",           FIELD_DATETIME, false},
+    {"description",    FIELD_VARCHAR,  true},
+    {"seller_id",      FIELD_VARCHAR,  false}
+  };
+};
+
+/**
+ * @brief Bid(item_id, bidder_id, time, amount)
+ */
+struct BidSchema {
+  enum Field {
+    ITEM_ID,
+    BIDDER_ID,
+    TIME,
+    AMOUNT,
+    NUM_FIELDS
+  };
+  static constexpr FieldDesc FIELDS[NUM_FIELDS] = {
+    {"item_id",   FIELD_INT32,    false},
+    {"bidder_id", FIELD_VARCHAR,  false},
+    {"time",      FIELD_DATETIME, false},
+    {"amount",    FIELD_DOUBLE,   false}
+  };
+};
+
+/**
+ * @brief User(user_id, rating, location, country)
+ */
+struct UserSchema {
+  enum Field {
+    USER_ID,
+    RATING,
+    LOCATION,
+    COUNTRY,
+    NUM_FIELDS
+  };
+  static constexpr FieldDesc FIELDS[NUM_FIELDS] = {
+    {"user_id",  FIELD_VARCHAR, false},
+    {"rating",   FIELD_INT32,   false},
+    {"location", FIELD_VARCHAR, true},
+    {"country",  FIELD_VARCHAR, true}
+  };
+};
+
+/**
+ * @brief Category(item_id, category_name)
+ */
+struct CategorySchema {
+  enum Field {
+    ITEM_ID,
+    CATEGORY_NAME,
+    NUM_FIELDS
+  };
+  static constexpr FieldDesc FIELDS[NUM_FIELDS] = {
+    {"item_id",       FIELD_INT32,   false},
+    {"category_name", FIELD_VARCHAR, false}
+  };
+};
+
+typedef RecordLayout<ItemSchema> ItemLayout;
+typedef RecordLayout<BidSchema> BidLayout;
+typedef RecordLayout<UserSchema> UserLayout;
+typedef RecordLayout<CategorySchema> CategoryLayout;
+
+// The layouts are fixed by the schemas; changing one changes the format of stored relations
+static_assert(ItemLayout::NULL_BYTES == 2 && ItemLayout::VARCHAR_DATA == 56, "Item layout changed");
+static_assert(BidLayout::NULL_BYTES == 0 && BidLayout::offset(BidSchema::AMOUNT) == 12, "Bid layout changed");
+static_assert(UserLayout::VARCHAR_DATA == 11, "User layout changed");
+static_assert(CategoryLayout::VARCHAR_DATA == 6, "Category layout changed");
+
+}
@@ -0,0 +1,41 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a JSON document is malformed.
+ */
+class BadJsonException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a bad JSON exception for the given document.
+   *
+   * @param name    Name of the document.
+   * @param reason  What is wrong with it, and where.
+   */
+  BadJsonException(const std::string& name, const std::string& reason);
+
+  /**
+   * Returns the name of the document that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of the document that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
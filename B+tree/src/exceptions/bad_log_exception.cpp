@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bad_log_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+BadLogException::BadLogException(const std::string& name, const std::string& reason)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Bad write-ahead log " << filename_ << ": " << reason;
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "index_unusable_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IndexUnusableException::IndexUnusableException(const std::string& name)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Index " << filename_ << " is unusable: an insert failed and could not be rolled back";
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,391 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "external_sort.h"
+
+#include <algorithm>
+#include <chrono>
+#include "file.h"
+#include "filescan.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Reads a run a record at a time, with its current page pinned.
+ *
+ * A reader that disposes of its pages frees each one in the run file once it has read past it, so
+ * the file's free list hands it to the run being written.
+ */
+class SortRunReader
+{
+ public:
+	SortRunReader(BufMgr *bufferMgr, File *runFile, const std::vector<PageId> &runPages, bool disposeRead)
+		: bufMgr(bufferMgr), file(runFile), pages(runPages), pageIndex(0), page(NULL), dispose(disposeRead),
+		  exhausted(false)
+	{
+		advance();
+	}
+
+	~SortRunReader()
+	{
+		if (page != NULL)
+			bufMgr->unPinPage(file, pages[pageIndex], false);
+	}
+
+	/**
+	 * Move to the next record of the run.
+	 */
+	void advance()
+	{
+		if (page != NULL)
+		{
+			++it;
+			if (it != page->end())
+			{
+				current = *it;
+				return;
+			}
+			bufMgr->unPinPage(file, pages[pageIndex], false);
+			if (dispose)
+				bufMgr->disposePage(file, pages[pageIndex]);
+			page = NULL;
+			pageIndex++;
+		}
+		// Runs have no empty pages
+		if (pageIndex == pages.size())
+		{
+			exhausted = true;
+			return;
+		}
+		bufMgr->readPage(file, pages[pageIndex], page);
+		it = page->begin();
+		current = *it;
+	}
+
+	bool done() const { return exhausted; }
+	FieldString record() const { return FieldString(current); }
+
+ private:
+	BufMgr *bufMgr;
+	File *file;
+	std::vector<PageId> pages;
+	std::size_t pageIndex;
+	Page *page;
+	PageIterator it;
+	std::string current;
+	bool dispose;
+	bool exhausted;
+};
+
+/**
+ * @brief Tree of losers over the current records of k runs (Knuth, TAOCP vol. 3, 5.4.1).
+ *
+ * Node 0 holds the run with the smallest record and every other node the run that lost the match
+ * played there, so taking the winner's next record replays only the matches on its path to the root.
+ * The runs are the leaves k .. 2k - 1 of a tree laid out as a heap, which works for any k.
+ */
+class LoserTree
+{
+ public:
+	LoserTree(const std::vector<SortRunReader*> &runReaders, const ExternalSort::RecordLess &recordLess)
+		: readers(runReaders), less(recordLess), nodes(runReaders.size())
+	{
+		nodes[0] = build(1);
+	}
+
+	/**
+	 * Run holding the smallest record, or -1 once every run is done.
+	 */
+	int winner() const { return readers[nodes[0]]->done() ? -1 : nodes[0]; }
+
+	/**
+	 * Take the winner's next record and find the new winner.
+	 */
+	void pop()
+	{
+		int run = nodes[0];
+		readers[run]->advance();
+		for (std::size_t node = (run + readers.size()) / 2; node > 0; node /= 2)
+		{
+			if (beats(nodes[node], run))
+				std::swap(nodes[node], run);
+		}
+		nodes[0] = run;
+	}
+
+ private:
+	/**
+	 * Whether run a's record goes before run b's.  Done runs lose; ties go to the lower run.
+	 */
+	bool beats(int a, int b) const
+	{
+		if (readers[a]->done() || readers[b]->done())
+			return !readers[a]->done();
+		const FieldString recordA = readers[a]->record(), recordB = readers[b]->record();
+		if (less(recordA, recordB))
+			return true;
+		return !less(recordB, recordA) && a < b;
+	}
+
+	/**
+	 * Play the matches below a node, returning the winner.
+	 */
+	int build(std::size_t node)
+	{
+		if (node >= readers.size())
+			return node - readers.size();
+		const int left = build(2 * node), right = build(2 * node + 1);
+		if (beats(left, right))
+		{
+			nodes[node] = right;
+			return left;
+		}
+		nodes[node] = left;
+		return right;
+	}
+
+	const std::vector<SortRunReader*> &readers;
+	const ExternalSort::RecordLess &less;
+	std::vector<int> nodes;
+};
+
+/**
+ * @brief Appends records to a run, filling one pinned page of the pool at a time.
+ */
+class SortRunWriter
+{
+ public:
+	SortRunWriter(BufMgr *bufferMgr, File *runFile, SortStats &sortStats)
+		: bufMgr(bufferMgr), file(runFile), stats(sortStats), page(NULL)
+	{
+	}
+
+	~SortRunWriter() { finish(); }
+
+	void append(const std::string &record)
+	{
+		if (page != NULL && !page->hasSpaceForRecord(record))
+			finish();
+		if (page == NULL)
+		{
+			bufMgr->allocPage(file, pageNo, page);
+			pages.push_back(pageNo);
+			stats.pagesWritten++;
+			stats.runFilePages = std::max<std::uint64_t>(stats.runFilePages, pageNo);
+		}
+		page->insertRecord(record);
+	}
+
+	/**
+	 * Unpin the last page.
+	 */
+	void finish()
+	{
+		if (page == NULL)
+			return;
+		bufMgr->unPinPage(file, pageNo, true);
+		page = NULL;
+	}
+
+	std::vector<PageId> pages;
+
+ private:
+	BufMgr *bufMgr;
+	File *file;
+	SortStats &stats;
+	PageId pageNo;
+	Page *page;
+};
+
+ExternalSort::ExternalSort(BufMgr *bufferMgr, const std::string &relationName, const RecordLess &recordLess,
+                           std::uint32_t frames, const std::string &runFileName, const RecordFilter &recordFilter)
+	: bufMgr(bufferMgr), relation(relationName), less(recordLess), filter(recordFilter),
+	  memoryFrames(std::max<std::uint32_t>(frames, 3)), runName(runFileName), runFile(NULL), nextEntry(0),
+	  tree(NULL), opened(false), advancePending(false)
+{
+}
+
+ExternalSort::~ExternalSort()
+{
+	endMerge();
+	if (runFile == NULL)
+		return;
+	bufMgr->flushFile(runFile);
+	delete runFile;
+	File::remove(runName);
+}
+
+const SortStats &ExternalSort::open()
+{
+	if (opened)
+		return stats;
+	opened = true;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Run generation: fill the budget, sort, write out
+	const std::size_t budget = std::size_t(memoryFrames) * Page::SIZE;
+	{
+		FileScan scan(relation, bufMgr);
+		for (;;)
+		{
+			RecordId rid;
+			try
+			{
+				scan.scanNext(rid);
+			}
+			catch (const EndOfFileException &e)
+			{
+				break;
+			}
+			const std::string record = scan.getRecord();
+			if (filter && !filter(record))
+				continue;
+			stats.records++;
+			if (!entries.empty() && arena.size() + record.size() + (entries.size() + 1) * sizeof(entries[0]) > budget)
+				writeRun();
+			entries.push_back(std::make_pair(arena.size(), record.size()));
+			arena.insert(arena.end(), record.begin(), record.end());
+		}
+	}
+
+	if (runs.empty())
+		sortEntries();
+	else
+	{
+		if (!entries.empty())
+			writeRun();
+		stats.runPages = stats.pagesWritten;
+		std::vector<char>().swap(arena);
+		std::vector<std::pair<std::uint32_t, std::uint32_t> >().swap(entries);
+
+		// A frame for each run and one for the output; merge the oldest runs until the rest fit
+		// in one merge
+		const std::size_t fanIn = memoryFrames - 1;
+		while (runs.size() > fanIn)
+			mergeRuns(std::min(fanIn, runs.size() - fanIn + 1));
+		startMerge(runs.size(), false);
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+bool ExternalSort::next(FieldString &record)
+{
+	open();
+	if (tree == NULL)
+	{
+		if (nextEntry == entries.size())
+			return false;
+		record = FieldString(&arena[entries[nextEntry].first], entries[nextEntry].second);
+		nextEntry++;
+		return true;
+	}
+
+	if (advancePending)
+		tree->pop();
+	const int run = tree->winner();
+	advancePending = run >= 0;
+	if (run < 0)
+		return false;
+	record = readers[run]->record();
+	return true;
+}
+
+SortStats ExternalSort::sort(const std::function<void(const FieldString &record)> &callback)
+{
+	open();
+	FieldString record;
+	while (next(record))
+		callback(record);
+	return stats;
+}
+
+void ExternalSort::sortEntries()
+{
+	const char *base = arena.data();
+	const RecordLess &order = less;
+	std::sort(entries.begin(), entries.end(),
+	          [base, &order](const std::pair<std::uint32_t, std::uint32_t> &a,
+	                         const std::pair<std::uint32_t, std::uint32_t> &b) {
+		return order(FieldString(base + a.first, a.second), FieldString(base + b.first, b.second));
+	});
+}
+
+void ExternalSort::writeRun()
+{
+	sortEntries();
+	if (runFile == NULL)
+	{
+		try
+		{
+			File::remove(runName);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+		runFile = new PageFile(runName, true);
+	}
+
+	SortRunWriter writer(bufMgr, runFile, stats);
+	std::string record;
+	for (std::size_t i = 0; i < entries.size(); i++)
+	{
+		record.assign(&arena[entries[i].first], entries[i].second);
+		writer.append(record);
+	}
+	writer.finish();
+	runs.push_back(writer.pages);
+	stats.runs++;
+	arena.clear();
+	entries.clear();
+}
+
+void ExternalSort::mergeRuns(std::size_t numRuns)
+{
+	// The runs merged are read once, so their pages go to the output as they are read
+	startMerge(numRuns, true);
+	SortRunWriter writer(bufMgr, runFile, stats);
+	std::string record;
+	for (int run = tree->winner(); run >= 0; run = tree->winner())
+	{
+		const FieldString next = readers[run]->record();
+		record.assign(next.data, next.size);
+		writer.append(record);
+		tree->pop();
+	}
+	writer.finish();
+	endMerge();
+	runs.push_back(writer.pages);
+	stats.intermediateMerges++;
+}
+
+void ExternalSort::startMerge(std::size_t numRuns, bool dispose)
+{
+	for (std::size_t i = 0; i < numRuns; i++)
+	{
+		readers.push_back(new SortRunReader(bufMgr, runFile, runs.front(), dispose));
+		runs.pop_front();
+	}
+	tree = new LoserTree(readers, less);
+	advancePending = false;
+}
+
+void ExternalSort::endMerge()
+{
+	delete tree;
+	tree = NULL;
+	for (std::size_t i = 0; i < readers.size(); i++)
+		delete readers[i];
+	readers.clear();
+}
+
+}
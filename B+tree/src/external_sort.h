@@ -0,0 +1,202 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "schema.h"
+
+namespace badgerdb {
+
+/**
+ * @brief What a sort did.
+ */
+struct SortStats
+{
+  /**
+   * Records sorted, after the filter left some out.
+   */
+  std::uint64_t records;
+
+  /**
+   * Sorted runs written by run generation, 0 if the input fit in memory.
+   */
+  std::uint32_t runs;
+
+  /**
+   * Merges of runs into longer runs before the final merge.
+   */
+  std::uint32_t intermediateMerges;
+
+  /**
+   * Pages written to the run file.
+   */
+  std::uint64_t pagesWritten;
+
+  /**
+   * Pages written by run generation, one copy of the input.
+   */
+  std::uint64_t runPages;
+
+  /**
+   * Pages the run file grew to.  Merges before the last free the pages of their runs as they read
+   * them, so this stays close to runPages.
+   */
+  std::uint64_t runFilePages;
+
+  /**
+   * Wall time until the first record could be returned, in seconds.
+   */
+  double seconds;
+
+  SortStats()
+    : records(0), runs(0), intermediateMerges(0), pagesWritten(0), runPages(0), runFilePages(0), seconds(0) {}
+};
+
+class SortRunReader;
+class LoserTree;
+
+/**
+ * @brief External merge sort of a relation.
+ *
+ * Run generation reads the relation with FileScan into memory, as many records as fit in the
+ * frame budget, sorts them and writes them out as a run to a temporary PageFile through the buffer
+ * pool.  Runs are merged with a loser tree, which takes one comparison per level of the tree per
+ * record.  Merging reads every run of the merge a page at a time with one pinned frame each, plus
+ * one frame for the output, so at most memoryFrames - 1 runs are merged at once; if there are more,
+ * the oldest are merged into longer runs first, just enough of them for the last merge to take
+ * the rest.  The last merge is not written: its output is returned by next().  An input that fits
+ * in memory is sorted there and never written.
+ *
+ * The sort is not stable.
+ */
+class ExternalSort
+{
+ public:
+  /**
+   * Strict weak order on records.
+   */
+  typedef std::function<bool(const FieldString &a, const FieldString &b)> RecordLess;
+
+  /**
+   * Returns false to leave a record out of the sort.
+   */
+  typedef std::function<bool(const std::string &record)> RecordFilter;
+
+  /**
+   * Constructor of ExternalSort class
+   *
+   * @param bufMgr        Buffer Manager the relation is scanned and the runs written through
+   * @param relation      Name of the relation to sort
+   * @param less          Order to sort the records in
+   * @param memoryFrames  Frames of memory the sort may use, at least 3; the pool has to have that many
+   *                      to spare while the output is read
+   * @param runName       Name of the temporary run file
+   * @param filter        Records to sort, all of them by default
+   */
+  ExternalSort(BufMgr *bufMgr, const std::string &relation, const RecordLess &less,
+               std::uint32_t memoryFrames = 64, const std::string &runName = "sort.runs",
+               const RecordFilter &filter = RecordFilter());
+
+  /**
+   * Destructor of ExternalSort class.  Unpins the pages of the output and removes the run file.
+   */
+  ~ExternalSort();
+
+  /**
+   * Sort the relation, up to the last merge.  Called by next() if need be.
+   *
+   * @return  What the sort did
+   */
+  const SortStats &open();
+
+  /**
+   * Returns the next record in order, valid until the next call, or false after the last one.
+   */
+  bool next(FieldString &record);
+
+  /**
+   * Sort the relation and hand every record to a callback, in order.
+   */
+  SortStats sort(const std::function<void(const FieldString &record)> &callback);
+
+ private:
+  /**
+   * Sort the records in memory and write them out as a run.
+   */
+  void writeRun();
+
+  /**
+   * Merge the runs at the front of the queue into one run at its back.
+   */
+  void mergeRuns(std::size_t numRuns);
+
+  /**
+   * Start merging the runs at the front of the queue, pinning their first pages.
+   *
+   * @param dispose  Whether to free the pages of the runs in the run file as they are read
+   */
+  void startMerge(std::size_t numRuns, bool dispose);
+
+  /**
+   * Unpin the pages of the runs being merged.
+   */
+  void endMerge();
+
+  /**
+   * Sort the records in memory.
+   */
+  void sortEntries();
+
+  BufMgr *bufMgr;
+  std::string relation;
+  RecordLess less;
+  RecordFilter filter;
+  std::uint32_t memoryFrames;
+  std::string runName;
+
+  /**
+   * Run file, created with the first run.
+   */
+  File *runFile;
+
+  /**
+   * Records of the run being made, and the offset and length of each one.  An input that fits
+   * in memory is returned from here, nextEntry being the next one to return.
+   */
+  std::vector<char> arena;
+  std::vector<std::pair<std::uint32_t, std::uint32_t> > entries;
+  std::size_t nextEntry;
+
+  /**
+   * Runs not merged yet, oldest first, each as the pages it was written to.
+   */
+  std::deque<std::vector<PageId> > runs;
+
+  /**
+   * Runs being merged and the tree merging them.
+   */
+  std::vector<SortRunReader*> readers;
+  LoserTree *tree;
+
+  bool opened;
+
+  /**
+   * Whether the record last returned by next() has to be taken off its run.
+   */
+  bool advancePending;
+
+  SortStats stats;
+};
+
+}
@@ -11,8 +11,12 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <algorithm>
 #include <cstdio>
+#include <cstddef>
 #include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
@@ -25,6 +29,9 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::StateMap File::open_states_;
+const PageId File::MIN_EXTENT_PAGES;
+const PageId File::MAX_EXTENT_PAGES;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -64,6 +71,11 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
+PageId File::getNumPages() {
+  const FileHeader& header = readHeader();
+  return header.num_pages;
+}
+
 File::File(const std::string& name, const bool create_new) : filename_(name) {
   openIfNeeded(create_new);
 
@@ -72,6 +84,7 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
                          0 /* num_free_pages */, 0 /* first_free_page */};
     writeHeader(header);
+    flushHeader();
   }
 }
 
@@ -79,6 +92,7 @@ void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    state_ = open_states_[filename_];
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -97,8 +111,35 @@ void File::openIfNeeded(const bool create_new) {
       }
     }
     stream_.reset(new std::fstream(filename_, mode));
+    state_.reset(new FileState());
+    state_->header_dirty = false;
+    state_->tail_page = Page::INVALID_NUMBER;
+    for (int i = 0; i < NUM_EXTENT_CLASSES; ++i) {
+      const Extent none = {Page::INVALID_NUMBER, Page::INVALID_NUMBER, 0};
+      state_->extents[i] = none;
+    }
+    state_->reserved_end = 0;
+    state_->fd = ::open(filename_.c_str(), O_RDWR);
+    if (!create_new) {
+      stream_->seekg(0 /* pos */, std::ios::beg);
+      stream_->read(reinterpret_cast<char*>(&state_->header), sizeof(FileHeader));
+
+      // Pages are written when they are allocated, so a header last written
+      // back before the file grew can take num_pages from the file size.
+      stream_->seekg(0 /* pos */, std::ios::end);
+      const std::streamoff size = stream_->tellg();
+      if (size > static_cast<std::streamoff>(sizeof(FileHeader))) {
+        const PageId num_pages = static_cast<PageId>(
+            (size - sizeof(FileHeader)) / Page::SIZE + 1);
+        if (num_pages > state_->header.num_pages) {
+          state_->header.num_pages = num_pages;
+          state_->header_dirty = true;
+        }
+      }
+    }
     open_streams_[filename_] = stream_;
     open_counts_[filename_] = 1;
+    open_states_[filename_] = state_;
   }
 }
 
@@ -106,26 +147,69 @@ void File::close() {
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
+    // Last user of the file, so its header goes to disk before the stream closes
+    if (stream_ && state_) {
+      flushHeader();
+      if (state_->fd >= 0) {
+        ::close(state_->fd);
+      }
+    }
     open_streams_.erase(filename_);
     open_counts_.erase(filename_);
+    open_states_.erase(filename_);
   }
+  stream_.reset();
+  state_.reset();
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  return state_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
+  FileHeader lists = header;
+  lists.num_pages = state_->header.num_pages;
+  const bool lists_changed = !(lists == state_->header);
+  if (header.num_pages != state_->header.num_pages) {
+    state_->header_dirty = true;
+  }
+  state_->header = header;
+  if (lists_changed) {
+    state_->header_dirty = true;
+    flushHeader();
+  }
+}
+
+PageId File::takeExtentPage(const ExtentClass extent_class) {
+  Extent& extent = state_->extents[extent_class];
+  if (extent.next_page == extent.end_page) {
+    extent.pages = (extent.pages == 0) ? MIN_EXTENT_PAGES
+                                       : std::min(extent.pages * 2, MAX_EXTENT_PAGES);
+    extent.next_page = std::max(state_->reserved_end, state_->header.num_pages);
+    extent.end_page = extent.next_page + extent.pages;
+    state_->reserved_end = extent.end_page;
+#ifdef FALLOC_FL_KEEP_SIZE
+    // Failing to reserve only costs contiguity, so errors are ignored
+    if (state_->fd >= 0) {
+      fallocate(state_->fd, FALLOC_FL_KEEP_SIZE, pagePosition(extent.next_page),
+                static_cast<off_t>(extent.pages) * Page::SIZE);
+    }
+#endif
+  }
+  return extent.next_page++;
+}
+
+void File::flushHeader() const {
+  if (!state_->header_dirty) {
+    return;
+  }
   stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+  stream_->write(reinterpret_cast<const char*>(&state_->header), sizeof(FileHeader));
   stream_->flush();
+  state_->header_dirty = false;
 }
 
 
@@ -163,14 +247,23 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePageInto(new_page_number, &new_page);
+  return new_page;
+}
+
+void PageFile::allocatePageInto(PageId &new_page_number, Page* page,
+                                const ExtentClass /* extent_class */) {
+  FileHeader header = readHeader();
+  Page& new_page = *page;
+  PageId previous_page_number = Page::INVALID_NUMBER;
+  new_page.initialize();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    // Free pages are cleared when they are deleted, so only the free list
+    // pointer is needed from the page.
     new_page.set_page_number(header.first_free_page);
 		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    header.first_free_page = nextPageNumber(new_page_number);
     --header.num_free_pages;
 
     if (header.first_used_page == Page::INVALID_NUMBER ||
@@ -185,15 +278,15 @@ Page PageFile::allocatePage(PageId &new_page_number) {
       // New page is reused from somewhere after the beginning, so we need to
       // find where in the used list to insert it.
       PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
+      previous_page_number = header.first_used_page;
+      for (;;) {
+        next_page_number = nextPageNumber(previous_page_number);
         if (next_page_number > new_page.page_number() ||
             next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
           break;
         }
+        previous_page_number = next_page_number;
       }
-      existing_page.set_next_page_number(new_page.page_number());
       new_page.set_next_page_number(next_page_number);
     }
 
@@ -202,8 +295,9 @@ Page PageFile::allocatePage(PageId &new_page_number) {
   }
 	else
 	{
-    new_page.set_page_number(header.num_pages);
+    new_page.set_page_number(takeExtentPage(EXTENT_DEFAULT));
 		new_page_number = new_page.page_number();
+    assert(new_page_number == header.num_pages);
 
     if (header.first_used_page == Page::INVALID_NUMBER)
 		{
@@ -213,53 +307,55 @@ Page PageFile::allocatePage(PageId &new_page_number) {
 		{
       // If we have pages allocated, we need to add the new page to the tail
       // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      previous_page_number = tailPage();
+      assert(previous_page_number != Page::INVALID_NUMBER);
     }
     ++header.num_pages;
   }
   writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  if (previous_page_number != Page::INVALID_NUMBER) {
+    // The page before the new one in the used list now points to it.
+    setNextPageNumber(previous_page_number, new_page_number);
+  }
+  if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+    state_->tail_page = new_page_number;
   }
   writeHeader(header);
-
-  return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
+  Page page;
+  readPageInto(page_number, &page);
+  return page;
+}
 
-	if (page_number >= header.num_pages)
+void PageFile::readPageInto(const PageId page_number, Page* page) const {
+	if (page_number >= state_->header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPageInto(page_number, page, false /* allow_free */);
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
+  readPageInto(page_number, &page, allow_free);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page* page, const bool allow_free) const {
+  // Header and data are contiguous, so the page comes in with one read
   stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
-  if (!allow_free && !page.isUsed()) {
+  stream_->read(reinterpret_cast<char*>(page), Page::SIZE);
+  noteLink(page_number, page->header_);
+  if (!allow_free && !page->isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
-	PageHeader header = readPageHeader(new_page_number);
-	if (header.current_page_number == Page::INVALID_NUMBER)
+	const PageLink& link = pageLink(new_page_number);
+	if (!link.used)
 	{
 		// Page has been deleted since it was read.
 		throw InvalidPageException(new_page_number, filename_);
@@ -267,39 +363,43 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	// Page on disk may have had its next page pointer updated since it was read;
 	// we don't modify that, but we do keep all the other modifications to the
 	// page header.
-	const PageId next_page_number = header.next_page_number;
-	header = new_page.header_;
-	header.next_page_number = next_page_number;
+	PageHeader header = new_page.header_;
+	header.next_page_number = link.next_page_number;
 	writePage(new_page_number, header, new_page);
 }
 
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
+	if (page_number >= header.num_pages || !pageLink(page_number).used)
+	{
+		throw InvalidPageException(page_number, filename_);
+	}
+  const PageId next_page_number = nextPageNumber(page_number);
+  PageId previous_page_number = Page::INVALID_NUMBER;
   // If this page is the head of the used list, update the header to point to
   // the next page in line.
   if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+    header.first_used_page = next_page_number;
   } else {
     // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
+    for (PageId number = header.first_used_page; number != Page::INVALID_NUMBER;
+         number = nextPageNumber(number)) {
+      if (nextPageNumber(number) == page_number) {
+        previous_page_number = number;
+        setNextPageNumber(previous_page_number, next_page_number);
         break;
       }
     }
   }
+  if (state_->tail_page == page_number) {
+    state_->tail_page = previous_page_number;
+  }
   // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
+  Page existing_page;
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
@@ -319,15 +419,65 @@ void PageFile::writePage(const PageId page_number, const PageHeader& header,
   stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
   stream_->write(&new_page.data_[0], Page::DATA_SIZE);
   stream_->flush();
+  noteLink(page_number, header);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  noteLink(page_number, header);
   return header;
 }
 
+const PageLink& PageFile::pageLink(const PageId page_number) const {
+  if (page_number >= state_->links.size() || !state_->links[page_number].known) {
+    readPageHeader(page_number);
+  }
+  return state_->links[page_number];
+}
+
+void PageFile::noteLink(const PageId page_number, const PageHeader& header) const {
+  std::vector<PageLink>& links = state_->links;
+  if (page_number >= links.size()) {
+    const PageLink unknown = {Page::INVALID_NUMBER, false, false};
+    links.resize(page_number + 1, unknown);
+  }
+  links[page_number].next_page_number = header.next_page_number;
+  links[page_number].used = header.current_page_number != Page::INVALID_NUMBER;
+  links[page_number].known = true;
+}
+
+void PageFile::setNextPageNumber(const PageId page_number, const PageId next_page_number) {
+  pageLink(page_number);
+  stream_->seekp(pagePosition(page_number) +
+                 static_cast<std::streamoff>(offsetof(PageHeader, next_page_number)),
+                 std::ios::beg);
+  stream_->write(reinterpret_cast<const char*>(&next_page_number), sizeof(PageId));
+  stream_->flush();
+  state_->links[page_number].next_page_number = next_page_number;
+}
+
+PageId PageFile::tailPage() const {
+  PageId page_number = state_->tail_page;
+  if (page_number != Page::INVALID_NUMBER) {
+    const PageLink& link = pageLink(page_number);
+    if (link.used && link.next_page_number == Page::INVALID_NUMBER) {
+      return page_number;
+    }
+  }
+  page_number = state_->header.first_used_page;
+  if (page_number == Page::INVALID_NUMBER) {
+    return page_number;
+  }
+  for (PageId next = nextPageNumber(page_number); next != Page::INVALID_NUMBER;
+       next = nextPageNumber(page_number)) {
+    page_number = next;
+  }
+  state_->tail_page = page_number;
+  return page_number;
+}
+
 
 
 
@@ -361,30 +511,40 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePageInto(new_page_number, &new_page);
+	return new_page;
+}
+
+void BlobFile::allocatePageInto(PageId &new_page_number, Page* page,
+                                const ExtentClass extent_class) {
+  FileHeader header = readHeader();
+	page->initialize();
 
-	new_page_number = header.num_pages;
+	new_page_number = takeExtentPage(extent_class);
 
 	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
+		header.first_used_page = new_page_number;
 	}
 
-	++header.num_pages;
+	// Pages skipped over for the extents of other classes count as allocated
+	header.num_pages = std::max(header.num_pages, new_page_number + 1);
 
-	writePage(new_page_number, new_page);
+	writePage(new_page_number, *page);
 	writeHeader(header);
-
-	return new_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPageInto(page_number, &page);
 	return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page* page) const {
+	stream_->seekg(pagePosition(page_number), std::ios::beg);
+	stream_->read(reinterpret_cast<char*>(page), Page::SIZE);
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
 	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
 	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
@@ -11,6 +11,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "page.h"
 
@@ -56,6 +57,100 @@ struct FileHeader {
   }
 };
 
+/**
+ * @brief Kinds of pages allocated from extents of their own, so that pages of
+ *        one kind lie next to each other on disk.
+ */
+enum ExtentClass {
+  EXTENT_DEFAULT = 0,   // any page; every page of a PageFile
+  EXTENT_LEAF,          // B+ tree leaves
+  EXTENT_INNER,         // B+ tree non-leaf nodes and other index pages
+  NUM_EXTENT_CLASSES
+};
+
+/**
+ * @brief Run of page numbers reserved for one class of pages.
+ */
+struct Extent {
+  /**
+   * Next page of the run to hand out.
+   */
+  PageId next_page;
+
+  /**
+   * Page after the last page of the run.
+   */
+  PageId end_page;
+
+  /**
+   * Number of pages reserved the last time, doubled for the next run.
+   */
+  PageId pages;
+};
+
+/**
+ * @brief Where a page points in the used or free page list, as far as it is
+ *        known without reading the page from disk.
+ */
+struct PageLink {
+  /**
+   * Number of the next page in the list the page is on.
+   */
+  PageId next_page_number;
+
+  /**
+   * Whether the page is used; otherwise it is on the free list.
+   */
+  bool used;
+
+  /**
+   * Whether the two fields above have been filled in from the page.
+   */
+  bool known;
+};
+
+/**
+ * @brief In-memory state of an open file, shared by all File objects using it
+ *        just like the stream.
+ */
+struct FileState {
+  /**
+   * Header of the file.  Changes to the page lists are written through to
+   * disk; a larger num_pages alone is written back by File::flushHeader().
+   */
+  FileHeader header;
+
+  /**
+   * Whether header differs from the header on disk.
+   */
+  bool header_dirty;
+
+  /**
+   * Last page of the used page list, or Page::INVALID_NUMBER if not known.
+   */
+  PageId tail_page;
+
+  /**
+   * Links of the pages, by page number, filled in as pages are read and written.
+   */
+  std::vector<PageLink> links;
+
+  /**
+   * Pages being handed out, by extent class.
+   */
+  Extent extents[NUM_EXTENT_CLASSES];
+
+  /**
+   * Page after the last page reserved for any extent.
+   */
+  PageId reserved_end;
+
+  /**
+   * Descriptor the extents are reserved on disk through, or -1.
+   */
+  int fd;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
@@ -67,6 +162,8 @@ struct FileHeader {
  * If a file that has already been opened (possibly by another query), then the File class
  * detects this (by looking in the open_streams_ map) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
+ * The file header is kept in memory alongside the stream, so that reading a page
+ * costs one disk read.
  *
  * @warning This class is not threadsafe.
  */
@@ -134,6 +231,30 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page, typically a
+   * frame of the buffer pool, without building a Page in between.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into; its contents are overwritten.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPageInto(const PageId page_number, Page* page) const = 0;
+
+  /**
+   * Allocates a new page in the file, setting up the given page in place as the
+   * new page.  Pages that are not reused are handed out from an extent of
+   * their class, so that pages of one class are numbered, and stored,
+   * contiguously.
+   *
+   * @param new_page_number   Number assigned to the new page.
+   * @param page              Page to set up; its contents are overwritten.
+   * @param extent_class      Class of page, for files that keep classes apart.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page* page,
+                                const ExtentClass extent_class = EXTENT_DEFAULT) = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -164,6 +285,21 @@ class File {
    */
 	PageId getFirstPageNo();
 
+ 	/**
+   * Returns the number of pages allocated in the file (the header counts as page 0).
+   * Valid page numbers are therefore 1 to getNumPages() - 1, some of which may be free.
+   *
+   * @return  Number of pages allocated in the file.
+   */
+	PageId getNumPages();
+
+  /**
+   * Writes the file header to disk if it has changed since it was last
+   * written.  Done when the last File object on the file closes it, and by
+   * BufMgr::flushFile().
+   */
+  void flushHeader() const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -176,6 +312,26 @@ class File {
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
+  /**
+   * Pages reserved by the first extent of a class; every further extent of the
+   * class reserves twice as many as the one before, up to MAX_EXTENT_PAGES.
+   */
+  static const PageId MIN_EXTENT_PAGES = 64;
+  static const PageId MAX_EXTENT_PAGES = 1024;
+
+  /**
+   * Returns the number of the next page of the given class past the end of
+   * the file, reserving a new extent for the class when its extent is used up.
+   * Extents are reserved with fallocate() without changing the size of the
+   * file, so that an extent's pages are contiguous on disk and a file opened
+   * after a crash still finds num_pages from its size.  Pages of an extent
+   * that a file closes without handing out are not reused.
+   *
+   * @param extent_class  Class of page.
+   * @return  Number of page.
+   */
+  PageId takeExtentPage(const ExtentClass extent_class);
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
@@ -197,14 +353,17 @@ class File {
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, as kept in memory.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Sets the header for this file.  Changes to the used or free page list are
+   * written to disk straight away; a file that has only grown has its header
+   * written back by flushHeader(), since opening the file recovers num_pages
+   * from the size of the file.
    *
    * @param header  File header to write.
    */
@@ -212,6 +371,7 @@ class File {
 
   typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<FileState> > StateMap;
 
   /**
    * Streams for opened files.
@@ -223,6 +383,11 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * In-memory state of opened files.
+   */
+  static StateMap open_states_;
+
   /**
    * Name of the file this object represents.
    */
@@ -233,6 +398,11 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * In-memory state of the underlying file.
+   */
+  std::shared_ptr<FileState> state_;
+
   friend class FileIterator;
 };
 
@@ -310,6 +480,28 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file into the given page with a single read.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page* page) const override;
+
+  /**
+   * Allocates a new page in the file, in place.  Free pages are reused first.
+   * All other pages come from one extent, so that no page number is skipped,
+   * and the extent class is ignored.
+   *
+   * @param new_page_number   Number assigned to the new page.
+   * @param page              Page to set up as the new page.
+   * @param extent_class      Class of page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page* page,
+                        const ExtentClass extent_class = EXTENT_DEFAULT) override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -358,6 +550,19 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page, header and data in one read.
+   * If <allow_free> is not set, an exception will be thrown if the page read
+   * from disk is not currently in use.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPageInto(const PageId page_number, Page* page, const bool allow_free) const;
+
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
@@ -372,13 +577,57 @@ class PageFile : public File {
 
   /**
    * Reads only the header of the given page from disk (not the record data
-   * or slot table).  No bounds checking is performed.
+   * or slot table), and notes its link.  No bounds checking is performed.
    *
    * @param page_number   Number of page whose header is to be read.
    * @return  Header of page.
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Returns the link of the given page, reading the page header from disk only
+   * if the page has not been read or written through this file before.
+   *
+   * @param page_number   Number of page.
+   * @return  Link of page.
+   */
+  const PageLink& pageLink(const PageId page_number) const;
+
+  /**
+   * Notes the link of a page whose header has just been read or written.
+   *
+   * @param page_number   Number of page.
+   * @param header        Header of page.
+   */
+  void noteLink(const PageId page_number, const PageHeader& header) const;
+
+  /**
+   * Returns the number of the page after the given one in its page list.
+   *
+   * @param page_number   Number of page.
+   * @return  Number of next page.
+   */
+  PageId nextPageNumber(const PageId page_number) const {
+    return pageLink(page_number).next_page_number;
+  }
+
+  /**
+   * Points the given page at another page, writing only that field of its
+   * header to disk.
+   *
+   * @param page_number       Number of page to update.
+   * @param next_page_number  Number of page it now points to.
+   */
+  void setNextPageNumber(const PageId page_number, const PageId next_page_number);
+
+  /**
+   * Returns the last page of the used page list, walking the list only when
+   * it is not already known.
+   *
+   * @return  Number of last used page, or Page::INVALID_NUMBER if none.
+   */
+  PageId tailPage() const;
+
   friend class FileIterator;
 };
 
@@ -458,6 +707,24 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file into the given page with a single read.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   */
+  void readPageInto(const PageId page_number, Page* page) const override;
+
+  /**
+   * Allocates a new page in the file, in place, from the extent of its class.
+   *
+   * @param new_page_number   Number assigned to the new page.
+   * @param page              Page to set up as the new page.
+   * @param extent_class      Class of page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page* page,
+                        const ExtentClass extent_class = EXTENT_DEFAULT) override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
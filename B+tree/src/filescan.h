@@ -49,17 +49,17 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Current page being scanned, pinned until the scan moves off it.
    */
-  Page*         curPage;
+  ReadPageGuard curPage;
 
   FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * Second pin of the current page, taken by markDirty() so that the page is unpinned dirty
    */
-  bool  	      curDirtyFlag;
+  WritePageGuard curDirtyPage;
 };
 
 }
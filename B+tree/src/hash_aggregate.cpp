@@ -0,0 +1,594 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hash_aggregate.h"
+
+#include <cmath>
+#include <cstring>
+#include "file.h"
+#include "hash_join.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "parallel.h"
+#include "parallel_filescan.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+/**
+ * 2^SPILL_BITS spill partitions, on the high bits of the group hash.
+ */
+static const std::uint32_t SPILL_BITS = 6;
+
+/**
+ * Tags of the partial aggregates in the spill file.
+ */
+static const char SPILLED_GROUP = 'G';
+static const char SPILLED_DISTINCT = 'D';
+
+Aggregate Aggregate::countStar()
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_COUNT;
+	return aggregate;
+}
+
+Aggregate Aggregate::count(const ValueFunction &value)
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_COUNT;
+	aggregate.value = value;
+	return aggregate;
+}
+
+Aggregate Aggregate::sum(const NumberFunction &number)
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_SUM;
+	aggregate.number = number;
+	return aggregate;
+}
+
+Aggregate Aggregate::min(const NumberFunction &number)
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_MIN;
+	aggregate.number = number;
+	return aggregate;
+}
+
+Aggregate Aggregate::max(const NumberFunction &number)
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_MAX;
+	aggregate.number = number;
+	return aggregate;
+}
+
+Aggregate Aggregate::countDistinct(const ValueFunction &value)
+{
+	Aggregate aggregate;
+	aggregate.function = AGG_COUNT_DISTINCT;
+	aggregate.value = value;
+	return aggregate;
+}
+
+/**
+ * Partial aggregate of a group: the values taken so far, and the sum, minimum or maximum of them.
+ */
+struct AggState
+{
+	double value;
+	std::uint64_t count;
+};
+
+/**
+ * Hash of a distinct value of an aggregate of a group.
+ */
+static std::uint64_t distinctHash(std::uint64_t groupHash, std::uint32_t aggregate, const FieldString &value)
+{
+	return (groupHash * 0x9e3779b97f4a7c15ull + aggregate) ^ HashJoin::hashKey(value.data, value.size);
+}
+
+/**
+ * @brief Open-addressing table of the groups of one worker, and its set of distinct values.
+ *
+ * Both index their entries with linear probing over slots holding the entry number plus one, 0
+ * for an empty slot, and double when they are half full.
+ */
+class AggTable
+{
+ public:
+	struct Group
+	{
+		std::uint64_t hash;
+		std::uint32_t keyOffset;
+		std::uint32_t keyLength;
+	};
+
+	struct Distinct
+	{
+		std::uint64_t hash;
+		std::uint32_t group;
+		std::uint32_t aggregate;
+		std::uint32_t valueOffset;
+		std::uint32_t valueLength;
+	};
+
+	explicit AggTable(std::size_t numAggregates) : aggregates(numAggregates), records(0) { clear(); }
+
+	void clear()
+	{
+		groups.clear();
+		keys.clear();
+		states.clear();
+		distincts.clear();
+		values.clear();
+		groupSlots.assign(16, 0);
+		distinctSlots.assign(16, 0);
+	}
+
+	bool empty() const { return groups.empty(); }
+
+	/**
+	 * Bytes taken by the groups, their keys, partials and distinct values, and the slots.
+	 */
+	std::size_t bytes() const
+	{
+		return groups.size() * sizeof(Group) + keys.size() + states.size() * sizeof(AggState) +
+		       distincts.size() * sizeof(Distinct) + values.size() +
+		       (groupSlots.size() + distinctSlots.size()) * sizeof(std::uint32_t);
+	}
+
+	/**
+	 * Returns the number of a group, adding it with empty partials if it is new.
+	 */
+	std::uint32_t findOrInsert(std::uint64_t hash, const FieldString &key)
+	{
+		const std::size_t mask = groupSlots.size() - 1;
+		std::size_t slot = hash & mask;
+		for (; groupSlots[slot] != 0; slot = (slot + 1) & mask)
+		{
+			const Group &group = groups[groupSlots[slot] - 1];
+			if (group.hash == hash && group.keyLength == key.size && memcmp(&keys[group.keyOffset], key.data, key.size) == 0)
+				return groupSlots[slot] - 1;
+		}
+
+		const Group group = {hash, static_cast<std::uint32_t>(keys.size()), static_cast<std::uint32_t>(key.size)};
+		keys.insert(keys.end(), key.data, key.data + key.size);
+		const AggState empty = {0, 0};
+		states.insert(states.end(), aggregates, empty);
+		groups.push_back(group);
+		groupSlots[slot] = groups.size();
+		if (2 * groups.size() > groupSlots.size())
+			rehash(groupSlots, groups);
+		return groups.size() - 1;
+	}
+
+	/**
+	 * Put a value of an aggregate of a group in the distinct set.  Returns whether it was new.
+	 */
+	bool insertDistinct(std::uint64_t hash, std::uint32_t group, std::uint32_t aggregate, const FieldString &value)
+	{
+		const std::size_t mask = distinctSlots.size() - 1;
+		std::size_t slot = hash & mask;
+		for (; distinctSlots[slot] != 0; slot = (slot + 1) & mask)
+		{
+			const Distinct &distinct = distincts[distinctSlots[slot] - 1];
+			if (distinct.hash == hash && distinct.group == group && distinct.aggregate == aggregate &&
+			    distinct.valueLength == value.size && memcmp(&values[distinct.valueOffset], value.data, value.size) == 0)
+				return false;
+		}
+
+		const Distinct distinct = {hash, group, aggregate, static_cast<std::uint32_t>(values.size()),
+		                           static_cast<std::uint32_t>(value.size)};
+		values.insert(values.end(), value.data, value.data + value.size);
+		distincts.push_back(distinct);
+		distinctSlots[slot] = distincts.size();
+		if (2 * distincts.size() > distinctSlots.size())
+			rehash(distinctSlots, distincts);
+		return true;
+	}
+
+	AggState *partials(std::uint32_t group) { return &states[group * aggregates]; }
+	const AggState *partials(std::uint32_t group) const { return &states[group * aggregates]; }
+	FieldString key(const Group &group) const { return FieldString(keys.data() + group.keyOffset, group.keyLength); }
+	FieldString value(const Distinct &distinct) const
+	{
+		return FieldString(values.data() + distinct.valueOffset, distinct.valueLength);
+	}
+
+	std::size_t aggregates;
+	std::vector<Group> groups;
+	std::vector<char> keys;
+	std::vector<AggState> states;
+	std::vector<Distinct> distincts;
+	std::vector<char> values;
+
+	/**
+	 * Records this worker added, spilled or not.
+	 */
+	std::uint64_t records;
+
+ private:
+	template <typename Entry>
+	static void rehash(std::vector<std::uint32_t> &slots, const std::vector<Entry> &entries)
+	{
+		slots.assign(2 * slots.size(), 0);
+		const std::size_t mask = slots.size() - 1;
+		for (std::size_t i = 0; i < entries.size(); i++)
+		{
+			std::size_t slot = entries[i].hash & mask;
+			while (slots[slot] != 0)
+				slot = (slot + 1) & mask;
+			slots[slot] = i + 1;
+		}
+	}
+
+	std::vector<std::uint32_t> groupSlots;
+	std::vector<std::uint32_t> distinctSlots;
+};
+
+/**
+ * @brief Temporary PageFile holding spilled partial aggregates by partition.  Every worker gathers
+ * its partials in pages of its own and copies a page into the buffer pool once it is full.
+ */
+class AggSpillFile
+{
+ public:
+	AggSpillFile(BufMgr *bufferMgr, const std::string &fileName, std::uint32_t numWorkers)
+		: bufMgr(bufferMgr), name(fileName), pending(numWorkers), pages(1 << SPILL_BITS), numPages(0)
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+		file = new PageFile(name, true);
+	}
+
+	~AggSpillFile()
+	{
+		bufMgr->flushFile(file);
+		delete file;
+		File::remove(name);
+	}
+
+	void append(std::uint32_t workerId, std::uint32_t partition, const std::string &partial)
+	{
+		if (pending[workerId].empty())
+			pending[workerId].assign(pages.size(), Page());
+		Page &page = pending[workerId][partition];
+		if (!page.hasSpaceForRecord(partial))
+		{
+			writePending(page, partition);
+			page = Page();
+		}
+		page.insertRecord(partial);
+	}
+
+	/**
+	 * Write the partly filled pages of every worker.  No worker may be appending.
+	 */
+	void finish()
+	{
+		for (std::size_t w = 0; w < pending.size(); w++)
+		{
+			for (std::uint32_t p = 0; p < pending[w].size(); p++)
+			{
+				if (pending[w][p].begin() != pending[w][p].end())
+					writePending(pending[w][p], p);
+			}
+			std::vector<Page>().swap(pending[w]);
+		}
+	}
+
+	void read(std::uint32_t partition, const std::function<void(const std::string &partial)> &sink)
+	{
+		for (std::size_t i = 0; i < pages[partition].size(); i++)
+		{
+			const PageId pageNo = pages[partition][i];
+			Page *page;
+			bufMgr->readPage(file, pageNo, page);
+			for (PageIterator it = page->begin(); it != page->end(); it++)
+				sink(*it);
+			bufMgr->unPinPage(file, pageNo, false);
+		}
+	}
+
+	std::uint32_t numPartitions() const { return pages.size(); }
+	std::uint64_t pagesWritten() const { return numPages; }
+
+ private:
+	void writePending(Page &from, std::uint32_t partition)
+	{
+		PageId pageNo;
+		Page *page;
+		bufMgr->allocPage(file, pageNo, page);
+		for (PageIterator it = from.begin(); it != from.end(); it++)
+			page->insertRecord(*it);
+		bufMgr->unPinPage(file, pageNo, true);
+
+		std::lock_guard<std::mutex> guard(pagesMutex);
+		pages[partition].push_back(pageNo);
+		numPages++;
+	}
+
+	BufMgr *bufMgr;
+	std::string name;
+	PageFile *file;
+
+	/**
+	 * Pages being filled, per worker and partition.
+	 */
+	std::vector<std::vector<Page> > pending;
+
+	/**
+	 * Pages written, per partition.
+	 */
+	std::vector<std::vector<PageId> > pages;
+	std::mutex pagesMutex;
+	std::uint64_t numPages;
+};
+
+HashAggregate::HashAggregate(BufMgr *bufferMgr, const GroupFunction &groupFunction,
+                             const std::vector<Aggregate> &aggregateList, std::uint32_t workers,
+                             std::size_t budget, const std::string &spillFileName)
+	: bufMgr(bufferMgr), group(groupFunction), aggregates(aggregateList), memoryBudget(budget),
+	  spillName(spillFileName), spillFile(NULL), spills(0), start(std::chrono::steady_clock::now())
+{
+	if (workers == 0)
+		workers = defaultWorkerCount();
+	for (std::uint32_t w = 0; w < workers; w++)
+		tables.push_back(new AggTable(aggregates.size()));
+}
+
+HashAggregate::~HashAggregate()
+{
+	for (std::size_t w = 0; w < tables.size(); w++)
+		delete tables[w];
+	delete spillFile;
+}
+
+void HashAggregate::add(std::uint32_t workerId, const FieldString &record)
+{
+	FieldString key;
+	if (!group(record, key))
+		return;
+	AggTable &table = *tables[workerId];
+	table.records++;
+	const std::uint64_t hash = HashJoin::hashKey(key.data, key.size);
+	const std::uint32_t groupNo = table.findOrInsert(hash, key);
+	AggState *partials = table.partials(groupNo);
+
+	for (std::uint32_t i = 0; i < aggregates.size(); i++)
+	{
+		const Aggregate &aggregate = aggregates[i];
+		AggState &partial = partials[i];
+		FieldString value;
+		double number;
+		switch (aggregate.function)
+		{
+		case AGG_COUNT:
+			if (!aggregate.value || aggregate.value(record, value))
+				partial.count++;
+			break;
+		case AGG_SUM:
+			if (aggregate.number(record, number))
+			{
+				partial.value += number;
+				partial.count++;
+			}
+			break;
+		case AGG_MIN:
+		case AGG_MAX:
+			if (aggregate.number(record, number))
+			{
+				if (partial.count == 0 || (aggregate.function == AGG_MIN ? number < partial.value : number > partial.value))
+					partial.value = number;
+				partial.count++;
+			}
+			break;
+		case AGG_COUNT_DISTINCT:
+			if (aggregate.value(record, value) && table.insertDistinct(distinctHash(hash, i, value), groupNo, i, value))
+				partial.count++;
+			break;
+		}
+	}
+
+	if (table.bytes() > memoryBudget / tables.size())
+		spill(workerId);
+}
+
+/**
+ * Fold one partial aggregate into another.  Distinct counts are left alone: they are counted
+ * again as the distinct values are merged.
+ */
+static void mergePartial(AggFunction function, AggState &into, const AggState &from)
+{
+	switch (function)
+	{
+	case AGG_COUNT:
+		into.count += from.count;
+		break;
+	case AGG_SUM:
+		into.value += from.value;
+		into.count += from.count;
+		break;
+	case AGG_MIN:
+	case AGG_MAX:
+		if (from.count != 0 &&
+		    (into.count == 0 || (function == AGG_MIN ? from.value < into.value : from.value > into.value)))
+			into.value = from.value;
+		into.count += from.count;
+		break;
+	case AGG_COUNT_DISTINCT:
+		break;
+	}
+}
+
+void HashAggregate::spill(std::uint32_t workerId)
+{
+	{
+		std::lock_guard<std::mutex> guard(spillMutex);
+		if (spillFile == NULL)
+			spillFile = new AggSpillFile(bufMgr, spillName, tables.size());
+		spills++;
+	}
+
+	// A group as tag, key length, key and partials; a distinct value as tag, aggregate, key
+	// length, key and value, in the partition of its group
+	AggTable &table = *tables[workerId];
+	std::string partial;
+	for (std::size_t g = 0; g < table.groups.size(); g++)
+	{
+		const AggTable::Group &group = table.groups[g];
+		const std::uint16_t keyLength = group.keyLength;
+		partial.assign(1, SPILLED_GROUP);
+		partial.append(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+		partial.append(&table.keys[group.keyOffset], keyLength);
+		partial.append(reinterpret_cast<const char*>(table.partials(g)), aggregates.size() * sizeof(AggState));
+		spillFile->append(workerId, group.hash >> (64 - SPILL_BITS), partial);
+	}
+	for (std::size_t d = 0; d < table.distincts.size(); d++)
+	{
+		const AggTable::Distinct &distinct = table.distincts[d];
+		const AggTable::Group &group = table.groups[distinct.group];
+		const std::uint8_t aggregate = distinct.aggregate;
+		const std::uint16_t keyLength = group.keyLength;
+		partial.assign(1, SPILLED_DISTINCT);
+		partial.append(reinterpret_cast<const char*>(&aggregate), sizeof(aggregate));
+		partial.append(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+		partial.append(&table.keys[group.keyOffset], keyLength);
+		partial.append(&table.values[distinct.valueOffset], distinct.valueLength);
+		spillFile->append(workerId, group.hash >> (64 - SPILL_BITS), partial);
+	}
+
+	const std::uint64_t records = table.records;
+	table.clear();
+	table.records = records;
+}
+
+void HashAggregate::mergeTable(AggTable &into, const AggTable &from)
+{
+	std::vector<std::uint32_t> groupMap(from.groups.size());
+	for (std::size_t g = 0; g < from.groups.size(); g++)
+	{
+		const AggTable::Group &group = from.groups[g];
+		groupMap[g] = into.findOrInsert(group.hash, from.key(group));
+		AggState *partials = into.partials(groupMap[g]);
+		for (std::size_t i = 0; i < aggregates.size(); i++)
+			mergePartial(aggregates[i].function, partials[i], from.partials(g)[i]);
+	}
+	for (std::size_t d = 0; d < from.distincts.size(); d++)
+	{
+		const AggTable::Distinct &distinct = from.distincts[d];
+		if (into.insertDistinct(distinct.hash, groupMap[distinct.group], distinct.aggregate, from.value(distinct)))
+			into.partials(groupMap[distinct.group])[distinct.aggregate].count++;
+	}
+}
+
+void HashAggregate::mergeSpilled(AggTable &into, const std::string &partial)
+{
+	const char *data = partial.data();
+	std::uint8_t aggregate = 0;
+	if (data[0] == SPILLED_DISTINCT)
+		aggregate = data[1];
+	const std::size_t keyAt = (data[0] == SPILLED_DISTINCT) ? 4 : 3;
+	std::uint16_t keyLength;
+	memcpy(&keyLength, data + keyAt - 2, sizeof(keyLength));
+	const FieldString key(data + keyAt, keyLength);
+	const std::uint64_t hash = HashJoin::hashKey(key.data, key.size);
+	const std::uint32_t groupNo = into.findOrInsert(hash, key);
+	AggState *partials = into.partials(groupNo);
+	const char *rest = key.data + keyLength;
+
+	if (data[0] == SPILLED_GROUP)
+	{
+		for (std::size_t i = 0; i < aggregates.size(); i++)
+		{
+			AggState from;
+			memcpy(&from, rest + i * sizeof(AggState), sizeof(AggState));
+			mergePartial(aggregates[i].function, partials[i], from);
+		}
+		return;
+	}
+	const FieldString value(rest, partial.size() - (rest - data));
+	if (into.insertDistinct(distinctHash(hash, aggregate, value), groupNo, aggregate, value))
+		partials[aggregate].count++;
+}
+
+void HashAggregate::emit(const AggTable &table, const GroupCallback &callback, AggregateStats &stats)
+{
+	std::vector<double> values(aggregates.size());
+	for (std::size_t g = 0; g < table.groups.size(); g++)
+	{
+		const AggState *partials = table.partials(g);
+		for (std::size_t i = 0; i < aggregates.size(); i++)
+		{
+			const bool isCount = aggregates[i].function == AGG_COUNT || aggregates[i].function == AGG_COUNT_DISTINCT;
+			values[i] = isCount ? partials[i].count : (partials[i].count == 0 ? NAN : partials[i].value);
+		}
+		callback(table.key(table.groups[g]), values.data());
+		stats.groups++;
+	}
+}
+
+AggregateStats HashAggregate::finish(const GroupCallback &callback)
+{
+	AggregateStats stats;
+	stats.workers = tables.size();
+	for (std::size_t w = 0; w < tables.size(); w++)
+		stats.records += tables[w]->records;
+
+	if (spillFile == NULL)
+	{
+		for (std::size_t w = 1; w < tables.size(); w++)
+		{
+			mergeTable(*tables[0], *tables[w]);
+			tables[w]->clear();
+		}
+		emit(*tables[0], callback, stats);
+	}
+	else
+	{
+		stats.spills = spills;
+		for (std::uint32_t w = 0; w < tables.size(); w++)
+		{
+			if (!tables[w]->empty())
+				spill(w);
+		}
+		spillFile->finish();
+		AggTable table(aggregates.size());
+		for (std::uint32_t p = 0; p < spillFile->numPartitions(); p++)
+		{
+			table.clear();
+			spillFile->read(p, [&](const std::string &partial) { mergeSpilled(table, partial); });
+			if (table.bytes() > memoryBudget)
+				stats.oversizedPartitions++;
+			emit(table, callback, stats);
+		}
+		stats.spillPages = spillFile->pagesWritten();
+		delete spillFile;
+		spillFile = NULL;
+	}
+	tables[0]->clear();
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+AggregateStats HashAggregate::scan(const std::string &relation, const GroupCallback &callback)
+{
+	ParallelFileScan scan(relation, bufMgr, tables.size());
+	scan.scan([this](std::uint32_t workerId, const RecordId &rid, const std::string &record) { add(workerId, record); });
+	return finish(callback);
+}
+
+}
@@ -0,0 +1,234 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "schema.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Aggregate functions.
+ */
+enum AggFunction {
+  AGG_COUNT,            // COUNT(*), or COUNT(x) with a value function
+  AGG_SUM,              // SUM(x)
+  AGG_MIN,              // MIN(x)
+  AGG_MAX,              // MAX(x)
+  AGG_COUNT_DISTINCT    // COUNT(DISTINCT x)
+};
+
+/**
+ * @brief One aggregate of a GROUP BY: a function and the value of a record it is taken over.
+ */
+struct Aggregate
+{
+  /**
+   * Number of a record for SUM, MIN and MAX.  Returns false for NULL, which is skipped.
+   */
+  typedef std::function<bool(const FieldString &record, double &value)> NumberFunction;
+
+  /**
+   * Value of a record for COUNT and COUNT DISTINCT, compared as bytes.  Returns false for NULL,
+   * which is not counted.
+   */
+  typedef std::function<bool(const FieldString &record, FieldString &value)> ValueFunction;
+
+  AggFunction function;
+  NumberFunction number;
+  ValueFunction value;
+
+  static Aggregate countStar();
+  static Aggregate count(const ValueFunction &value);
+  static Aggregate sum(const NumberFunction &number);
+  static Aggregate min(const NumberFunction &number);
+  static Aggregate max(const NumberFunction &number);
+  static Aggregate countDistinct(const ValueFunction &value);
+};
+
+/**
+ * @brief What an aggregation did.
+ */
+struct AggregateStats
+{
+  /**
+   * Records aggregated, after the group function left some out.
+   */
+  std::uint64_t records;
+
+  /**
+   * Groups handed to the callback.
+   */
+  std::uint64_t groups;
+
+  /**
+   * Workers the records were added by.
+   */
+  std::uint32_t workers;
+
+  /**
+   * Times a worker's partial aggregates outgrew its share of the budget and were spilled, and
+   * the pages written to the spill file.
+   */
+  std::uint32_t spills;
+  std::uint64_t spillPages;
+
+  /**
+   * Spill partitions whose groups alone were over the memory budget.
+   */
+  std::uint32_t oversizedPartitions;
+
+  /**
+   * Wall time from the construction of the HashAggregate to the last group emitted, in seconds.
+   */
+  double seconds;
+
+  AggregateStats()
+    : records(0), groups(0), workers(0), spills(0), spillPages(0), oversizedPartitions(0), seconds(0)
+  {
+  }
+};
+
+class AggTable;
+class AggSpillFile;
+
+/**
+ * @brief GROUP BY with COUNT, SUM, MIN, MAX and COUNT DISTINCT, by hashing.
+ *
+ * Every worker aggregates the records it is given into a table of its own, so workers never
+ * share a cache line: an open-addressing table with linear probing over the hashes of the group
+ * keys, whose groups keep their keys in an arena and their partial aggregates next to each other.
+ * COUNT DISTINCT keeps a second open-addressing set of (group, aggregate, value) and counts a value
+ * the first time it is put in the set.  When all records are in, the partial tables are merged.
+ *
+ * A worker whose table grows past its share of the memory budget writes the table out as partial
+ * aggregates, split on the high bits of the group hash into spill partitions of a temporary
+ * PageFile written through the buffer pool, and starts on an empty table.  If any worker spilled,
+ * every table is spilled at the end, and each spill partition is merged in memory by itself.
+ * Partials merge the way they would have been added: counts and sums are added up, minimums and
+ * maximums compared, and distinct values put in the set of the merged table.
+ *
+ * Group keys are compared as bytes, so a GROUP BY on several columns takes a key made of all
+ * of them.  An empty key aggregates the whole input as one group.
+ */
+class HashAggregate
+{
+ public:
+  /**
+   * Takes the group key of a record.  Returns false to leave the record out, which is how a
+   * WHERE clause is applied.  The key may point into the record.
+   */
+  typedef std::function<bool(const FieldString &record, FieldString &key)> GroupFunction;
+
+  /**
+   * Called once per group with the key and the value of every aggregate, in the order they were
+   * given.  Counts are whole numbers; a SUM, MIN or MAX over no values other than NULL is NaN.
+   */
+  typedef std::function<void(const FieldString &key, const double *values)> GroupCallback;
+
+  /**
+   * Constructor of HashAggregate class
+   *
+   * @param bufMgr        Buffer Manager the relation is scanned and partials spilled through
+   * @param group         Group key of a record
+   * @param aggregates    Aggregates to take per group
+   * @param numWorkers    Workers adding records, 0 for one per hardware thread
+   * @param memoryBudget  Bytes the tables of all workers may take before they spill
+   * @param spillName     Name of the temporary spill file
+   */
+  HashAggregate(BufMgr *bufMgr, const GroupFunction &group, const std::vector<Aggregate> &aggregates,
+                std::uint32_t numWorkers = 1, std::size_t memoryBudget = 64 << 20,
+                const std::string &spillName = "hashagg.spill");
+
+  ~HashAggregate();
+
+  /**
+   * Aggregate one record, e.g. one found by an index scan.  Workers may add records at the same time.
+   *
+   * @param workerId  Worker adding the record, below the number of workers
+   * @param record    Record to aggregate
+   */
+  void add(std::uint32_t workerId, const FieldString &record);
+
+  /**
+   * Merge the partial aggregates of the workers and hand every group to the callback, in no
+   * particular order.  No records may be added after.
+   *
+   * @param callback  Receives every group
+   * @return          What the aggregation did
+   */
+  AggregateStats finish(const GroupCallback &callback);
+
+  /**
+   * Aggregate every record of a relation with a ParallelFileScan on the workers, then finish().
+   *
+   * @param relation  Name of the relation
+   * @param callback  Receives every group
+   * @return          What the aggregation did
+   */
+  AggregateStats scan(const std::string &relation, const GroupCallback &callback);
+
+  /**
+   * Returns the number of workers.
+   */
+  std::uint32_t numWorkers() const { return tables.size(); }
+
+ private:
+  /**
+   * Write a worker's table out to the spill file and empty it.
+   */
+  void spill(std::uint32_t workerId);
+
+  /**
+   * Merge the groups of a table into another.
+   */
+  void mergeTable(AggTable &into, const AggTable &from);
+
+  /**
+   * Merge a partial aggregate read back from the spill file into a table.
+   */
+  void mergeSpilled(AggTable &into, const std::string &partial);
+
+  /**
+   * Hand the groups of a table to the callback.
+   */
+  void emit(const AggTable &table, const GroupCallback &callback, AggregateStats &stats);
+
+  BufMgr *bufMgr;
+  GroupFunction group;
+  std::vector<Aggregate> aggregates;
+  std::size_t memoryBudget;
+  std::string spillName;
+
+  /**
+   * Partial aggregates, one table per worker.
+   */
+  std::vector<AggTable*> tables;
+
+  /**
+   * Spill file, created by the first spill.
+   */
+  AggSpillFile *spillFile;
+
+  /**
+   * Serializes creating the spill file and counting spills.
+   */
+  std::mutex spillMutex;
+  std::uint32_t spills;
+
+  std::chrono::steady_clock::time_point start;
+};
+
+}
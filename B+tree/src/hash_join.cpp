@@ -0,0 +1,511 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hash_join.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "file.h"
+#include "filescan.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+/**
+ * A partition of the build table should fit in this much of the L2 cache.
+ */
+static const std::size_t PARTITION_BYTES = 256 << 10;
+
+/**
+ * At most 2^MAX_RADIX_BITS partitions, so that partitioning stays within the TLB.
+ */
+static const std::uint32_t MAX_RADIX_BITS = 10;
+
+/**
+ * At most 2^MAX_SPILL_BITS spill partitions, taken from the top of the hash.
+ */
+static const std::uint32_t MAX_SPILL_BITS = 8;
+
+/**
+ * Probe records sorted and probed together.
+ */
+static const std::size_t PROBE_BATCH = 4096;
+
+enum JoinSide {
+  BUILD_SIDE,
+  PROBE_SIDE
+};
+
+/**
+ * A key and its record in the arena of a table or a probe batch.  The key comes first.
+ */
+struct HashEntry
+{
+	std::uint64_t hash;
+	std::uint32_t offset;
+	std::uint16_t keyLength;
+	std::uint16_t recordLength;
+};
+
+static std::uint32_t ceilLog2(std::uint64_t n)
+{
+	std::uint32_t bits = 0;
+	while ((std::uint64_t(1) << bits) < n)
+		bits++;
+	return bits;
+}
+
+static void scanRelation(const std::string &name, BufMgr *bufMgr, const HashJoin::RecordSink &sink)
+{
+	FileScan scan(name, bufMgr);
+	for (;;)
+	{
+		RecordId rid;
+		try
+		{
+			scan.scanNext(rid);
+		}
+		catch (const EndOfFileException &e)
+		{
+			break;
+		}
+		sink(scan.getRecord());
+	}
+}
+
+/**
+ * Append a key and a record to an arena, returning the entry for them.
+ */
+static HashEntry appendEntry(std::vector<char> &arena, std::uint64_t hash, const FieldString &key,
+                             const std::string &record)
+{
+	const HashEntry entry = {hash, static_cast<std::uint32_t>(arena.size()), static_cast<std::uint16_t>(key.size),
+	                         static_cast<std::uint16_t>(record.size())};
+	arena.insert(arena.end(), key.data, key.data + key.size);
+	arena.insert(arena.end(), record.begin(), record.end());
+	return entry;
+}
+
+/**
+ * @brief In-memory build table: entries radix sorted on the low bits of their hash, first by
+ * partition and then by bucket within the partition, with a directory of where each bucket starts.
+ */
+class RadixHashTable
+{
+ public:
+	RadixHashTable() : radixBits(0), bucketBits(0) {}
+
+	void clear()
+	{
+		arena.clear();
+		entries.clear();
+		directory.clear();
+		radixBits = bucketBits = 0;
+	}
+
+	void insert(std::uint64_t hash, const FieldString &key, const std::string &record)
+	{
+		entries.push_back(appendEntry(arena, hash, key, record));
+	}
+
+	/**
+	 * Bytes taken by the entries and their keys and records.
+	 */
+	std::size_t bytes() const { return arena.size() + entries.size() * sizeof(HashEntry); }
+
+	/**
+	 * Sort the entries into partitions and buckets.  Nothing may be inserted after.
+	 */
+	void finalize()
+	{
+		const std::uint64_t numEntries = entries.size();
+		radixBits = std::min(MAX_RADIX_BITS, ceilLog2((bytes() + PARTITION_BYTES - 1) / PARTITION_BYTES));
+		bucketBits = ceilLog2(std::max<std::uint64_t>(numEntries >> radixBits, 1));
+		const std::uint32_t numPartitions = 1 << radixBits;
+		const std::uint64_t partitionMask = numPartitions - 1;
+		const std::uint64_t numBuckets = std::uint64_t(1) << bucketBits;
+
+		// Pass 1 scatters the entries to their partitions
+		std::vector<HashEntry> partitioned(numEntries);
+		std::vector<std::uint32_t> partitionStart(numPartitions + 1, 0);
+		for (std::size_t i = 0; i < numEntries; i++)
+			partitionStart[(entries[i].hash & partitionMask) + 1]++;
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+			partitionStart[p + 1] += partitionStart[p];
+		std::vector<std::uint32_t> cursor(partitionStart.begin(), partitionStart.end() - 1);
+		for (std::size_t i = 0; i < numEntries; i++)
+			partitioned[cursor[entries[i].hash & partitionMask]++] = entries[i];
+
+		// Pass 2 sorts each partition by bucket, while the partition is in cache
+		directory.assign((numPartitions << bucketBits) + 1, 0);
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+		{
+			std::uint32_t *buckets = &directory[p << bucketBits];
+			for (std::uint32_t i = partitionStart[p]; i < partitionStart[p + 1]; i++)
+				buckets[bucketOf(partitioned[i].hash) + 1]++;
+			buckets[0] = partitionStart[p];
+			for (std::uint64_t b = 0; b < numBuckets; b++)
+				buckets[b + 1] += buckets[b];
+			std::vector<std::uint32_t> next(buckets, buckets + numBuckets);
+			for (std::uint32_t i = partitionStart[p]; i < partitionStart[p + 1]; i++)
+				entries[next[bucketOf(partitioned[i].hash)]++] = partitioned[i];
+		}
+	}
+
+	std::uint32_t partitionOf(std::uint64_t hash) const
+	{
+		return hash & ((std::uint64_t(1) << radixBits) - 1);
+	}
+
+	/**
+	 * Entries of the bucket a hash falls in, as [begin, end).
+	 */
+	void bucket(std::uint64_t hash, const HashEntry *&begin, const HashEntry *&end) const
+	{
+		const std::uint64_t slot = (std::uint64_t(partitionOf(hash)) << bucketBits) | bucketOf(hash);
+		begin = entries.data() + directory[slot];
+		end = entries.data() + directory[slot + 1];
+	}
+
+	std::vector<char> arena;
+	std::vector<HashEntry> entries;
+
+	/**
+	 * Index of the first entry of each bucket of each partition, and one past the last entry.
+	 */
+	std::vector<std::uint32_t> directory;
+
+	std::uint32_t radixBits;
+	std::uint32_t bucketBits;
+
+ private:
+	std::uint64_t bucketOf(std::uint64_t hash) const
+	{
+		return (hash >> radixBits) & ((std::uint64_t(1) << bucketBits) - 1);
+	}
+};
+
+/**
+ * @brief Temporary PageFile holding the records of spill partitions, written and read through
+ * the buffer pool.  Records of a partition are gathered in a page in memory and copied into a
+ * page of the pool once it is full, so only one page of the file is pinned at a time.
+ */
+class JoinSpillFile
+{
+ public:
+	JoinSpillFile(BufMgr *bufferMgr, const std::string &fileName)
+		: bufMgr(bufferMgr), name(fileName), file(NULL), numPages(0)
+	{
+	}
+
+	~JoinSpillFile()
+	{
+		if (file == NULL)
+			return;
+		bufMgr->flushFile(file);
+		delete file;
+		File::remove(name);
+	}
+
+	bool isOpen() const { return file != NULL; }
+
+	/**
+	 * Create the file with room for a number of partitions per side.
+	 */
+	void open(std::uint32_t numPartitions)
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+		file = new PageFile(name, true);
+		for (int side = 0; side < 2; side++)
+		{
+			pending[side].assign(numPartitions, Page());
+			pages[side].assign(numPartitions, std::vector<PageId>());
+			counts[side].assign(numPartitions, 0);
+		}
+	}
+
+	void append(JoinSide side, std::uint32_t partition, const std::string &record)
+	{
+		Page &page = pending[side][partition];
+		if (!page.hasSpaceForRecord(record))
+		{
+			writePending(side, partition);
+			page = Page();
+		}
+		page.insertRecord(record);
+		counts[side][partition]++;
+	}
+
+	/**
+	 * Write the partly filled pages of one side.
+	 */
+	void finish(JoinSide side)
+	{
+		for (std::uint32_t p = 0; p < pending[side].size(); p++)
+		{
+			if (pending[side][p].begin() != pending[side][p].end())
+				writePending(side, p);
+			pending[side][p] = Page();
+		}
+	}
+
+	/**
+	 * Read the records of one partition of one side.
+	 */
+	void read(JoinSide side, std::uint32_t partition, const HashJoin::RecordSink &sink)
+	{
+		const std::vector<PageId> &list = pages[side][partition];
+		for (std::size_t i = 0; i < list.size(); i++)
+		{
+			Page *page;
+			bufMgr->readPage(file, list[i], page);
+			try
+			{
+				for (PageIterator it = page->begin(); it != page->end(); it++)
+					sink(*it);
+			}
+			catch (...)
+			{
+				bufMgr->unPinPage(file, list[i], false);
+				throw;
+			}
+			bufMgr->unPinPage(file, list[i], false);
+		}
+	}
+
+	std::uint32_t numPartitions() const { return counts[BUILD_SIDE].size(); }
+	std::uint64_t count(JoinSide side, std::uint32_t partition) const { return counts[side][partition]; }
+	std::uint64_t pagesWritten() const { return numPages; }
+
+ private:
+	void writePending(JoinSide side, std::uint32_t partition)
+	{
+		Page &from = pending[side][partition];
+		PageId pageNo;
+		Page *page;
+		bufMgr->allocPage(file, pageNo, page);
+		for (PageIterator it = from.begin(); it != from.end(); it++)
+			page->insertRecord(*it);
+		bufMgr->unPinPage(file, pageNo, true);
+		pages[side][partition].push_back(pageNo);
+		numPages++;
+	}
+
+	BufMgr *bufMgr;
+	std::string name;
+	PageFile *file;
+	std::vector<Page> pending[2];
+	std::vector<std::vector<PageId> > pages[2];
+	std::vector<std::uint64_t> counts[2];
+	std::uint64_t numPages;
+};
+
+std::uint64_t HashJoin::hashKey(const char *key, std::size_t len)
+{
+	// 8 bytes at a time, mixed with the finalizer of MurmurHash3
+	const std::uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+	std::uint64_t hash = len * multiplier;
+	while (len >= 8)
+	{
+		std::uint64_t word;
+		memcpy(&word, key, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 32;
+		key += 8;
+		len -= 8;
+	}
+	if (len > 0)
+	{
+		std::uint64_t word = 0;
+		memcpy(&word, key, len);
+		hash = (hash ^ word) * multiplier;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+HashJoin::HashJoin(BufMgr *bufferMgr, const JoinInput &buildInput, const JoinInput &probeInput,
+                   std::size_t budget, const std::string &spillFileName)
+	: bufMgr(bufferMgr), build(buildInput), probe(probeInput), memoryBudget(budget), spillName(spillFileName)
+{
+}
+
+HashJoinStats HashJoin::join(const JoinCallback &callback)
+{
+	return run(&callback, NULL);
+}
+
+HashJoinStats HashJoin::semiJoin(const SemiJoinCallback &callback)
+{
+	return run(NULL, &callback);
+}
+
+void HashJoin::probeTable(const RadixHashTable &table, const RecordSource &records, const JoinCallback *joinCallback,
+                          const SemiJoinCallback *semiCallback, HashJoinStats &stats, bool countProbes)
+{
+	std::vector<char> arena;
+	std::vector<HashEntry> batch, sorted;
+	std::vector<std::uint32_t> cursor;
+	const std::uint32_t numPartitions = 1 << table.radixBits;
+
+	// Probe a batch a partition at a time, so that each partition of the table is read from cache
+	std::function<void()> probeBatch = [&]() {
+		const std::vector<HashEntry> *order = &batch;
+		if (numPartitions > 1)
+		{
+			cursor.assign(numPartitions + 1, 0);
+			for (std::size_t i = 0; i < batch.size(); i++)
+				cursor[table.partitionOf(batch[i].hash) + 1]++;
+			for (std::uint32_t p = 0; p < numPartitions; p++)
+				cursor[p + 1] += cursor[p];
+			sorted.resize(batch.size());
+			for (std::size_t i = 0; i < batch.size(); i++)
+				sorted[cursor[table.partitionOf(batch[i].hash)]++] = batch[i];
+			order = &sorted;
+		}
+
+		for (std::size_t i = 0; i < order->size(); i++)
+		{
+			const HashEntry &probeEntry = (*order)[i];
+			const char *probeKey = arena.data() + probeEntry.offset;
+			const FieldString probeRecord(probeKey + probeEntry.keyLength, probeEntry.recordLength);
+			const HashEntry *it, *end;
+			table.bucket(probeEntry.hash, it, end);
+			for (; it != end; ++it)
+			{
+				const char *buildKey = table.arena.data() + it->offset;
+				if (it->hash != probeEntry.hash || it->keyLength != probeEntry.keyLength ||
+				    memcmp(buildKey, probeKey, probeEntry.keyLength) != 0)
+					continue;
+				stats.matches++;
+				if (semiCallback != NULL)
+				{
+					(*semiCallback)(probeRecord);
+					break;
+				}
+				(*joinCallback)(FieldString(buildKey + it->keyLength, it->recordLength), probeRecord);
+			}
+		}
+		arena.clear();
+		batch.clear();
+	};
+
+	records([&](const std::string &record) {
+		FieldString key;
+		if (!probe.key(record, key))
+			return;
+		if (countProbes)
+			stats.probeRecords++;
+		batch.push_back(appendEntry(arena, hashKey(key.data, key.size), key, record));
+		if (batch.size() == PROBE_BATCH)
+			probeBatch();
+	});
+	probeBatch();
+}
+
+HashJoinStats HashJoin::run(const JoinCallback *joinCallback, const SemiJoinCallback *semiCallback)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	HashJoinStats stats;
+	RadixHashTable table;
+	JoinSpillFile spill(bufMgr, spillName);
+	std::uint32_t spillBits = 0;
+
+	// Build in memory, until the table outgrows the budget
+	scanRelation(build.relation, bufMgr, [&](const std::string &record) {
+		FieldString key;
+		if (!build.key(record, key))
+			return;
+		stats.buildRecords++;
+		const std::uint64_t hash = hashKey(key.data, key.size);
+		if (spill.isOpen())
+		{
+			spill.append(BUILD_SIDE, hash >> (64 - spillBits), record);
+			return;
+		}
+		table.insert(hash, key, record);
+		if (table.bytes() <= memoryBudget)
+			return;
+
+		// Guess the build side is at most 4 times what it is now, and aim at half the budget
+		// per spill partition
+		spillBits = std::min(MAX_SPILL_BITS, std::max<std::uint32_t>(1, ceilLog2(8 * table.bytes() / memoryBudget)));
+		spill.open(1 << spillBits);
+		for (std::size_t i = 0; i < table.entries.size(); i++)
+		{
+			const HashEntry &entry = table.entries[i];
+			const std::string spilled(table.arena.data() + entry.offset + entry.keyLength, entry.recordLength);
+			spill.append(BUILD_SIDE, entry.hash >> (64 - spillBits), spilled);
+		}
+		table.clear();
+		std::vector<char>().swap(table.arena);
+		std::vector<HashEntry>().swap(table.entries);
+	});
+
+	if (!spill.isOpen())
+	{
+		table.finalize();
+		stats.radixBits = table.radixBits;
+		probeTable(table, [&](const RecordSink &sink) { scanRelation(probe.relation, bufMgr, sink); },
+		           joinCallback, semiCallback, stats, true);
+	}
+	else
+	{
+		// Grace hash join: partition the probe side the same way, then join partition by partition.
+		// Probe records of an empty build partition cannot match, so they are not spilled.
+		spill.finish(BUILD_SIDE);
+		scanRelation(probe.relation, bufMgr, [&](const std::string &record) {
+			FieldString key;
+			if (!probe.key(record, key))
+				return;
+			stats.probeRecords++;
+			const std::uint32_t partition = hashKey(key.data, key.size) >> (64 - spillBits);
+			if (spill.count(BUILD_SIDE, partition) != 0)
+				spill.append(PROBE_SIDE, partition, record);
+		});
+		spill.finish(PROBE_SIDE);
+
+		stats.spillPartitions = spill.numPartitions();
+		for (std::uint32_t p = 0; p < spill.numPartitions(); p++)
+		{
+			if (spill.count(BUILD_SIDE, p) == 0 || spill.count(PROBE_SIDE, p) == 0)
+				continue;
+			table.clear();
+			spill.read(BUILD_SIDE, p, [&](const std::string &record) {
+				FieldString key;
+				build.key(record, key);
+				table.insert(hashKey(key.data, key.size), key, record);
+			});
+			if (table.bytes() > memoryBudget)
+				stats.oversizedPartitions++;
+			table.finalize();
+			stats.radixBits = std::max(stats.radixBits, table.radixBits);
+			probeTable(table, [&](const RecordSink &sink) { spill.read(PROBE_SIDE, p, sink); },
+			           joinCallback, semiCallback, stats, false);
+		}
+		stats.spillPages = spill.pagesWritten();
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+}
@@ -0,0 +1,189 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "schema.h"
+
+namespace badgerdb {
+
+/**
+ * @brief One side of a join: a relation scanned with FileScan, and how to get the join key of
+ * its records.
+ */
+struct JoinInput
+{
+  /**
+   * Takes the join key of a record.  Returns false to leave the record out of the join, which
+   * is how a selection on the input (or a NULL key) is applied.  The key may point into the
+   * record.
+   */
+  typedef std::function<bool(const FieldString &record, FieldString &key)> KeyFunction;
+
+  /**
+   * Name of the relation.
+   */
+  std::string relation;
+
+  /**
+   * Join key of a record.
+   */
+  KeyFunction key;
+
+  JoinInput(const std::string &name, const KeyFunction &keyFunction) : relation(name), key(keyFunction) {}
+};
+
+/**
+ * @brief What a join did.
+ */
+struct HashJoinStats
+{
+  /**
+   * Records of either side that took part, after the key functions left some out.
+   */
+  std::uint64_t buildRecords, probeRecords;
+
+  /**
+   * Pairs joined, or probe records emitted by a semi-join.
+   */
+  std::uint64_t matches;
+
+  /**
+   * Radix bits of the in-memory build table (the largest one, if the build side was spilled).
+   */
+  std::uint32_t radixBits;
+
+  /**
+   * Spill partitions, 0 if the build side fit in memory; pages written to the spill file.
+   */
+  std::uint32_t spillPartitions;
+  std::uint64_t spillPages;
+
+  /**
+   * Spill partitions whose build side alone was over the memory budget.
+   */
+  std::uint32_t oversizedPartitions;
+
+  /**
+   * Wall time of the join, in seconds.
+   */
+  double seconds;
+
+  HashJoinStats()
+    : buildRecords(0), probeRecords(0), matches(0), radixBits(0), spillPartitions(0), spillPages(0),
+      oversizedPartitions(0), seconds(0)
+  {
+  }
+};
+
+class RadixHashTable;
+class JoinSpillFile;
+
+/**
+ * @brief Equi-join and semi-join of two relations by hashing.
+ *
+ * The build side is read into a table that is radix partitioned on the low bits of the key hash,
+ * with as many partitions as it takes for each to fit in the L2 cache, and within a partition
+ * sorted by bucket, so that a bucket is one contiguous run of 16 byte entries (hash, offset,
+ * lengths) in front of the key and record bytes.  Probe records are taken in batches, each batch
+ * radix sorted on the same bits and probed a partition at a time, so the partition being probed
+ * stays in cache.
+ *
+ * If the build side grows past the memory budget, the join turns into a Grace hash join: both
+ * sides are split on the high bits of the hash into spill partitions written to a temporary
+ * PageFile through the buffer pool, and every pair of spill partitions is then joined in memory
+ * as above.  A spill partition whose build side is still over the budget is joined anyway and
+ * counted in HashJoinStats::oversizedPartitions.
+ *
+ * Keys are compared as bytes.  Records are handed to the callbacks as FieldStrings pointing into
+ * the join's buffers, valid until the callback returns, in no particular order.
+ */
+class HashJoin
+{
+ public:
+  /**
+   * Called for every pair of records with equal keys.
+   */
+  typedef std::function<void(const FieldString &build, const FieldString &probe)> JoinCallback;
+
+  /**
+   * Called for every probe record with at least one match.
+   */
+  typedef std::function<void(const FieldString &probe)> SemiJoinCallback;
+
+  /**
+   * Constructor of HashJoin class
+   *
+   * @param bufMgr        Buffer Manager the relations are scanned and partitions spilled through
+   * @param build         Side the table is built from, best the smaller one
+   * @param probe         Side looked up in the table
+   * @param memoryBudget  Bytes the build table may take before the join spills, below 4 GB
+   * @param spillName     Name of the temporary spill file
+   */
+  HashJoin(BufMgr *bufMgr, const JoinInput &build, const JoinInput &probe,
+           std::size_t memoryBudget = 64 << 20, const std::string &spillName = "hashjoin.spill");
+
+  /**
+   * Join the two sides.
+   *
+   * @param callback  Receives every matching pair
+   * @return          What the join did
+   */
+  HashJoinStats join(const JoinCallback &callback);
+
+  /**
+   * Semi-join: each probe record with a key in the build side, once.
+   *
+   * @param callback  Receives every probe record that has a match
+   * @return          What the join did
+   */
+  HashJoinStats semiJoin(const SemiJoinCallback &callback);
+
+  /**
+   * Receives the records of an input, one at a time.
+   */
+  typedef std::function<void(const std::string &record)> RecordSink;
+
+  /**
+   * Hands the records of an input, scanned or spilled, to a sink.
+   */
+  typedef std::function<void(const RecordSink &sink)> RecordSource;
+
+  /**
+   * Hash of a join key.  The in-memory table partitions on the low bits of the hash and the
+   * spill file on the high bits, so every bit has to be well mixed.
+   */
+  static std::uint64_t hashKey(const char *key, std::size_t len);
+
+ private:
+  /**
+   * Run the join, emitting pairs or probe records.
+   */
+  HashJoinStats run(const JoinCallback *joinCallback, const SemiJoinCallback *semiCallback);
+
+  /**
+   * Probe a table with the records of the probe side, scanned or spilled.
+   *
+   * @param countProbes  Whether to count the records in stats.probeRecords, not yet counted
+   */
+  void probeTable(const RadixHashTable &table, const RecordSource &records, const JoinCallback *joinCallback,
+                  const SemiJoinCallback *semiCallback, HashJoinStats &stats, bool countProbes);
+
+  BufMgr *bufMgr;
+  JoinInput build;
+  JoinInput probe;
+  std::size_t memoryBudget;
+  std::string spillName;
+};
+
+}
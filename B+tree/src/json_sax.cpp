@@ -0,0 +1,401 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "json_sax.h"
+
+#include <cstring>
+#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "exceptions/bad_json_exception.h"
+
+namespace badgerdb {
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Returns the first position from pos on holding a quote, a backslash or a control character,
+ * or len if there is none.
+ */
+static inline std::size_t findSpecial(const char *data, std::size_t pos, std::size_t len)
+{
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	for (; pos + 16 <= len; pos += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		// min(c, 0x1f) == c exactly for the bytes up to 0x1f
+		const __m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+		const int mask = _mm_movemask_epi8(special);
+		if (mask != 0)
+			return pos + __builtin_ctz(mask);
+	}
+#endif
+	for (; pos < len; pos++)
+	{
+		const unsigned char c = data[pos];
+		if (c == '"' || c == '\\' || c < 0x20)
+			return pos;
+	}
+	return len;
+}
+
+static void appendUtf8(std::string &out, std::uint32_t code)
+{
+	if (code < 0x80)
+		out += static_cast<char>(code);
+	else if (code < 0x800)
+	{
+		out += static_cast<char>(0xc0 | (code >> 6));
+		out += static_cast<char>(0x80 | (code & 0x3f));
+	}
+	else if (code < 0x10000)
+	{
+		out += static_cast<char>(0xe0 | (code >> 12));
+		out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code & 0x3f));
+	}
+	else
+	{
+		out += static_cast<char>(0xf0 | (code >> 18));
+		out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+		out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code & 0x3f));
+	}
+}
+
+JsonSaxParser::JsonSaxParser(JsonHandler *jsonHandler, const std::string &documentName)
+	: handler(jsonHandler), name(documentName), state(EXPECT_VALUE), consumed(0)
+{
+}
+
+void JsonSaxParser::fail(std::size_t pos, const std::string &reason) const
+{
+	std::stringstream ss;
+	ss << reason << " at byte " << consumed + pos;
+	throw BadJsonException(name, ss.str());
+}
+
+std::size_t JsonSaxParser::scanString(const char *data, std::size_t pos, std::size_t len, bool &escaped)
+{
+	escaped = false;
+	std::size_t i = pos + 1;
+	for (;;)
+	{
+		i = findSpecial(data, i, len);
+		if (i == len)
+			return 0;
+		if (data[i] == '"')
+			return i + 1;
+		if (data[i] != '\\')
+			fail(i, "control character in string");
+		// The escaped character is skipped whatever it is, unescape() checks it
+		escaped = true;
+		i += 2;
+		if (i > len)
+			return 0;
+	}
+}
+
+void JsonSaxParser::unescape(const char *s, std::size_t len, std::size_t pos)
+{
+	scratch.clear();
+	std::size_t i = 0;
+	while (i < len)
+	{
+		const char *backslash = static_cast<const char*>(memchr(s + i, '\\', len - i));
+		const std::size_t run = (backslash == NULL) ? len - i : backslash - (s + i);
+		scratch.append(s + i, run);
+		i += run;
+		if (i == len)
+			break;
+
+		const char c = s[i + 1];
+		i += 2;
+		switch (c)
+		{
+			case '"': scratch += '"'; break;
+			case '\\': scratch += '\\'; break;
+			case '/': scratch += '/'; break;
+			case 'b': scratch += '\b'; break;
+			case 'f': scratch += '\f'; break;
+			case 'n': scratch += '\n'; break;
+			case 'r': scratch += '\r'; break;
+			case 't': scratch += '\t'; break;
+			case 'u':
+			{
+				std::uint32_t code = 0;
+				for (int digit = 0; digit < 4; digit++)
+				{
+					const int value = (i < len) ? hexValue(s[i]) : -1;
+					if (value < 0)
+						fail(pos + i, "bad \\u escape");
+					code = (code << 4) | value;
+					i++;
+				}
+				if (code >= 0xd800 && code < 0xdc00)
+				{
+					// A high surrogate has to be followed by the low one of its pair
+					std::uint32_t low = 0;
+					if (i + 6 > len || s[i] != '\\' || s[i + 1] != 'u')
+						fail(pos + i, "unpaired surrogate");
+					for (int digit = 0; digit < 4; digit++)
+					{
+						const int value = hexValue(s[i + 2 + digit]);
+						if (value < 0)
+							fail(pos + i, "bad \\u escape");
+						low = (low << 4) | value;
+					}
+					if (low < 0xdc00 || low >= 0xe000)
+						fail(pos + i, "unpaired surrogate");
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					i += 6;
+				}
+				else if (code >= 0xdc00 && code < 0xe000)
+					fail(pos + i, "unpaired surrogate");
+				appendUtf8(scratch, code);
+				break;
+			}
+			default:
+				fail(pos + i - 1, "bad escape");
+		}
+	}
+}
+
+std::size_t JsonSaxParser::scanNumber(const char *data, std::size_t pos, std::size_t len, bool last)
+{
+	std::size_t i = pos;
+	if (data[i] == '-')
+		i++;
+	const std::size_t intStart = i;
+	while (i < len && isDigit(data[i]))
+		i++;
+	if (i == intStart && i < len)
+		fail(i, "bad number");
+	if (i - intStart > 1 && data[intStart] == '0')
+		fail(intStart, "leading zero in number");
+	if (i < len && data[i] == '.')
+	{
+		const std::size_t fracStart = ++i;
+		while (i < len && isDigit(data[i]))
+			i++;
+		if (i == fracStart && i < len)
+			fail(i, "bad number");
+	}
+	if (i < len && (data[i] == 'e' || data[i] == 'E'))
+	{
+		i++;
+		if (i < len && (data[i] == '+' || data[i] == '-'))
+			i++;
+		const std::size_t expStart = i;
+		while (i < len && isDigit(data[i]))
+			i++;
+		if (i == expStart && i < len)
+			fail(i, "bad number");
+	}
+	if (i == len)
+	{
+		// The number may go on in the next chunk
+		if (!last)
+			return 0;
+		const char end = data[len - 1];
+		if (!isDigit(end))
+			fail(len, "bad number");
+	}
+	return i;
+}
+
+void JsonSaxParser::endContainer()
+{
+	if (containers.back())
+		handler->endObject();
+	else
+		handler->endArray();
+	containers.pop_back();
+	state = containers.empty() ? DONE : EXPECT_COMMA_OR_END;
+}
+
+std::size_t JsonSaxParser::parse(const char *data, std::size_t len, bool last)
+{
+	std::size_t pos = 0;
+	for (;;)
+	{
+		while (pos < len && isSpace(data[pos]))
+			pos++;
+		if (pos == len)
+		{
+			if (last && state != DONE)
+				fail(pos, "unexpected end of document");
+			consumed += pos;
+			return pos;
+		}
+
+		const char c = data[pos];
+		switch (state)
+		{
+			case DONE:
+				fail(pos, "trailing characters after the document");
+
+			case EXPECT_COLON:
+				if (c != ':')
+					fail(pos, "expected ':'");
+				state = EXPECT_VALUE;
+				pos++;
+				continue;
+
+			case EXPECT_COMMA_OR_END:
+				if (c == ',')
+				{
+					state = containers.back() ? EXPECT_KEY : EXPECT_VALUE;
+					pos++;
+				}
+				else if (c == (containers.back() ? '}' : ']'))
+				{
+					endContainer();
+					pos++;
+				}
+				else
+					fail(pos, containers.back() ? "expected ',' or '}'" : "expected ',' or ']'");
+				continue;
+
+			case EXPECT_KEY_OR_END_OBJECT:
+				if (c == '}')
+				{
+					endContainer();
+					pos++;
+					continue;
+				}
+				// fall through
+			case EXPECT_KEY:
+			{
+				if (c != '"')
+					fail(pos, "expected a member name");
+				bool escaped;
+				const std::size_t end = scanString(data, pos, len, escaped);
+				if (end == 0)
+					break;
+				if (escaped)
+				{
+					unescape(data + pos + 1, end - pos - 2, pos + 1);
+					handler->key(scratch.data(), scratch.size());
+				}
+				else
+					handler->key(data + pos + 1, end - pos - 2);
+				state = EXPECT_COLON;
+				pos = end;
+				continue;
+			}
+
+			case EXPECT_VALUE_OR_END_ARRAY:
+				if (c == ']')
+				{
+					endContainer();
+					pos++;
+					continue;
+				}
+				// fall through
+			case EXPECT_VALUE:
+			{
+				std::size_t end = pos + 1;
+				if (c == '{' || c == '[')
+				{
+					if (containers.size() == MAX_DEPTH)
+						fail(pos, "nested too deep");
+					containers.push_back(c == '{');
+					if (c == '{')
+					{
+						handler->startObject();
+						state = EXPECT_KEY_OR_END_OBJECT;
+					}
+					else
+					{
+						handler->startArray();
+						state = EXPECT_VALUE_OR_END_ARRAY;
+					}
+					pos = end;
+					continue;
+				}
+				else if (c == '"')
+				{
+					bool escaped;
+					end = scanString(data, pos, len, escaped);
+					if (end == 0)
+						break;
+					if (escaped)
+					{
+						unescape(data + pos + 1, end - pos - 2, pos + 1);
+						handler->string(scratch.data(), scratch.size());
+					}
+					else
+						handler->string(data + pos + 1, end - pos - 2);
+				}
+				else if (c == '-' || isDigit(c))
+				{
+					end = scanNumber(data, pos, len, last);
+					if (end == 0)
+						break;
+					handler->number(data + pos, end - pos);
+				}
+				else if (c == 't' || c == 'f' || c == 'n')
+				{
+					const char *literal = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+					const std::size_t literalLen = strlen(literal);
+					end = pos + literalLen;
+					if (end > len)
+					{
+						if (memcmp(data + pos, literal, len - pos) != 0)
+							fail(pos, "bad literal");
+						break;
+					}
+					if (memcmp(data + pos, literal, literalLen) != 0)
+						fail(pos, "bad literal");
+					if (c == 'n')
+						handler->null();
+					else
+						handler->boolean(c == 't');
+				}
+				else
+					fail(pos, "expected a value");
+				state = containers.empty() ? DONE : EXPECT_COMMA_OR_END;
+				pos = end;
+				continue;
+			}
+		}
+
+		// The token at pos is cut by the end of the chunk
+		if (last)
+			fail(pos, "unexpected end of document");
+		consumed += pos;
+		return pos;
+	}
+}
+
+}
@@ -0,0 +1,179 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Receives the events of a JsonSaxParser, in document order.
+ *
+ * Strings, keys and numbers are passed as pointer and length.  They point either into the input
+ * or into a scratch buffer of the parser, and are only valid until the call returns.  Numbers are
+ * passed as their text, already checked against the JSON grammar.  A handler stops the parse by
+ * throwing.  Every event does nothing by default.
+ */
+class JsonHandler
+{
+ public:
+  virtual ~JsonHandler() {}
+
+  virtual void startObject() {}
+  virtual void endObject() {}
+  virtual void startArray() {}
+  virtual void endArray() {}
+
+  /**
+   * Name of the next member of the innermost object, unescaped.
+   */
+  virtual void key(const char *s, std::size_t len) {}
+
+  /**
+   * String value, unescaped to UTF-8.
+   */
+  virtual void string(const char *s, std::size_t len) {}
+
+  /**
+   * Number value, as written.
+   */
+  virtual void number(const char *s, std::size_t len) {}
+
+  virtual void boolean(bool value) {}
+  virtual void null() {}
+};
+
+/**
+ * @brief Streaming (SAX style) parser of one JSON document.
+ *
+ * The document is fed in chunks of any size; parse() reports the events of every token complete
+ * in the chunk and returns how many bytes it consumed.  It stops in front of a token cut by the
+ * end of the chunk, so the caller keeps the bytes it did not consume and presents them again at
+ * the start of the next chunk.  Nothing of the document is kept between calls but a stack of the
+ * open containers, so memory does not grow with the document.
+ *
+ * Strings are scanned 16 bytes at a time with SSE2 for the quote, backslash or control character
+ * ending the plain run, which is most of the work on text heavy documents.  Strings without
+ * escapes are handed over in place; others are unescaped into a scratch buffer first.
+ */
+class JsonSaxParser
+{
+ public:
+  /**
+   * Constructor of JsonSaxParser class
+   *
+   * @param handler  Receiver of the events
+   * @param name     Name of the document, for error messages
+   */
+  JsonSaxParser(JsonHandler *handler, const std::string &name);
+
+  /**
+   * Parse the next chunk of the document.
+   *
+   * @param data  Unconsumed bytes of the previous chunk followed by new ones
+   * @param len   Number of bytes at data
+   * @param last  Whether the document ends with this chunk
+   * @return      Number of bytes consumed; the rest starts with an incomplete token
+   * @throws BadJsonException  If the document is malformed, or ends early when last is set
+   */
+  std::size_t parse(const char *data, std::size_t len, bool last);
+
+  /**
+   * Returns whether the whole document has been parsed.
+   */
+  bool done() const { return state == DONE; }
+
+  /**
+   * Returns the number of bytes consumed so far.
+   */
+  std::uint64_t offset() const { return consumed; }
+
+  /**
+   * Containers may nest this deep.
+   */
+  static const std::size_t MAX_DEPTH = 512;
+
+ private:
+  /**
+   * What may come next.
+   */
+  enum State {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_END_ARRAY,
+    EXPECT_KEY_OR_END_OBJECT,
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_END,
+    DONE
+  };
+
+  /**
+   * Find the end of the string starting with the quote at pos.
+   *
+   * @param escaped  Set if the string contains escapes
+   * @return         One past the closing quote, or 0 if the string runs past len
+   */
+  std::size_t scanString(const char *data, std::size_t pos, std::size_t len, bool &escaped);
+
+  /**
+   * Find the end of the number starting at pos.
+   *
+   * @return  One past the number, or 0 if it may run past len
+   */
+  std::size_t scanNumber(const char *data, std::size_t pos, std::size_t len, bool last);
+
+  /**
+   * Unescape the body of a string into the scratch buffer.
+   */
+  void unescape(const char *s, std::size_t len, std::size_t pos);
+
+  /**
+   * Pop the innermost container.
+   */
+  void endContainer();
+
+  /**
+   * Throw a BadJsonException for the byte at pos of the current chunk.
+   */
+  void fail(std::size_t pos, const std::string &reason) const;
+
+  /**
+   * Receiver of the events.
+   */
+  JsonHandler *handler;
+
+  /**
+   * Name of the document.
+   */
+  std::string name;
+
+  /**
+   * What may come next.
+   */
+  State state;
+
+  /**
+   * Open containers, innermost last: true for an object, false for an array.
+   */
+  std::vector<bool> containers;
+
+  /**
+   * Unescaped string.
+   */
+  std::string scratch;
+
+  /**
+   * Bytes consumed by previous calls.
+   */
+  std::uint64_t consumed;
+};
+
+}
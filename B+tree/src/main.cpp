@@ -5,10 +5,16 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
 #include <vector>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "parallel_filescan.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
 #include "exceptions/insufficient_space_exception.h"
@@ -19,6 +25,24 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "buf_trace.h"
+#include "parallel.h"
+#include "wal.h"
+#include "recovery.h"
+#include "exceptions/bad_log_exception.h"
+#include "exceptions/index_unusable_exception.h"
+#include "json_sax.h"
+#include "ebay_loader.h"
+#include "ebay_schema.h"
+#include "exceptions/bad_json_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "hash_join.h"
+#include "external_sort.h"
+#include "sort_merge_join.h"
+#include "hash_aggregate.h"
 
 
 #define checkPassFail(a, b) 																				\
@@ -83,6 +107,30 @@ void test8();
 void test9();
 void test10();
 void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
 void errorTests();
 void deleteRelation();
 void largeInt();
@@ -97,6 +145,41 @@ void smallInt();
 void middleInt();
 void createRelationDiySize(int relationSize);
 void insertDiyTests();
+void parallelScanTests();
+void bulkInsertTests();
+void backgroundWriterTests();
+void flushFileTests();
+void evictionTests();
+void metricsTests();
+void traceTests();
+void walTests();
+void recoveryTests();
+void failedInsertTests();
+void crashIndex(BTreeIndex *index, LogManager *log);
+int recoveredKeys(File *indexFile);
+void ebayLoaderTests();
+int scanRelation(const std::string &name, std::vector<std::string> &records);
+void schemaTests();
+int bidScan(BTreeIndex *index, File *relation, int low, int high);
+void hashJoinTests();
+void writeRelation(const std::string &name, const std::vector<std::string> &records);
+void sortTests();
+void aggregateTests();
+void pageIntoTests();
+void fileHeaderTests();
+bool hasUsedPages(PageFile &file, const std::vector<PageId> &expected);
+void extentTests();
+void pageGuardTests();
+void pinnedLevelTests();
+int countScan(BTreeIndex *index, int low, int high);
+void splitPathTests();
+void appendSplitTests();
+int leafRuns(File *indexFile, int *numLeaves = NULL);
+void postingListTests();
+void flatDuplicateTests();
+int checkedScan(BTreeIndex *index, int low, int high);
+void packedLeafTests();
+void nonLeafSearchTests();
 
 int main(int argc, char **argv)
 {
@@ -168,6 +251,30 @@ int main(int argc, char **argv)
 	// test9();
 	// test10();
 	// test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
+	test27();
+	test28();
+	test29();
+	test30();
+	test31();
+	test32();
+	test33();
+	test34();
+	test35();
 	errorTests();
 
 	delete bufMgr;
@@ -293,6 +400,242 @@ void test11()
 	std::cout << "test11 passed" << std::endl;
 }
 
+void test12()
+{
+	// Scan a relation with ParallelFileScan and check every record is visited exactly once
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationRandom, parallel file scan" << std::endl;
+	createRelationRandom();
+	parallelScanTests();
+	deleteRelation();
+}
+
+void test13()
+{
+	// Bulk load an index, then keep inserting on both ends so that bulk loaded leaves split
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationForward, insert after bulk load" << std::endl;
+	createRelationForward();
+	bulkInsertTests();
+	deleteRelation();
+}
+
+void test14()
+{
+	// Build and scan an index while the background writer trickles dirty pages out
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationRandom, background writer and checkpoint" << std::endl;
+	createRelationRandom();
+	bufMgr->startBackgroundWriter(0.05, 0.1, 4, 1);
+	backgroundWriterTests();
+	bufMgr->stopBackgroundWriter();
+	deleteRelation();
+}
+
+void test15()
+{
+	// Flush one file while another file keeps dirty pages in the pool
+	std::cout << "--------------------" << std::endl;
+	std::cout << "flushFile with several files in the pool" << std::endl;
+	flushFileTests();
+	evictionTests();
+}
+
+void test16()
+{
+	// Run the index tests on a pool backed by huge pages and split into two NUMA sub-pools
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationRandom, huge page pool with two sub-pools" << std::endl;
+	BufPoolOptions options;
+	options.hugePages = true;
+	options.numaNodes = 2;
+	BufMgr *defaultBufMgr = bufMgr;
+	bufMgr = new BufMgr(1000, options);
+	checkPassFail(bufMgr->getNumNumaNodes(), 2)
+	createRelationRandom();
+	indexTests();
+	deleteRelation();
+	delete bufMgr;
+	bufMgr = defaultBufMgr;
+}
+
+void test17()
+{
+	// Check the buffer manager counts hits, misses and writes per operation and per file
+	std::cout << "--------------------" << std::endl;
+	std::cout << "buffer manager metrics" << std::endl;
+	metricsTests();
+}
+
+void test18()
+{
+	// Record a trace of an index build and scan, then read it back
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationForward, page access trace" << std::endl;
+	createRelationForward();
+	traceTests();
+	deleteRelation();
+}
+
+void test19()
+{
+	// Log page and index changes, check the log goes out ahead of the pages and commits share syncs
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationForward, write-ahead log" << std::endl;
+	createRelationForward();
+	walTests();
+	deleteRelation();
+}
+
+void test20()
+{
+	// Crash a logged index in the middle of an insert and recover it from the log
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationForward, crash recovery" << std::endl;
+	createRelationForward();
+	recoveryTests();
+	failedInsertTests();
+	deleteRelation();
+}
+
+void test21()
+{
+	// Stream JSON documents cut at every byte, and load eBay items into relations
+	std::cout << "--------------------" << std::endl;
+	std::cout << "eBay JSON loader" << std::endl;
+	ebayLoaderTests();
+}
+
+void test22()
+{
+	// Encode records of a compile-time schema, read them in place and index one of their fields
+	std::cout << "--------------------" << std::endl;
+	std::cout << "record schemas" << std::endl;
+	schemaTests();
+}
+
+void test23()
+{
+	// Join and semi-join eBay-shaped relations in memory and through spill partitions
+	std::cout << "--------------------" << std::endl;
+	std::cout << "hash join" << std::endl;
+	hashJoinTests();
+}
+
+void test24()
+{
+	// Sort a relation many times the memory given to it, and merge join sorted relations
+	std::cout << "--------------------" << std::endl;
+	std::cout << "external sort" << std::endl;
+	sortTests();
+}
+
+void test25()
+{
+	// GROUP BY with every aggregate, on one and several workers, in memory and spilled
+	std::cout << "--------------------" << std::endl;
+	std::cout << "hash aggregation" << std::endl;
+	aggregateTests();
+}
+
+void test26()
+{
+	// Allocate and read pages straight into a caller's page, as the buffer manager does with its frames
+	std::cout << "--------------------" << std::endl;
+	std::cout << "pages read in place" << std::endl;
+	pageIntoTests();
+}
+
+void test27()
+{
+	// Page lists kept in memory, shared by every File on the file and surviving a stale header on disk
+	std::cout << "--------------------" << std::endl;
+	std::cout << "cached file header" << std::endl;
+	fileHeaderTests();
+}
+
+void test28()
+{
+	// Pages of each class numbered contiguously, and B+ tree leaves allocated apart from the other nodes
+	std::cout << "--------------------" << std::endl;
+	std::cout << "extent allocation" << std::endl;
+	createRelationForward();
+	extentTests();
+	deleteRelation();
+}
+
+void test29()
+{
+	// Pages pinned through guards are unpinned on every way out of their scope, scans included
+	std::cout << "--------------------" << std::endl;
+	std::cout << "page guards" << std::endl;
+	BufMgr *defaultBufMgr = bufMgr;
+	bufMgr = new BufMgr(100);
+	createRelationForward();
+	pageGuardTests();
+	deleteRelation();
+	delete bufMgr;
+	bufMgr = defaultBufMgr;
+}
+
+void test30()
+{
+	// The root kept pinned through scans of other files, and lookups reaching the leaf with one access
+	std::cout << "--------------------" << std::endl;
+	std::cout << "pinned index levels" << std::endl;
+	createRelationForward();
+	pinnedLevelTests();
+	deleteRelation();
+}
+
+void test31()
+{
+	// Inserts deep enough to split non-leaf nodes, which are found again through the descent path
+	std::cout << "--------------------" << std::endl;
+	std::cout << "splits along the descent path" << std::endl;
+	createRelationForward();
+	splitPathTests();
+	deleteRelation();
+}
+
+void test32()
+{
+	// Ascending inserts fill leaves up to the append split point and skip the descent
+	std::cout << "--------------------" << std::endl;
+	std::cout << "append splits" << std::endl;
+	createRelationForward();
+	appendSplitTests();
+	deleteRelation();
+}
+
+void test33()
+{
+	// A low-cardinality key indexed with posting-list leaves, bulk loaded and then inserted into
+	std::cout << "--------------------" << std::endl;
+	std::cout << "posting list leaves" << std::endl;
+	postingListTests();
+	flatDuplicateTests();
+	deleteRelation();
+}
+
+void test34()
+{
+	// Bit-packed leaves, bulk loaded, inserted into in and out of order and scanned
+	std::cout << "--------------------" << std::endl;
+	std::cout << "bit-packed leaves" << std::endl;
+	createRelationForward();
+	packedLeafTests();
+	deleteRelation();
+}
+
+void test35()
+{
+	// Search of a non-leaf node through its separator key summary
+	std::cout << "--------------------" << std::endl;
+	std::cout << "non-leaf node search" << std::endl;
+	nonLeafSearchTests();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -670,6 +1013,2200 @@ void insertDiyTests()
 	checkPassFail(intScan(&index,17,GTE,30,LTE), 3)
 }
 
+// -----------------------------------------------------------------------------
+// parallelScanTests
+// -----------------------------------------------------------------------------
+
+void parallelScanTests()
+{
+	for(std::uint32_t workers = 1; workers <= 4; workers *= 2)
+	{
+		ParallelFileScan pscan(relationName, bufMgr, workers, 3);
+		std::vector<int> seen(relationSize, 0);
+
+		pscan.scan([&](std::uint32_t workerId, const RecordId &scanRid, const std::string &recordStr) {
+			const RECORD *rec = reinterpret_cast<const RECORD*>(recordStr.data());
+			__sync_fetch_and_add(&seen[rec->i], 1);
+		});
+
+		int numRecords = 0;
+		int numDuplicates = 0;
+		for(int i = 0; i < relationSize; i++)
+		{
+			numRecords += (seen[i] > 0);
+			numDuplicates += (seen[i] > 1);
+		}
+		std::cout << "Workers: " << workers << std::endl;
+		checkPassFail(numRecords, relationSize)
+		checkPassFail(numDuplicates, 0)
+	}
+}
+
+// -----------------------------------------------------------------------------
+// bulkInsertTests
+// -----------------------------------------------------------------------------
+
+void bulkInsertTests()
+{
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+	// Extra entries all point at the first record of the relation
+	RecordId firstRid = {1, 1, 0};
+	for(int key = relationSize; key < relationSize + 3000; key++)
+		index.insertEntry(&key, firstRid);
+	for(int key = -1; key >= -1000; key--)
+		index.insertEntry(&key, firstRid);
+
+	checkPassFail(intScan(&index,25,GT,40,LT), 14)
+	checkPassFail(intScan(&index,4990,GTE,relationSize + 3000,LT), 3010)
+	checkPassFail(intScan(&index,-1000,GTE,10,LT), 1010)
+	checkPassFail(intScan(&index,-5000,GT,relationSize + 5000,LT), relationSize + 4000)
+}
+
+// -----------------------------------------------------------------------------
+// backgroundWriterTests
+// -----------------------------------------------------------------------------
+
+void backgroundWriterTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+	// Dirty a good part of the pool, then check a checkpoint leaves nothing dirty behind
+	RecordId firstRid = {1, 1, 0};
+	for(int key = relationSize; key < relationSize + 20000; key++)
+		index.insertEntry(&key, firstRid);
+	bufMgr->checkpoint(8);
+	checkPassFail(bufMgr->getNumDirtyFrames(), 0)
+
+	checkPassFail(intScan(&index,25,GT,40,LT), 14)
+	checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+	checkPassFail(intScan(&index,relationSize,GTE,relationSize + 20000,LT), 20000)
+}
+
+// -----------------------------------------------------------------------------
+// flushFileTests
+// -----------------------------------------------------------------------------
+
+void flushFileTests()
+{
+	const std::string nameA = "relA.flush";
+	const std::string nameB = "relB.flush";
+	{
+		PageFile fileA = PageFile::create(nameA);
+		PageFile fileB = PageFile::create(nameB);
+		const std::uint32_t startDirty = bufMgr->getNumDirtyFrames();
+
+		PageId pageNo;
+		Page *page;
+		PageId firstA = Page::INVALID_NUMBER;
+		for(int i = 0; i < 10; i++)
+		{
+			bufMgr->allocPage(&fileA, pageNo, page);
+			bufMgr->unPinPage(&fileA, pageNo, true);
+			if(firstA == Page::INVALID_NUMBER)
+				firstA = pageNo;
+			bufMgr->allocPage(&fileB, pageNo, page);
+			bufMgr->unPinPage(&fileB, pageNo, true);
+		}
+		checkPassFail(bufMgr->getNumDirtyFrames(), startDirty + 20)
+
+		// A pinned page makes the flush fail without writing or evicting anything
+		bufMgr->readPage(&fileA, firstA, page);
+		bool pinned = false;
+		try
+		{
+			bufMgr->flushFile(&fileA);
+		}
+		catch(const PagePinnedException &e)
+		{
+			pinned = true;
+		}
+		checkPassFail(pinned, true)
+		checkPassFail(bufMgr->getNumDirtyFrames(), startDirty + 20)
+		bufMgr->unPinPage(&fileA, firstA, false);
+
+		// Flushing one file leaves the other file's dirty pages alone
+		bufMgr->flushFile(&fileA);
+		checkPassFail(bufMgr->getNumDirtyFrames(), startDirty + 10)
+		bufMgr->flushFile(&fileB);
+		checkPassFail(bufMgr->getNumDirtyFrames(), startDirty)
+	}
+	File::remove(nameA);
+	File::remove(nameB);
+}
+
+// -----------------------------------------------------------------------------
+// evictionTests
+// -----------------------------------------------------------------------------
+
+void evictionTests()
+{
+	// Threads dirtying their own pages of a file four times the pool's size, so that most pins
+	// evict a dirty page and others pin or write back pages while its write-back has the latch let go
+	const std::string name = "relA.evict";
+	const int numThreads = 4;
+	const int numPages = 64;
+	const int rounds = 50;
+	{
+		BufMgr pool(16);
+		PageFile file = PageFile::create(name);
+		std::vector<PageId> pageNos(numPages);
+		std::vector<RecordId> rids(numPages);
+		for(int i = 0; i < numPages; i++)
+		{
+			WritePageGuard page = pool.allocPage(&file, pageNos[i]);
+			rids[i] = page->insertRecord("00000000");
+		}
+
+		std::vector<std::thread> threads;
+		for(int t = 0; t < numThreads; t++)
+			threads.push_back(std::thread([&, t]() {
+				for(int round = 1; round <= rounds; round++)
+					for(int i = t; i < numPages; i += numThreads)
+					{
+						std::string stamp = std::to_string(round);
+						stamp.insert(0, 8 - stamp.size(), '0');
+						WritePageGuard page = pool.readPageForWrite(&file, pageNos[i]);
+						page->updateRecord(rids[i], stamp);
+					}
+			}));
+		for(int t = 0; t < numThreads; t++)
+			threads[t].join();
+
+		pool.flushFile(&file);
+		int current = 0;
+		for(int i = 0; i < numPages; i++)
+			current += (file.readPage(pageNos[i]).getRecord(rids[i]) == "00000050");
+		checkPassFail(current, numPages)
+	}
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// metricsTests
+// -----------------------------------------------------------------------------
+
+void metricsTests()
+{
+	const std::string name = "relA.metrics";
+	{
+		PageFile file = PageFile::create(name);
+		std::vector<PageId> pages;
+		bufMgr->clearMetrics();
+
+		PageId pageNo;
+		Page *page;
+		for(int i = 0; i < 10; i++)
+		{
+			bufMgr->allocPage(&file, pageNo, page);
+			bufMgr->unPinPage(&file, pageNo, true);
+			pages.push_back(pageNo);
+		}
+
+		// resident pages are hits, once flushed they are misses
+		for(std::size_t i = 0; i < pages.size(); i++)
+		{
+			bufMgr->readPage(&file, pages[i], page);
+			bufMgr->unPinPage(&file, pages[i], false);
+		}
+		bufMgr->flushFile(&file);
+		for(std::size_t i = 0; i < pages.size(); i++)
+		{
+			bufMgr->readPage(&file, pages[i], page);
+			bufMgr->unPinPage(&file, pages[i], false);
+		}
+
+		const BufMetrics &metrics = bufMgr->getMetrics();
+		checkPassFail(metrics.total(BUFOP_READ_PAGE, BUFEVENT_HIT), 10)
+		checkPassFail(metrics.total(BUFOP_READ_PAGE, BUFEVENT_MISS), 10)
+		checkPassFail(metrics.total(BUFOP_FLUSH_FILE, BUFEVENT_WRITE), 10)
+		checkPassFail(metrics.hitRatio(), 0.5)
+		checkPassFail(metrics.readLatency().count(), 10)
+
+		BufFileCounters counters = bufMgr->getFileCounters(name);
+		checkPassFail(counters.hits, 10)
+		checkPassFail(counters.misses, 10)
+		checkPassFail(counters.writes, 10)
+
+		bufMgr->flushFile(&file);
+		bufMgr->dumpMetrics(std::cout);
+	}
+	File::remove(name);
+
+	// a histogram bucket covers values within 1/8 of its lowest value
+	for(std::uint64_t v = 1; v < (1ULL << 40); v = v * 3 + 1)
+	{
+		const std::uint32_t bucket = LatencyHistogram::bucketOf(v);
+		if(LatencyHistogram::bucketLowest(bucket) > v || LatencyHistogram::bucketLowest(bucket + 1) <= v)
+		{
+			std::cout << "Bad histogram bucket for " << v << std::endl;
+			exit(1);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// traceTests
+// -----------------------------------------------------------------------------
+
+void traceTests()
+{
+	const std::string traceName = "relA.trace";
+	bufMgr->startTrace(traceName);
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+	}
+	bufMgr->stopTrace();
+	File::remove(intIndexName);
+
+	// every pin is matched by an unpin, and only the relation and the index are touched
+	BufTraceReader reader(traceName);
+	BufTraceRecord record;
+	std::uint64_t pins = 0, unpins = 0;
+	while(reader.next(record))
+	{
+		if(record.op == TRACE_READ_PAGE || record.op == TRACE_ALLOC_PAGE)
+			pins++;
+		else if(record.op == TRACE_UNPIN || record.op == TRACE_UNPIN_DIRTY)
+			unpins++;
+	}
+	const bool tracedPins = pins > 0;
+	checkPassFail(tracedPins, true)
+	checkPassFail(pins, unpins)
+	checkPassFail(reader.numFiles(), 2)
+	File::remove(traceName);
+}
+
+// -----------------------------------------------------------------------------
+// walTests
+// -----------------------------------------------------------------------------
+
+void walTests()
+{
+	const std::string logName = "relA.wal";
+	const std::string name = "relA.walpages";
+	const int numInserts = 500;
+	{
+		LogManager log(logName);
+		bufMgr->setLogManager(&log);
+		{
+			PageFile file = PageFile::create(name);
+
+			// A logged image of a new page, stamped in the page header
+			TxnId txn = log.beginTxn();
+			PageId pageNo;
+			Page *page;
+			bufMgr->allocPage(&file, pageNo, page);
+			const std::string data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			const std::uint16_t offset = Page::SIZE - data.size();
+			memcpy(reinterpret_cast<char*>(page) + offset, data.data(), data.size());
+			const std::string image(reinterpret_cast<char*>(page), Page::SIZE);
+			const Lsn insertLsn = log.logNodeImage(txn, &file, pageNo, NULL, image.data());
+			page->set_lsn(insertLsn);
+			bufMgr->unPinPage(&file, pageNo, true);
+
+			// Nothing is durable until the page is written back, which forces the log out first
+			const bool buffered = log.getFlushedLsn() <= insertLsn;
+			checkPassFail(buffered, true)
+			bufMgr->flushFile(&file);
+			const bool forced = log.getFlushedLsn() > insertLsn;
+			checkPassFail(forced, true)
+			log.commit(txn);
+
+			// Concurrent committers share syncs
+			log.setGroupCommitDelay(200);
+			const std::uint64_t syncs = log.getNumSyncs();
+			runWorkers(8, [&](std::uint32_t workerId) {
+				for(int i = 0; i < 25; i++)
+				{
+					TxnId updateTxn = log.beginTxn();
+					log.logNodeImage(updateTxn, &file, pageNo, image.data(), image.data());
+					log.commit(updateTxn);
+				}
+			});
+			log.setGroupCommitDelay(0);
+			checkPassFail(log.getNumCommits(), 201)
+			const bool grouped = log.getNumSyncs() - syncs < 200;
+			checkPassFail(grouped, true)
+		}
+		File::remove(name);
+
+		// Every insert into a logged index commits on its own
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+			index.setLogManager(&log);
+			RecordId firstRid = {1, 1, 0};
+			for(int key = relationSize; key < relationSize + numInserts; key++)
+				index.insertEntry(&key, firstRid);
+			checkPassFail(log.getNumCommits(), 201 + numInserts)
+			checkPassFail(intScan(&index,relationSize - 10,GTE,relationSize + numInserts,LT), 10 + numInserts)
+		}
+		bufMgr->setLogManager(NULL);
+		File::remove(intIndexName);
+	}
+
+	// Read the log back: records of a transaction are chained, and each ends in a commit
+	Lsn end;
+	{
+		LogReader reader(logName);
+		LogRecord record;
+		std::map<TxnId, Lsn> last;
+		int commits = 0, nodeWrites = 0;
+		bool chained = true;
+		while(reader.next(record))
+		{
+			if(record.prevLsn != (last.count(record.txn) ? last[record.txn] : 0))
+				chained = false;
+			last[record.txn] = record.lsn;
+			if(record.type == LOG_COMMIT)
+			{
+				commits++;
+				last.erase(record.txn);
+			}
+			else if(record.type == LOG_NODE_INSERT || record.type == LOG_NODE_IMAGE)
+				nodeWrites++;
+		}
+		checkPassFail(chained, true)
+		checkPassFail(commits, 201 + numInserts)
+		const bool loggedNodes = nodeWrites >= numInserts;
+		checkPassFail(loggedNodes, true)
+		end = reader.endLsn();
+	}
+
+	// A torn tail is cut off when the log is opened again
+	{
+		std::ofstream torn(logName.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+		torn << "torn record";
+	}
+	{
+		LogManager log(logName);
+		checkPassFail(log.getEndLsn(), end)
+	}
+
+	// So is a garbage header whose lengths add up to its size, without allocating gigabytes for it:
+	// checksum, size, prevLsn, undoNextLsn, txn, pageNo, type and offset, the three lengths, padding
+	{
+		std::uint32_t garbage[14] = {0};
+		garbage[1] = sizeof(garbage) + 3 * 0x50000000u;
+		garbage[9] = LOG_NODE_IMAGE;
+		garbage[10] = garbage[11] = garbage[12] = 0x50000000u;
+		std::ofstream torn(logName.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+		torn.write(reinterpret_cast<const char*>(garbage), sizeof(garbage));
+	}
+	{
+		LogManager log(logName);
+		checkPassFail(log.getEndLsn(), end)
+	}
+	File::remove(logName);
+}
+
+void recoveryTests()
+{
+	const std::string logName = "relA.recovery";
+	const int numInserts = 300;
+	int committed = 0;
+	int losers = 0;
+	{
+		LogManager *log = new LogManager(logName);
+		bufMgr->setLogManager(log);
+		BTreeIndex *index = new BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index->setLogManager(log);
+		RecoveryManager recovery(log, bufMgr);
+		RecordId firstRid = {1, 1, 0};
+
+		// Committed inserts on both sides of a checkpoint, then a crash a few records into the next ones
+		for(int key = relationSize; key < relationSize + numInserts; key++)
+		{
+			index->insertEntry(&key, firstRid);
+			committed++;
+			if(committed == numInserts / 2)
+				recovery.checkpoint();
+		}
+		log->injectCrash(8);
+		for(int key = relationSize + numInserts; ; key++)
+		{
+			const Lsn before = log->getEndLsn();
+			try
+			{
+				index->insertEntry(&key, firstRid);
+			}
+			catch(const BadLogException &e)
+			{
+				losers = (log->getEndLsn() > before) ? 1 : 0;
+				break;
+			}
+			committed++;
+		}
+
+		// Another committer forces the log, unfinished insert included; then only the log and
+		// the pages written before the crash survive
+		log->flushAll();
+		crashIndex(index, log);
+	}
+
+	{
+		LogManager log(logName);
+		bufMgr->setLogManager(&log);
+		BlobFile file(intIndexName, false);
+		RecoveryManager recovery(&log, bufMgr);
+		recovery.addFile(&file);
+		RecoveryStats stats = recovery.recover(4, 8);
+		const int loserTxns = stats.loserTxns;
+		checkPassFail(loserTxns, losers)
+		const bool redone = stats.recordsRedone > 0;
+		checkPassFail(redone, true)
+		const bool undone = stats.recordsUndone > 0;
+		const bool crashedMidInsert = losers > 0;
+		checkPassFail(undone, crashedMidInsert)
+		checkPassFail(recoveredKeys(&file), relationSize + committed)
+
+		// Recovery ends with a checkpoint, so recovering again finds nothing to do
+		stats = recovery.recover(4, 8);
+		const int again = stats.recordsRedone + stats.loserTxns;
+		checkPassFail(again, 0)
+		checkPassFail(recoveredKeys(&file), relationSize + committed)
+		bufMgr->flushFile(&file);
+		bufMgr->setLogManager(NULL);
+	}
+	File::remove(intIndexName);
+	File::remove(logName);
+}
+
+/**
+ * Inserts that fail part way are rolled back and aborted, and the index goes on being used; one
+ * that cannot be rolled back leaves the index unusable and a loser for recovery.
+ */
+void failedInsertTests()
+{
+	const std::string logName = "relA.failed";
+	const int numInserts = 3000;
+	{
+		LogManager *log = new LogManager(logName);
+		bufMgr->setLogManager(log);
+		BTreeIndex *index = new BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		index->setLogManager(log);
+		RecoveryManager recovery(log, bufMgr);
+		RecordId firstRid = {1, 1, 0};
+
+		// Keys out of order, every third insert failing at its first record or at its second, the
+		// commit of one that fits its leaf; a failed insert is tried again
+		int failures = 0;
+		for(int i = 0; i < numInserts; i++)
+		{
+			const int key = relationSize + i * 7919 % numInserts;
+			if(i % 3 == 0)
+				log->injectFailure(1 + i / 3 % 2);
+			try
+			{
+				index->insertEntry(&key, firstRid);
+			}
+			catch(const BadLogException &e)
+			{
+				failures++;
+				index->insertEntry(&key, firstRid);
+			}
+			log->injectFailure(0);
+		}
+		const bool failed = failures > numInserts / 4;
+		checkPassFail(failed, true)
+		checkPassFail(countScan(index, 0, relationSize + numInserts), relationSize + numInserts)
+		bool eachOnce = true;
+		for(int key = relationSize; key < relationSize + numInserts; key++)
+			eachOnce = eachOnce && countScan(index, key, key) == 1;
+		checkPassFail(eachOnce, true)
+
+		// No failed insert is left active in the checkpoint
+		recovery.checkpoint();
+
+		// The log dies after the first change of an insert, so that it cannot be rolled back
+		log->injectCrash(2);
+		const int key = relationSize + numInserts;
+		bool crashed = false;
+		try
+		{
+			index->insertEntry(&key, firstRid);
+		}
+		catch(const BadLogException &e)
+		{
+			crashed = true;
+		}
+		checkPassFail(crashed, true)
+		bool unusable = false;
+		try
+		{
+			index->insertEntry(&key, firstRid);
+		}
+		catch(const IndexUnusableException &e)
+		{
+			unusable = true;
+		}
+		checkPassFail(unusable, true)
+
+		log->flushAll();
+		crashIndex(index, log);
+	}
+
+	{
+		LogManager log(logName);
+		bufMgr->setLogManager(&log);
+		BlobFile file(intIndexName, false);
+		RecoveryManager recovery(&log, bufMgr);
+		recovery.addFile(&file);
+		RecoveryStats stats = recovery.recover(4, 8);
+		const int loserTxns = stats.loserTxns;
+		checkPassFail(loserTxns, 1)
+		checkPassFail(recoveredKeys(&file), relationSize + numInserts)
+		bufMgr->flushFile(&file);
+		bufMgr->setLogManager(NULL);
+	}
+	File::remove(intIndexName);
+	File::remove(logName);
+}
+
+/**
+ * Crash testing: a crash leaves the index file and the log as they are on disk, so they are saved
+ * aside while the index and the log are torn down, which writes the index's pages back from the
+ * pool, and then put back.  The log should be forced first if its tail is meant to survive.
+ */
+void crashIndex(BTreeIndex *index, LogManager *log)
+{
+	const std::string names[2] = {intIndexName, log->filename()};
+	std::string saved[2];
+	for(int i = 0; i < 2; i++)
+	{
+		std::ifstream in(names[i].c_str(), std::ios::in | std::ios::binary);
+		std::ostringstream bytes;
+		bytes << in.rdbuf();
+		saved[i] = bytes.str();
+	}
+
+	log->simulateCrash();
+	bufMgr->setLogManager(NULL);
+	delete index;
+	delete log;
+
+	for(int i = 0; i < 2; i++)
+	{
+		std::ofstream out(names[i].c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(saved[i].data(), saved[i].size());
+	}
+}
+
+/**
+ * Walk a recovered integer index from its meta page down to the leftmost leaf and along the leaf
+ * chain.  Returns the number of keys if they are exactly 0, 1, 2, ... in order, -1 otherwise.
+ */
+int recoveredKeys(File *indexFile)
+{
+	// The meta page is the first page allocated in the index file
+	const PageId metaPageNo = 1;
+	Page *page;
+	bufMgr->readPage(indexFile, metaPageNo, page);
+	PageId pageNo = ((IndexMetaInfo *)page)->rootPageNo;
+	bufMgr->unPinPage(indexFile, metaPageNo, false);
+
+	for(int level = 0; level != 1; )
+	{
+		bufMgr->readPage(indexFile, pageNo, page);
+		NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+		level = node->level;
+		const PageId child = node->pageNoArray[0];
+		bufMgr->unPinPage(indexFile, pageNo, false);
+		pageNo = child;
+	}
+
+	int expected = 0;
+	while(pageNo != std::uint32_t(-1))
+	{
+		bufMgr->readPage(indexFile, pageNo, page);
+		LeafNodeInt *leaf = (LeafNodeInt *)page;
+		bool inOrder = true;
+		for(int i = 0; i < leaf->numValidKeys && inOrder; i++)
+			inOrder = leaf->keyArray[i] == expected++;
+		const PageId next = leaf->rightSibPageNo;
+		bufMgr->unPinPage(indexFile, pageNo, false);
+		if(!inOrder)
+			return -1;
+		pageNo = next;
+	}
+	return expected;
+}
+
+/**
+ * Writes the events of a JsonSaxParser out as text, so that two parses can be compared.
+ */
+class JsonEventLog : public JsonHandler
+{
+ public:
+	void startObject() { events += "{\n"; }
+	void endObject() { events += "}\n"; }
+	void startArray() { events += "[\n"; }
+	void endArray() { events += "]\n"; }
+	void key(const char *s, std::size_t len) { events += "key "; events.append(s, len); events += '\n'; }
+	void string(const char *s, std::size_t len) { events += "string "; events.append(s, len); events += '\n'; }
+	void number(const char *s, std::size_t len) { events += "number "; events.append(s, len); events += '\n'; }
+	void boolean(bool value) { events += value ? "true\n" : "false\n"; }
+	void null() { events += "null\n"; }
+
+	std::string events;
+};
+
+void ebayLoaderTests()
+{
+	const std::string prefix = "relA.ebay";
+	const std::string jsonNames[] = {"relA.items-0.json", "relA.items-1.json"};
+
+	// Escapes, a repeated category, bids by the seller and by a new user, no buy price
+	const std::string items0 =
+		"{\"Items\": [{\"ItemID\": \"1\", \"Name\": \"a \\\"quoted\\\" name\", "
+		"\"Category\": [\"Toys\", \"Dolls\", \"Toys\"], \"Currently\": \"$1,030.50\", \"First_Bid\": \"$5.00\", "
+		"\"Number_of_Bids\": \"2\", \"Bids\": [{\"Bid\": {\"Bidder\": {\"UserID\": \"bob\", \"Rating\": \"7\", "
+		"\"Location\": \"Madison, WI\", \"Country\": \"USA\"}, \"Time\": \"Dec-04-01 10:00:00\", \"Amount\": \"$6.00\"}}, "
+		"{\"Bid\": {\"Bidder\": {\"UserID\": \"seller1\", \"Rating\": \"42\"}, \"Time\": \"Dec-05-01 11:00:00\", "
+		"\"Amount\": \"$1,030.50\"}}], \"Location\": \"Here\", \"Country\": \"USA\", "
+		"\"Started\": \"Dec-03-01 18:10:40\", \"Ends\": \"Dec-13-01 18:10:40\", "
+		"\"Seller\": {\"UserID\": \"seller1\", \"Rating\": \"42\"}, "
+		"\"Description\": \"caf\\u00e9 \\ud83d\\ude00 back\\\\slash\"},\n"
+		"{\"ItemID\": \"2\", \"Name\": \"plain\", \"Category\": [\"Toys\"], \"Currently\": \"$3.00\", "
+		"\"Buy_Price\": \"$9.99\", \"First_Bid\": \"$3.00\", \"Number_of_Bids\": \"0\", \"Bids\": null, "
+		"\"Location\": \"There\", \"Country\": \"Canada\", \"Started\": \"Jan-01-02 00:00:00\", "
+		"\"Ends\": \"Jan-08-02 00:00:00\", \"Seller\": {\"UserID\": \"bob\", \"Rating\": \"7\"}, \"Description\": null}]}\n";
+	// A description too long for a page
+	const std::string items1 =
+		"{\"Items\": [{\"ItemID\": \"3\", \"Name\": \"long\", \"Category\": [\"Books\"], \"Currently\": \"$1.00\", "
+		"\"First_Bid\": \"$1.00\", \"Number_of_Bids\": \"1\", \"Bids\": [{\"Bid\": {\"Bidder\": {\"UserID\": \"carol\", "
+		"\"Rating\": \"0\"}, \"Time\": \"Jan-02-02 00:00:00\", \"Amount\": \"$1.00\"}}], \"Location\": \"There\", "
+		"\"Country\": \"Canada\", \"Started\": \"Jan-01-02 00:00:00\", \"Ends\": \"Jan-08-02 00:00:00\", "
+		"\"Seller\": {\"UserID\": \"bob\", \"Rating\": \"7\"}, \"Description\": \"" + std::string(9000, 'x') + "\"}]}";
+	const std::string documents[] = {items0, items1};
+	for(int i = 0; i < 2; i++)
+	{
+		std::ofstream out(jsonNames[i].c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out << documents[i];
+	}
+
+	// Cut anywhere, a document gives the events it gives in one piece
+	JsonEventLog whole;
+	JsonSaxParser(&whole, jsonNames[0]).parse(items0.data(), items0.size(), true);
+	bool sameEvents = true;
+	for(std::size_t cut = 0; cut <= items0.size() && sameEvents; cut++)
+	{
+		JsonEventLog pieces;
+		JsonSaxParser parser(&pieces, jsonNames[0]);
+		const std::size_t used = parser.parse(items0.data(), cut, false);
+		const std::string rest = items0.substr(used);
+		parser.parse(rest.data(), rest.size(), true);
+		sameEvents = parser.done() && pieces.events == whole.events;
+	}
+	checkPassFail(sameEvents, true)
+	const bool unescaped = whole.events.find("string a \"quoted\" name\n") != std::string::npos &&
+	                       whole.events.find("string caf\xc3\xa9 \xf0\x9f\x98\x80 back\\slash\n") != std::string::npos;
+	checkPassFail(unescaped, true)
+
+	const char *malformed[] = {"{\"a\": [1, 2}", "{\"a\" 1}", "[01]", "\"\\x\"", "\"\\ud800\"", "{\"a\": tru}",
+	                           "[1] 2", "[1,", "[\"tab\there\"]", "-"};
+	const int numMalformed = sizeof(malformed) / sizeof(malformed[0]);
+	int rejected = 0;
+	for(int i = 0; i < numMalformed; i++)
+	{
+		JsonEventLog ignored;
+		JsonSaxParser parser(&ignored, "malformed");
+		try
+		{
+			parser.parse(malformed[i], strlen(malformed[i]), true);
+		}
+		catch(const BadJsonException &e)
+		{
+			rejected++;
+		}
+	}
+	checkPassFail(rejected, numMalformed)
+
+	// Load both documents in chunks smaller than most tokens
+	{
+		EbayLoader loader(prefix);
+		const std::vector<std::string> files(jsonNames, jsonNames + 2);
+		const EbayLoadStats stats = loader.load(files, 2, 7);
+		checkPassFail(stats.items, 3)
+		checkPassFail(stats.bids, 3)
+		checkPassFail(stats.users, 3)
+		checkPassFail(stats.categories, 4)
+		checkPassFail(stats.truncatedDescriptions, 1)
+	}
+
+	std::vector<std::string> records;
+	checkPassFail(scanRelation(prefix + "Bid", records), 3)
+	checkPassFail(scanRelation(prefix + "User", records), 3)
+	checkPassFail(scanRelation(prefix + "Category", records), 4)
+	checkPassFail(scanRelation(prefix + "Item", records), 3)
+	bool decoded = false, fits = true;
+	for(std::size_t i = 0; i < records.size(); i++)
+	{
+		const RecordView<ItemSchema> item(records[i]);
+		if(item.get<ItemSchema::ITEM_ID>() == 1)
+			decoded = item.valid() && item.isNull(ItemSchema::BUY_PRICE) && !item.isNull(ItemSchema::DESCRIPTION) &&
+			          item.get<ItemSchema::CURRENTLY>() == 1030.5 && item.get<ItemSchema::STARTED>() == 1007403040 &&
+			          item.get<ItemSchema::NAME>() == "a \"quoted\" name" &&
+			          item.get<ItemSchema::DESCRIPTION>() == "caf\xc3\xa9 \xf0\x9f\x98\x80 back\\slash";
+		fits = fits && records[i].size() <= EbayLoader::maxRecordSize();
+	}
+	checkPassFail(decoded, true)
+	checkPassFail(fits, true)
+
+	const std::string tables[] = {"Item", "Bid", "User", "Category"};
+	for(int i = 0; i < 4; i++)
+		File::remove(prefix + tables[i]);
+	for(int i = 0; i < 2; i++)
+		File::remove(jsonNames[i]);
+}
+
+void schemaTests()
+{
+	const std::string name = "relA.bids";
+	const int numItems = 100, bidsPerItem = 7;
+
+	// Fields are found where the layout says, NULLs included
+	{
+		RecordBuilder<UserSchema> builder;
+		builder.set<UserSchema::USER_ID>(std::string("alice"));
+		builder.set<UserSchema::RATING>(-3);
+		builder.setNull<UserSchema::LOCATION>();
+		builder.set<UserSchema::COUNTRY>(std::string("USA"));
+		std::string record;
+		builder.encode(record);
+		const RecordView<UserSchema> user(record);
+		const bool sized = record.size() == UserLayout::VARCHAR_DATA + 8 && builder.size() == record.size();
+		checkPassFail(sized, true)
+		const bool read = user.valid() && user.get<UserSchema::USER_ID>() == "alice" &&
+		                  user.get<UserSchema::RATING>() == -3 && user.isNull(UserSchema::LOCATION) &&
+		                  user.get<UserSchema::LOCATION>().size == 0 && !user.isNull(UserSchema::COUNTRY) &&
+		                  user.get<UserSchema::COUNTRY>() == "USA";
+		checkPassFail(read, true)
+		const bool truncated = RecordView<UserSchema>(record.data(), record.size() - 1).valid();
+		checkPassFail(truncated, false)
+	}
+
+	// A relation of bids, indexed on item_id at the offset of its layout
+	{
+		PageFile file = PageFile::create(name);
+		RecordBuilder<BidSchema> builder;
+		std::string record;
+		PageId pageNo;
+		Page page = file.allocatePage(pageNo);
+		for(int i = 0; i < numItems * bidsPerItem; i++)
+		{
+			builder.set<BidSchema::ITEM_ID>(i % numItems);
+			builder.set<BidSchema::BIDDER_ID>(std::string(i % 13, 'b'));
+			builder.set<BidSchema::TIME>(1000000000 + i);
+			builder.set<BidSchema::AMOUNT>(i * 0.25);
+			builder.encode(record);
+			if(!page.hasSpaceForRecord(record))
+			{
+				file.writePage(pageNo, page);
+				page = file.allocatePage(pageNo);
+			}
+			page.insertRecord(record);
+		}
+		file.writePage(pageNo, page);
+	}
+
+	std::vector<std::string> records;
+	scanRelation(name, records);
+	bool inPlace = true;
+	for(std::size_t i = 0; i < records.size(); i++)
+	{
+		const RecordView<BidSchema> bid(records[i]);
+		const std::int64_t n = bid.get<BidSchema::TIME>() - 1000000000;
+		inPlace = inPlace && bid.valid() && bid.get<BidSchema::ITEM_ID>() == n % numItems &&
+		          bid.get<BidSchema::AMOUNT>() == n * 0.25 && bid.get<BidSchema::BIDDER_ID>().size == std::size_t(n % 13);
+	}
+	checkPassFail(inPlace, true)
+
+	std::string indexName;
+	{
+		BTreeIndex index(name, indexName, bufMgr, BidLayout::offset(BidSchema::ITEM_ID), INTEGER);
+		PageFile file(name, false);
+		checkPassFail(bidScan(&index, &file, 10, 19), 10 * bidsPerItem)
+		checkPassFail(bidScan(&index, &file, 0, numItems), numItems * bidsPerItem)
+		bufMgr->flushFile(&file);
+	}
+	File::remove(indexName);
+	File::remove(name);
+}
+
+void hashJoinTests()
+{
+	const std::string itemName = "relA.item", userName = "relA.user";
+	const int numUsers = 2000, numItems = 6000, numSellers = 2500;
+
+	// Users u0..u1999 and items sold by u0..u2499, so some sellers are not users and some users sell nothing
+	std::vector<std::string> users, items;
+	std::string record;
+	RecordBuilder<UserSchema> userBuilder;
+	for(int i = 0; i < numUsers; i++)
+	{
+		const std::string userId = "u" + std::to_string(i);
+		userBuilder.set<UserSchema::USER_ID>(userId);
+		userBuilder.set<UserSchema::RATING>(i % 100);
+		userBuilder.encode(record);
+		users.push_back(record);
+	}
+	RecordBuilder<ItemSchema> itemBuilder;
+	std::vector<int> soldBy(numSellers, 0);
+	for(int i = 0; i < numItems; i++)
+	{
+		const int seller = (i * 7919) % numSellers;
+		const std::string sellerId = "u" + std::to_string(seller);
+		itemBuilder.set<ItemSchema::ITEM_ID>(i);
+		itemBuilder.set<ItemSchema::SELLER_ID>(sellerId);
+		itemBuilder.set<ItemSchema::NUMBER_OF_BIDS>(i % 5);
+		itemBuilder.encode(record);
+		items.push_back(record);
+		soldBy[seller]++;
+	}
+	writeRelation(userName, users);
+	writeRelation(itemName, items);
+
+	int sellers = 0, sales = 0;
+	for(int i = 0; i < numUsers; i++)
+	{
+		sellers += soldBy[i] > 0;
+		sales += soldBy[i];
+	}
+
+	const JoinInput userInput(userName, [](const FieldString &user, FieldString &key) {
+		key = RecordView<UserSchema>(user).get<UserSchema::USER_ID>();
+		return true;
+	});
+	const JoinInput itemInput(itemName, [](const FieldString &item, FieldString &key) {
+		key = RecordView<ItemSchema>(item).get<ItemSchema::SELLER_ID>();
+		return true;
+	});
+	// Items with bids only, as a selection pushed into the key function
+	const JoinInput biddedInput(itemName, [](const FieldString &item, FieldString &key) {
+		const RecordView<ItemSchema> view(item);
+		key = view.get<ItemSchema::SELLER_ID>();
+		return view.get<ItemSchema::NUMBER_OF_BIDS>() > 0;
+	});
+	int biddedSellers = 0;
+	for(int i = 0; i < numUsers; i++)
+	{
+		bool bidded = false;
+		for(int j = 0; j < numItems && !bidded; j++)
+			bidded = (j * 7919) % numSellers == i && j % 5 > 0;
+		biddedSellers += bidded;
+	}
+
+	// Once with the build side in memory, once spilled to 8 KB partitions
+	const std::size_t budgets[] = {64 << 20, 8 << 10};
+	for(int b = 0; b < 2; b++)
+	{
+		// SELECT COUNT(*) FROM User WHERE user_id IN (SELECT seller_id FROM Item)
+		int semiMatches = 0;
+		bool distinct = true;
+		std::vector<bool> seen(numUsers, false);
+		HashJoin semi(bufMgr, itemInput, userInput, budgets[b], "relA.spill");
+		const HashJoinStats semiStats = semi.semiJoin([&](const FieldString &user) {
+			const int id = atoi(RecordView<UserSchema>(user).get<UserSchema::USER_ID>().str().c_str() + 1);
+			distinct = distinct && !seen[id];
+			seen[id] = true;
+			semiMatches++;
+		});
+		checkPassFail(semiMatches, sellers)
+		checkPassFail(distinct, true)
+		checkPassFail(semiStats.buildRecords, std::uint64_t(numItems))
+		checkPassFail(semiStats.probeRecords, std::uint64_t(numUsers))
+		checkPassFail((semiStats.spillPartitions > 0), (b == 1))
+
+		// SELECT COUNT(*) FROM Item, User WHERE seller_id = user_id
+		int joined = 0;
+		bool equal = true;
+		HashJoin join(bufMgr, userInput, itemInput, budgets[b], "relA.spill");
+		const HashJoinStats joinStats = join.join([&](const FieldString &user, const FieldString &item) {
+			equal = equal && RecordView<UserSchema>(user).get<UserSchema::USER_ID>() ==
+			                 RecordView<ItemSchema>(item).get<ItemSchema::SELLER_ID>().str();
+			joined++;
+		});
+		checkPassFail(joined, sales)
+		checkPassFail(equal, true)
+		checkPassFail(joinStats.matches, std::uint64_t(sales))
+		checkPassFail((joinStats.spillPartitions > 0), (b == 1))
+
+		int bidded = 0;
+		HashJoin(bufMgr, biddedInput, userInput, budgets[b], "relA.spill").semiJoin([&](const FieldString &) { bidded++; });
+		checkPassFail(bidded, biddedSellers)
+	}
+
+	File::remove(itemName);
+	File::remove(userName);
+}
+
+void sortTests()
+{
+	const std::string bidName = "relA.bids", itemName = "relA.item";
+	const int numBids = 20000, numItems = 1000;
+
+	// Bids on item ids up to 1199, so that some bids have no item
+	std::vector<std::string> bids, items;
+	std::vector<int> bidsOf(1200, 0);
+	std::string record;
+	RecordBuilder<BidSchema> bidBuilder;
+	for(int i = 0; i < numBids; i++)
+	{
+		const int itemId = (i * 7919 + 13) % 1200;
+		bidBuilder.set<BidSchema::ITEM_ID>(itemId);
+		bidBuilder.set<BidSchema::BIDDER_ID>(std::string(i % 11, 'b'));
+		bidBuilder.set<BidSchema::TIME>(i);
+		bidBuilder.encode(record);
+		bids.push_back(record);
+		bidsOf[itemId]++;
+	}
+	RecordBuilder<ItemSchema> itemBuilder;
+	for(int i = numItems - 1; i >= 0; i--)
+	{
+		itemBuilder.set<ItemSchema::ITEM_ID>(i);
+		itemBuilder.set<ItemSchema::SELLER_ID>(std::string("seller"));
+		itemBuilder.encode(record);
+		items.push_back(record);
+	}
+	writeRelation(bidName, bids);
+	writeRelation(itemName, items);
+
+	const ExternalSort::RecordLess byItem = [](const FieldString &a, const FieldString &b) {
+		return RecordView<BidSchema>(a).get<BidSchema::ITEM_ID>() < RecordView<BidSchema>(b).get<BidSchema::ITEM_ID>();
+	};
+
+	// 4 frames hold a few hundred bids, so there are many runs and merges of merges; 512 hold them all
+	const std::uint32_t frames[] = {4, 512};
+	for(int f = 0; f < 2; f++)
+	{
+		ExternalSort sorter(bufMgr, bidName, byItem, frames[f], "relA.sort");
+		int count = 0, previous = -1;
+		bool ordered = true;
+		std::vector<bool> seen(numBids, false);
+		const SortStats stats = sorter.sort([&](const FieldString &bid) {
+			const RecordView<BidSchema> view(bid);
+			ordered = ordered && view.get<BidSchema::ITEM_ID>() >= previous && !seen[view.get<BidSchema::TIME>()];
+			previous = view.get<BidSchema::ITEM_ID>();
+			seen[view.get<BidSchema::TIME>()] = true;
+			count++;
+		});
+		checkPassFail(count, numBids)
+		checkPassFail(ordered, true)
+		checkPassFail((stats.runs > frames[f]), (f == 0))
+		checkPassFail((stats.intermediateMerges > 0), (f == 0))
+		// Merged runs hand their pages on, so the file holds one copy of the bids and a page per run merged
+		checkPassFail((stats.runFilePages <= stats.runPages + frames[f]), true)
+	}
+
+	// Only the bids on items up to 99, pulled one at a time
+	{
+		ExternalSort sorter(bufMgr, bidName, byItem, 4, "relA.sort", [](const std::string &bid) {
+			return RecordView<BidSchema>(bid).get<BidSchema::ITEM_ID>() < 100;
+		});
+		int count = 0, expected = 0;
+		FieldString bid;
+		while(sorter.next(bid))
+			count++;
+		for(int i = 0; i < 100; i++)
+			expected += bidsOf[i];
+		checkPassFail(count, expected)
+	}
+
+	// Bid joined to Item on item_id, in item_id order
+	const SortMergeJoin::KeyLess intLess = [](const FieldString &a, const FieldString &b) {
+		std::int32_t x, y;
+		memcpy(&x, a.data, sizeof(x));
+		memcpy(&y, b.data, sizeof(y));
+		return x < y;
+	};
+	const JoinInput itemInput(itemName, [](const FieldString &item, FieldString &key) {
+		key = FieldString(item.data + ItemLayout::offset(ItemSchema::ITEM_ID), sizeof(std::int32_t));
+		return true;
+	});
+	const JoinInput bidInput(bidName, [](const FieldString &bid, FieldString &key) {
+		key = FieldString(bid.data + BidLayout::offset(BidSchema::ITEM_ID), sizeof(std::int32_t));
+		return true;
+	});
+	{
+		int joined = 0, expected = 0, previous = -1;
+		bool ordered = true;
+		SortMergeJoin join(bufMgr, itemInput, bidInput, 8, "relA.sort", intLess);
+		const MergeJoinStats stats = join.join([&](const FieldString &item, const FieldString &bid) {
+			const int itemId = RecordView<ItemSchema>(item).get<ItemSchema::ITEM_ID>();
+			ordered = ordered && itemId == RecordView<BidSchema>(bid).get<BidSchema::ITEM_ID>() && itemId >= previous;
+			previous = itemId;
+			joined++;
+		});
+		for(int i = 0; i < numItems; i++)
+			expected += bidsOf[i];
+		checkPassFail(joined, expected)
+		checkPassFail(ordered, true)
+		checkPassFail(stats.largestGroup, 1)
+		checkPassFail((stats.rightSort.runs > 0), true)
+	}
+
+	// Bids joined to bids on the same item: duplicate keys on both sides, in byte order
+	{
+		std::uint64_t joined = 0, expected = 0;
+		SortMergeJoin join(bufMgr, bidInput, bidInput, 8, "relA.sort");
+		const MergeJoinStats stats = join.join([&](const FieldString &, const FieldString &) { joined++; });
+		for(int i = 0; i < 1200; i++)
+			expected += std::uint64_t(bidsOf[i]) * bidsOf[i];
+		checkPassFail(joined, expected)
+		checkPassFail(stats.matches, expected)
+	}
+
+	File::remove(bidName);
+	File::remove(itemName);
+}
+
+void aggregateTests()
+{
+	const std::string categoryName = "relA.category", bidName = "relA.bids";
+	const int numItems = 3000, numBids = 12000;
+
+	// Item i is in (i % 6) + 1 categories, some of them twice
+	std::vector<std::string> categories, bids;
+	std::map<int, int> categoriesOf;
+	std::set<std::string> lowCategories;
+	std::string record;
+	RecordBuilder<CategorySchema> categoryBuilder;
+	for(int i = 0; i < numItems; i++)
+	{
+		for(int j = 0; j <= i % 6; j++)
+		{
+			const std::string name = "category " + std::to_string((i * 7 + j * j * 13) % 97);
+			categoryBuilder.set<CategorySchema::ITEM_ID>(i);
+			categoryBuilder.set<CategorySchema::CATEGORY_NAME>(name);
+			categoryBuilder.encode(record);
+			categories.push_back(record);
+			categoriesOf[i]++;
+			if(i < 300)
+				lowCategories.insert(name);
+		}
+	}
+	// Bids on 1000 items, with their sum, minimum, maximum and distinct bidders
+	struct BidTotals { double sum, min, max; std::set<std::string> bidders; };
+	std::map<int, BidTotals> totals;
+	RecordBuilder<BidSchema> bidBuilder;
+	for(int i = 0; i < numBids; i++)
+	{
+		const int itemId = (i * 7919) % 1000;
+		const double amount = (i * 37 % 1001) * 0.5;
+		const std::string bidder = "bidder" + std::to_string(i % 17);
+		bidBuilder.set<BidSchema::ITEM_ID>(itemId);
+		bidBuilder.set<BidSchema::BIDDER_ID>(bidder);
+		bidBuilder.set<BidSchema::AMOUNT>(amount);
+		bidBuilder.encode(record);
+		bids.push_back(record);
+		BidTotals &total = totals[itemId];
+		if(total.bidders.empty())
+		{
+			total.sum = 0;
+			total.min = total.max = amount;
+		}
+		total.sum += amount;
+		total.min = std::min(total.min, amount);
+		total.max = std::max(total.max, amount);
+		total.bidders.insert(bidder);
+	}
+	writeRelation(categoryName, categories);
+	writeRelation(bidName, bids);
+
+	int expectedFour = 0;
+	for(std::map<int, int>::const_iterator it = categoriesOf.begin(); it != categoriesOf.end(); it++)
+		expectedFour += it->second == 4;
+
+	const HashAggregate::GroupFunction byItem = [](const FieldString &record, FieldString &key) {
+		key = FieldString(record.data, sizeof(std::int32_t));
+		return true;
+	};
+	const Aggregate::NumberFunction amount = [](const FieldString &bid, double &value) {
+		value = RecordView<BidSchema>(bid).get<BidSchema::AMOUNT>();
+		return true;
+	};
+	std::vector<Aggregate> bidAggregates;
+	bidAggregates.push_back(Aggregate::sum(amount));
+	bidAggregates.push_back(Aggregate::min(amount));
+	bidAggregates.push_back(Aggregate::max(amount));
+	bidAggregates.push_back(Aggregate::countDistinct([](const FieldString &bid, FieldString &value) {
+		value = RecordView<BidSchema>(bid).get<BidSchema::BIDDER_ID>();
+		return true;
+	}));
+	bidAggregates.push_back(Aggregate::countStar());
+
+	// One worker with room for everything, then four with room for a few hundred groups each
+	const std::uint32_t workers[] = {1, 4};
+	const std::size_t budgets[] = {64 << 20, 64 << 10};
+	for(int run = 0; run < 2; run++)
+	{
+		// SELECT COUNT(*) FROM (SELECT item_id FROM Category GROUP BY item_id HAVING COUNT(*) = 4)
+		int four = 0, groups = 0;
+		HashAggregate perItem(bufMgr, byItem, std::vector<Aggregate>(1, Aggregate::countStar()), workers[run],
+		                      budgets[run], "relA.spill");
+		const AggregateStats itemStats = perItem.scan(categoryName, [&](const FieldString &, const double *values) {
+			four += values[0] == 4;
+			groups++;
+		});
+		checkPassFail(four, expectedFour)
+		checkPassFail(groups, numItems)
+		checkPassFail(itemStats.records, categories.size())
+		checkPassFail((itemStats.spills > 0), (run == 1))
+
+		// SELECT COUNT(DISTINCT category_name) FROM Category WHERE item_id < 300
+		double distinct = -1;
+		HashAggregate whole(bufMgr, [](const FieldString &category, FieldString &key) {
+			key = FieldString();
+			return RecordView<CategorySchema>(category).get<CategorySchema::ITEM_ID>() < 300;
+		}, std::vector<Aggregate>(1, Aggregate::countDistinct([](const FieldString &category, FieldString &value) {
+			value = RecordView<CategorySchema>(category).get<CategorySchema::CATEGORY_NAME>();
+			return true;
+		})), workers[run], budgets[run] / 64, "relA.spill");
+		const AggregateStats wholeStats = whole.scan(categoryName, [&](const FieldString &key, const double *values) {
+			distinct = key.size == 0 ? values[0] : -2;
+		});
+		checkPassFail(distinct, lowCategories.size())
+		checkPassFail(wholeStats.groups, 1)
+
+		// SELECT item_id, SUM(amount), MIN(amount), MAX(amount), COUNT(DISTINCT bidder_id), COUNT(*)
+		// FROM Bid GROUP BY item_id
+		bool agrees = true;
+		int bidGroups = 0;
+		HashAggregate perBid(bufMgr, byItem, bidAggregates, workers[run], budgets[run], "relA.spill");
+		perBid.scan(bidName, [&](const FieldString &key, const double *values) {
+			std::int32_t itemId;
+			memcpy(&itemId, key.data, sizeof(itemId));
+			const BidTotals &total = totals[itemId];
+			agrees = agrees && std::fabs(values[0] - total.sum) < 1e-6 && values[1] == total.min &&
+			         values[2] == total.max && values[3] == total.bidders.size() && values[4] == numBids / 1000;
+			bidGroups++;
+		});
+		checkPassFail(agrees, true)
+		checkPassFail(bidGroups, 1000)
+	}
+
+	// The bids of items 100 to 199 found by an index scan; MIN of nothing is NULL
+	std::string indexName;
+	{
+		BTreeIndex index(bidName, indexName, bufMgr, BidLayout::offset(BidSchema::ITEM_ID), INTEGER);
+		PageFile file(bidName, false);
+		std::vector<Aggregate> aggregates(bidAggregates.begin(), bidAggregates.begin() + 2);
+		aggregates.push_back(Aggregate::min([](const FieldString &, double &) { return false; }));
+		HashAggregate fromIndex(bufMgr, byItem, aggregates);
+		const int low = 100, high = 199;
+		RecordId scanRid;
+		Page *page;
+		index.startScan(&low, GTE, &high, LTE);
+		try
+		{
+			while(1)
+			{
+				index.scanNext(scanRid);
+				bufMgr->readPage(&file, scanRid.page_number, page);
+				fromIndex.add(0, page->getRecord(scanRid));
+				bufMgr->unPinPage(&file, scanRid.page_number, false);
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		bool agrees = true;
+		const AggregateStats stats = fromIndex.finish([&](const FieldString &key, const double *values) {
+			std::int32_t itemId;
+			memcpy(&itemId, key.data, sizeof(itemId));
+			agrees = agrees && itemId >= low && itemId <= high && std::fabs(values[0] - totals[itemId].sum) < 1e-6 &&
+			         values[1] == totals[itemId].min && std::isnan(values[2]);
+		});
+		checkPassFail(agrees, true)
+		checkPassFail(stats.groups, 100)
+		bufMgr->flushFile(&file);
+	}
+	File::remove(indexName);
+	File::remove(categoryName);
+	File::remove(bidName);
+}
+
+void pageIntoTests()
+{
+	const std::string name = "relA.pages";
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(name);
+
+		// A frame left holding another page comes back empty
+		Page *frame = new Page();
+		PageId first, second;
+		file.allocatePageInto(first, frame);
+		frame->insertRecord("left over from the first page");
+		file.writePage(first, *frame);
+		file.allocatePageInto(second, frame);
+		checkPassFail(frame->page_number(), second)
+		checkPassFail(frame->getFreeSpace(), file.readPage(second).getFreeSpace())
+		const bool firstEmpty = frame->begin() == frame->end();
+		checkPassFail(firstEmpty, true)
+
+		// A record written through one page is read back into another
+		const RecordId rid = frame->insertRecord("read in place");
+		file.writePage(second, *frame);
+		Page *other = new Page();
+		file.readPageInto(second, other);
+		checkPassFail(other->getRecord(rid), std::string("read in place"))
+		checkPassFail(other->page_number(), second)
+
+		// Pages past the end and deleted pages are not read
+		bool thrown = false;
+		try
+		{
+			file.readPageInto(second + 1, other);
+		}
+		catch(const InvalidPageException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		file.deletePage(first);
+		thrown = false;
+		try
+		{
+			file.readPageInto(first, other);
+		}
+		catch(const InvalidPageException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// The deleted page is handed out again, empty
+		PageId reused;
+		file.allocatePageInto(reused, other);
+		checkPassFail(reused, first)
+		const bool reusedEmpty = other->begin() == other->end();
+		checkPassFail(reusedEmpty, true)
+
+		delete frame;
+		delete other;
+	}
+	File::remove(name);
+}
+
+void fileHeaderTests()
+{
+	const std::string name = "relA.header", copyName = "relA.header.copy";
+	const char *names[] = {name.c_str(), copyName.c_str()};
+	for(int i = 0; i < 2; i++)
+	{
+		try
+		{
+			File::remove(names[i]);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+
+	std::vector<PageId> expected;
+	{
+		PageFile file = PageFile::create(name);
+		PageId pageNo;
+		for(int i = 0; i < 6; i++)
+		{
+			file.allocatePage(pageNo);
+			expected.push_back(pageNo);
+		}
+
+		// A second File on the same file sees the same pages without reading the header
+		PageFile other = PageFile::open(name);
+		checkPassFail(other.getNumPages(), 7)
+		checkPassFail(hasUsedPages(other, expected), true)
+
+		// Pages deleted through one are reused in order through the other
+		file.deletePage(3);
+		file.deletePage(6);
+		checkPassFail(other.getNumPages(), 7)
+		std::vector<PageId> left = expected;
+		left.erase(left.begin() + 5);
+		left.erase(left.begin() + 2);
+		checkPassFail(hasUsedPages(other, left), true)
+		other.allocatePage(pageNo);
+		checkPassFail(pageNo, 6)
+		other.allocatePage(pageNo);
+		checkPassFail(pageNo, 3)
+		checkPassFail(hasUsedPages(file, expected), true)
+		bool thrown = false;
+		try
+		{
+			file.readPage(7);
+		}
+		catch(const InvalidPageException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// Grow the file; its header on disk still counts 7 pages until it is written back
+		for(int i = 0; i < 3; i++)
+		{
+			file.allocatePage(pageNo);
+			expected.push_back(pageNo);
+		}
+		std::ifstream in(name.c_str(), std::ios::binary);
+		std::ofstream out(copyName.c_str(), std::ios::binary);
+		out << in.rdbuf();
+	}
+
+	// Opening a file whose header is stale takes the number of pages from its size
+	{
+		PageFile copy = PageFile::open(copyName);
+		checkPassFail(copy.getNumPages(), 10)
+		checkPassFail(hasUsedPages(copy, expected), true)
+		PageId pageNo;
+		copy.allocatePage(pageNo);
+		checkPassFail(pageNo, 10)
+	}
+
+	// Closing the file wrote its header back
+	{
+		PageFile file = PageFile::open(name);
+		checkPassFail(file.getNumPages(), 10)
+		checkPassFail(hasUsedPages(file, expected), true)
+	}
+	File::remove(name);
+	File::remove(copyName);
+}
+
+/**
+ * Whether the used page list of a file holds exactly the given pages, in order.
+ */
+bool hasUsedPages(PageFile &file, const std::vector<PageId> &expected)
+{
+	std::vector<PageId> pages;
+	for(FileIterator iter = file.begin(); iter != file.end(); ++iter)
+		pages.push_back((*iter).page_number());
+	return pages == expected;
+}
+
+void extentTests()
+{
+	const std::string name = "relA.extents";
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	// Leaves and inner pages allocated in turn are each numbered one after another
+	std::vector<PageId> leaves, inners;
+	PageId pageNo;
+	{
+		BlobFile file = BlobFile::create(name);
+		Page page;
+		file.allocatePageInto(pageNo, &page);
+		checkPassFail(pageNo, 1)
+		for(int i = 0; i < 100; i++)
+		{
+			file.allocatePageInto(pageNo, &page, EXTENT_LEAF);
+			page.insertRecord("leaf " + std::to_string(i));
+			file.writePage(pageNo, page);
+			leaves.push_back(pageNo);
+			if(i % 10 == 0)
+			{
+				file.allocatePageInto(pageNo, &page, EXTENT_INNER);
+				page.insertRecord("inner " + std::to_string(i));
+				file.writePage(pageNo, page);
+				inners.push_back(pageNo);
+			}
+		}
+		int leafBreaks = 0, innerBreaks = 0;
+		for(std::size_t i = 1; i < leaves.size(); i++)
+			leafBreaks += leaves[i] != leaves[i - 1] + 1;
+		for(std::size_t i = 1; i < inners.size(); i++)
+			innerBreaks += inners[i] != inners[i - 1] + 1;
+		checkPassFail(leafBreaks, 1)
+		checkPassFail(innerBreaks, 0)
+		checkPassFail(file.getNumPages(), std::max(leaves.back(), inners.back()) + 1)
+	}
+
+	// The pages are all there once the file is opened again, and new ones come after them
+	{
+		BlobFile file = BlobFile::open(name);
+		checkPassFail(file.getNumPages(), std::max(leaves.back(), inners.back()) + 1)
+		int found = 0;
+		for(std::size_t i = 0; i < leaves.size(); i++)
+		{
+			Page page = file.readPage(leaves[i]);
+			found += *page.begin() == "leaf " + std::to_string(i);
+		}
+		for(std::size_t i = 0; i < inners.size(); i++)
+		{
+			Page page = file.readPage(inners[i]);
+			found += *page.begin() == "inner " + std::to_string(i * 10);
+		}
+		checkPassFail(found, 110)
+		const PageId numPages = file.getNumPages();
+		Page page;
+		file.allocatePageInto(pageNo, &page, EXTENT_LEAF);
+		checkPassFail(pageNo, numPages)
+	}
+	File::remove(name);
+
+	// Leaves of an index built in key order follow each other on disk in key order
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		RecordId firstRid = {1, 1, 0};
+		for(int key = relationSize; key < relationSize + 20000; key++)
+			index.insertEntry(&key, firstRid);
+	}
+	{
+		BlobFile file(intIndexName, false);
+		const int runs = leafRuns(&file);
+		const bool contiguous = runs >= 1 && runs <= 2;
+		checkPassFail(contiguous, true)
+		bufMgr->flushFile(&file);
+	}
+	File::remove(intIndexName);
+}
+
+void pageGuardTests()
+{
+	const std::string name = "relA.guards";
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(name);
+		PageId pageNo;
+		RecordId recordId;
+
+		// A write guard unpins its page dirty when it goes out of scope
+		{
+			WritePageGuard page = bufMgr->allocPage(&file, pageNo);
+			recordId = page->insertRecord("guarded");
+		}
+		bool flushed = true;
+		try
+		{
+			bufMgr->flushFile(&file);
+		}
+		catch(const PagePinnedException &e)
+		{
+			flushed = false;
+		}
+		checkPassFail(flushed, true)
+		checkPassFail(file.readPage(pageNo).getRecord(recordId), "guarded")
+
+		// Moving a guard hands its pin over, and assigning over a guard drops the pin it held
+		ReadPageGuard first = bufMgr->readPage(&file, pageNo);
+		ReadPageGuard second = std::move(first);
+		checkPassFail(first.valid(), false)
+		checkPassFail(second.valid(), true)
+		checkPassFail(second->getRecord(recordId), "guarded")
+		second = bufMgr->readPage(&file, pageNo);
+		second.release();
+		checkPassFail(second.valid(), false)
+
+		// An exception thrown while the page is pinned unpins it on the way out
+		bool thrown = false;
+		try
+		{
+			ReadPageGuard page = bufMgr->readPage(&file, pageNo);
+			file.readPage(pageNo + 1);
+		}
+		catch(const InvalidPageException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+		flushed = true;
+		try
+		{
+			bufMgr->flushFile(&file);
+		}
+		catch(const PagePinnedException &e)
+		{
+			flushed = false;
+		}
+		checkPassFail(flushed, true)
+
+		// A guard whose page was disposed of is refused, and leaves the page now in its frame pinned
+		ReadPageGuard stale = bufMgr->readPage(&file, pageNo);
+		bufMgr->disposePage(&file, pageNo);
+		PageId otherPageNo;
+		WritePageGuard other = bufMgr->allocPage(&file, otherPageNo);
+		bool refused = false;
+		try
+		{
+			stale.release();
+		}
+		catch(const PageNotPinnedException &e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+		flushed = true;
+		try
+		{
+			bufMgr->flushFile(&file);
+		}
+		catch(const PagePinnedException &e)
+		{
+			flushed = false;
+		}
+		checkPassFail(flushed, false)
+		other.release();
+		bufMgr->flushFile(&file);
+	}
+	File::remove(name);
+
+	// Scans that find no key leave nothing pinned, so failing again and again never fills the pool
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		int notFound = 0;
+		bool exceeded = false;
+		try
+		{
+			for(int i = 0; i < 200; i++)
+			{
+				int low = relationSize + i, high = relationSize + 1000;
+				try
+				{
+					index.startScan(&low, GTE, &high, LTE);
+				}
+				catch(const NoSuchKeyFoundException &e)
+				{
+					notFound++;
+				}
+				low = relationSize - 1;
+				try
+				{
+					index.startScan(&low, GT, &high, LTE);
+				}
+				catch(const NoSuchKeyFoundException &e)
+				{
+					notFound++;
+				}
+			}
+		}
+		catch(const BufferExceededException &e)
+		{
+			exceeded = true;
+		}
+		checkPassFail(exceeded, false)
+		checkPassFail(notFound, 400)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+	}
+	File::remove(intIndexName);
+
+	// Marking a scanned page dirty writes it back when the scan ends
+	const std::uint64_t writes = bufMgr->getFileCounters(relationName).writes;
+	{
+		FileScan scan(relationName, bufMgr);
+		RecordId scanRid;
+		scan.scanNext(scanRid);
+		scan.markDirty();
+		scan.scanNext(scanRid);
+		scan.markDirty();
+	}
+	const bool written = bufMgr->getFileCounters(relationName).writes > writes;
+	checkPassFail(written, true)
+}
+
+void pinnedLevelTests()
+{
+	const std::string floodName = "relA.flood";
+	try
+	{
+		File::remove(floodName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		// More pages than the pool holds, to push everything unpinned out of it
+		PageFile flood = PageFile::create(floodName);
+		std::vector<PageId> floodPages;
+		for(int i = 0; i < 300; i++)
+		{
+			PageId pageNo;
+			WritePageGuard page = bufMgr->allocPage(&flood, pageNo);
+			page->insertRecord("flood");
+			floodPages.push_back(pageNo);
+		}
+		bufMgr->flushFile(&flood);
+
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+			// Without pinning, a lookup after the pool was flooded reads the root and the leaf again
+			countScan(&index, 2500, 2500);
+			for(std::size_t i = 0; i < floodPages.size(); i++)
+				bufMgr->readPage(&flood, floodPages[i]);
+			bufMgr->clearBufStats();
+			countScan(&index, 2500, 2500);
+			checkPassFail(bufMgr->getBufStats().accesses, 2)
+			checkPassFail(bufMgr->getBufStats().diskreads, 2)
+
+			// Pinned, the root stays resident and only the leaf goes through the pool
+			index.pinTopLevels(3);
+			countScan(&index, 2500, 2500);
+			for(std::size_t i = 0; i < floodPages.size(); i++)
+				bufMgr->readPage(&flood, floodPages[i]);
+			bufMgr->clearBufStats();
+			countScan(&index, 2500, 2500);
+			checkPassFail(bufMgr->getBufStats().accesses, 1)
+			checkPassFail(bufMgr->getBufStats().diskreads, 1)
+
+			// Nor does a lookup of the first key of a leaf, the fifth of the nine the load filled
+			bufMgr->clearBufStats();
+			countScan(&index, 2222, 2222);
+			checkPassFail(bufMgr->getBufStats().accesses, 1)
+			bufMgr->flushFile(&flood);
+
+			// Splits under the pinned root are seen by later lookups and scans
+			for(int key = relationSize; key < relationSize + 20000; key++)
+				index.insertEntry(&key, rid);
+			for(int key = -1; key >= -5000; key--)
+				index.insertEntry(&key, rid);
+			checkPassFail(countScan(&index, -5000, relationSize + 19999), relationSize + 25000)
+			checkPassFail(countScan(&index, relationSize + 9990, relationSize + 10009), 20)
+			bufMgr->clearBufStats();
+			countScan(&index, relationSize + 12345, relationSize + 12345);
+			checkPassFail(bufMgr->getBufStats().accesses, 1)
+
+			// Unpinned again, the lookup goes back to reading the root through the pool
+			index.pinTopLevels(0);
+			bufMgr->clearBufStats();
+			countScan(&index, relationSize + 12345, relationSize + 12345);
+			checkPassFail(bufMgr->getBufStats().accesses, 2)
+			index.pinTopLevels(1);
+		}
+	}
+	File::remove(intIndexName);
+	File::remove(floodName);
+}
+
+void splitPathTests()
+{
+	// Enough keys in random order for more leaves than a non-leaf node holds, so that the root
+	// splits and the tree grows a level
+	const int numKeys = 500000;
+	std::vector<int> keys(numKeys);
+	for(int i = 0; i < numKeys; i++)
+		keys[i] = relationSize + i;
+	for(int i = numKeys - 1; i > 0; i--)
+		std::swap(keys[i], keys[random() % (i + 1)]);
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		RecordId keyRid = {1, 1, 0};
+
+		// A split touches the nodes on its path and the new ones, never the children of a split node
+		int maxAccesses = 0;
+		for(int i = 0; i < numKeys; i++)
+		{
+			bufMgr->clearBufStats();
+			index.insertEntry(&keys[i], keyRid);
+			maxAccesses = std::max(maxAccesses, bufMgr->getBufStats().accesses);
+		}
+		const bool fewAccesses = maxAccesses <= 8;
+		checkPassFail(fewAccesses, true)
+
+		// A lookup now goes through the new root, a non-leaf level and a leaf
+		bufMgr->clearBufStats();
+		countScan(&index, relationSize, relationSize);
+		checkPassFail(bufMgr->getBufStats().accesses, 3)
+
+		checkPassFail(countScan(&index, 0, relationSize + numKeys), relationSize + numKeys)
+		int found = 0;
+		for(int key = 0; key < relationSize + numKeys; key += 499)
+			found += countScan(&index, key, key);
+		checkPassFail(found, (relationSize + numKeys + 498) / 499)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	}
+	File::remove(intIndexName);
+}
+
+void appendSplitTests()
+{
+	const int numKeys = 200000;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		RecordId keyRid = {1, 1, 0};
+
+		// After the first one, appends go straight to the rightmost leaf; only the few that split
+		// it go through more of the tree
+		int first = relationSize;
+		index.insertEntry(&first, keyRid);
+		bufMgr->clearBufStats();
+		for(int key = relationSize + 1; key < relationSize + numKeys; key++)
+			index.insertEntry(&key, keyRid);
+		const bool fewAccesses = bufMgr->getBufStats().accesses < numKeys * 11 / 10;
+		checkPassFail(fewAccesses, true)
+
+		// Keys out of order still land in the right leaves, splitting them in half
+		for(int key = relationSize + 100; key < relationSize + numKeys; key += 100)
+			index.insertEntry(&key, keyRid);
+		checkPassFail(countScan(&index, 0, relationSize + numKeys), relationSize + numKeys + numKeys / 100 - 1)
+		checkPassFail(countScan(&index, relationSize + 12300, relationSize + 12300), 2)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	}
+	{
+		// The appended leaves are nearly full rather than half full
+		BlobFile file(intIndexName, false);
+		int numLeaves = 0;
+		leafRuns(&file, &numLeaves);
+		const int appendFill = INTARRAYLEAFSIZE * 85 / 100;
+		const bool full = numLeaves < (relationSize + numKeys + numKeys / 100) / appendFill;
+		checkPassFail(full, true)
+		bufMgr->flushFile(&file);
+	}
+	File::remove(intIndexName);
+}
+
+void postingListTests()
+{
+	// Ratings 0 to 4, round robin
+	const int numRecords = 100000, numRatings = 5;
+	std::vector<std::string> records(numRecords);
+	for(int i = 0; i < numRecords; i++)
+	{
+		RECORD record;
+		memset(&record, 0, sizeof(record));
+		record.i = i % numRatings;
+		record.d = i;
+		sprintf(record.s, "%05d string record", i);
+		records[i].assign(reinterpret_cast<const char*>(&record), sizeof(record));
+	}
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	writeRelation(relationName, records);
+	file1 = new PageFile(relationName, false);
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, LEAF_POSTING);
+
+		// The rids of a rating are a few leaves of varints, against one leaf per INTARRAYLEAFSIZE of them
+		bufMgr->clearBufStats();
+		checkPassFail(countScan(&index, 2, 2), numRecords / numRatings)
+		const bool fewLeaves = bufMgr->getBufStats().accesses * 4 < numRecords / numRatings / INTARRAYLEAFSIZE;
+		checkPassFail(fewLeaves, true)
+		checkPassFail(checkedScan(&index, 0, 0), numRecords / numRatings)
+		checkPassFail(checkedScan(&index, 1, 3), 3 * numRecords / numRatings)
+		checkPassFail(checkedScan(&index, -10, 10), numRecords)
+		checkPassFail(intScan(&index, 0, GT, 4, LT), 3 * numRecords / numRatings)
+		checkPassFail(intScan(&index, 4, GT, 10, LTE), 0)
+
+		// Rids of a new key in random order, many pages apart so that they take several bytes each
+		// and split leaves in the middle of the key, and more rids for an existing rating
+		std::vector<std::uint64_t> inserted;
+		for(int i = 0; i < 5000; i++)
+		{
+			const int key = i % 2 == 0 ? 7 : 2;
+			RecordId keyRid = {PageId(random() % 1000000 + 1), SlotId(random() % 100 + 1), 0};
+			index.insertEntry(&key, keyRid);
+			if(key == 7)
+				inserted.push_back((std::uint64_t(keyRid.page_number) << 16) | keyRid.slot_number);
+		}
+		checkPassFail(countScan(&index, 2, 2), numRecords / numRatings + 2500)
+		checkPassFail(countScan(&index, 5, 10), 2500)
+		checkPassFail(countScan(&index, 0, 10), numRecords + 5000)
+		checkPassFail(checkedScan(&index, 3, 4), 2 * numRecords / numRatings)
+
+		std::vector<std::uint64_t> scanned;
+		RecordId scanRid;
+		const int key = 7;
+		index.startScan(&key, GTE, &key, LTE);
+		try
+		{
+			while(true)
+			{
+				index.scanNext(scanRid);
+				scanned.push_back((std::uint64_t(scanRid.page_number) << 16) | scanRid.slot_number);
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		std::sort(inserted.begin(), inserted.end());
+		std::sort(scanned.begin(), scanned.end());
+		const bool sameRids = scanned == inserted;
+		checkPassFail(sameRids, true)
+
+		// Appended keys split nearly full leaves at the right edge
+		RecordId keyRid = {1, 1, 0};
+		for(int key = 100; key < 20000; key++)
+			index.insertEntry(&key, keyRid);
+		checkPassFail(countScan(&index, 100, 20000), 19900)
+		checkPassFail(countScan(&index, 0, 20000), numRecords + 5000 + 19900)
+	}
+	File::remove(intIndexName);
+}
+
+void flatDuplicateTests()
+{
+	// The same ratings with flat leaves, each key a run of copies across many leaves
+	{
+		const int numRecords = 100000, numRatings = 5;
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		for(int rating = 0; rating < numRatings; rating++)
+			checkPassFail(countScan(&index, rating, rating), numRecords / numRatings)
+
+		// 4 copies of each of 3000 keys, a copy of every key at a time, so that splits make separators
+		// of keys with copies left of them
+		const int numKeys = 3000, numCopies = 4, firstKey = 100;
+		for(int copy = 0; copy < numCopies; copy++)
+		{
+			for(int i = 0; i < numKeys; i++)
+			{
+				const int key = firstKey + i * 7919 % numKeys;
+				RecordId keyRid = {PageId(copy + 1), SlotId(i + 1), 0};
+				index.insertEntry(&key, keyRid);
+			}
+		}
+
+		// Every copy of a key is found, and skipped by GT
+		int missing = 0, extra = 0;
+		for(int key = firstKey; key < firstKey + numKeys; key++)
+		{
+			missing += countScan(&index, key, key) != numCopies;
+			const int next = key + 1;
+			RecordId scanRid;
+			int found = 0;
+			try
+			{
+				index.startScan(&key, GT, &next, LTE);
+				while(true)
+				{
+					index.scanNext(scanRid);
+					found++;
+				}
+			}
+			catch(const NoSuchKeyFoundException &e)
+			{
+			}
+			catch(const IndexScanCompletedException &e)
+			{
+				index.endScan();
+			}
+			extra += found != (next < firstKey + numKeys ? numCopies : 0);
+		}
+		checkPassFail(missing, 0)
+		checkPassFail(extra, 0)
+		checkPassFail(countScan(&index, 0, firstKey + numKeys), numRecords + numKeys * numCopies)
+	}
+	File::remove(intIndexName);
+}
+
+void packedLeafTests()
+{
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, LEAF_PACKED);
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(intScan(&index,20,GTE,35,LTE), 16)
+		checkPassFail(intScan(&index,-3,GT,3,LT), 3)
+		checkPassFail(intScan(&index,996,GT,1001,LT), 4)
+		checkPassFail(intScan(&index,0,GT,1,LT), 0)
+		checkPassFail(intScan(&index,300,GT,400,LT), 99)
+		checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		checkPassFail(checkedScan(&index, 0, relationSize), relationSize)
+
+		// Keys in random order, each with a rid it can be told from, spread over many pages
+		const int numKeys = 100000;
+		std::vector<int> keys(numKeys);
+		for(int i = 0; i < numKeys; i++)
+			keys[i] = relationSize + i;
+		for(int i = numKeys - 1; i > 0; i--)
+			std::swap(keys[i], keys[random() % (i + 1)]);
+		for(int i = 0; i < numKeys; i++)
+		{
+			RecordId keyRid = {PageId(keys[i] / 64 + 1), SlotId(keys[i] % 64 + 1), 0};
+			index.insertEntry(&keys[i], keyRid);
+		}
+		for(int key = -1; key >= -1000; key--)
+		{
+			RecordId keyRid = {1, 1, 0};
+			index.insertEntry(&key, keyRid);
+		}
+		checkPassFail(countScan(&index, -1000, relationSize + numKeys), 1000 + relationSize + numKeys)
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+
+		// Every rid comes back unpacked as it went in, in key order
+		const int low = relationSize + 12345, high = relationSize + 23456;
+		bool sameRids = true;
+		int expected = low;
+		RecordId scanRid;
+		index.startScan(&low, GTE, &high, LTE);
+		try
+		{
+			while(true)
+			{
+				index.scanNext(scanRid);
+				sameRids = sameRids && int(scanRid.page_number - 1) * 64 + scanRid.slot_number - 1 == expected;
+				expected++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(sameRids, true)
+		checkPassFail(expected, high + 1)
+
+		// Leaves hold several times as many entries as flat ones, even half full after random splits
+		bufMgr->clearBufStats();
+		countScan(&index, relationSize, relationSize + numKeys);
+		const bool fewLeaves = bufMgr->getBufStats().accesses * 2 < numKeys / INTARRAYLEAFSIZE;
+		checkPassFail(fewLeaves, true)
+
+		// A key repeated more times than a leaf holds spans leaves, and all of it is found
+		RecordId keyRid = {1, 1, 0};
+		const int repeated = relationSize + 50000;
+		for(int i = 0; i < 2 * PACKEDLEAFMAXSIZE; i++)
+			index.insertEntry(&repeated, keyRid);
+		checkPassFail(countScan(&index, repeated, repeated), 2 * PACKEDLEAFMAXSIZE + 1)
+		checkPassFail(countScan(&index, repeated - 1, repeated + 1), 2 * PACKEDLEAFMAXSIZE + 3)
+
+		// Appends past the greatest key
+		for(int key = relationSize + numKeys; key < relationSize + 2 * numKeys; key++)
+			index.insertEntry(&key, keyRid);
+		checkPassFail(countScan(&index, -1000, relationSize + 2 * numKeys), 1000 + relationSize + 2 * numKeys + 2 * PACKEDLEAFMAXSIZE)
+	}
+	File::remove(intIndexName);
+}
+
+/**
+ * Check childIndex against a search of keyArray from the start, on nodes of every fill with
+ * runs of equal keys and keys at both ends of the int range.
+ */
+void nonLeafSearchTests()
+{
+	const int fills[] = {0, 1, NONLEAFLINEKEYS - 1, NONLEAFLINEKEYS, NONLEAFLINEKEYS + 1, 5 * NONLEAFLINEKEYS,
+	                     INTARRAYNONLEAFSIZE - 1, INTARRAYNONLEAFSIZE};
+	NonLeafNodeInt node;
+	for(std::size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++)
+	{
+		node.numValidKeys = fills[f];
+		for(int i = 0; i < node.numValidKeys; i++)
+			node.keyArray[i] = i / 3 * 2;
+		if(node.numValidKeys > 1)
+		{
+			node.keyArray[0] = std::numeric_limits<int>::min();
+			node.keyArray[node.numValidKeys - 1] = std::numeric_limits<int>::max();
+		}
+		node.buildSummary();
+
+		std::vector<int> probes;
+		probes.push_back(std::numeric_limits<int>::min());
+		probes.push_back(std::numeric_limits<int>::max());
+		for(int key = -2; key <= node.numValidKeys; key++)
+			probes.push_back(key);
+
+		bool matches = true;
+		for(std::size_t p = 0; p < probes.size(); p++)
+		{
+			int expected = 0;
+			while(expected < node.numValidKeys && !(probes[p] < node.keyArray[expected]))
+				expected++;
+			matches = matches && node.childIndex(probes[p]) == expected;
+		}
+		checkPassFail(matches, true)
+	}
+}
+
+/**
+ * Count the entries with keys in [low, high], reading their records from file1.
+ * Returns -1 if a record's key is outside the range.
+ */
+int checkedScan(BTreeIndex *index, int low, int high)
+{
+	int numResults = 0;
+	bool inRange = true;
+	RecordId scanRid;
+	Page *page;
+	index->startScan(&low, GTE, &high, LTE);
+	try
+	{
+		while(1)
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, page);
+			const RECORD record = *reinterpret_cast<const RECORD*>(page->getRecord(scanRid).data());
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+			inRange = inRange && record.i >= low && record.i <= high;
+			numResults++;
+		}
+	}
+	catch(const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+	return inRange ? numResults : -1;
+}
+
+/**
+ * Count the entries with keys in [low, high] without reading their records.
+ */
+int countScan(BTreeIndex *index, int low, int high)
+{
+	RecordId scanRid;
+	int found = 0;
+	index->startScan(&low, GTE, &high, LTE);
+	try
+	{
+		while(true)
+		{
+			index->scanNext(scanRid);
+			found++;
+		}
+	}
+	catch(const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+	return found;
+}
+
+/**
+ * Walk an integer index from its meta page down to the leftmost leaf and along the leaf chain.
+ * Returns the number of runs of consecutive page numbers the leaves are in, -1 if a leaf comes
+ * before the one to its left.  The number of leaves is returned via numLeaves if given.
+ */
+int leafRuns(File *indexFile, int *numLeaves)
+{
+	const PageId metaPageNo = 1;
+	Page *page;
+	bufMgr->readPage(indexFile, metaPageNo, page);
+	PageId pageNo = ((IndexMetaInfo *)page)->rootPageNo;
+	bufMgr->unPinPage(indexFile, metaPageNo, false);
+
+	for(int level = 0; level != 1; )
+	{
+		bufMgr->readPage(indexFile, pageNo, page);
+		NonLeafNodeInt *node = (NonLeafNodeInt *)page;
+		level = node->level;
+		const PageId child = node->pageNoArray[0];
+		bufMgr->unPinPage(indexFile, pageNo, false);
+		pageNo = child;
+	}
+
+	int runs = 0;
+	PageId previous = Page::INVALID_NUMBER;
+	while(pageNo != std::uint32_t(-1))
+	{
+		if(previous != Page::INVALID_NUMBER && pageNo < previous)
+			return -1;
+		runs += pageNo != previous + 1;
+		previous = pageNo;
+		if(numLeaves != NULL)
+			(*numLeaves)++;
+		bufMgr->readPage(indexFile, pageNo, page);
+		const PageId next = ((LeafNodeInt *)page)->rightSibPageNo;
+		bufMgr->unPinPage(indexFile, pageNo, false);
+		pageNo = next;
+	}
+	return runs;
+}
+
+/**
+ * Create a relation holding the given records, in order.
+ */
+void writeRelation(const std::string &name, const std::vector<std::string> &records)
+{
+	PageFile file = PageFile::create(name);
+	PageId pageNo;
+	Page page = file.allocatePage(pageNo);
+	for(std::size_t i = 0; i < records.size(); i++)
+	{
+		if(!page.hasSpaceForRecord(records[i]))
+		{
+			file.writePage(pageNo, page);
+			page = file.allocatePage(pageNo);
+		}
+		page.insertRecord(records[i]);
+	}
+	file.writePage(pageNo, page);
+}
+
+/**
+ * Scan an index of bids on item_id for [low, high] and read each bid found in place.  Returns the
+ * number of bids found, or -1 if one of them is out of the range.
+ */
+int bidScan(BTreeIndex *index, File *relation, int low, int high)
+{
+	int numResults = 0;
+	bool inRange = true;
+	RecordId scanRid;
+	Page *page;
+	index->startScan(&low, GTE, &high, LTE);
+	try
+	{
+		while(1)
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(relation, scanRid.page_number, page);
+			const std::string record = page->getRecord(scanRid);
+			bufMgr->unPinPage(relation, scanRid.page_number, false);
+			const std::int32_t itemId = RecordView<BidSchema>(record).get<BidSchema::ITEM_ID>();
+			inRange = inRange && itemId >= low && itemId <= high;
+			numResults++;
+		}
+	}
+	catch(const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+	return inRange ? numResults : -1;
+}
+
+/**
+ * Read every record of a relation.  Returns the number of records.
+ */
+int scanRelation(const std::string &name, std::vector<std::string> &records)
+{
+	records.clear();
+	FileScan scan(name, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			scan.scanNext(scanRid);
+			records.push_back(scan.getRecord());
+		}
+	}
+	catch(const EndOfFileException &e)
+	{
+	}
+	return records.size();
+}
+
 // -----------------------------------------------------------------------------
 // intTests
 // -----------------------------------------------------------------------------
@@ -24,6 +24,13 @@ namespace badgerdb {
  * contains a pointer to the next page in the file.
  */
 struct PageHeader {
+  /**
+   * LSN of the last logged change applied to the page.  Kept first so that
+   * pages cast to other layouts (B+ tree nodes) carry their LSN at the same
+   * offset.
+   */
+  Lsn lsn;
+
   /**
    * Lower bound of the free space.  This is the offset of the first unused byte
    * after the slot array.
@@ -200,12 +207,26 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the LSN of the last logged change applied to this page.
+   *
+   * @return  Page LSN.
+   */
+  Lsn lsn() const { return header_.lsn; }
+
+  /**
+   * Stamps this page with the LSN of a logged change just applied to it.
+   *
+   * @param new_lsn   LSN of the log record describing the change.
+   */
+  void set_lsn(const Lsn new_lsn) { header_.lsn = new_lsn; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
    * @return  Iterator at first record of page.
    */
-  PageIterator begin();
+  PageIterator begin() const;
 
   /**
    * Returns an iterator representing the record after the last record in the
@@ -213,7 +234,7 @@ class Page {
    *
    * @return  Iterator representing record after the last record in the page.
    */
-  PageIterator end();
+  PageIterator end() const;
 
  private:
   /**
@@ -343,5 +364,7 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be its header followed by its data, so that it can be read and written in one piece.");
 
 }
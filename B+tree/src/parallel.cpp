@@ -0,0 +1,111 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "parallel.h"
+
+#include <exception>
+#include <thread>
+
+namespace badgerdb {
+
+MorselQueue::MorselQueue(std::uint32_t begin, std::uint32_t end, std::uint32_t morselSize, std::uint32_t numWorkers)
+	: deques(numWorkers == 0 ? 1 : numWorkers)
+{
+	if (morselSize == 0)
+		morselSize = 1;
+
+	std::vector<Morsel> all;
+	for (std::uint32_t b = begin; b < end; b += morselSize)
+	{
+		Morsel m;
+		m.begin = b;
+		m.end = (end - b > morselSize) ? b + morselSize : end;
+		all.push_back(m);
+	}
+
+	// Deal out contiguous blocks so every worker starts at its own offset of the range
+	const std::size_t perWorker = (all.size() + deques.size() - 1) / deques.size();
+	for (std::size_t i = 0; i < all.size(); i++)
+		deques[i / perWorker].morsels.push_back(all[i]);
+}
+
+bool MorselQueue::next(std::uint32_t workerId, Morsel &morsel)
+{
+	{
+		WorkerDeque &own = deques[workerId % deques.size()];
+		std::lock_guard<std::mutex> guard(own.latch);
+		if (!own.morsels.empty())
+		{
+			morsel = own.morsels.front();
+			own.morsels.pop_front();
+			return true;
+		}
+	}
+
+	// Own deque is drained, steal from the back of the others
+	for (std::size_t i = 1; i < deques.size(); i++)
+	{
+		WorkerDeque &victim = deques[(workerId + i) % deques.size()];
+		std::lock_guard<std::mutex> guard(victim.latch);
+		if (!victim.morsels.empty())
+		{
+			morsel = victim.morsels.back();
+			victim.morsels.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+std::uint32_t defaultWorkerCount()
+{
+	const unsigned hw = std::thread::hardware_concurrency();
+	return hw == 0 ? 1 : hw;
+}
+
+void runWorkers(std::uint32_t numWorkers, const std::function<void(std::uint32_t)> &func)
+{
+	if (numWorkers == 0)
+		numWorkers = defaultWorkerCount();
+
+	std::vector<std::exception_ptr> errors(numWorkers);
+	std::vector<std::thread> threads;
+
+	for (std::uint32_t w = 1; w < numWorkers; w++)
+	{
+		threads.push_back(std::thread([&func, &errors, w]() {
+			try
+			{
+				func(w);
+			}
+			catch (...)
+			{
+				errors[w] = std::current_exception();
+			}
+		}));
+	}
+
+	try
+	{
+		func(0);
+	}
+	catch (...)
+	{
+		errors[0] = std::current_exception();
+	}
+
+	for (std::size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	for (std::size_t i = 0; i < errors.size(); i++)
+	{
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+	}
+}
+
+}
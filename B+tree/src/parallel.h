@@ -0,0 +1,92 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief A contiguous run of work items [begin, end) handed to a worker as a single unit.
+ */
+struct Morsel {
+  /**
+   * First item of the morsel.
+   */
+  std::uint32_t begin;
+
+  /**
+   * One past the last item of the morsel.
+   */
+  std::uint32_t end;
+};
+
+/**
+ * @brief Work-stealing queue of morsels shared by a fixed set of workers.
+ *
+ * The item range is cut into morsels which are dealt out to the workers in contiguous blocks,
+ * so that each worker starts on its own region of the range.  A worker takes morsels from the
+ * front of its own deque and, once that is empty, steals from the back of the other workers'
+ * deques.  Each deque has its own lock so workers only contend while stealing.
+ */
+class MorselQueue {
+ public:
+  /**
+   * Constructor of MorselQueue class
+   *
+   * @param begin       First item of the range to be split
+   * @param end         One past the last item of the range
+   * @param morselSize  Number of items per morsel
+   * @param numWorkers  Number of workers which will pull from the queue
+   */
+  MorselQueue(std::uint32_t begin, std::uint32_t end, std::uint32_t morselSize, std::uint32_t numWorkers);
+
+  /**
+   * Fetch the next morsel for a worker, stealing from the other workers if its own deque is empty.
+   *
+   * @param workerId  Id of the calling worker
+   * @param morsel    Morsel returned via this reference
+   * @return          False once every morsel has been handed out
+   */
+  bool next(std::uint32_t workerId, Morsel &morsel);
+
+ private:
+  /**
+   * Per-worker deque of morsels together with the lock guarding it.
+   */
+  struct WorkerDeque {
+    std::mutex latch;
+    std::deque<Morsel> morsels;
+  };
+
+  /**
+   * One deque per worker.
+   */
+  std::vector<WorkerDeque> deques;
+};
+
+/**
+ * Returns the number of workers to use when the caller asks for 0 (one per hardware thread).
+ */
+std::uint32_t defaultWorkerCount();
+
+/**
+ * Run func(workerId) on numWorkers threads and wait for all of them to finish.
+ * Worker 0 runs on the calling thread.  If any worker throws, the first exception is rethrown
+ * here once every worker has finished.
+ *
+ * @param numWorkers  Number of workers, 0 meaning defaultWorkerCount()
+ * @param func        Work to run on each worker
+ */
+void runWorkers(std::uint32_t numWorkers, const std::function<void(std::uint32_t)> &func);
+
+}
@@ -0,0 +1,68 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "parallel_filescan.h"
+#include "parallel.h"
+#include "page_iterator.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr,
+                                   std::uint32_t numWorkers, std::uint32_t pagesPerMorsel)
+{
+  file = new PageFile(name, false);	//dont create new file
+	bufMgr = bufferMgr;
+	workers = (numWorkers == 0) ? defaultWorkerCount() : numWorkers;
+	morselSize = (pagesPerMorsel == 0) ? 1 : pagesPerMorsel;
+}
+
+ParallelFileScan::~ParallelFileScan()
+{
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::scan(const RecordCallback &callback)
+{
+	// Page 0 is the file header, data pages are numbered 1 to num_pages - 1
+	MorselQueue queue(1, file->getNumPages(), morselSize, workers);
+
+	runWorkers(workers, [&](std::uint32_t workerId) {
+		Morsel morsel;
+		while (queue.next(workerId, morsel))
+		{
+			for (PageId pageNo = morsel.begin; pageNo < morsel.end; pageNo++)
+			{
+				Page *page;
+				try
+				{
+					bufMgr->readPage(file, pageNo, page);
+				}
+				catch (const InvalidPageException &e)
+				{
+					// free page, nothing to scan
+					continue;
+				}
+
+				try
+				{
+					for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+						callback(workerId, iter.getCurrentRecord(), *iter);
+				}
+				catch (...)
+				{
+					bufMgr->unPinPage(file, pageNo, false);
+					throw;
+				}
+				bufMgr->unPinPage(file, pageNo, false);
+			}
+		}
+	});
+}
+
+}
@@ -0,0 +1,83 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include "types.h"
+#include "page.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief This class is used to scan all records of a relation on several threads at once.
+ *
+ * Instead of following the used-page linked list like FileScan, the scan splits the page number
+ * range [1, num_pages) of the file into morsels of consecutive pages and hands them to a pool of
+ * workers through a work-stealing MorselQueue, so every worker can start at its own offset.
+ * Pages are read through the buffer manager; free pages in the range are skipped.
+ * Records are visited in no particular order.
+ */
+class ParallelFileScan
+{
+ public:
+  /**
+   * Callback invoked for every record.  Called concurrently from the worker threads;
+   * workerId lies in [0, numWorkers()) and may be used to index per-worker state.
+   */
+  typedef std::function<void(std::uint32_t workerId, const RecordId &rid, const std::string &record)> RecordCallback;
+
+  /**
+   * Constructor of ParallelFileScan class
+   *
+   * @param name            Name of the relation file
+   * @param bufMgr          Buffer Manager instance shared by the workers
+   * @param numWorkers      Number of worker threads, 0 for one per hardware thread
+   * @param pagesPerMorsel  Number of consecutive pages handed to a worker at a time
+   */
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr, std::uint32_t numWorkers = 0,
+                   std::uint32_t pagesPerMorsel = 8);
+
+  ~ParallelFileScan();
+
+  /**
+   * Visit every record of the relation once.  Returns after all workers are done.
+   *
+   * @param callback  Function invoked for every record
+   */
+  void scan(const RecordCallback &callback);
+
+  /**
+   * Returns the number of workers the scan runs on.
+   */
+  std::uint32_t numWorkers() const { return workers; }
+
+ private:
+  /**
+   * File which is being scanned.
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr        *bufMgr;
+
+  /**
+   * Number of worker threads.
+   */
+  std::uint32_t workers;
+
+  /**
+   * Number of pages per morsel.
+   */
+  std::uint32_t morselSize;
+};
+
+}
@@ -0,0 +1,114 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "pool_memory.h"
+
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace badgerdb {
+
+// Memory policy of mbind(2), from <numaif.h>, which we do not want to depend on
+static const int MPOL_PREFERRED_POLICY = 1;
+
+static std::size_t roundUp(std::size_t bytes, std::size_t unit)
+{
+	return (bytes + unit - 1) / unit * unit;
+}
+
+PoolMemory::PoolMemory(std::size_t bytes, PoolBacking request)
+	: mem(NULL), size(bytes), kind(request)
+{
+	if (request == POOL_HEAP)
+	{
+		mem = ::operator new(bytes);
+		return;
+	}
+
+	if (request == POOL_HUGETLB)
+	{
+		size = roundUp(bytes, HUGE_PAGE_SIZE);
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED)
+			return;
+		// no huge pages reserved, fall back to transparent huge pages
+		kind = POOL_THP;
+	}
+
+	size = roundUp(bytes, (kind == POOL_THP) ? HUGE_PAGE_SIZE : (std::size_t)sysconf(_SC_PAGESIZE));
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		mem = NULL;
+		throw std::bad_alloc();
+	}
+
+	if (kind == POOL_THP && madvise(mem, size, MADV_HUGEPAGE) != 0)
+		kind = POOL_MMAP;
+}
+
+PoolMemory::~PoolMemory()
+{
+	if (kind == POOL_HEAP)
+		::operator delete(mem);
+	else
+		munmap(mem, size);
+}
+
+bool PoolMemory::bindToNode(std::size_t offset, std::size_t len, std::uint32_t node)
+{
+	if (kind == POOL_HEAP || len == 0)
+		return false;
+
+	unsigned long nodeMask[4] = {0, 0, 0, 0};
+	const std::size_t bitsPerWord = 8 * sizeof(unsigned long);
+	if (node >= 4 * bitsPerWord)
+		return false;
+	nodeMask[node / bitsPerWord] = 1UL << (node % bitsPerWord);
+
+	char *start = static_cast<char*>(mem) + offset;
+	return syscall(SYS_mbind, start, len, MPOL_PREFERRED_POLICY, nodeMask, 4 * bitsPerWord, 0) == 0;
+}
+
+std::uint32_t PoolMemory::numNumaNodes()
+{
+	std::uint32_t nodes = 0;
+	while (nodes < 1024)
+	{
+		const std::string path = "/sys/devices/system/node/node" + std::to_string(nodes);
+		if (access(path.c_str(), F_OK) != 0)
+			break;
+		nodes++;
+	}
+	return nodes == 0 ? 1 : nodes;
+}
+
+std::uint32_t PoolMemory::currentNumaNode()
+{
+	unsigned cpu = 0;
+	unsigned node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return 0;
+	return node;
+}
+
+const char* PoolMemory::backingName(PoolBacking backing)
+{
+	switch (backing)
+	{
+		case POOL_HEAP:    return "heap";
+		case POOL_MMAP:    return "mmap";
+		case POOL_THP:     return "thp";
+		case POOL_HUGETLB: return "hugetlb";
+	}
+	return "unknown";
+}
+
+}
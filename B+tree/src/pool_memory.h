@@ -0,0 +1,112 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * @brief Where the memory of a PoolMemory region comes from.
+ */
+enum PoolBacking {
+  POOL_HEAP,      // general heap, default 4K pages
+  POOL_MMAP,      // anonymous mapping, default 4K pages
+  POOL_THP,       // anonymous mapping with transparent huge pages requested through madvise
+  POOL_HUGETLB    // anonymous mapping from the reserved huge page pool
+};
+
+/**
+ * @brief A large, page aligned region of memory backing the frames of the buffer pool.
+ *
+ * A huge page request first tries MAP_HUGETLB, which only succeeds if the administrator reserved
+ * huge pages (vm.nr_hugepages), then falls back to a regular mapping marked MADV_HUGEPAGE for
+ * transparent huge pages, and finally to a plain mapping.  backing() reports what was obtained.
+ * Mapped regions can be bound to a NUMA node piece by piece before they are first touched.
+ */
+class PoolMemory
+{
+ public:
+  /**
+   * Size of a huge page assumed for MAP_HUGETLB and for aligning NUMA sub-pools.
+   */
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  /**
+   * Allocate the region.
+   *
+   * @param bytes     Size of the region
+   * @param request   POOL_HEAP for the general heap, POOL_MMAP for a plain mapping, POOL_THP or
+   *                  POOL_HUGETLB to ask for huge pages
+   * @throws std::bad_alloc  If no memory could be obtained
+   */
+  PoolMemory(std::size_t bytes, PoolBacking request);
+
+  /**
+   * Release the region.
+   */
+  ~PoolMemory();
+
+  /**
+   * Returns the start of the region.
+   */
+  void* base() const { return mem; }
+
+  /**
+   * Returns how the region is actually backed.
+   */
+  PoolBacking backing() const { return kind; }
+
+  /**
+   * Ask the kernel to place the pages of part of a mapped region on a NUMA node.
+   * Must be called before the pages are first touched.  Has no effect on heap regions.
+   *
+   * @param offset  Start of the part, a multiple of the system page size (of HUGE_PAGE_SIZE for POOL_HUGETLB)
+   * @param len     Length of the part
+   * @param node    NUMA node to prefer
+   * @return        True if the kernel accepted the policy
+   */
+  bool bindToNode(std::size_t offset, std::size_t len, std::uint32_t node);
+
+  /**
+   * Returns the number of NUMA nodes of the machine, 1 if it cannot be determined.
+   */
+  static std::uint32_t numNumaNodes();
+
+  /**
+   * Returns the NUMA node of the CPU the calling thread is running on, 0 if it cannot be determined.
+   */
+  static std::uint32_t currentNumaNode();
+
+  /**
+   * Returns a printable name for a backing.
+   */
+  static const char* backingName(PoolBacking backing);
+
+ private:
+  PoolMemory(const PoolMemory &);
+  PoolMemory &operator=(const PoolMemory &);
+
+  /**
+   * Start of the region.
+   */
+  void*         mem;
+
+  /**
+   * Size of the region, rounded up to the mapping granularity.
+   */
+  std::size_t   size;
+
+  /**
+   * How the region is backed.
+   */
+  PoolBacking   kind;
+};
+
+}
@@ -0,0 +1,289 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "recovery.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
+#include "btree.h"
+#include "file.h"
+#include "page.h"
+#include "parallel.h"
+#include "exceptions/bad_log_exception.h"
+
+namespace badgerdb {
+
+/**
+ * Entry of the transaction table built by the analysis.
+ */
+struct TxnEntry
+{
+	Lsn lastLsn;
+	Lsn undoNextLsn;
+};
+
+typedef std::pair<std::string, PageId> PageKey;
+
+/**
+ * A record redo has to look at.  Workers read the record itself from their own reader, so that
+ * the images are never all in memory at once.
+ */
+struct RedoItem
+{
+	Lsn lsn;
+	File *file;
+	PageId pageNo;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool changesPage(const LogRecord &record)
+{
+	return record.type == LOG_NODE_INSERT || record.type == LOG_NODE_REMOVE || record.type == LOG_NODE_IMAGE;
+}
+
+RecoveryManager::RecoveryManager(LogManager *logManager, BufMgr *bufferMgr)
+	: log(logManager), bufMgr(bufferMgr)
+{
+}
+
+void RecoveryManager::addFile(File *file)
+{
+	files[file->filename()] = file;
+}
+
+File *RecoveryManager::fileOf(const std::string &name)
+{
+	std::unordered_map<std::string, File*>::const_iterator it = files.find(name);
+	if (it == files.end())
+		throw BadLogException(log->filename(), "no file added for " + name);
+	return it->second;
+}
+
+Lsn RecoveryManager::checkpoint()
+{
+	// Taken first, so that a page dirtied while the table is collected is seen by the analysis
+	const Lsn analysisLsn = log->getEndLsn();
+	std::vector<DirtyPage> dirtyPages;
+	bufMgr->getDirtyPages(dirtyPages);
+	return log->logCheckpoint(analysisLsn, dirtyPages);
+}
+
+void RecoveryManager::applyRecord(Page *page, const LogRecord &record, bool undo)
+{
+	switch (record.type)
+	{
+		case LOG_NODE_INSERT:
+		case LOG_NODE_REMOVE:
+		case LOG_NODE_IMAGE:
+			if (!BTreeIndex::applyNodeRecord(page, record, undo))
+				throw BadLogException(log->filename(), "node change does not fit its page");
+			break;
+		default:
+			break;
+	}
+}
+
+RecoveryStats RecoveryManager::recover(std::uint32_t numWorkers, std::uint32_t prefetchBatch)
+{
+	RecoveryStats stats;
+	const std::uint32_t workers = (numWorkers == 0) ? defaultWorkerCount() : numWorkers;
+	if (prefetchBatch == 0)
+		prefetchBatch = 1;
+
+	// Analysis: unfinished transactions and the pages that may miss changes
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::map<TxnId, TxnEntry> txns;
+	std::set<TxnId> ended;
+	std::map<PageKey, Lsn> dirtyPages;
+	LogReader reader(log->filename());
+	const Lsn firstLsn = reader.endLsn();
+	const Lsn analysisLsn = (reader.checkpointLsn() != 0) ? reader.checkpointLsn() : firstLsn;
+	reader.seek(analysisLsn);
+
+	LogRecord record;
+	while (reader.next(record))
+	{
+		stats.recordsAnalyzed++;
+		if (record.type == LOG_COMMIT || record.type == LOG_ABORT)
+		{
+			txns.erase(record.txn);
+			ended.insert(record.txn);
+		}
+		else if (record.type == LOG_CHECKPOINT)
+		{
+			CheckpointData data;
+			if (!data.decode(record.after))
+				throw BadLogException(log->filename(), "malformed checkpoint");
+			// The checkpoint may be older than records already seen, so only fill gaps
+			for (std::size_t i = 0; i < data.activeTxns.size(); i++)
+			{
+				const TxnId txn = data.activeTxns[i].first;
+				if (ended.count(txn) == 0 && txns.count(txn) == 0)
+				{
+					TxnEntry entry = {data.activeTxns[i].second, data.activeTxns[i].second};
+					txns[txn] = entry;
+				}
+			}
+			for (std::size_t i = 0; i < data.dirtyPages.size(); i++)
+			{
+				const PageKey key(data.dirtyPages[i].fileName, data.dirtyPages[i].pageNo);
+				std::map<PageKey, Lsn>::iterator it = dirtyPages.find(key);
+				if (it == dirtyPages.end())
+					dirtyPages[key] = data.dirtyPages[i].recLsn;
+				else
+					it->second = std::min(it->second, data.dirtyPages[i].recLsn);
+			}
+		}
+		else if (changesPage(record))
+		{
+			TxnEntry &entry = txns[record.txn];
+			entry.lastLsn = record.lsn;
+			entry.undoNextLsn = record.compensation ? record.undoNextLsn : record.lsn;
+			const PageKey key(record.fileName, record.pageNo);
+			if (dirtyPages.count(key) == 0)
+				dirtyPages[key] = record.lsn;
+		}
+	}
+	const Lsn endLsn = reader.endLsn();
+	stats.logBytes = endLsn - analysisLsn;
+	stats.dirtyPages = dirtyPages.size();
+	stats.loserTxns = txns.size();
+	stats.analysisSeconds = secondsSince(start);
+
+	// Redo: repeat history from the oldest change a dirty page may miss, partitioned by page
+	start = std::chrono::steady_clock::now();
+	Lsn redoLsn = endLsn;
+	for (std::map<PageKey, Lsn>::const_iterator it = dirtyPages.begin(); it != dirtyPages.end(); ++it)
+		redoLsn = std::min(redoLsn, it->second);
+	redoLsn = std::max(redoLsn, firstLsn);
+
+	std::vector<std::vector<RedoItem> > partitions(workers);
+	std::hash<std::string> hashName;
+	reader.seek(redoLsn);
+	while (reader.next(record))
+	{
+		if (!changesPage(record))
+			continue;
+		std::map<PageKey, Lsn>::const_iterator it = dirtyPages.find(PageKey(record.fileName, record.pageNo));
+		if (it == dirtyPages.end() || record.lsn < it->second)
+			continue;
+		const std::size_t hash = hashName(record.fileName) ^ (record.pageNo * 0x9e3779b97f4a7c15ull);
+		const RedoItem item = {record.lsn, fileOf(record.fileName), record.pageNo};
+		partitions[hash % workers].push_back(item);
+	}
+
+	std::atomic<std::uint64_t> redone(0), skipped(0);
+	runWorkers(workers, [&](std::uint32_t workerId) {
+		const std::vector<RedoItem> &items = partitions[workerId];
+		LogReader workerReader(log->filename());
+		LogRecord workerRecord;
+		for (std::size_t batch = 0; batch < items.size(); batch += prefetchBatch)
+		{
+			const std::size_t batchEnd = std::min<std::size_t>(batch + prefetchBatch, items.size());
+			std::map<File*, std::vector<PageId> > pages;
+			for (std::size_t i = batch; i < batchEnd; i++)
+				pages[items[i].file].push_back(items[i].pageNo);
+			for (std::map<File*, std::vector<PageId> >::iterator it = pages.begin(); it != pages.end(); ++it)
+				bufMgr->prefetchPages(it->first, it->second);
+
+			for (std::size_t i = batch; i < batchEnd; i++)
+			{
+				const RedoItem &item = items[i];
+				Page *page;
+				bufMgr->readPage(item.file, item.pageNo, page);
+				if (page->lsn() >= item.lsn)
+				{
+					bufMgr->unPinPage(item.file, item.pageNo, false);
+					skipped++;
+					continue;
+				}
+				try
+				{
+					if (!workerReader.readAt(item.lsn, workerRecord))
+						throw BadLogException(log->filename(), "record vanished during redo");
+					applyRecord(page, workerRecord, false);
+				}
+				catch (...)
+				{
+					bufMgr->unPinPage(item.file, item.pageNo, false);
+					throw;
+				}
+				page->set_lsn(item.lsn);
+				bufMgr->unPinPage(item.file, item.pageNo, true);
+				redone++;
+			}
+		}
+	});
+	stats.recordsRedone = redone;
+	stats.recordsSkipped = skipped;
+	stats.redoSeconds = secondsSince(start);
+
+	// Undo: roll the losers back together, newest record first
+	start = std::chrono::steady_clock::now();
+	std::priority_queue<std::pair<Lsn, TxnId> > toUndo;
+	for (std::map<TxnId, TxnEntry>::const_iterator it = txns.begin(); it != txns.end(); ++it)
+	{
+		log->resumeTxn(it->first, it->second.lastLsn);
+		if (it->second.undoNextLsn != 0)
+			toUndo.push(std::make_pair(it->second.undoNextLsn, it->first));
+		else
+			log->logAbort(it->first);
+	}
+
+	while (!toUndo.empty())
+	{
+		const TxnId txn = toUndo.top().second;
+		if (!reader.readAt(toUndo.top().first, record) || record.txn != txn)
+			throw BadLogException(log->filename(), "broken undo chain");
+		toUndo.pop();
+
+		Lsn next = record.prevLsn;
+		if (record.compensation)
+			next = record.undoNextLsn;
+		else if (changesPage(record))
+		{
+			File *file = fileOf(record.fileName);
+			Page *page;
+			bufMgr->readPage(file, record.pageNo, page);
+			try
+			{
+				const Lsn clrLsn = log->logCompensation(record, file);
+				applyRecord(page, record, true);
+				page->set_lsn(clrLsn);
+			}
+			catch (...)
+			{
+				bufMgr->unPinPage(file, record.pageNo, false);
+				throw;
+			}
+			bufMgr->unPinPage(file, record.pageNo, true);
+			stats.recordsUndone++;
+		}
+
+		if (next == 0)
+			log->logAbort(txn);
+		else
+			toUndo.push(std::make_pair(next, txn));
+	}
+	log->flushAll();
+	stats.undoSeconds = secondsSince(start);
+
+	bufMgr->checkpoint();
+	checkpoint();
+	return stats;
+}
+
+}
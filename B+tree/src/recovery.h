@@ -0,0 +1,163 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "types.h"
+#include "wal.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief What a recovery did and how long each pass took.
+ */
+struct RecoveryStats
+{
+  /**
+   * Bytes of log from the start of the analysis to the end of the log.
+   */
+  std::uint64_t logBytes;
+
+  /**
+   * Records read by the analysis pass.
+   */
+  std::uint64_t recordsAnalyzed;
+
+  /**
+   * Page changes applied by the redo pass.
+   */
+  std::uint64_t recordsRedone;
+
+  /**
+   * Page changes the redo pass found already on the page.
+   */
+  std::uint64_t recordsSkipped;
+
+  /**
+   * Records rolled back by the undo pass.
+   */
+  std::uint64_t recordsUndone;
+
+  /**
+   * Pages in the dirty page table after the analysis.
+   */
+  std::uint32_t dirtyPages;
+
+  /**
+   * Transactions that had not committed at the crash.
+   */
+  std::uint32_t loserTxns;
+
+  /**
+   * Wall time of the analysis, redo and undo passes, in seconds.
+   */
+  double analysisSeconds, redoSeconds, undoSeconds;
+
+  RecoveryStats()
+    : logBytes(0), recordsAnalyzed(0), recordsRedone(0), recordsSkipped(0), recordsUndone(0),
+      dirtyPages(0), loserTxns(0), analysisSeconds(0), redoSeconds(0), undoSeconds(0)
+  {
+  }
+};
+
+/**
+ * @brief Brings the files of a write-ahead log back to a transaction consistent state after a
+ * crash, ARIES style, and takes the fuzzy checkpoints recovery starts from.
+ *
+ * recover() runs three passes over the log:
+ *  - Analysis reads from the last checkpoint to the end of the log and rebuilds the transactions
+ *    that had not committed and the pages that may have been dirty, with the LSN of the first
+ *    change each may be missing (recLsn).
+ *  - Redo repeats history from the smallest recLsn on.  Records of pages in the dirty page table
+ *    are partitioned by page across worker threads, so the changes of a page stay in log order.
+ *    Each worker prefetches the pages of its next batch of records into the buffer pool in one go
+ *    and then applies every record whose LSN is newer than the LSN stamped in its page.
+ *  - Undo rolls the unfinished transactions back, always undoing the newest record left of any
+ *    of them.  Each undo is logged as a compensation record, so a crash during recovery neither
+ *    repeats nor loses undo work; a rolled back transaction ends with an abort record.
+ *
+ * Pages are found by file name, so every file the log refers to has to be added first.
+ * Changes to a page are redone as node entries or whole node images, which is why a transaction
+ * has to be the only one changing the pages it changes until it ends.
+ */
+class RecoveryManager
+{
+ public:
+  /**
+   * Constructor of RecoveryManager class
+   *
+   * @param log     Write-ahead log, opened after the crash
+   * @param bufMgr  Buffer manager enforcing the log, through which pages are repaired
+   */
+  RecoveryManager(LogManager *log, BufMgr *bufMgr);
+
+  /**
+   * Register a file the log may refer to.  The file has to stay open until recovery is done.
+   *
+   * @param file  File object
+   */
+  void addFile(File *file);
+
+  /**
+   * Take a fuzzy checkpoint: log the unfinished transactions and the dirty pages of the buffer
+   * pool without writing any page, and make it the point the next recovery starts from.
+   *
+   * @return  LSN of the checkpoint record
+   */
+  Lsn checkpoint();
+
+  /**
+   * Run the analysis, redo and undo passes, then write the repaired pages back and take a
+   * checkpoint, so that the next recovery starts after this one.  Pages repaired by redo carry
+   * changes older than the log end they were pinned at, which a dirty page table could not tell.
+   *
+   * @param numWorkers     Redo worker threads, 0 for one per hardware thread
+   * @param prefetchBatch  Records a redo worker prefetches the pages of at a time
+   * @return               What was done
+   * @throws BadLogException  If the log refers to a file that was not added
+   */
+  RecoveryStats recover(std::uint32_t numWorkers = 0, std::uint32_t prefetchBatch = 64);
+
+ private:
+  /**
+   * Returns the file a record refers to.
+   *
+   * @throws BadLogException  If the file was not added
+   */
+  File *fileOf(const std::string &name);
+
+  /**
+   * Apply a record, or the compensation logged for it, to its page.
+   *
+   * @param page    Page of the record, pinned
+   * @param record  Record
+   * @param undo    Apply the inverse change
+   */
+  void applyRecord(Page *page, const LogRecord &record, bool undo);
+
+  /**
+   * Log whose records are replayed.
+   */
+  LogManager *log;
+
+  /**
+   * Buffer manager the pages are repaired in.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Files the log may refer to, by name.
+   */
+  std::unordered_map<std::string, File*> files;
+};
+
+}
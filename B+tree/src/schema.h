@@ -0,0 +1,339 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Type of a field of a record.
+ */
+enum FieldType {
+  FIELD_INT32,      // std::int32_t
+  FIELD_INT64,      // std::int64_t
+  FIELD_DOUBLE,     // double
+  FIELD_DATETIME,   // std::int64_t, seconds since 1970-01-01 00:00:00 UTC
+  FIELD_VARCHAR     // FieldString, variable length
+};
+
+/**
+ * @brief Description of one field of a schema.
+ */
+struct FieldDesc {
+  /**
+   * Column name.
+   */
+  const char *name;
+
+  /**
+   * Type of the field.
+   */
+  FieldType type;
+
+  /**
+   * Whether the field may be NULL.
+   */
+  bool nullable;
+};
+
+/**
+ * @brief VARCHAR value: bytes inside a record or a string, not copied.
+ */
+struct FieldString {
+  const char *data;
+  std::size_t size;
+
+  FieldString() : data(""), size(0) {}
+  FieldString(const char *s, std::size_t len) : data(s), size(len) {}
+  FieldString(const std::string &s) : data(s.data()), size(s.size()) {}
+
+  std::string str() const { return std::string(data, size); }
+  bool operator==(const std::string &s) const { return s.size() == size && memcmp(s.data(), data, size) == 0; }
+};
+
+/**
+ * Returns the bytes a field takes in the fixed width part of a record, 0 for a VARCHAR.
+ */
+constexpr std::size_t fieldWidth(FieldType type)
+{
+  return type == FIELD_INT32 ? 4 : type == FIELD_VARCHAR ? 0 : 8;
+}
+
+/**
+ * Returns whether any of the first n fields may be NULL.
+ */
+constexpr bool anyNullable(const FieldDesc *fields, std::size_t n)
+{
+  return n != 0 && (fields[n - 1].nullable || anyNullable(fields, n - 1));
+}
+
+/**
+ * Returns the total width of the first n fields.
+ */
+constexpr std::size_t fixedWidth(const FieldDesc *fields, std::size_t n)
+{
+  return n == 0 ? 0 : fixedWidth(fields, n - 1) + fieldWidth(fields[n - 1].type);
+}
+
+/**
+ * Returns how many of the first n fields are VARCHARs.
+ */
+constexpr std::size_t countVarchars(const FieldDesc *fields, std::size_t n)
+{
+  return n == 0 ? 0 : countVarchars(fields, n - 1) + (fields[n - 1].type == FIELD_VARCHAR ? 1 : 0);
+}
+
+/**
+ * @brief Packed layout of the records of a schema, worked out at compile time.
+ *
+ * A schema is a struct with an enum of its fields ending in NUM_FIELDS and a static constexpr
+ * array FIELDS describing them in that order (see ebay_schema.h).  Its records are laid out as
+ *  - a bitmap with a bit per field, set for NULL (only if some field is nullable),
+ *  - the fixed width fields, in schema order, unaligned,
+ *  - a uint16 per VARCHAR: end of its bytes, relative to the start of the VARCHAR bytes,
+ *  - the bytes of the VARCHARs, in schema order.
+ * So every fixed width field is at the same offset in every record, which is the attrByteOffset
+ * to index it by (an INTEGER index for FIELD_INT32, a DOUBLE one for FIELD_DOUBLE), and a VARCHAR
+ * is found with two reads of the offset table.
+ */
+template <typename Schema>
+struct RecordLayout {
+  static constexpr std::size_t NUM_FIELDS = Schema::NUM_FIELDS;
+
+  /**
+   * Bytes of the null bitmap.
+   */
+  static constexpr std::size_t NULL_BYTES = anyNullable(Schema::FIELDS, NUM_FIELDS) ? (NUM_FIELDS + 7) / 8 : 0;
+
+  static constexpr std::size_t NUM_VARCHARS = countVarchars(Schema::FIELDS, NUM_FIELDS);
+
+  /**
+   * Offset of the VARCHAR offset table, one past the fixed width fields.
+   */
+  static constexpr std::size_t VARCHAR_TABLE = NULL_BYTES + fixedWidth(Schema::FIELDS, NUM_FIELDS);
+
+  /**
+   * Offset of the VARCHAR bytes, and the size of a record whose VARCHARs are all empty.
+   */
+  static constexpr std::size_t VARCHAR_DATA = VARCHAR_TABLE + NUM_VARCHARS * sizeof(std::uint16_t);
+
+  /**
+   * Returns the offset of a fixed width field.
+   */
+  static constexpr std::size_t offset(std::size_t field)
+  {
+    return NULL_BYTES + fixedWidth(Schema::FIELDS, field);
+  }
+
+  /**
+   * Returns the position of a VARCHAR field in the offset table.
+   */
+  static constexpr std::size_t varcharIndex(std::size_t field)
+  {
+    return countVarchars(Schema::FIELDS, field);
+  }
+};
+
+/**
+ * @brief C++ type of the values of a field type.
+ */
+template <FieldType T> struct FieldValue;
+template <> struct FieldValue<FIELD_INT32> { typedef std::int32_t type; };
+template <> struct FieldValue<FIELD_INT64> { typedef std::int64_t type; };
+template <> struct FieldValue<FIELD_DOUBLE> { typedef double type; };
+template <> struct FieldValue<FIELD_DATETIME> { typedef std::int64_t type; };
+template <> struct FieldValue<FIELD_VARCHAR> { typedef FieldString type; };
+
+/**
+ * @brief Type and position of field F of a schema.
+ */
+template <typename Schema, std::size_t F>
+struct FieldOf {
+  static_assert(F < Schema::NUM_FIELDS, "no such field");
+  static constexpr FieldType TYPE = Schema::FIELDS[F].type;
+  typedef typename FieldValue<TYPE>::type type;
+  static constexpr std::size_t OFFSET = RecordLayout<Schema>::offset(F);
+  static constexpr std::size_t VARCHAR_INDEX = RecordLayout<Schema>::varcharIndex(F);
+};
+
+/**
+ * @brief Typed read access to a record of a schema, in place.
+ *
+ * Fixed width fields are read from their fixed offsets and VARCHARs are returned as pointers into
+ * the record, so the record has to outlive the view and the strings taken from it.
+ */
+template <typename Schema>
+class RecordView
+{
+ public:
+  typedef RecordLayout<Schema> Layout;
+
+  RecordView(const char *data, std::size_t size) : data(data), size(size) {}
+  explicit RecordView(const std::string &record) : data(record.data()), size(record.size()) {}
+  explicit RecordView(const FieldString &record) : data(record.data), size(record.size) {}
+
+  /**
+   * Returns whether the record is long enough for its fixed part and its VARCHAR offsets.
+   */
+  bool valid() const
+  {
+    return size >= Layout::VARCHAR_DATA &&
+           (Layout::NUM_VARCHARS == 0 || Layout::VARCHAR_DATA + varcharEnd(Layout::NUM_VARCHARS - 1) == size);
+  }
+
+  /**
+   * Returns whether a field is NULL.
+   */
+  bool isNull(std::size_t field) const
+  {
+    return Layout::NULL_BYTES != 0 && (data[field / 8] >> (field % 8) & 1) != 0;
+  }
+
+  /**
+   * Returns the value of field F; 0 or empty if it is NULL.
+   */
+  template <std::size_t F>
+  typename FieldOf<Schema, F>::type get() const
+  {
+    return read<F>(static_cast<typename FieldOf<Schema, F>::type *>(NULL));
+  }
+
+ private:
+  template <std::size_t F, typename T>
+  T read(T *) const
+  {
+    T value;
+    memcpy(&value, data + FieldOf<Schema, F>::OFFSET, sizeof(value));
+    return value;
+  }
+
+  template <std::size_t F>
+  FieldString read(FieldString *) const
+  {
+    const std::size_t index = FieldOf<Schema, F>::VARCHAR_INDEX;
+    const std::size_t begin = (index == 0) ? 0 : varcharEnd(index - 1);
+    return FieldString(data + Layout::VARCHAR_DATA + begin, varcharEnd(index) - begin);
+  }
+
+  std::size_t varcharEnd(std::size_t index) const
+  {
+    std::uint16_t end;
+    memcpy(&end, data + Layout::VARCHAR_TABLE + index * sizeof(end), sizeof(end));
+    return end;
+  }
+
+  const char *data;
+  std::size_t size;
+};
+
+/**
+ * @brief Encodes records of a schema.
+ *
+ * Fields are set one at a time, in any order; fields never set are 0, empty and not NULL.
+ * VARCHARs are only referred to until encode(), which copies them into the record.
+ */
+template <typename Schema>
+class RecordBuilder
+{
+ public:
+  typedef RecordLayout<Schema> Layout;
+
+  RecordBuilder() { clear(); }
+
+  /**
+   * Start on a new record.
+   */
+  void clear()
+  {
+    memset(fixed, 0, sizeof(fixed));
+    for (std::size_t i = 0; i < Layout::NUM_VARCHARS; i++)
+      varchars[i] = FieldString();
+  }
+
+  /**
+   * Set field F.
+   */
+  template <std::size_t F>
+  void set(typename FieldOf<Schema, F>::type value)
+  {
+    write<F>(value);
+    if (Layout::NULL_BYTES != 0)
+      fixed[F / 8] &= ~(1 << (F % 8));
+  }
+
+  /**
+   * Set field F to NULL.
+   */
+  template <std::size_t F>
+  void setNull()
+  {
+    static_assert(Schema::FIELDS[F].nullable, "field is not nullable");
+    write<F>(typename FieldOf<Schema, F>::type());
+    fixed[F / 8] |= 1 << (F % 8);
+  }
+
+  /**
+   * Returns the size of the record as set so far.
+   */
+  std::size_t size() const
+  {
+    std::size_t total = Layout::VARCHAR_DATA;
+    for (std::size_t i = 0; i < Layout::NUM_VARCHARS; i++)
+      total += varchars[i].size;
+    return total;
+  }
+
+  /**
+   * Encode the record into out.  The VARCHARs have to total less than 64 KB, as any record
+   * that fits in a page does.
+   */
+  void encode(std::string &out) const
+  {
+    out.assign(fixed, sizeof(fixed));
+    std::size_t end = 0;
+    for (std::size_t i = 0; i < Layout::NUM_VARCHARS; i++)
+    {
+      end += varchars[i].size;
+      assert(end <= UINT16_MAX);
+      const std::uint16_t end16 = end;
+      out.append(reinterpret_cast<const char*>(&end16), sizeof(end16));
+    }
+    for (std::size_t i = 0; i < Layout::NUM_VARCHARS; i++)
+      out.append(varchars[i].data, varchars[i].size);
+  }
+
+ private:
+  template <std::size_t F, typename T>
+  void write(const T &value)
+  {
+    memcpy(fixed + FieldOf<Schema, F>::OFFSET, &value, sizeof(value));
+  }
+
+  template <std::size_t F>
+  void write(const FieldString &value)
+  {
+    varchars[FieldOf<Schema, F>::VARCHAR_INDEX] = value;
+  }
+
+  /**
+   * Null bitmap and fixed width fields.
+   */
+  char fixed[Layout::VARCHAR_TABLE];
+
+  /**
+   * VARCHAR values, referred to.
+   */
+  FieldString varchars[Layout::NUM_VARCHARS + 1];
+};
+
+}
@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "sort_merge_join.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace badgerdb {
+
+bool SortMergeJoin::bytesLess(const FieldString &a, const FieldString &b)
+{
+	const int order = memcmp(a.data, b.data, std::min(a.size, b.size));
+	return order < 0 || (order == 0 && a.size < b.size);
+}
+
+SortMergeJoin::SortMergeJoin(BufMgr *bufferMgr, const JoinInput &leftInput, const JoinInput &rightInput,
+                             std::uint32_t frames, const std::string &runFileName, const KeyLess &less)
+	: bufMgr(bufferMgr), left(leftInput), right(rightInput), memoryFrames(frames), runName(runFileName), keyLess(less)
+{
+}
+
+/**
+ * Key of a record that passed the key function's filter.
+ */
+static FieldString keyOf(const JoinInput &input, const FieldString &record)
+{
+	FieldString key;
+	input.key(record, key);
+	return key;
+}
+
+MergeJoinStats SortMergeJoin::join(const HashJoin::JoinCallback &callback)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MergeJoinStats stats;
+	const KeyLess &less = keyLess;
+	const JoinInput &leftInput = left, &rightInput = right;
+
+	// Both sides sorted on the key, leaving out the records the key functions leave out
+	const ExternalSort::RecordLess leftLess = [&](const FieldString &a, const FieldString &b) {
+		return less(keyOf(leftInput, a), keyOf(leftInput, b));
+	};
+	const ExternalSort::RecordLess rightLess = [&](const FieldString &a, const FieldString &b) {
+		return less(keyOf(rightInput, a), keyOf(rightInput, b));
+	};
+	const ExternalSort::RecordFilter leftFilter = [&](const std::string &record) {
+		FieldString key;
+		return leftInput.key(record, key);
+	};
+	const ExternalSort::RecordFilter rightFilter = [&](const std::string &record) {
+		FieldString key;
+		return rightInput.key(record, key);
+	};
+	ExternalSort leftSort(bufMgr, left.relation, leftLess, memoryFrames / 2, runName + ".left", leftFilter);
+	ExternalSort rightSort(bufMgr, right.relation, rightLess, memoryFrames / 2, runName + ".right", rightFilter);
+	stats.leftSort = leftSort.open();
+	stats.rightSort = rightSort.open();
+
+	FieldString leftRecord, rightRecord;
+	bool moreLeft = leftSort.next(leftRecord), moreRight = rightSort.next(rightRecord);
+	std::vector<std::string> group;
+	std::string groupKey;
+	while (moreLeft && moreRight)
+	{
+		const FieldString leftKey = keyOf(left, leftRecord), rightKey = keyOf(right, rightRecord);
+		if (less(leftKey, rightKey))
+		{
+			moreLeft = leftSort.next(leftRecord);
+			continue;
+		}
+		if (less(rightKey, leftKey))
+		{
+			moreRight = rightSort.next(rightRecord);
+			continue;
+		}
+
+		// Hold the left records of the key, since the sort returns a record only until the next one
+		groupKey.assign(leftKey.data, leftKey.size);
+		group.clear();
+		do
+		{
+			group.push_back(leftRecord.str());
+			moreLeft = leftSort.next(leftRecord);
+		} while (moreLeft && !less(FieldString(groupKey), keyOf(left, leftRecord)));
+		stats.largestGroup = std::max<std::uint64_t>(stats.largestGroup, group.size());
+
+		while (moreRight && !less(FieldString(groupKey), keyOf(right, rightRecord)))
+		{
+			for (std::size_t i = 0; i < group.size(); i++)
+				callback(FieldString(group[i]), rightRecord);
+			stats.matches += group.size();
+			moreRight = rightSort.next(rightRecord);
+		}
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+}
@@ -0,0 +1,97 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "buffer.h"
+#include "external_sort.h"
+#include "hash_join.h"
+
+namespace badgerdb {
+
+/**
+ * @brief What a sort-merge join did.
+ */
+struct MergeJoinStats
+{
+  /**
+   * Pairs joined.
+   */
+  std::uint64_t matches;
+
+  /**
+   * Largest number of left records with one key, all held in memory while they were joined.
+   */
+  std::uint64_t largestGroup;
+
+  /**
+   * What the sorts of either side did.
+   */
+  SortStats leftSort, rightSort;
+
+  /**
+   * Wall time of the join, sorts included, in seconds.
+   */
+  double seconds;
+
+  MergeJoinStats() : matches(0), largestGroup(0), seconds(0) {}
+};
+
+/**
+ * @brief Equi-join of two relations by sorting both on the join key with ExternalSort and merging.
+ *
+ * Pairs come out in key order, so the join is the one to use when the output has to be ordered
+ * on the key.  The left records of a key are held in memory while the right records of that key
+ * go by, so the left side should be the one with fewer duplicates (the key side of a foreign key).
+ */
+class SortMergeJoin
+{
+ public:
+  /**
+   * Strict weak order on join keys.
+   */
+  typedef std::function<bool(const FieldString &a, const FieldString &b)> KeyLess;
+
+  /**
+   * Orders keys as bytes, shorter first on a common prefix.
+   */
+  static bool bytesLess(const FieldString &a, const FieldString &b);
+
+  /**
+   * Constructor of SortMergeJoin class
+   *
+   * @param bufMgr        Buffer Manager the relations are scanned and sorted through
+   * @param left          One side, whose records of a key are held in memory
+   * @param right         Other side
+   * @param memoryFrames  Frames of memory for the two sorts, half each
+   * @param runName       Prefix of the names of the run files of the sorts
+   * @param keyLess       Order of the keys, and so of the output; keys are equal if neither is less
+   */
+  SortMergeJoin(BufMgr *bufMgr, const JoinInput &left, const JoinInput &right, std::uint32_t memoryFrames = 64,
+                const std::string &runName = "mergejoin.runs", const KeyLess &keyLess = bytesLess);
+
+  /**
+   * Join the two sides.
+   *
+   * @param callback  Receives every matching pair, as (left, right), in key order
+   * @return          What the join did
+   */
+  MergeJoinStats join(const HashJoin::JoinCallback &callback);
+
+ private:
+  BufMgr *bufMgr;
+  JoinInput left;
+  JoinInput right;
+  std::uint32_t memoryFrames;
+  std::string runName;
+  KeyLess keyLess;
+};
+
+}
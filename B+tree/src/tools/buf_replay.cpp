@@ -0,0 +1,311 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Offline buffer replacement simulator for page access traces recorded with BufMgr::startTrace().
+ *
+ * Every readPage and allocPage pin in the trace is one reference.  The tool reports, for a range of
+ * pool sizes, the hit ratio of
+ *   - LRU, from a single pass computing the stack distance of every reference with a Fenwick tree
+ *     (LRU is a stack algorithm, so one distance histogram answers every pool size at once),
+ *   - OPT (Belady), replaying the trace per size with the next use of every reference precomputed,
+ *   - CLOCK, replaying the trace per size with the same sweep as BufMgr::allocBuf,
+ *   - 2Q (full version: A1in FIFO of 25% of the pool, A1out ghost list of 50%, Am LRU), per size.
+ * CLOCK and 2Q are not stack algorithms, so they cannot share the single pass.  Unpins, disposes and
+ * flushes are ignored: the simulators model a pool in steady state without pinned frames.
+ *
+ * Usage: buf_replay trace [poolSize ...]
+ * Without pool sizes, powers of two from 8 up to the number of distinct pages are used.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "buf_trace.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+/**
+ * Counts over positions 1..n supporting point updates and prefix sums in O(log n).
+ */
+class FenwickTree
+{
+ public:
+	explicit FenwickTree(std::size_t n) : tree(n + 1, 0) {}
+
+	void add(std::size_t pos, int delta)
+	{
+		for (pos++; pos < tree.size(); pos += pos & (~pos + 1))
+			tree[pos] += delta;
+	}
+
+	// sum of positions [0, pos)
+	std::int64_t prefix(std::size_t pos) const
+	{
+		std::int64_t sum = 0;
+		for (; pos > 0; pos -= pos & (~pos + 1))
+			sum += tree[pos];
+		return sum;
+	}
+
+ private:
+	std::vector<std::int64_t> tree;
+};
+
+/**
+ * Histogram of LRU stack distances: distances[d] references found their page at depth d of the
+ * LRU stack, so a pool of C frames hits every reference of distance C or less.
+ */
+static std::vector<std::uint64_t> lruStackDistances(const std::vector<std::uint32_t> &refs, std::uint32_t numPages)
+{
+	std::vector<std::uint64_t> distances(numPages + 1, 0);
+	std::vector<std::int64_t> last(numPages, -1);
+	FenwickTree recent(refs.size());
+
+	for (std::size_t t = 0; t < refs.size(); t++)
+	{
+		const std::uint32_t page = refs[t];
+		if (last[page] >= 0)
+		{
+			// distinct pages referenced since the last reference of this one, plus itself
+			const std::int64_t depth = recent.prefix(t) - recent.prefix(last[page] + 1) + 1;
+			distances[depth]++;
+			recent.add(last[page], -1);
+		}
+		recent.add(t, 1);
+		last[page] = t;
+	}
+	return distances;
+}
+
+static std::uint64_t simulateOpt(const std::vector<std::uint32_t> &refs, const std::vector<std::size_t> &nextUse,
+                                 std::uint32_t numPages, std::uint32_t poolSize)
+{
+	std::uint64_t hits = 0;
+	std::vector<std::size_t> residentUntil(numPages, 0);
+	std::vector<bool> resident(numPages, false);
+	std::set<std::pair<std::size_t, std::uint32_t> > byNextUse;
+
+	for (std::size_t t = 0; t < refs.size(); t++)
+	{
+		const std::uint32_t page = refs[t];
+		if (resident[page])
+		{
+			hits++;
+			byNextUse.erase(std::make_pair(residentUntil[page], page));
+		}
+		else
+		{
+			if (byNextUse.size() == poolSize)
+			{
+				// evict the page used furthest in the future
+				std::set<std::pair<std::size_t, std::uint32_t> >::iterator victim = --byNextUse.end();
+				resident[victim->second] = false;
+				byNextUse.erase(victim);
+			}
+			resident[page] = true;
+		}
+		residentUntil[page] = nextUse[t];
+		byNextUse.insert(std::make_pair(nextUse[t], page));
+	}
+	return hits;
+}
+
+static std::uint64_t simulateClock(const std::vector<std::uint32_t> &refs, std::uint32_t numPages, std::uint32_t poolSize)
+{
+	const std::uint32_t NONE = 0xFFFFFFFF;
+	std::uint64_t hits = 0;
+	std::vector<std::uint32_t> frameOf(numPages, NONE);
+	std::vector<std::uint32_t> pageIn(poolSize, NONE);
+	std::vector<bool> refbit(poolSize, false);
+	std::uint32_t hand = poolSize - 1;
+
+	for (std::size_t t = 0; t < refs.size(); t++)
+	{
+		const std::uint32_t page = refs[t];
+		if (frameOf[page] != NONE)
+		{
+			hits++;
+			refbit[frameOf[page]] = true;
+			continue;
+		}
+
+		while (true)
+		{
+			hand = (hand + 1) % poolSize;
+			if (pageIn[hand] == NONE || !refbit[hand])
+				break;
+			refbit[hand] = false;
+		}
+		if (pageIn[hand] != NONE)
+			frameOf[pageIn[hand]] = NONE;
+		pageIn[hand] = page;
+		frameOf[page] = hand;
+		refbit[hand] = true;
+	}
+	return hits;
+}
+
+static std::uint64_t simulate2Q(const std::vector<std::uint32_t> &refs, std::uint32_t numPages, std::uint32_t poolSize)
+{
+	enum Where { NOWHERE, IN_AM, IN_A1IN, IN_A1OUT };
+	const std::size_t kIn = std::max<std::size_t>(1, poolSize / 4);
+	const std::size_t kOut = std::max<std::size_t>(1, poolSize / 2);
+
+	std::uint64_t hits = 0;
+	std::vector<Where> where(numPages, NOWHERE);
+	std::vector<std::list<std::uint32_t>::iterator> position(numPages);
+	std::list<std::uint32_t> am, a1in, a1out;   // most recent at the front
+
+	for (std::size_t t = 0; t < refs.size(); t++)
+	{
+		const std::uint32_t page = refs[t];
+		if (where[page] == IN_AM)
+		{
+			hits++;
+			am.splice(am.begin(), am, position[page]);
+			continue;
+		}
+		if (where[page] == IN_A1IN)
+		{
+			hits++;
+			continue;
+		}
+
+		// make room
+		if (am.size() + a1in.size() >= poolSize)
+		{
+			if (a1in.size() > kIn || am.empty())
+			{
+				const std::uint32_t victim = a1in.back();
+				a1in.pop_back();
+				a1out.push_front(victim);
+				where[victim] = IN_A1OUT;
+				position[victim] = a1out.begin();
+				if (a1out.size() > kOut)
+				{
+					where[a1out.back()] = NOWHERE;
+					a1out.pop_back();
+				}
+			}
+			else
+			{
+				where[am.back()] = NOWHERE;
+				am.pop_back();
+			}
+		}
+
+		if (where[page] == IN_A1OUT)
+		{
+			// seen recently enough to be worth keeping for long
+			a1out.erase(position[page]);
+			am.push_front(page);
+			where[page] = IN_AM;
+			position[page] = am.begin();
+		}
+		else
+		{
+			a1in.push_front(page);
+			where[page] = IN_A1IN;
+			position[page] = a1in.begin();
+		}
+	}
+	return hits;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " trace [poolSize ...]" << std::endl;
+		return 2;
+	}
+
+	// Number the distinct (file, page) pairs densely
+	std::vector<std::uint32_t> refs;
+	std::uint32_t numFiles = 0;
+	std::unordered_map<std::uint64_t, std::uint32_t> pageIds;
+	try
+	{
+		BufTraceReader reader(argv[1]);
+		BufTraceRecord record;
+		while (reader.next(record))
+		{
+			if (record.op != TRACE_READ_PAGE && record.op != TRACE_ALLOC_PAGE)
+				continue;
+			const std::uint64_t key = ((std::uint64_t)record.fileId << 32) | record.pageNo;
+			std::unordered_map<std::uint64_t, std::uint32_t>::iterator it = pageIds.find(key);
+			if (it == pageIds.end())
+				it = pageIds.insert(std::make_pair(key, (std::uint32_t)pageIds.size())).first;
+			refs.push_back(it->second);
+		}
+		numFiles = reader.numFiles();
+	}
+	catch (const BadgerDbException &e)
+	{
+		std::cerr << e.message() << std::endl;
+		return 1;
+	}
+	const std::uint32_t numPages = pageIds.size();
+
+	std::vector<std::uint32_t> sizes;
+	for (int i = 2; i < argc; i++)
+		sizes.push_back(std::strtoul(argv[i], NULL, 10));
+	if (sizes.empty())
+	{
+		for (std::uint32_t size = 8; ; size *= 2)
+		{
+			sizes.push_back(size);
+			if (size >= numPages)
+				break;
+		}
+	}
+
+	std::cout << "references=" << refs.size() << " distinct_pages=" << numPages << " files=" << numFiles << std::endl;
+	if (refs.empty())
+		return 0;
+
+	std::vector<std::uint64_t> distances = lruStackDistances(refs, numPages);
+
+	std::vector<std::size_t> nextUse(refs.size());
+	{
+		std::vector<std::size_t> upcoming(numPages, refs.size());
+		for (std::size_t t = refs.size(); t-- > 0; )
+		{
+			nextUse[t] = upcoming[refs[t]];
+			upcoming[refs[t]] = t;
+		}
+	}
+
+	std::cout << std::setw(10) << "frames" << std::setw(10) << "LRU" << std::setw(10) << "OPT"
+	          << std::setw(10) << "CLOCK" << std::setw(10) << "2Q" << std::endl;
+	std::cout << std::fixed << std::setprecision(4);
+	for (std::size_t i = 0; i < sizes.size(); i++)
+	{
+		const std::uint32_t size = sizes[i];
+		if (size == 0)
+			continue;
+
+		std::uint64_t lruHits = 0;
+		for (std::uint32_t d = 1; d <= numPages && d <= size; d++)
+			lruHits += distances[d];
+
+		const double n = refs.size();
+		std::cout << std::setw(10) << size
+		          << std::setw(10) << lruHits / n
+		          << std::setw(10) << simulateOpt(refs, nextUse, numPages, size) / n
+		          << std::setw(10) << simulateClock(refs, numPages, size) / n
+		          << std::setw(10) << simulate2Q(refs, numPages, size) / n << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Loads the items-*.json files of the eBay dataset into BadgerDB relations with EbayLoader.
+ *
+ * Usage: ebay_load [-j workers] [-p prefix] file.json ...
+ * The relations are named prefix + "Item", "Bid", "User" and "Category", prefix defaulting to
+ * "ebay".  Without -j, one worker per hardware thread is used.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ebay_loader.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+int main(int argc, char **argv)
+{
+	std::uint32_t workers = 0;
+	std::string prefix = "ebay";
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			prefix = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		std::cerr << "Usage: " << argv[0] << " [-j workers] [-p prefix] file.json ..." << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		EbayLoader loader(prefix);
+		const EbayLoadStats stats = loader.load(files, workers);
+		std::cout << "files " << stats.files << ", " << std::fixed << std::setprecision(1)
+		          << stats.bytes / 1048576.0 << " MB in " << std::setprecision(3) << stats.seconds << " s" << std::endl;
+		std::cout << loader.relationName(EBAY_ITEM) << ": " << stats.items << " records ("
+		          << stats.truncatedDescriptions << " descriptions truncated)" << std::endl;
+		std::cout << loader.relationName(EBAY_BID) << ": " << stats.bids << " records" << std::endl;
+		std::cout << loader.relationName(EBAY_USER) << ": " << stats.users << " records" << std::endl;
+		std::cout << loader.relationName(EBAY_CATEGORY) << ": " << stats.categories << " records" << std::endl;
+	}
+	catch(const BadgerDbException &e)
+	{
+		std::cerr << e.message() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,584 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "wal.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file.h"
+#include "page.h"
+#include "exceptions/bad_log_exception.h"
+
+namespace badgerdb {
+
+static const char LOG_MAGIC[8] = {'B', 'D', 'B', 'W', 'A', 'L', '0', '1'};
+
+// The magic is followed by the LSN recovery starts at; the first record comes after it
+static const Lsn LOG_CHECKPOINT_OFFSET = sizeof(LOG_MAGIC);
+static const Lsn LOG_FIRST_LSN = LOG_CHECKPOINT_OFFSET + sizeof(Lsn);
+
+// Set in the stored type of a compensation record
+static const std::uint16_t LOG_CLR_FLAG = 0x100;
+
+// Once this many bytes are buffered the appending thread syncs them itself
+static const std::size_t LOG_BUFFER_SIZE = 1 << 20;
+
+/**
+ * Fixed part of a record as stored in the log.  The checksum covers the rest of the header,
+ * the file name and the images.
+ */
+struct LogRecordHeader
+{
+	std::uint32_t checksum;
+	std::uint32_t size;
+	Lsn prevLsn;
+	Lsn undoNextLsn;
+	TxnId txn;
+	PageId pageNo;
+	std::uint16_t type;
+	std::uint16_t offset;
+	std::uint32_t nameLength;
+	std::uint32_t beforeLength;
+	std::uint32_t afterLength;
+	std::uint32_t padding;
+};
+
+/**
+ * FNV-1a, continuing from hash.
+ */
+static std::uint32_t fnv1a(const char *bytes, std::size_t len, std::uint32_t hash = 2166136261u)
+{
+	for (std::size_t i = 0; i < len; i++)
+	{
+		hash ^= static_cast<std::uint8_t>(bytes[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * Checksum of a record: the variable part first, so that it can be hashed before the log latch
+ * is taken, then the header fields following the checksum.
+ */
+static std::uint32_t recordChecksum(const LogRecordHeader &header, std::uint32_t payloadHash)
+{
+	const char *fields = reinterpret_cast<const char*>(&header) + sizeof(header.checksum);
+	return fnv1a(fields, sizeof(header) - sizeof(header.checksum), payloadHash);
+}
+
+static bool writeAll(int fd, const char *bytes, std::size_t len, Lsn offset)
+{
+	while (len > 0)
+	{
+		const ssize_t n = pwrite(fd, bytes, len, offset);
+		if (n <= 0)
+			return false;
+		bytes += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+template <typename T>
+static void putValue(std::string &out, T value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool getValue(const std::string &in, std::size_t &pos, T &value)
+{
+	if (in.size() - pos < sizeof(value))
+		return false;
+	memcpy(&value, in.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+//----------------------------------------
+// CheckpointData
+//----------------------------------------
+
+std::string CheckpointData::encode() const
+{
+	std::string out;
+	putValue<TxnId>(out, nextTxn);
+	putValue<std::uint32_t>(out, activeTxns.size());
+	for (std::size_t i = 0; i < activeTxns.size(); i++)
+	{
+		putValue<TxnId>(out, activeTxns[i].first);
+		putValue<Lsn>(out, activeTxns[i].second);
+	}
+	putValue<std::uint32_t>(out, dirtyPages.size());
+	for (std::size_t i = 0; i < dirtyPages.size(); i++)
+	{
+		putValue<std::uint32_t>(out, dirtyPages[i].fileName.size());
+		out += dirtyPages[i].fileName;
+		putValue<PageId>(out, dirtyPages[i].pageNo);
+		putValue<Lsn>(out, dirtyPages[i].recLsn);
+	}
+	return out;
+}
+
+bool CheckpointData::decode(const std::string &image)
+{
+	std::size_t pos = 0;
+	std::uint32_t count;
+	activeTxns.clear();
+	dirtyPages.clear();
+	if (!getValue(image, pos, nextTxn) || !getValue(image, pos, count))
+		return false;
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		std::pair<TxnId, Lsn> txn;
+		if (!getValue(image, pos, txn.first) || !getValue(image, pos, txn.second))
+			return false;
+		activeTxns.push_back(txn);
+	}
+	if (!getValue(image, pos, count))
+		return false;
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		DirtyPage page;
+		std::uint32_t nameLength;
+		if (!getValue(image, pos, nameLength) || image.size() - pos < nameLength)
+			return false;
+		page.fileName.assign(image, pos, nameLength);
+		pos += nameLength;
+		if (!getValue(image, pos, page.pageNo) || !getValue(image, pos, page.recLsn))
+			return false;
+		dirtyPages.push_back(page);
+	}
+	return pos == image.size();
+}
+
+//----------------------------------------
+// LogManager
+//----------------------------------------
+
+LogManager::LogManager(const std::string &path)
+	: path(path), flushing(false), nextTxn(1), checkpointLsn(0), crashCountdown(0), failureCountdown(0),
+	  crashed(false), numSyncs(0), numCommits(0), groupCommitDelayUs(0)
+{
+	fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		throw BadLogException(path, "cannot open");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw BadLogException(path, "cannot stat");
+	}
+
+	Lsn end = LOG_FIRST_LSN;
+	if (st.st_size == 0)
+	{
+		char header[LOG_FIRST_LSN] = {0};
+		memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC));
+		if (!writeAll(fd, header, sizeof(header), 0) || fdatasync(fd) != 0)
+		{
+			close(fd);
+			throw BadLogException(path, "cannot write");
+		}
+	}
+	else
+	{
+		// Skip over the existing records from the last checkpoint on, dropping a torn tail
+		try
+		{
+			LogReader reader(path);
+			checkpointLsn = reader.checkpointLsn();
+			if (checkpointLsn != 0)
+				reader.seek(checkpointLsn);
+			LogRecord record;
+			while (reader.next(record))
+			{
+				CheckpointData data;
+				if (record.type == LOG_CHECKPOINT && data.decode(record.after) && data.nextTxn > nextTxn)
+					nextTxn = data.nextTxn;
+				if (record.txn >= nextTxn)
+					nextTxn = record.txn + 1;
+			}
+			end = reader.endLsn();
+		}
+		catch (...)
+		{
+			close(fd);
+			throw;
+		}
+		if ((Lsn)st.st_size > end && ftruncate(fd, end) != 0)
+		{
+			close(fd);
+			throw BadLogException(path, "cannot cut off torn tail");
+		}
+	}
+	bufferStart = endLsn = flushedLsn = end;
+}
+
+LogManager::~LogManager()
+{
+	try
+	{
+		flushAll();
+	}
+	catch (const BadLogException &e)
+	{
+		std::cerr << e.message() << std::endl;
+	}
+	close(fd);
+}
+
+TxnId LogManager::beginTxn()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return nextTxn++;
+}
+
+Lsn LogManager::append(LogRecordType type, TxnId txn, const File *file, PageId pageNo, std::uint16_t offset,
+                       const char *before, std::uint32_t beforeLength, const char *after, std::uint32_t afterLength,
+                       bool compensation, Lsn undoNextLsn)
+{
+	const std::string name = (file != NULL) ? file->filename() : std::string();
+
+	LogRecordHeader header;
+	header.size = sizeof(header) + name.size() + beforeLength + afterLength;
+	header.undoNextLsn = undoNextLsn;
+	header.pageNo = pageNo;
+	header.type = compensation ? (type | LOG_CLR_FLAG) : type;
+	header.offset = offset;
+	header.nameLength = name.size();
+	header.beforeLength = beforeLength;
+	header.afterLength = afterLength;
+	header.padding = 0;
+	std::uint32_t payloadHash = fnv1a(name.data(), name.size());
+	payloadHash = fnv1a(before, beforeLength, payloadHash);
+	payloadHash = fnv1a(after, afterLength, payloadHash);
+
+	Lsn lsn;
+	bool full;
+	{
+		std::lock_guard<std::mutex> guard(logLatch);
+		if (crashed || (crashCountdown > 0 && --crashCountdown == 0))
+		{
+			crashed = true;
+			throw BadLogException(path, "injected crash");
+		}
+		if (failureCountdown > 0 && --failureCountdown == 0)
+			throw BadLogException(path, "injected failure");
+
+		lsn = endLsn;
+		std::unordered_map<TxnId, Lsn>::iterator it = lastLsn.find(txn);
+		header.prevLsn = (it == lastLsn.end()) ? 0 : it->second;
+		header.txn = txn;
+		header.checksum = recordChecksum(header, payloadHash);
+
+		if (type == LOG_COMMIT || type == LOG_ABORT)
+		{
+			if (it != lastLsn.end())
+				lastLsn.erase(it);
+			if (type == LOG_COMMIT)
+				numCommits++;
+		}
+		else if (type != LOG_CHECKPOINT)
+			lastLsn[txn] = lsn;
+
+		const char *h = reinterpret_cast<const char*>(&header);
+		buffer.insert(buffer.end(), h, h + sizeof(header));
+		buffer.insert(buffer.end(), name.begin(), name.end());
+		buffer.insert(buffer.end(), before, before + beforeLength);
+		buffer.insert(buffer.end(), after, after + afterLength);
+		endLsn += header.size;
+		full = buffer.size() >= LOG_BUFFER_SIZE && !flushing;
+	}
+
+	if (full)
+		flush(lsn);
+	return lsn;
+}
+
+Lsn LogManager::logNodeInsert(TxnId txn, const File *file, PageId pageNo, std::uint16_t slot,
+                              const char *entry, std::uint32_t length)
+{
+	return append(LOG_NODE_INSERT, txn, file, pageNo, slot, NULL, 0, entry, length);
+}
+
+Lsn LogManager::logNodeImage(TxnId txn, const File *file, PageId pageNo, const char *before, const char *after)
+{
+	return append(LOG_NODE_IMAGE, txn, file, pageNo, 0, before, (before != NULL) ? Page::SIZE : 0, after, Page::SIZE);
+}
+
+Lsn LogManager::logCompensation(const LogRecord &undone, const File *file)
+{
+	// The compensating change: inserts are undone by removes and vice versa, rewrites by
+	// writing the before image back.  A compensation is never undone, so it needs no before image
+	// of its own.
+	switch (undone.type)
+	{
+		case LOG_NODE_INSERT:
+			return append(LOG_NODE_REMOVE, undone.txn, file, undone.pageNo, undone.offset,
+			              undone.after.data(), undone.after.size(), NULL, 0, true, undone.prevLsn);
+		case LOG_NODE_REMOVE:
+			return append(LOG_NODE_INSERT, undone.txn, file, undone.pageNo, undone.offset,
+			              NULL, 0, undone.before.data(), undone.before.size(), true, undone.prevLsn);
+		case LOG_NODE_IMAGE:
+			return append(LOG_NODE_IMAGE, undone.txn, file, undone.pageNo, undone.offset,
+			              NULL, 0, undone.before.data(), undone.before.size(), true, undone.prevLsn);
+		default:
+			throw BadLogException(path, "record cannot be undone");
+	}
+}
+
+Lsn LogManager::logAbort(TxnId txn)
+{
+	return append(LOG_ABORT, txn, NULL, Page::INVALID_NUMBER, 0, NULL, 0, NULL, 0);
+}
+
+Lsn LogManager::logCheckpoint(Lsn analysisLsn, const std::vector<DirtyPage> &dirtyPages)
+{
+	CheckpointData data;
+	{
+		std::lock_guard<std::mutex> guard(logLatch);
+		data.nextTxn = nextTxn;
+		data.activeTxns.assign(lastLsn.begin(), lastLsn.end());
+	}
+	data.dirtyPages = dirtyPages;
+
+	const std::string image = data.encode();
+	const Lsn lsn = append(LOG_CHECKPOINT, 0, NULL, Page::INVALID_NUMBER, 0, NULL, 0, image.data(), image.size());
+	flush(lsn);
+
+	// Only a checkpoint that is durable as a whole may become the starting point
+	if (!writeAll(fd, reinterpret_cast<const char*>(&analysisLsn), sizeof(analysisLsn), LOG_CHECKPOINT_OFFSET) ||
+	    fdatasync(fd) != 0)
+		throw BadLogException(path, "cannot write checkpoint");
+
+	std::lock_guard<std::mutex> guard(logLatch);
+	checkpointLsn = analysisLsn;
+	return lsn;
+}
+
+Lsn LogManager::getCheckpointLsn()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return checkpointLsn;
+}
+
+void LogManager::resumeTxn(TxnId txn, Lsn last)
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	lastLsn[txn] = last;
+	if (txn >= nextTxn)
+		nextTxn = txn + 1;
+}
+
+Lsn LogManager::getLastLsn(TxnId txn)
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	std::unordered_map<TxnId, Lsn>::iterator it = lastLsn.find(txn);
+	return (it == lastLsn.end()) ? 0 : it->second;
+}
+
+Lsn LogManager::commit(TxnId txn)
+{
+	const Lsn lsn = append(LOG_COMMIT, txn, NULL, Page::INVALID_NUMBER, 0, NULL, 0, NULL, 0);
+	flush(lsn);
+	return lsn;
+}
+
+void LogManager::flush(Lsn lsn)
+{
+	if (lsn == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock(logLatch);
+	if (lsn >= endLsn)
+		lsn = endLsn - 1;
+
+	while (flushedLsn <= lsn)
+	{
+		// Somebody else is syncing; their batch may well cover our record
+		if (flushing)
+		{
+			flushedCond.wait(lock);
+			continue;
+		}
+
+		// Lead the next sync, taking along everything appended up to now
+		flushing = true;
+		if (groupCommitDelayUs > 0)
+		{
+			lock.unlock();
+			std::this_thread::sleep_for(std::chrono::microseconds(groupCommitDelayUs));
+			lock.lock();
+		}
+		std::vector<char> batch;
+		batch.swap(buffer);
+		const Lsn batchStart = bufferStart;
+		bufferStart = endLsn;
+		lock.unlock();
+
+		const bool written = writeAll(fd, batch.data(), batch.size(), batchStart) && fdatasync(fd) == 0;
+
+		lock.lock();
+		flushing = false;
+		if (written)
+		{
+			flushedLsn = batchStart + batch.size();
+			numSyncs++;
+		}
+		else
+		{
+			// Put the batch back ahead of what was appended meanwhile, so that the next sync
+			// writes it again at its place instead of leaving a gap the log would end at
+			batch.insert(batch.end(), buffer.begin(), buffer.end());
+			buffer.swap(batch);
+			bufferStart = batchStart;
+		}
+		flushedCond.notify_all();
+		if (!written)
+			throw BadLogException(path, "cannot write");
+	}
+}
+
+void LogManager::flushAll()
+{
+	flush(getEndLsn());
+}
+
+Lsn LogManager::getFlushedLsn()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return flushedLsn;
+}
+
+Lsn LogManager::getEndLsn()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return endLsn;
+}
+
+std::uint64_t LogManager::getNumSyncs()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return numSyncs;
+}
+
+std::uint64_t LogManager::getNumCommits()
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	return numCommits;
+}
+
+void LogManager::setGroupCommitDelay(std::uint32_t micros)
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	groupCommitDelayUs = micros;
+}
+
+void LogManager::injectCrash(std::uint64_t records)
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	crashCountdown = records;
+}
+
+void LogManager::injectFailure(std::uint64_t records)
+{
+	std::lock_guard<std::mutex> guard(logLatch);
+	failureCountdown = records;
+}
+
+void LogManager::simulateCrash()
+{
+	std::unique_lock<std::mutex> lock(logLatch);
+	while (flushing)
+		flushedCond.wait(lock);
+	buffer.clear();
+	bufferStart = endLsn = flushedLsn;
+	lastLsn.clear();
+	crashCountdown = 0;
+	failureCountdown = 0;
+	crashed = false;
+}
+
+//----------------------------------------
+// LogReader
+//----------------------------------------
+
+LogReader::LogReader(const std::string &path)
+	: path(path), in(path.c_str(), std::ios::in | std::ios::binary), end(LOG_FIRST_LSN), checkpoint(0), fileSize(0)
+{
+	char magic[sizeof(LOG_MAGIC)];
+	if (!in)
+		throw BadLogException(path, "cannot open");
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0 ||
+	    !in.read(reinterpret_cast<char*>(&checkpoint), sizeof(checkpoint)))
+		throw BadLogException(path, "not a write-ahead log");
+}
+
+void LogReader::seek(Lsn lsn)
+{
+	in.clear();
+	in.seekg(lsn);
+	end = lsn;
+}
+
+bool LogReader::readAt(Lsn lsn, LogRecord &record)
+{
+	seek(lsn);
+	return next(record);
+}
+
+bool LogReader::next(LogRecord &record)
+{
+	LogRecordHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	const std::uint16_t type = header.type & ~LOG_CLR_FLAG;
+	if ((std::uint64_t)header.size != (std::uint64_t)sizeof(header) + header.nameLength + header.beforeLength +
+	                                  header.afterLength ||
+	    type < LOG_COMMIT || type > LOG_ABORT)
+		return false;
+
+	// A garbage size is caught before it is allocated; the log may have grown since it was opened
+	if (end + header.size > fileSize)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0)
+			fileSize = st.st_size;
+		if (end + header.size > fileSize)
+			return false;
+	}
+
+	std::string payload(header.size - sizeof(header), '\0');
+	if (!payload.empty() && !in.read(&payload[0], payload.size()))
+		return false;
+	if (recordChecksum(header, fnv1a(payload.data(), payload.size())) != header.checksum)
+		return false;
+
+	record.lsn = end;
+	record.prevLsn = header.prevLsn;
+	record.undoNextLsn = header.undoNextLsn;
+	record.compensation = (header.type & LOG_CLR_FLAG) != 0;
+	record.txn = header.txn;
+	record.type = (LogRecordType)type;
+	record.pageNo = header.pageNo;
+	record.offset = header.offset;
+	record.fileName.assign(payload, 0, header.nameLength);
+	record.before.assign(payload, header.nameLength, header.beforeLength);
+	record.after.assign(payload, header.nameLength + header.beforeLength, header.afterLength);
+	end += header.size;
+	return true;
+}
+
+}
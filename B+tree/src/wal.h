@@ -0,0 +1,508 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Identifier of a transaction in the write-ahead log.
+ */
+typedef std::uint64_t TxnId;
+
+/**
+ * @brief Kind of a write-ahead log record.
+ */
+enum LogRecordType {
+  LOG_COMMIT        = 1,   // transaction committed, no page
+  LOG_NODE_INSERT   = 2,   // entry inserted into a B+ tree node (at slot <offset> of a non-leaf node), after image is the entry
+  LOG_NODE_REMOVE   = 3,   // entry removed from a B+ tree node, before image is the entry
+  LOG_NODE_IMAGE    = 4,   // B+ tree node rewritten, before (empty for a new node) and after images are the whole page
+  LOG_CHECKPOINT    = 5,   // active transactions and dirty pages, see CheckpointData
+  LOG_ABORT         = 6    // transaction rolled back, no page
+};
+
+/**
+ * @brief A page dirty in the buffer pool, as recorded in a checkpoint.
+ */
+struct DirtyPage
+{
+  /**
+   * Name of the file of the page.
+   */
+  std::string fileName;
+
+  /**
+   * Page number in the file.
+   */
+  PageId pageNo;
+
+  /**
+   * Every change the page on disk may be missing has an LSN of at least this.
+   */
+  Lsn recLsn;
+};
+
+/**
+ * @brief Contents of a LOG_CHECKPOINT record.
+ */
+struct CheckpointData
+{
+  /**
+   * Id the next transaction was going to get.
+   */
+  TxnId nextTxn;
+
+  /**
+   * Transactions that had not committed, with the LSN of their last record.
+   */
+  std::vector<std::pair<TxnId, Lsn> > activeTxns;
+
+  /**
+   * Pages that were dirty in the buffer pool.
+   */
+  std::vector<DirtyPage> dirtyPages;
+
+  /**
+   * Serialize into the after image of a checkpoint record.
+   */
+  std::string encode() const;
+
+  /**
+   * Parse the after image of a checkpoint record.
+   *
+   * @return  False if the image is malformed
+   */
+  bool decode(const std::string &image);
+};
+
+/**
+ * @brief A write-ahead log record, as handed back by LogReader.
+ *
+ * Records are physiological: they name one page, and within the page describe the change
+ * logically (an entry of a B+ tree node) or, for a split or a node's first change after a
+ * checkpoint, as whole page images.
+ */
+struct LogRecord
+{
+  /**
+   * Offset of the record in the log.
+   */
+  Lsn lsn;
+
+  /**
+   * LSN of the previous record of the same transaction, 0 for its first record.
+   */
+  Lsn prevLsn;
+
+  /**
+   * For a compensation record, LSN of the next record of the transaction still to be undone.
+   */
+  Lsn undoNextLsn;
+
+  /**
+   * True for a compensation record (CLR), which redoes the undo of an earlier record and is
+   * never undone itself.  Its type and images are those of the compensating change.
+   */
+  bool compensation;
+
+  /**
+   * Transaction the record belongs to.
+   */
+  TxnId txn;
+
+  /**
+   * What the record describes.
+   */
+  LogRecordType type;
+
+  /**
+   * Name of the file of the page changed, empty for LOG_COMMIT.
+   */
+  std::string fileName;
+
+  /**
+   * Page changed.
+   */
+  PageId pageNo;
+
+  /**
+   * Slot of the entry for LOG_NODE_INSERT and LOG_NODE_REMOVE in a non-leaf node.
+   */
+  std::uint16_t offset;
+
+  /**
+   * Contents before and after the change.
+   */
+  std::string before, after;
+};
+
+/**
+ * @brief Appends physiological redo/undo records to a write-ahead log file and makes them durable
+ * with group commit.
+ *
+ * The log starts with the 8 byte magic "BDBWAL01" and the LSN recovery starts its analysis at, set
+ * by the last complete checkpoint (0 if there is none).  The LSN of a record is its byte offset in
+ * the file, so LSNs grow with every record and a record is durable once the file is synced past
+ * it.  Each record is a fixed header (checksum, size, prevLsn, undoNextLsn, txn, page, type,
+ * offset and the lengths of the file name and the images) followed by the file name, the before
+ * and the after image; a record whose checksum does not match ends the log, which is how a torn
+ * tail is told apart.
+ *
+ * Records are appended to an in-memory buffer.  flush() writes the buffer out and syncs it with
+ * fdatasync; a thread calling flush() while another is already syncing waits for it and then, if
+ * its record is still not durable, becomes the next leader and syncs everything appended in the
+ * meantime.  Committers arriving while a sync is in progress are thus batched into the next one.
+ *
+ * The caller stamps a page with the LSN returned for the change (Page::set_lsn) before unpinning
+ * it; BufMgr flushes the log up to a page's LSN before writing the page back.
+ */
+class LogManager
+{
+ public:
+  /**
+   * Open a log, creating it if it does not exist.  An existing log is appended to after its last
+   * valid record; anything after that is cut off.  Only the part from the last checkpoint on is
+   * read.
+   *
+   * @param path  Name of the log file
+   * @throws BadLogException  If the file cannot be opened or is not a log
+   */
+  explicit LogManager(const std::string &path);
+
+  /**
+   * Make every appended record durable and close the log.
+   */
+  ~LogManager();
+
+  /**
+   * Start a transaction.
+   *
+   * @return  Id of the transaction
+   */
+  TxnId beginTxn();
+
+  /**
+   * Log an entry inserted into a B+ tree node.
+   *
+   * @param txn     Transaction making the change
+   * @param file    File of the node
+   * @param pageNo  Page of the node
+   * @param slot    Slot the entry went in, for a non-leaf node
+   * @param entry   Bytes of the entry
+   * @param length  Number of bytes of the entry
+   * @return        LSN to stamp the node with
+   */
+  Lsn logNodeInsert(TxnId txn, const File *file, PageId pageNo, std::uint16_t slot,
+                    const char *entry, std::uint32_t length);
+
+  /**
+   * Log a B+ tree node rewritten as a whole, by a split or as its first change since the last
+   * checkpoint.
+   *
+   * @param txn     Transaction making the change
+   * @param file    File of the node
+   * @param pageNo  Page of the node
+   * @param before  The page before the change, NULL for a new node
+   * @param after   The page after the change
+   * @return        LSN to stamp the node with
+   */
+  Lsn logNodeImage(TxnId txn, const File *file, PageId pageNo, const char *before, const char *after);
+
+  /**
+   * Log the undo of a record: a compensation record carrying the inverse change, chained to the
+   * transaction's last record and pointing at undone.prevLsn as the next record to undo.
+   *
+   * @param undone  Record being undone, of the transaction's own chain
+   * @param file    File of the page
+   * @return        LSN to stamp the page with
+   */
+  Lsn logCompensation(const LogRecord &undone, const File *file);
+
+  /**
+   * Log that a transaction has been rolled back completely.  Not synced: if it is lost, recovery
+   * just finds nothing left to undo.
+   *
+   * @param txn  Transaction rolled back
+   * @return     LSN of the abort record
+   */
+  Lsn logAbort(TxnId txn);
+
+  /**
+   * Write a checkpoint record holding the active transactions and the given dirty pages, sync it,
+   * and make analysisLsn the point the next recovery starts at.  analysisLsn has to be taken with
+   * getEndLsn() before the dirty pages were collected, so that a page dirtied in between is still
+   * seen by the analysis.
+   *
+   * @param analysisLsn  End of the log before the dirty pages were collected
+   * @param dirtyPages   Pages dirty in the buffer pool, with their recLsn
+   * @return             LSN of the checkpoint record
+   */
+  Lsn logCheckpoint(Lsn analysisLsn, const std::vector<DirtyPage> &dirtyPages);
+
+  /**
+   * Returns the LSN the analysis of a recovery starts at, 0 if there has been no checkpoint.
+   */
+  Lsn getCheckpointLsn();
+
+  /**
+   * Take over a transaction found unfinished by recovery, so that records logged for it are
+   * chained to its last one.
+   *
+   * @param txn      Transaction to take over
+   * @param lastLsn  LSN of its last record
+   */
+  void resumeTxn(TxnId txn, Lsn lastLsn);
+
+  /**
+   * Returns the LSN of the last record of an unfinished transaction, 0 if it has logged nothing.
+   */
+  Lsn getLastLsn(TxnId txn);
+
+  /**
+   * Commit a transaction: append its commit record and wait until it is durable.
+   *
+   * @param txn  Transaction to commit
+   * @return     LSN of the commit record
+   */
+  Lsn commit(TxnId txn);
+
+  /**
+   * Wait until the record at lsn, and every record before it, is durable.  An LSN beyond the end
+   * of the log makes everything appended so far durable.
+   *
+   * @param lsn  LSN of the record, 0 to return at once
+   * @throws BadLogException  If the log cannot be written
+   */
+  void flush(Lsn lsn);
+
+  /**
+   * Make every appended record durable.
+   */
+  void flushAll();
+
+  /**
+   * Returns the offset up to which the log is durable; every record with a smaller LSN is durable.
+   */
+  Lsn getFlushedLsn();
+
+  /**
+   * Returns the LSN the next record will get.
+   */
+  Lsn getEndLsn();
+
+  /**
+   * Returns the number of fdatasync calls made so far.
+   */
+  std::uint64_t getNumSyncs();
+
+  /**
+   * Returns the number of transactions committed so far.
+   */
+  std::uint64_t getNumCommits();
+
+  /**
+   * Have a thread that starts a sync wait this long first, so that more committers can join it.
+   * Trades commit latency for fewer syncs; 0, the default, syncs at once.
+   *
+   * @param micros  Delay in microseconds
+   */
+  void setGroupCommitDelay(std::uint32_t micros);
+
+  /**
+   * Returns the name of the log file.
+   */
+  const std::string &filename() const { return path; }
+
+  /**
+   * Crash testing: throw a BadLogException from the append of the given number of records from
+   * now on, as if the process died right there.  Every later append throws as well, until
+   * simulateCrash.  0 turns the injection off.
+   *
+   * @param records  Records to append before the crash
+   */
+  void injectCrash(std::uint64_t records);
+
+  /**
+   * Failure testing: throw a BadLogException from the append of the given number of records from
+   * now on, as if that one write had failed; later appends go through.  0 turns the injection off.
+   *
+   * @param records  Records to append before the failure
+   */
+  void injectFailure(std::uint64_t records);
+
+  /**
+   * Crash testing: forget every record not durable yet, as a crash would.  The log is left as it
+   * is on disk; the object should only be destroyed after this.
+   */
+  void simulateCrash();
+
+ private:
+  LogManager(const LogManager &);
+  LogManager &operator=(const LogManager &);
+
+  /**
+   * Append a record to the buffer, chaining it to the transaction's previous record.
+   *
+   * @return  LSN of the record
+   */
+  Lsn append(LogRecordType type, TxnId txn, const File *file, PageId pageNo, std::uint16_t offset,
+             const char *before, std::uint32_t beforeLength, const char *after, std::uint32_t afterLength,
+             bool compensation = false, Lsn undoNextLsn = 0);
+
+  /**
+   * Name of the log file.
+   */
+  std::string path;
+
+  /**
+   * Descriptor of the log file, written with pwrite and synced with fdatasync.
+   */
+  int fd;
+
+  /**
+   * Latch protecting every member below.  Not held while writing or syncing.
+   */
+  std::mutex logLatch;
+
+  /**
+   * Signalled whenever a sync completes.
+   */
+  std::condition_variable flushedCond;
+
+  /**
+   * Records appended but not handed to a sync yet; they start at LSN bufferStart.
+   */
+  std::vector<char> buffer;
+
+  /**
+   * LSN of the first byte of the buffer.
+   */
+  Lsn bufferStart;
+
+  /**
+   * LSN the next record will get.
+   */
+  Lsn endLsn;
+
+  /**
+   * The log is durable below this offset.
+   */
+  Lsn flushedLsn;
+
+  /**
+   * True while a thread is writing and syncing a batch.
+   */
+  bool flushing;
+
+  /**
+   * LSN of the last record of every transaction that has not committed.
+   */
+  std::unordered_map<TxnId, Lsn> lastLsn;
+
+  /**
+   * Id the next transaction will get.
+   */
+  TxnId nextTxn;
+
+  /**
+   * LSN the analysis of a recovery starts at, as stored in the log header.
+   */
+  Lsn checkpointLsn;
+
+  /**
+   * Appends left before an injected crash, 0 if none is injected.
+   */
+  std::uint64_t crashCountdown;
+
+  /**
+   * Appends left before an injected failure, 0 if none is injected.
+   */
+  std::uint64_t failureCountdown;
+
+  /**
+   * Set once an injected crash has happened; every append throws until simulateCrash.
+   */
+  bool crashed;
+
+  std::uint64_t numSyncs, numCommits;
+
+  std::uint32_t groupCommitDelayUs;
+};
+
+/**
+ * @brief Reads back the records of a write-ahead log in LSN order.
+ */
+class LogReader
+{
+ public:
+  /**
+   * Open a log, positioned at its first record.
+   *
+   * @param path  Name of the log file
+   * @throws BadLogException  If the file cannot be opened or is not a log
+   */
+  explicit LogReader(const std::string &path);
+
+  /**
+   * Returns the LSN the analysis of a recovery starts at, 0 if there has been no checkpoint.
+   */
+  Lsn checkpointLsn() const { return checkpoint; }
+
+  /**
+   * Continue reading at the record with the given LSN.
+   *
+   * @param lsn  LSN of a record, or of the end of the log
+   */
+  void seek(Lsn lsn);
+
+  /**
+   * Read the record at an LSN, leaving the position just past it.
+   *
+   * @param lsn     LSN of a record
+   * @param record  Record returned via this reference
+   * @return        False if there is no valid record at lsn
+   */
+  bool readAt(Lsn lsn, LogRecord &record);
+
+  /**
+   * Read the next record.
+   *
+   * @param record  Record returned via this reference
+   * @return        False at the end of the log, or at a torn or corrupt record
+   */
+  bool next(LogRecord &record);
+
+  /**
+   * Returns the offset just past the last record read.
+   */
+  Lsn endLsn() const { return end; }
+
+ private:
+  std::string path;
+  std::ifstream in;
+  Lsn end;
+  Lsn checkpoint;
+
+  /**
+   * Size of the log file when last looked at; a record claiming to run past it is torn.
+   */
+  Lsn fileSize;
+};
+
+}